@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CallGraph;
+class ClassHierarchy;
+class DexClass;
+class DexClasses;
+class PurityAnalysis;
+class ReferenceIndex;
+using DexClassesVector = std::vector<DexClasses>;
+using Scope = std::vector<DexClass*>;
+
+/*
+ * Whole-program analyses, built on first request and shared by the passes
+ * that follow until one of them changes what they describe.
+ *
+ * After each pass the PassManager drops every analysis the pass doesn't
+ * list in Pass::preserved_analyses(), along with anything built on top of
+ * one that's dropped: the call graph, reference index and purity summaries
+ * all depend on the scope, and the call graph and purity summaries on the
+ * class hierarchy too.
+ *
+ * Analyses that read code sync pending MethodTransforms before building.
+ * The reference index is kept current through MethodTransform edits, so
+ * passes that only edit code that way may preserve it.  Not thread-safe:
+ * request analyses before fanning work out.
+ *
+ * Reachability isn't managed here: init_reachable_classes() records it on
+ * the members themselves before the first pass (a checkpoint carries it
+ * over), and recomputing it between passes would change what later passes
+ * may delete.
+ */
+class AnalysisManager {
+ public:
+  enum Analysis : uint32_t {
+    SCOPE = 1 << 0,
+    CLASS_HIERARCHY = 1 << 1,
+    CALL_GRAPH = 1 << 2,
+    REFERENCE_INDEX = 1 << 3,
+    PURITY = 1 << 4,
+    ALL = (1 << 5) - 1,
+  };
+
+  explicit AnalysisManager(DexClassesVector& dexen);
+  ~AnalysisManager();
+
+  const Scope& scope();
+  std::shared_ptr<const ClassHierarchy> class_hierarchy();
+  CallGraph& call_graph();
+  ReferenceIndex& reference_index();
+  const PurityAnalysis& purity();
+
+  /* Drop every analysis not in the mask `preserved`. */
+  void invalidate(uint32_t preserved);
+
+  /* How many times this manager has built an analysis it holds. */
+  size_t builds(Analysis analysis) const;
+
+ private:
+  void count_build(Analysis analysis);
+
+  DexClassesVector& m_dexen;
+  std::unique_ptr<Scope> m_scope;
+  std::unique_ptr<CallGraph> m_call_graph;
+  std::unique_ptr<ReferenceIndex> m_reference_index;
+  std::unique_ptr<PurityAnalysis> m_purity;
+  size_t m_builds[5]{0, 0, 0, 0, 0};
+};
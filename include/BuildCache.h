@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "Sha1.h"
+
+/*
+ * A SHA-1 over whatever a cached result depends on, fed piece by piece.
+ * Strings go in with their length, so "ab" + "c" and "a" + "bc" differ.
+ */
+class ContentHash {
+ public:
+  ContentHash();
+
+  void add(const void* data, size_t size);
+  void add(const std::string& s);
+  void add(uint32_t n);
+
+  /* JSON with object keys sorted, so member order doesn't matter. */
+  void add_json(const folly::dynamic& value);
+
+  /* The file's contents; false, with nothing added, if it can't be read. */
+  bool add_file(const std::string& path);
+
+  /* The 20-byte digest.  Nothing can be added after. */
+  std::string digest();
+  std::string hex_digest();
+
+ private:
+  Sha1Context m_ctx;
+};
+
+/*
+ * The whole-build cache redex-all uses when the config names a
+ * "build_cache_dir": a run whose inputs all hash the same as an earlier
+ * run's copies that run's outputs into place instead of optimizing again.
+ *
+ * The key covers the redex-all binary, the input dexes (by their headers,
+ * whose SHA-1 signature covers the rest of the file), the library jar,
+ * ProGuard config and seeds files, the config with the pass list and every
+ * pass's settings, each file a config string names, and the manifest,
+ * layouts and native libraries read from "apk_dir".  Output paths are
+ * hashed as names only, since an earlier run may have written them.
+ *
+ * The outputs are the dexes in the output directory and the files the
+ * global and pass configs name under the keys in build_output_keys().
+ * Each build's are kept in a directory named by its key.
+ */
+class BuildCache {
+ public:
+  BuildCache(const std::string& dir, const std::string& key)
+    : m_dir(dir), m_key(key) {}
+
+  /*
+   * The key of a run over `dexes` with `config` and the given library jar,
+   * ProGuard config and seeds files, any of which may be empty.  Empty if
+   * the redex-all binary can't be read, since a different redex could then
+   * pass for this one.
+   */
+  static std::string build_key(const folly::dynamic& config,
+                               const std::vector<std::string>& dexes,
+                               const std::vector<std::string>& input_files);
+
+  /* Config keys, global or per pass, naming files a run writes. */
+  static const std::vector<std::string>& build_output_keys();
+
+  /*
+   * Copy the outputs of the build with this key to `out_dir` and the paths
+   * `config` gives them, or return false if there's no such build.
+   */
+  bool restore(const std::string& out_dir, const folly::dynamic& config);
+
+  /*
+   * Save the outputs of this run under its key, once written: the `dexes`
+   * and the files `config` names.
+   */
+  void store(const std::vector<std::string>& dexes,
+             const folly::dynamic& config);
+
+ private:
+  std::string m_dir;
+  std::string m_key;
+};
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+
+/*
+ * The calls between the methods of a scope, with an edge per invoke
+ * instruction in each direction.
+ *
+ * invoke-direct, invoke-static and invoke-super go to the method they
+ * resolve to.  invoke-virtual and invoke-interface use class hierarchy
+ * analysis: they may reach the resolved method or any override of it in a
+ * subclass of the receiver type (for interfaces, in any class implementing
+ * it).  Only concrete methods are targets, so calls into the framework show
+ * up in callees() with no targets and abstract methods have no callers.
+ *
+ * Built by scanning every method's code in parallel; reads the DexCode, so
+ * any pending MethodTransforms need to be synced first.  Queries are safe
+ * from any thread, but updates must not run concurrently with anything
+ * else.
+ */
+class CallGraph {
+ public:
+  /* An invoke in the caller and the methods it may call. */
+  struct Call {
+    DexInstruction* insn;
+    std::vector<DexMethod*> targets;
+  };
+
+  /* An invoke that may call the callee. */
+  struct CallSite {
+    DexMethod* caller;
+    DexInstruction* insn;
+  };
+
+  explicit CallGraph(const Scope& scope);
+
+  // The shards are cache-line aligned, which plain new doesn't honour
+  // before C++17.
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
+  const std::vector<Call>& callees(const DexMethod* caller) const;
+  const std::vector<CallSite>& callers(const DexMethod* callee) const;
+
+  /*
+   * Rescan `caller`, after inlining into it or otherwise changing its
+   * invokes.
+   */
+  void update_method(DexMethod* caller);
+
+  /* Forget a deleted method and every edge to or from it. */
+  void remove_method(DexMethod* method);
+
+  /* The number of (call site, target) pairs. */
+  size_t edges() const { return m_edges; }
+
+ private:
+  struct Scan;
+  static void scan(Scan* s);
+  std::vector<Call> calls(const DexMethod* caller) const;
+  std::vector<DexMethod*> targets(DexInstruction* insn) const;
+  const std::vector<DexMethod*>& virtual_targets(DexMethod* ref) const;
+  void add_calls(DexMethod* caller, std::vector<Call> calls);
+  void remove_calls(DexMethod* caller);
+
+  std::shared_ptr<const ClassHierarchy> m_hierarchy;
+  // The classes listing each interface among their interfaces, interfaces
+  // extending it included.
+  std::unordered_map<const DexType*, std::vector<const DexClass*>>
+    m_implementors;
+  std::unordered_map<const DexMethod*, std::vector<Call>> m_callees;
+  std::unordered_map<const DexMethod*, std::vector<CallSite>> m_callers;
+  // Deleted methods, still in target sets computed before they went.
+  std::unordered_set<const DexMethod*> m_removed;
+  size_t m_edges{0};
+
+  // Virtual and interface target sets, by method ref, shared by the call
+  // sites invoking the same ref.
+  struct alignas(64) TargetShard {
+    std::mutex lock;
+    std::unordered_map<const DexMethod*,
+                       std::unique_ptr<std::vector<DexMethod*>>> targets;
+  };
+  static constexpr size_t kTargetShards = 64;
+  mutable TargetShard m_targets[kTargetShards];
+};
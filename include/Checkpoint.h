@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+
+struct ConfigFiles;
+struct checkpoint_header;
+
+/*
+ * A checkpoint is the IR as it stood after some pass, saved so a later run
+ * can pick up from there instead of loading the inputs and running every
+ * earlier pass again.
+ *
+ * It's a directory holding the classes as dexes (classes.dex,
+ * classes2.dex, ...), written and read by the usual DexOutput and
+ * DexLoader, and a "state" file with what dexes can't hold:
+ *
+ *   - every string and type name RedexContext has interned;
+ *   - the ReferencedState of classes, fields and methods, external ones
+ *     included, wherever it isn't the default;
+ *   - ConfigFiles' moved methods map;
+ *   - the position and name of the pass the checkpoint was taken after.
+ *
+ * The state file is little-endian 32-bit words laid out to be read in
+ * place from a mapping: a header of section offsets and counts, fixed-size
+ * records referring to strings and types by index, and NUL-terminated
+ * strings last.  Field and method refs nothing in the dexes mentions, and
+ * the old names of renamed types, aren't kept.
+ */
+
+/*
+ * Write the checkpoint of `dexen` and `cfg` to `dir`, creating it if need
+ * be and replacing any checkpoint there.  Code must be synced.
+ */
+void write_checkpoint(const std::string& dir,
+                      size_t pass_index,
+                      const std::string& pass_name,
+                      DexClassesVector& dexen,
+                      ConfigFiles& cfg);
+
+class CheckpointReader {
+ public:
+  /* Maps the state file in `dir`, failing if it isn't one. */
+  explicit CheckpointReader(const std::string& dir);
+  ~CheckpointReader();
+
+  /* The pass the checkpoint was taken after and its index in the list. */
+  size_t pass_index() const;
+  std::string pass_name() const;
+
+  /*
+   * Intern the strings and types, load the dexes and restore the
+   * ReferencedState of their members and of any classes already loaded,
+   * like those from library jars.
+   */
+  DexClassesVector load_classes();
+
+  /* Restore the moved methods map, once the classes are loaded. */
+  void restore_config(ConfigFiles& cfg);
+
+ private:
+  const uint32_t* words(uint32_t offset) const;
+  const char* string(uint32_t index) const;
+  DexType* type(uint32_t index) const;
+  DexTypeList* type_list(uint32_t offset) const;
+
+  std::string m_dir;
+  const uint8_t* m_mapping;
+  size_t m_size;
+  const checkpoint_header* m_header;
+};
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Dataflow.h"
+#include "DexClass.h"
+
+/*
+ * An immutable snapshot of the type system's class hierarchy, flattened for
+ * constant-time subtype queries.
+ *
+ * The superclass forest is numbered in DFS preorder, so the subclasses of a
+ * type are the types numbered after it up to the end of its subtree: one
+ * interval test answers "is a a subclass of b", and all the subclasses come
+ * out as a contiguous range.  Each type also carries the set of interfaces
+ * it implements, directly or through superclasses and superinterfaces, as a
+ * bitset; types that add no interfaces of their own share their
+ * superclass's set.
+ *
+ * Like check_cast(), only classes the type system knows about are followed:
+ * a type whose DexClass is missing is a subtype of nothing but itself.
+ */
+class ClassHierarchy {
+ public:
+  /*
+   * The snapshot of the current hierarchy.  It is rebuilt on the first call
+   * after invalidate(); until then every caller shares the same one, and
+   * holding on to it keeps it valid, so readers on any thread need no locks.
+   */
+  static std::shared_ptr<const ClassHierarchy> get();
+
+  /*
+   * Call after adding classes or changing a class's superclass or
+   * interfaces.  build_type_system() does so for new classes.
+   */
+  static void invalidate();
+
+  explicit ClassHierarchy(const std::vector<DexClass*>& classes);
+
+  /* True if `type` is `base`, extends it or implements it. */
+  bool is_subtype(const DexType* type, const DexType* base) const;
+
+  /* True if `type` is `base` or extends it, following superclasses only. */
+  bool is_subclass(const DexType* type, const DexType* base) const;
+
+  /*
+   * Every class that extends `type`, directly or not, in the order of
+   * get_all_children(): each child is followed by its own subclasses.
+   */
+  struct Range {
+    const DexType* const* b;
+    const DexType* const* e;
+    const DexType* const* begin() const { return b; }
+    const DexType* const* end() const { return e; }
+    size_t size() const { return e - b; }
+  };
+  Range subclasses(const DexType* type) const;
+
+  size_t size() const { return m_order.size(); }
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+  using TypeIds = std::unordered_map<const DexType*, uint32_t>;
+
+  uint32_t id(const DexType* type) const {
+    auto it = m_id.find(type);
+    return it == m_id.end() ? kNone : it->second;
+  }
+  uint32_t closure(uint32_t n,
+                   const std::vector<DexClass*>& cls,
+                   const std::vector<uint32_t>& parent,
+                   const TypeIds& tmp,
+                   std::vector<uint32_t>& state);
+
+  // Node ids are preorder numbers.
+  TypeIds m_id;
+  std::vector<const DexType*> m_order;
+  // One past the last node in each node's subtree.
+  std::vector<uint32_t> m_end;
+  // Bit number of each interface, kNone for everything else.
+  std::vector<uint32_t> m_intf_bit;
+  // Index into m_closures of each node's interfaces.
+  std::vector<uint32_t> m_closure;
+  std::vector<BitVector> m_closures;
+};
@@ -55,6 +55,11 @@ struct ConfigFiles {
     m_moved_methods_map[mt] = cls;
   }
 
+  /* Where build results are cached ("build_cache_dir"), empty if not. */
+  const std::string& get_build_cache_dir() const {
+    return m_build_cache_dir;
+  }
+
  private:
   std::vector<std::string> load_coldstart_classes();
   std::vector<std::string> load_coldstart_methods();
@@ -65,6 +70,7 @@ struct ConfigFiles {
   MethodMap m_moved_methods_map;
   std::string m_coldstart_class_filename;
   std::string m_coldstart_method_filename;
+  std::string m_build_cache_dir;
   std::vector<std::string> m_coldstart_classes;
   std::vector<std::string> m_coldstart_methods;
 
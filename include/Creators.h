@@ -203,6 +203,16 @@ struct MethodBlock {
    */
   void load_null(Location& loc);
 
+  //
+  // arithmetic instruction
+  //
+
+  /**
+   * Emit the int binary operation `op` (add-int through ushr-int) on the
+   * src1 and src2 locations into the dst location.
+   */
+  void binop(DexOpcode op, Location src1, Location src2, Location& dst);
+
   //
   // branch instruction
   //
@@ -442,6 +452,7 @@ struct MethodCreator {
   MethodTransform* meth_code;
   uint16_t out_count;
   uint16_t top_reg;
+  DexAccessFlags access;
   std::vector<Location> locals;
   MethodBlock* main_block;
 
@@ -506,6 +517,13 @@ struct ClassCreator {
     m_cls->m_external = true;
   }
 
+  /**
+   * Set the annotations of the DexClass to be created.
+   */
+  void set_anno_set(DexAnnotationSet* aset) {
+    m_cls->m_anno = aset;
+  }
+
   /**
    * Add an interface to the DexClass to be created.
    */
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "Transform.h"
+
+/*
+ * Fixed-size set of bits packed into 64-bit words.  The set operations work a
+ * whole word at a time in tight loops the compiler can vectorize, which is
+ * where dataflow analyses spend most of their time.
+ */
+class BitVector {
+ public:
+  using word_t = uint64_t;
+  static constexpr size_t kWordBits = 64;
+
+  explicit BitVector(size_t nbits = 0)
+      : m_nbits(nbits), m_words((nbits + kWordBits - 1) / kWordBits) {}
+
+  size_t size() const { return m_nbits; }
+
+  bool test(size_t i) const {
+    return (m_words[i / kWordBits] >> (i % kWordBits)) & 1;
+  }
+
+  void set(size_t i) { m_words[i / kWordBits] |= word_t(1) << (i % kWordBits); }
+
+  void reset(size_t i) {
+    m_words[i / kWordBits] &= ~(word_t(1) << (i % kWordBits));
+  }
+
+  /* Clear every bit. */
+  void reset() {
+    for (auto& w : m_words) {
+      w = 0;
+    }
+  }
+
+  bool any() const {
+    for (auto w : m_words) {
+      if (w) return true;
+    }
+    return false;
+  }
+
+  size_t count() const {
+    size_t n = 0;
+    for (auto w : m_words) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+  /* Call fn(i) for every set bit i, in increasing order. */
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    for (size_t w = 0; w < m_words.size(); ++w) {
+      for (auto bits = m_words[w]; bits; bits &= bits - 1) {
+        fn(w * kWordBits + __builtin_ctzll(bits));
+      }
+    }
+  }
+
+  BitVector& operator|=(const BitVector& other) {
+    auto dst = m_words.data();
+    auto src = other.m_words.data();
+    for (size_t i = 0, n = m_words.size(); i < n; ++i) {
+      dst[i] |= src[i];
+    }
+    return *this;
+  }
+
+  BitVector& operator&=(const BitVector& other) {
+    auto dst = m_words.data();
+    auto src = other.m_words.data();
+    for (size_t i = 0, n = m_words.size(); i < n; ++i) {
+      dst[i] &= src[i];
+    }
+    return *this;
+  }
+
+  /* Remove the bits of `other` from this set. */
+  BitVector& subtract(const BitVector& other) {
+    auto dst = m_words.data();
+    auto src = other.m_words.data();
+    for (size_t i = 0, n = m_words.size(); i < n; ++i) {
+      dst[i] &= ~src[i];
+    }
+    return *this;
+  }
+
+  bool operator==(const BitVector& other) const {
+    return m_nbits == other.m_nbits && m_words == other.m_words;
+  }
+
+  bool operator!=(const BitVector& other) const { return !(*this == other); }
+
+ private:
+  size_t m_nbits;
+  std::vector<word_t> m_words;
+};
+
+std::string show(const BitVector& bits);
+
+enum class DataflowDirection {
+  FORWARD,
+  BACKWARD,
+};
+
+template <typename State>
+struct DataflowResult {
+  // State at the entry and exit of each block, indexed by Block::id().
+  std::vector<State> in;
+  std::vector<State> out;
+  // Number of times a block's transfer function was applied.
+  size_t visits{0};
+};
+
+/*
+ * Solve a monotone dataflow problem over `cfg` with a worklist.
+ *
+ * Blocks are processed in reverse postorder for forward problems and in
+ * postorder for backward ones, always taking the pending block that comes
+ * first in that order, so most blocks see their inputs settle before they're
+ * visited.  A block is only revisited when one of the blocks it depends on
+ * changed.
+ *
+ * `bottom` is the initial state of every block, `meet(from, into)` merges a
+ * neighbor's state into `into`, and `transfer(block, input, output)` computes
+ * the state on the far side of the block: exit from entry for a forward
+ * problem, entry from exit for a backward one.  State needs copy-assignment
+ * and operator!=.
+ *
+ * Blocks that can't be reached from the entry (or from a block without
+ * predecessors) are never visited and keep the bottom state.
+ */
+template <typename State, typename Transfer, typename Meet>
+DataflowResult<State> run_dataflow(const std::vector<Block*>& cfg,
+                                   DataflowDirection direction,
+                                   const State& bottom,
+                                   Transfer transfer,
+                                   Meet meet) {
+  DataflowResult<State> result;
+  result.in.resize(cfg.size(), bottom);
+  result.out.resize(cfg.size(), bottom);
+
+  auto order = PostOrderSort(cfg).get();
+  bool forward = direction == DataflowDirection::FORWARD;
+  if (forward) {
+    std::reverse(order.begin(), order.end());
+  }
+  // Rank of each block in processing order; -1 for unvisited blocks.
+  std::vector<int> rank(cfg.size(), -1);
+  for (size_t i = 0; i < order.size(); ++i) {
+    rank[order[i]->id()] = i;
+  }
+
+  std::priority_queue<int, std::vector<int>, std::greater<int>> worklist;
+  std::vector<bool> queued(cfg.size(), true);
+  for (size_t i = 0; i < order.size(); ++i) {
+    worklist.push(i);
+  }
+
+  State scratch = bottom;
+  while (!worklist.empty()) {
+    auto b = order[worklist.top()];
+    worklist.pop();
+    queued[b->id()] = false;
+
+    auto& input = forward ? result.in[b->id()] : result.out[b->id()];
+    auto& output = forward ? result.out[b->id()] : result.in[b->id()];
+    input = bottom;
+    for (auto n : forward ? b->preds() : b->succs()) {
+      meet(forward ? result.out[n->id()] : result.in[n->id()], input);
+    }
+    scratch = bottom;
+    transfer(b, input, scratch);
+    ++result.visits;
+    if (scratch != output) {
+      std::swap(scratch, output);
+      for (auto n : forward ? b->succs() : b->preds()) {
+        if (rank[n->id()] >= 0 && !queued[n->id()]) {
+          queued[n->id()] = true;
+          worklist.push(rank[n->id()]);
+        }
+      }
+    }
+  }
+  return result;
+}
@@ -14,6 +14,7 @@
 #include <sstream>
 
 #include "Gatherable.h"
+#include "MemoryAccounting.h"
 #include "Show.h"
 
 class DexField;
@@ -51,7 +52,9 @@ enum DexAnnotationVisibility : uint8_t {
   DAV_SYSTEM = 2,
 };
 
-class DexEncodedValue : public Gatherable {
+class DexEncodedValue
+    : public Gatherable,
+      public MemoryAccounted<MemoryAccounting::ANNOTATIONS> {
  protected:
   DexEncodedValueTypes m_evtype;
   uint64_t m_value;
@@ -235,7 +238,9 @@ class DexEncodedValueAnnotation : public DexEncodedValue {
   virtual std::string show() const;
 };
 
-class DexAnnotation : public Gatherable {
+class DexAnnotation
+    : public Gatherable,
+      public MemoryAccounted<MemoryAccounting::ANNOTATIONS> {
   EncodedAnnotations m_anno_elems;
   DexType* m_type;
   DexAnnotationVisibility m_viz;
@@ -243,6 +248,9 @@ class DexAnnotation : public Gatherable {
   DexAnnotation() : Gatherable() {}
 
  public:
+  DexAnnotation(DexType* type, DexAnnotationVisibility viz)
+      : Gatherable(), m_type(type), m_viz(viz) {}
+
   static DexAnnotation* get_annotation(DexIdx* idx, uint32_t anno_off);
   virtual void gather_types(std::vector<DexType*>& ltype);
   virtual void gather_fields(std::vector<DexField*>& lfield);
@@ -268,16 +276,19 @@ class DexAnnotation : public Gatherable {
   DexType* type() const { return m_type; }
   void rewrite_type(DexType* type) { m_type = type; }
   const EncodedAnnotations& anno_elems() { return m_anno_elems; }
+  void add_element(const char* key, DexEncodedValue* value);
 
   friend std::string show(const DexAnnotation*);
 };
 
-class DexAnnotationSet : public Gatherable {
+class DexAnnotationSet
+    : public Gatherable,
+      public MemoryAccounted<MemoryAccounting::ANNOTATIONS> {
   std::list<DexAnnotation*> m_annotations;
 
+ public:
   DexAnnotationSet() : Gatherable() {}
 
- public:
   virtual void gather_types(std::vector<DexType*>& ltype);
   virtual void gather_fields(std::vector<DexField*>& lfield);
   virtual void gather_methods(std::vector<DexMethod*>& lmethod);
@@ -310,7 +321,8 @@ typedef std::list<std::pair<DexMethod*, DexAnnotationSet*>>
 typedef std::list<std::pair<DexMethod*, ParamAnnotations*>>
     DexMethodParamAnnotations;
 
-class DexAnnotationDirectory {
+class DexAnnotationDirectory
+    : public MemoryAccounted<MemoryAccounting::ANNOTATIONS> {
   double m_viz;
   DexAnnotationSet* m_class;
   DexFieldAnnotations* m_field;
@@ -340,8 +352,9 @@ class DexAnnotationDirectory {
     calc_internals();
   }
 
+  // The class annotation set belongs to the class, which may be written
+  // again; only the lists made for the directory are its own.
   ~DexAnnotationDirectory() {
-    delete m_class;
     delete m_field;
     delete m_method;
     delete m_method_param;
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -22,6 +23,7 @@
 #include "DexAccess.h"
 #include "DexInstruction.h"
 #include "DexAnnotation.h"
+#include "MemoryAccounting.h"
 #include "Show.h"
 #include "Trace.h"
 #include "RedexContext.h"
@@ -47,12 +49,13 @@
  * the pointer values of each type that has a uniqueness requirement.
  */
 
+class DexClass;
 class DexDebugInstruction;
 class DexOutputIdx;
 class DexString;
 class DexType;
 
-class DexString {
+class DexString : public MemoryAccounted<MemoryAccounting::STRINGS> {
   friend struct RedexContext;
 
   const char* m_cstr;
@@ -64,9 +67,11 @@ class DexString {
     m_cstr = (const char*)strdup(nstr);
     m_utfsize = utfsize;
     m_strlen = strlen(nstr);
+    MemoryAccounting::record(MemoryAccounting::STRINGS, 0, m_strlen + 1);
   }
 
   ~DexString() {
+    MemoryAccounting::record(MemoryAccounting::STRINGS, 0, -(m_strlen + 1));
     free(const_cast<char*>(m_cstr));
   }
 
@@ -150,10 +155,14 @@ inline bool compare_dexstrings(const DexString* a, const DexString* b) {
   }
 }
 
-class DexType {
+class DexType : public MemoryAccounted<MemoryAccounting::TYPES> {
   friend struct RedexContext;
+  friend void build_type_system(DexClass* cls);
 
   DexString* m_name;
+  // The class that defines this type, the first one handed to
+  // build_type_system().  Set once, and read by every type_class() call.
+  std::atomic<DexClass*> m_class{nullptr};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexType(DexString* dstring) {
@@ -197,6 +206,11 @@ class DexType {
 
   DexString* get_name() const { return m_name; }
 
+  /* Use type_class() instead. */
+  DexClass* get_defining_class() const {
+    return m_class.load(std::memory_order_acquire);
+  }
+
   friend std::string show(const DexType*);
 
   template <typename V>
@@ -208,7 +222,7 @@ inline bool compare_dextypes(const DexType* a, const DexType* b) {
   return compare_dexstrings(a->get_name(), b->get_name());
 }
 
-class DexField {
+class DexField : public MemoryAccounted<MemoryAccounting::FIELDS> {
   friend struct RedexContext;
 
   DexType* m_class; // Field inside of class m_class.
@@ -310,7 +324,7 @@ inline bool compare_dexfields(const DexField* a, const DexField* b) {
   return compare_dextypes(a->get_type(), b->get_type());
 }
 
-class DexTypeList {
+class DexTypeList : public MemoryAccounted<MemoryAccounting::PROTOS> {
   friend struct RedexContext;
 
   std::list<DexType*> m_list;
@@ -366,7 +380,7 @@ inline bool compare_dextypelists(DexTypeList* a, DexTypeList* b) {
   return *a < *b;
 }
 
-class DexProto {
+class DexProto : public MemoryAccounted<MemoryAccounting::PROTOS> {
   friend struct RedexContext;
 
   DexTypeList* m_args;
@@ -417,7 +431,7 @@ inline bool compare_dexprotos(const DexProto* a, const DexProto* b) {
   return (*(a->get_args()) < *(b->get_args()));
 }
 
-class DexDebugItem {
+class DexDebugItem : public MemoryAccounted<MemoryAccounting::CODE> {
   uint32_t m_line_start;
   std::vector<DexString*> m_param_names;
   std::vector<DexDebugInstruction*> m_insns;
@@ -430,6 +444,9 @@ class DexDebugItem {
   ~DexDebugItem();
 
   std::vector<DexDebugInstruction*>& get_instructions() { return m_insns; }
+  const std::vector<DexString*>& get_param_names() const {
+    return m_param_names;
+  }
   uint32_t get_line_start() const { return m_line_start; }
 
   /* Returns number of bytes encoded, *output has no alignment requirements */
@@ -449,7 +466,7 @@ struct DexTryItem {
   uint32_t m_catchall; /* DEX_NO_INDEX if none */
 };
 
-class DexCode {
+class DexCode : public MemoryAccounted<MemoryAccounting::CODE> {
   uint16_t m_registers_size;
   uint16_t m_ins_size;
   uint16_t m_outs_size;
@@ -508,7 +525,7 @@ class DexCode {
   friend std::string show(const DexCode*);
 };
 
-class DexMethod {
+class DexMethod : public MemoryAccounted<MemoryAccounting::METHODS> {
   friend struct RedexContext;
 
   /* Method Ref related members */
@@ -667,7 +684,7 @@ inline bool compare_dexmethods(const DexMethod* a, const DexMethod* b) {
 
 typedef std::map<DexCode*, uint32_t> dexcode_to_offset;
 
-class DexClass {
+class DexClass : public MemoryAccounted<MemoryAccounting::CLASSES> {
  private:
   DexAccessFlags m_access_flags;
   DexType* m_super_class;
@@ -13,13 +13,16 @@
 
 #include "dexdefs.h"
 #include "Gatherable.h"
+#include "MemoryAccounting.h"
 
 class DexIdx;
 class DexOutputIdx;
 class DexString;
 class DexType;
 
-class DexDebugInstruction : public Gatherable {
+class DexDebugInstruction
+    : public Gatherable,
+      public MemoryAccounted<MemoryAccounting::CODE> {
  private:
   union {
     uint32_t m_uvalue;
@@ -18,6 +18,7 @@
 #include "Debug.h"
 #include "dexdefs.h"
 #include "Gatherable.h"
+#include "MemoryAccounting.h"
 
 /*
  * Dex opcode formats as defined by the spec; the _d and _s variants indicate
@@ -349,7 +350,9 @@ std::string show(DexOpcode);
 class DexIdx;
 class DexOutputIdx;
 
-class DexInstruction : public Gatherable {
+class DexInstruction
+    : public Gatherable,
+      public MemoryAccounted<MemoryAccounting::INSTRUCTIONS> {
  protected:
   bool m_has_strings{false};
   bool m_has_types{false};
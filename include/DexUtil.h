@@ -109,7 +109,9 @@ DataType type_to_datatype(const DexType* t);
  * Return the DexClass that represents the DexType in input or nullptr if
  * no such DexClass exists.
  */
-DexClass* type_class(const DexType*);
+inline DexClass* type_class(const DexType* t) {
+  return t != nullptr ? t->get_defining_class() : nullptr;
+}
 
 /**
  * Return the DexClass that represents an internal DexType or nullptr if
@@ -159,6 +161,8 @@ DexType* get_array_type(const DexType*);
  * Retrieves all the children of a type and pushes them in the provided vector.
  * Effectively everything that derives from a given type.
  * There is no guaranteed or known order in which children are returned.
+ * Callers asking repeatedly should hold on to ClassHierarchy::get() and use
+ * subclasses() instead, which doesn't copy.
  */
 void get_all_children(const DexType*, TypeVector&);
 
@@ -191,6 +195,17 @@ DexAccessFlags merge_visibility(uint32_t vis1, uint32_t vis2);
  */
 void build_type_system(DexClass* cls);
 
+/**
+ * Forget every class build_type_system() has seen.  The RedexContext calls
+ * this as it deletes them.
+ */
+void clear_type_system();
+
+/**
+ * Every class handed to build_type_system(), in the order it was.
+ */
+std::vector<DexClass*> get_all_classes();
+
 /**
  * Sorts and unique-ifies the given vector.
  */
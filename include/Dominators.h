@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Transform.h"
+
+/*
+ * Dominator (or post-dominator) tree of a CFG, computed with the iterative
+ * algorithm of Cooper, Harvey and Kennedy ("A Simple, Fast Dominance
+ * Algorithm").  Dominance frontiers are computed along with the tree.
+ *
+ * Blocks are identified by Block::id(), so the tree is only meaningful for
+ * the CFG it was built from; MethodTransform::dominators() takes care of
+ * rebuilding it when the CFG changes.
+ *
+ * Post-dominators are computed on the reversed CFG with a virtual exit
+ * joining every block that has no successors.  Blocks that can't reach an
+ * exit (e.g. infinite loops) are treated as unreachable.
+ */
+class DominatorTree {
+ public:
+  explicit DominatorTree(const std::vector<Block*>& cfg, bool post = false);
+
+  bool is_post() const { return m_post; }
+
+  /*
+   * Blocks that are unreachable from the entry (or, for post-dominators,
+   * that can't reach an exit) have no dominators at all.
+   */
+  bool is_reachable(Block* b) const {
+    return m_rpo_number[b->id()] != kUndefined;
+  }
+
+  /*
+   * The immediate dominator of `b`, or nullptr for the entry block,
+   * unreachable blocks, and (for post-dominators) blocks immediately
+   * post-dominated by the virtual exit.
+   */
+  Block* idom(Block* b) const;
+
+  /* Blocks whose immediate dominator is `b`. */
+  const std::vector<Block*>& children(Block* b) const {
+    return m_children[b->id()];
+  }
+
+  /*
+   * True if every path from the entry to `b` goes through `a` (for
+   * post-dominators: every path from `b` to an exit).  A block dominates
+   * itself.  Constant time.
+   */
+  bool dominates(Block* a, Block* b) const;
+
+  bool strictly_dominates(Block* a, Block* b) const {
+    return a != b && dominates(a, b);
+  }
+
+  /* The dominance frontier of `b`, in no particular order. */
+  const std::vector<Block*>& frontier(Block* b) const {
+    return m_frontier[b->id()];
+  }
+
+  /* Reachable blocks in reverse postorder of the (possibly reversed) CFG. */
+  const std::vector<Block*>& reverse_postorder() const { return m_rpo; }
+
+ private:
+  static constexpr size_t kUndefined = static_cast<size_t>(-1);
+
+  size_t intersect(size_t a, size_t b) const;
+
+  const std::vector<Block*>& m_cfg;
+  bool m_post;
+  // Node numbering: blocks use their id, the virtual exit of a post-dominator
+  // tree is node cfg.size().
+  size_t m_root;
+  std::vector<Block*> m_rpo;
+  std::vector<size_t> m_rpo_number;
+  std::vector<size_t> m_idom;
+  std::vector<std::vector<Block*>> m_children;
+  std::vector<std::vector<Block*>> m_frontier;
+  // Preorder interval of each node in the dominator tree.
+  std::vector<size_t> m_tree_in;
+  std::vector<size_t> m_tree_out;
+};
+
+/*
+ * A natural loop: the header plus every block that can reach one of the
+ * loop's back edges without going through the header.  Back edges sharing a
+ * header form a single loop.
+ */
+struct Loop {
+  Block* header;
+  // Sources of the back edges to the header.
+  std::vector<Block*> latches;
+  // All blocks of the loop, including the header and nested loops, in
+  // Block::id() order.
+  std::vector<Block*> blocks;
+  Loop* parent{nullptr};
+  std::vector<Loop*> children;
+  // 1 for outermost loops.
+  size_t depth{1};
+
+  bool contains(Block* b) const { return m_members[b->id()]; }
+
+ private:
+  friend class LoopInfo;
+  std::vector<bool> m_members;
+};
+
+/*
+ * The loop nesting forest of a CFG.  Only natural loops (those whose back
+ * edges target a dominating header) are found; the extra entries of an
+ * irreducible cycle leave it undetected.
+ */
+class LoopInfo {
+ public:
+  LoopInfo(const std::vector<Block*>& cfg, const DominatorTree& doms);
+  ~LoopInfo();
+
+  /* Every loop, outer loops before the loops they contain. */
+  const std::vector<Loop*>& loops() const { return m_loops; }
+
+  /* Loops that aren't nested in another loop. */
+  const std::vector<Loop*>& top_level() const { return m_top_level; }
+
+  /* The innermost loop containing `b`, or nullptr. */
+  Loop* loop_for(Block* b) const { return m_innermost[b->id()]; }
+
+  /* How many loops `b` is nested in; 0 outside of any loop. */
+  size_t depth(Block* b) const {
+    auto loop = loop_for(b);
+    return loop ? loop->depth : 0;
+  }
+
+  bool is_header(Block* b) const {
+    auto loop = loop_for(b);
+    return loop && loop->header == b;
+  }
+
+ private:
+  std::vector<Loop*> m_loops;
+  std::vector<Loop*> m_top_level;
+  std::vector<Loop*> m_innermost;
+};
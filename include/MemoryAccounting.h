@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace folly {
+struct dynamic;
+}
+
+/*
+ * Live heap objects and bytes held by the IR, by kind of object, so it's
+ * clear where memory goes on large apps.
+ *
+ * The IR classes count themselves through MemoryAccounted, which gives them
+ * an operator new and delete that record the size of each object they
+ * allocate, subclasses included.  Memory an object owns beyond itself is
+ * counted only where noted: the characters of strings, not the vectors and
+ * lists inside code or type lists.  RedexContext's interning maps aren't
+ * counted as they change; report() estimates them from their sizes.
+ *
+ * Counts are kept per thread, so recording costs a couple of uncontended
+ * stores.  The PassManager traces the report (TRACE=MEM:1) and adds it to
+ * its perf report after each pass; anything else may ask for it at any
+ * time.
+ */
+class MemoryAccounting {
+ public:
+  enum Category : uint8_t {
+    STRINGS,
+    TYPES,
+    FIELDS,
+    METHODS,
+    PROTOS,
+    CLASSES,
+    CODE,
+    INSTRUCTIONS,
+    METHOD_ITEMS,
+    ANNOTATIONS,
+    CONTEXT_MAPS,
+    CATEGORIES
+  };
+
+  struct Usage {
+    int64_t objects{0};
+    int64_t bytes{0};
+  };
+
+  static const char* name(Category category);
+
+  static void record(Category category, int64_t objects, int64_t bytes);
+
+  /* What's live now in `category`. */
+  static Usage usage(Category category);
+
+  /* {"<category>": {"objects": n, "bytes": n}, ..., "total_bytes": n} */
+  static folly::dynamic report();
+
+  /* Trace the report at MEM level 1, headed by `when`. */
+  static void trace_report(const char* when);
+};
+
+/*
+ * Derive from this to have every heap instance of the class, and of its
+ * subclasses, counted under `C`.  Deleting through a base pointer needs a
+ * virtual destructor, as it does anyway.
+ */
+template <MemoryAccounting::Category C>
+struct MemoryAccounted {
+  static void* operator new(size_t size) {
+    MemoryAccounting::record(C, 1, size);
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* ptr, size_t size) {
+    MemoryAccounting::record(C, -1, -static_cast<int64_t>(size));
+    ::operator delete(ptr);
+  }
+};
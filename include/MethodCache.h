@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "DexClass.h"
+
+struct method_cache_entry;
+
+/*
+ * Results of a per-method pass, kept across runs so a method whose code
+ * and dependencies haven't changed since gets the code the pass gave it
+ * last time without running the pass on it.
+ *
+ * A key covers the redex binary, the pass's name and config, the method's
+ * signature and access flags, its code, and `deps`: whatever else the
+ * pass looked at, like the purity of the methods it calls, as the pass
+ * spells it out.  Code is held as a little dex of its own: a header, the
+ * ids of just the strings, types, protos, fields and methods it refers
+ * to, the code item and its debug info.  Refs are by name, so they
+ * resolve in any context.
+ *
+ * Along with the code, an entry holds the pass's counters for the method,
+ * so its stats can count cached methods as though it had run on them.
+ *
+ * Each pass keeps a file "<dir>/<name>.methods", the name being
+ * Pass::run_name() so a pass that runs twice keeps two.  It's mapped in
+ * whole: a header, an index of (SHA-1 key, offset, size) sorted by key,
+ * then the entries, each the counters and then the code.  write()
+ * replaces it with the entries this run restored or saved, so methods
+ * that went away don't linger.
+ *
+ * Code must be synced for key(), restore() and save().  key() and
+ * restore() may be called from many threads at once, as may save().
+ */
+class MethodCache {
+ public:
+  /* Disabled, doing nothing, if `dir` is empty. */
+  MethodCache(const std::string& dir,
+              const std::string& pass_name,
+              const folly::dynamic& pass_config);
+  ~MethodCache();
+
+  bool enabled() const { return !m_path.empty(); }
+
+  std::string key(DexMethod* method, const std::string& deps) const;
+
+  /*
+   * Give `method` the code cached under `key`, and `counters` what was
+   * saved with it; false if there's none.  The current ReferenceIndex is
+   * updated; other analyses that hold on to instructions, like the
+   * CallGraph, are stale after a hit.
+   */
+  bool restore(DexMethod* method,
+               const std::string& key,
+               std::vector<uint64_t>* counters = nullptr);
+
+  /*
+   * Cache `method`'s code, as the pass left it, and the pass's counters for
+   * it, under `key`.
+   */
+  void save(DexMethod* method,
+            const std::string& key,
+            const std::vector<uint64_t>& counters = {});
+
+  void write();
+
+  size_t hits() const { return m_hits.size(); }
+  size_t misses() const { return m_misses.size(); }
+
+ private:
+  const method_cache_entry* find(const std::string& key) const;
+
+  std::string m_path;
+  std::string m_salt;
+  const uint8_t* m_mapping;
+  size_t m_size;
+  std::mutex m_lock;
+  // Key to the old entry, or the new code.
+  std::unordered_map<std::string, const method_cache_entry*> m_hits;
+  std::unordered_map<std::string, std::string> m_misses;
+};
+
+/*
+ * Encode `code` as a standalone dex image of the kind MethodCache keeps,
+ * and decode one.  Exposed for tests.
+ */
+std::string encode_method_code(DexCode* code);
+DexCode* decode_method_code(const uint8_t* image);
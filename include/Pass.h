@@ -9,12 +9,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <folly/dynamic.h>
 
 #include "ConfigFiles.h"
 
+class AnalysisManager;
 class DexClasses;
 class DexClass;
 using DexClassesVector = std::vector<DexClasses>;
@@ -41,10 +43,31 @@ class Pass {
 
   virtual void run_pass(DexClassesVector&, ConfigFiles&) = 0;
 
+  /*
+   * The AnalysisManager analyses still accurate after run_pass(), as a mask
+   * of AnalysisManager::Analysis.  Everything else is rebuilt for the next
+   * pass that asks for it.
+   */
+  virtual uint32_t preserved_analyses() const { return 0; }
+
   // configuration data
   folly::dynamic m_config;
 
+ protected:
+  /* Analyses shared across passes; only valid inside run_pass(). */
+  AnalysisManager& analyses() { return *m_analyses; }
+
+  /*
+   * name(), numbered Name#2, Name#3... if the pass ran before in this pass
+   * list; only valid inside run_pass().
+   */
+  const std::string& run_name() const { return m_run_name; }
+
  private:
+  friend class PassManager;
+
   std::string m_name;
   const bool m_assumes_sync;
+  AnalysisManager* m_analyses{nullptr};
+  std::string m_run_name;
 };
@@ -22,14 +22,43 @@ class PassManager {
     const std::vector<Pass*>& passes,
     const std::vector<KeepRule>& rules,
     const folly::dynamic& config = folly::dynamic::object);
+
+  /*
+   * Run the activated passes.  If the config names one in
+   * "checkpoint_after", the IR is checkpointed to "checkpoint_dir"
+   * (redex-checkpoint by default) once it has run.
+   */
   void run_passes(DexClassesVector&, ConfigFiles&);
 
+  /*
+   * What each pass of the last run_passes() cost: wall and CPU seconds, peak
+   * and change in resident memory, methods ballooned and synced, and the
+   * classes, methods and instructions before and after.  Instruction counts
+   * come from DexCode, so they don't see edits a pass leaves unsynced.
+   */
+  const folly::dynamic& get_perf_report() const { return m_perf_report; }
+
+  /*
+   * Have run_passes() start after the pass a checkpoint was taken after
+   * (see Checkpoint.h) rather than from the first, and keep the
+   * reachability the checkpoint restored.
+   */
+  void resume_after(size_t pass_index, const std::string& pass_name);
+
  private:
   void activate_pass(const char* name, const folly::dynamic& cfg);
 
+  /*
+   * The name of the pass at `index`, numbered Name#2, Name#3... if it ran
+   * before.  "checkpoint_after" picks a pass by it.
+   */
+  std::string run_name(size_t index) const;
+
   folly::dynamic m_config;
+  folly::dynamic m_perf_report;
   std::vector<Pass*> m_registered_passes;
   std::vector<Pass*> m_activated_passes;
+  size_t m_first_pass;
 
   //proguard rules
   const std::vector<KeepRule>& m_proguard_rules;
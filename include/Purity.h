@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+
+/*
+ * What a call to a method can do, from worst to best; a method is no better
+ * than the worst thing it does.
+ *
+ * Neither level promises that the method won't throw: an unused call to a
+ * side-effect-free method may be deleted even though that also deletes the
+ * NullPointerException (or ArithmeticException, ...) it might have raised.
+ * Explicit `throw`s do make a method impure.
+ */
+enum class Purity {
+  IMPURE,
+  // Writes nothing the caller can see, takes no locks, initializes no
+  // classes and always returns.  It may read the heap and allocate.
+  SIDE_EFFECT_FREE,
+  // Side-effect-free, and the result depends only on the arguments and
+  // final fields, so two calls with the same arguments give the same value.
+  PURE,
+};
+
+/*
+ * Side-effect summaries for every method in the scope, plus a curated model
+ * of framework methods (String, boxing, Math and a few collection getters).
+ *
+ * Summaries are computed bottom-up over the call graph, one strongly
+ * connected component at a time.  Deliberately conservative: recursion,
+ * backward branches (which might not terminate), interface calls, virtual
+ * calls that some app method overrides and calls that may run a static
+ * initializer all count as impure.
+ *
+ * Reads the DexCode of each method, so any pending MethodTransforms need to
+ * be synced first.
+ */
+class PurityAnalysis {
+ public:
+  explicit PurityAnalysis(const Scope& scope);
+
+  /* The summary of a method definition or modeled framework method. */
+  Purity purity(DexMethod* method) const;
+
+  /*
+   * What executing the invoke `insn` in `caller` can do, taking virtual
+   * dispatch and class initialization into account.  `caller` may be
+   * nullptr, in which case any static initializer counts.
+   */
+  Purity invoke_purity(const DexMethod* caller, DexInstruction* insn) const;
+
+  /* How many of the scope's methods got each summary. */
+  size_t count(Purity p) const { return m_counts[static_cast<int>(p)]; }
+
+ private:
+  void add_model();
+  void find_overrides(const Scope& scope);
+  void find_initializers(const Scope& scope);
+  Purity instruction_purity(const DexMethod* caller,
+                            DexInstruction* insn) const;
+  Purity local_purity(const DexMethod* method) const;
+  DexMethod* resolve_callee(DexInstruction* insn) const;
+  bool needs_init(const DexMethod* caller, DexType* type) const;
+
+  std::unordered_map<DexMethod*, Purity> m_summaries;
+  // Methods that some app method overrides, so a virtual call to them may
+  // end up anywhere.
+  std::unordered_set<DexMethod*> m_overridden;
+  // App classes whose initialization runs a <clinit>, theirs or a
+  // superclass's.
+  std::unordered_set<const DexType*> m_initializers;
+  size_t m_counts[3]{0, 0, 0};
+};
@@ -14,6 +14,8 @@
 #include <map>
 #include <pthread.h>
 
+#include "MemoryAccounting.h"
+
 class DexString;
 class DexType;
 class DexField;
@@ -69,6 +71,9 @@ struct RedexContext {
   void mutate_method_class(DexMethod* method, DexType* cls);
   void mutate_method_proto(DexMethod* method, DexProto* proto);
 
+  /* Estimated nodes and bytes of the interning maps. */
+  MemoryAccounting::Usage map_usage();
+
  private:
   struct carray_cmp {
     bool operator()(const char* a, const char* b) const {
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+
+class MethodTransform;
+
+/*
+ * Who references what: for every field, method, type and string an
+ * instruction refers to, the (method, instruction) pairs that do.  Types
+ * count only as operands of the type instructions (new-instance,
+ * check-cast, const-class, ...), not as owners of field and method refs.
+ *
+ * Built once by scanning the scope's code in parallel.  While an index is
+ * alive it is the current() one, and MethodTransform keeps it up to date as
+ * instructions are replaced, inserted, removed and inlined.  Anything that
+ * edits code some other way -- the rewrite_*() calls on instructions,
+ * changing a DexCode directly, deleting a method -- must call
+ * update_method() or remove_method() itself.
+ *
+ * Updates are safe from any thread, and adding or removing a site takes
+ * constant time.  Sites start out in scope order, but removing one moves
+ * the last site of the same entity into its place.  Queries return
+ * references into the index, so they must not race with updates touching
+ * the same entity.
+ */
+class ReferenceIndex {
+ public:
+  struct Site {
+    DexMethod* method;
+    DexInstruction* insn;
+  };
+  using Sites = std::vector<Site>;
+
+  explicit ReferenceIndex(const Scope& scope);
+  ~ReferenceIndex();
+
+  // The shards are cache-line aligned, which plain new doesn't honour
+  // before C++17.
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
+  /* The index MethodTransform maintains, if one exists. */
+  static ReferenceIndex* current() { return s_current; }
+
+  const Sites& sites(const DexField* field) const { return find(field); }
+  const Sites& sites(const DexMethod* method) const { return find(method); }
+  const Sites& sites(const DexType* type) const { return find(type); }
+  const Sites& sites(const DexString* str) const { return find(str); }
+
+  /* Record or forget one instruction of `method`. */
+  void add(DexMethod* method, DexInstruction* insn);
+  void remove(DexMethod* method, DexInstruction* insn);
+
+  /* Reindex all of `method`, from its transform if given, else its code. */
+  void update_method(DexMethod* method, MethodTransform* transform = nullptr);
+
+  /* Forget every reference made by `method`. */
+  void remove_method(DexMethod* method);
+
+ private:
+  // What each indexed instruction of a method refers to, so entries can be
+  // dropped without looking at instructions that may already be deleted.
+  using MethodRefs = std::unordered_map<DexInstruction*, const void*>;
+
+  // A site, and where it sits in its entity's Sites.
+  using SiteKey = std::pair<const DexMethod*, const DexInstruction*>;
+  struct SiteKeyHash {
+    size_t operator()(const SiteKey& key) const {
+      return std::hash<const void*>()(key.first) * 31 +
+             std::hash<const void*>()(key.second);
+    }
+  };
+
+  struct Scan;
+  static void scan(Scan* s);
+  static const void* referenced(DexInstruction* insn);
+  const Sites& find(const void* entity) const;
+  void add_site(const void* entity, DexMethod* method, DexInstruction* insn);
+  void remove_site(const void* entity,
+                   const DexMethod* method,
+                   const DexInstruction* insn);
+
+  static constexpr size_t kShards = 64;
+  template <typename Map>
+  struct alignas(64) Shard {
+    std::mutex lock;
+    Map map;
+  };
+  static size_t shard(const void* p) {
+    return (reinterpret_cast<uintptr_t>(p) >> 4) % kShards;
+  }
+
+  struct alignas(64) SiteShard {
+    std::mutex lock;
+    std::unordered_map<const void*, Sites> map;
+    std::unordered_map<SiteKey, size_t, SiteKeyHash> position;
+  };
+
+  mutable SiteShard m_sites[kShards];
+  Shard<std::unordered_map<const DexMethod*, MethodRefs>> m_methods[kShards];
+
+  static ReferenceIndex* s_current;
+};
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 class ReferencedState {
  private:
   bool m_bytype;
@@ -61,4 +63,16 @@ class ReferencedState {
     m_seed = true;
   }
 
+  // The flags packed into a byte and back, for checkpoints
+  uint8_t encode() const {
+    return m_bytype | m_bystring << 1 | m_computed << 2 | m_seed << 3;
+  }
+
+  void decode(uint8_t bits) {
+    m_bytype = bits & 1;
+    m_bystring = bits & 2;
+    m_computed = bits & 4;
+    m_seed = bits & 8;
+  }
+
 };
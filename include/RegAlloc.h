@@ -9,6 +9,74 @@
 
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
+#include "Dataflow.h"
 #include "DexClass.h"
 
-void allocate_registers(DexMethod*);
+/*
+ * Undirected graph over registers, stored as the lower triangle of a bit
+ * matrix for constant-time edge queries, plus an adjacency vector per node
+ * for walking neighbors.  Adding an edge that already exists is a no-op, so
+ * the adjacency vectors never hold duplicates.
+ */
+class InterferenceGraph {
+ public:
+  explicit InterferenceGraph(size_t nnodes);
+
+  size_t size() const { return m_adj.size(); }
+
+  /* Self-edges are ignored. */
+  void add_edge(size_t a, size_t b);
+
+  /* Connect `n` to every member of `nodes`. */
+  void add_edges(size_t n, const BitVector& nodes);
+
+  /* Connect every pair of members of `nodes`. */
+  void add_clique(const BitVector& nodes);
+
+  bool interferes(size_t a, size_t b) const {
+    if (a == b) {
+      return false;
+    }
+    auto bit = index(a, b);
+    return (m_bits[bit / 64] >> (bit % 64)) & 1;
+  }
+
+  const std::vector<uint16_t>& adj(size_t n) const { return m_adj[n]; }
+
+ private:
+  static size_t index(size_t a, size_t b) {
+    if (a < b) {
+      std::swap(a, b);
+    }
+    return a * (a - 1) / 2 + b;
+  }
+
+  std::vector<uint64_t> m_bits;
+  std::vector<std::vector<uint16_t>> m_adj;
+};
+
+struct RegAllocStats {
+  // Whether the method was allocated at all.
+  bool allocated{false};
+  // If not, why; nullptr for methods without code.
+  const char* skipped{nullptr};
+  uint16_t regs_before{0};
+  uint16_t regs_after{0};
+  // Moves whose source and destination ended up in the same register.
+  size_t moves_removed{0};
+};
+
+/*
+ * Renumber the registers of `m` so that it needs as few as possible:
+ * registers that are never live at the same time share a number.  The
+ * halves of wide values, the operands of range instructions and the
+ * arguments move as blocks, and the arguments stay at the top of the frame.
+ * With `coalesce`, the two ends of each move share a number unless they
+ * interfere, which deletes the move.  If the result would overflow an
+ * operand field, coalescing is given up, and failing that, the method is
+ * left alone.
+ */
+RegAllocStats allocate_registers(DexMethod* m, bool coalesce = true);
@@ -9,7 +9,6 @@
 #include <unordered_set>
 
 
-using MethodRefCache = std::unordered_map<DexMethod*, DexMethod*>;
 using MethodSet = std::unordered_set<DexMethod*>;
 
 /**
@@ -94,40 +93,10 @@ inline DexMethod* resolve_static(
  * Resolve a method to its definition.
  * If the method is already a definition return itself.
  * If the type the method belongs to is unknown return nullptr.
+ * Resolutions of refs, including failed ones, are remembered in a cache
+ * shared by all threads until invalidate_resolve_cache() is called.
  */
-inline DexMethod* resolve_method(DexMethod* method, MethodSearch search) {
-  if (method->is_def()) return method;
-  auto cls = type_class(method->get_class());
-  if (cls == nullptr) return nullptr;
-  return resolve_method(cls, method->get_name(), method->get_proto(), search);
-}
-
-/**
- * Resolve a method and cache the mapping.
- * If the method is already a definition return itself.
- * If the type the method belongs to is unknown return nullptr.
- * This method takes a cache from refs to defs and populate it
- * to help speed up resolution.
- * When walking all the opcodes this method performs better avoiding lookup
- * of refs that had been resolved already.
- * Clients are responsible for the lifetime of the cache.
- */
-inline DexMethod* resolve_method(
-    DexMethod* method, MethodSearch search, MethodRefCache& ref_cache) {
-  if (method->is_def()) return method;
-  auto cls = type_class(method->get_class());
-  if (cls == nullptr) return nullptr;
-  auto def = ref_cache.find(method);
-  if (def != ref_cache.end()) {
-    return def->second;
-  }
-  auto mdef = resolve_method(
-      cls, method->get_name(), method->get_proto(), search);
-  if (mdef != nullptr) {
-    ref_cache[method] = mdef;
-  }
-  return mdef;
-}
+DexMethod* resolve_method(DexMethod* method, MethodSearch search);
 
 /**
  * Given a scope defined by DexClass, a name and a proto look for the vmethod
@@ -197,11 +166,16 @@ DexField* resolve_field(
  * Given a field, search its class hierarchy for the definition.
  * If the field is a definition already the field is returned otherwise a
  * lookup in the class hierarchy is performed looking for the definition.
+ * Both static and instance fields are searched, whatever the FieldSearch.
+ * Cached like resolve_method(DexMethod*, MethodSearch).
  */
-inline DexField* resolve_field(
-    DexField* field, FieldSearch = FieldSearch::Any) {
-  if (field->is_def()) return field;
-  return resolve_field(
-      field->get_class(), field->get_name(), field->get_type());
-}
+DexField* resolve_field(DexField* field, FieldSearch = FieldSearch::Any);
+
+/**
+ * Forget every cached resolution.  Call after adding, removing or moving
+ * methods or fields, or changing a class's superclass; RedexContext does so
+ * when a method changes class or proto, and the PassManager before each
+ * pass.
+ */
+void invalidate_resolve_cache();
 
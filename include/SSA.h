@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Transform.h"
+
+struct SSAPhi;
+
+/*
+ * Where an SSA value is read: source `index` of `insn`, or operand `index` of
+ * `phi`.
+ */
+struct SSAUse {
+  DexInstruction* insn;
+  SSAPhi* phi;
+  size_t index;
+};
+
+struct SSAValue {
+  enum Kind {
+    // Incoming argument, including `this`.
+    PARAM,
+    // The contents of a register that hasn't been written on some path.
+    UNDEF,
+    // Result of an instruction.
+    INSN,
+    // Result of a phi.
+    PHI,
+  };
+
+  size_t id;
+  Kind kind;
+  // The register holding the value in the original code.
+  uint16_t reg;
+  bool is_object{false};
+  DexInstruction* insn{nullptr};
+  SSAPhi* phi{nullptr};
+  std::vector<SSAUse> uses;
+
+  SSAValue(size_t id, Kind kind, uint16_t reg)
+      : id(id), kind(kind), reg(reg) {}
+};
+
+/*
+ * Operands are parallel to block->preds().  A phi in the entry block has one
+ * more operand at the end, for the value coming in from the method entry.
+ */
+struct SSAPhi {
+  SSAValue* dest;
+  Block* block;
+  std::vector<SSAValue*> srcs;
+};
+
+/*
+ * Static single assignment view of a method.
+ *
+ * The FatMethod is left as is while the SSA form exists: every register
+ * operand of every instruction is mapped to the SSAValue it reads or writes,
+ * and phis live on the side, indexed by block.  Optimizations query def-use
+ * chains and record their edits here; destruct() then writes everything back
+ * to the method in one go.  Don't edit the method by other means until then.
+ *
+ * Construction places pruned phis at iterated dominance frontiers of each
+ * register's definitions and renames along the dominator tree.  Blocks
+ * unreachable from the entry are left out (phi operands coming from them are
+ * UNDEF) and are never rewritten.
+ *
+ * A throwing instruction that ends a block inside a try region doesn't write
+ * its destination when it throws, so the catch handlers see the register as
+ * it was before the instruction.  Each catch handler gets a phi for the
+ * register so that the edge can carry the older value.
+ *
+ * Destruction follows Sreedhar et al. ("Translating Out of Static Single
+ * Assignment Form", method I): every phi operand and result gets a copy, and
+ * every copy whose ends don't interfere is coalesced away.  Values are then
+ * mapped back to their original register when that doesn't clash with an
+ * interfering value, so a method that wasn't edited is written back exactly
+ * as it was.  Edited methods get fresh registers where needed and are
+ * compacted by allocate_registers().
+ *
+ * Wide values and range instructions aren't modeled yet; can_build() rejects
+ * methods using them.
+ */
+class SSAForm {
+ public:
+  static bool can_build(DexMethod* method);
+
+  explicit SSAForm(DexMethod* method);
+  ~SSAForm();
+
+  DexMethod* method() const { return m_method; }
+
+  /* Every value, indexed by SSAValue::id. */
+  const std::vector<SSAValue*>& values() const { return m_values; }
+
+  /* Whether `insn` is modeled, i.e. reachable from the entry. */
+  bool contains(DexInstruction* insn) const {
+    return m_insns.count(insn) != 0;
+  }
+
+  /* The value written by `insn`, or nullptr if it has no destination. */
+  SSAValue* def(DexInstruction* insn) const;
+
+  /* The value read by source `i` of `insn`. */
+  SSAValue* use(DexInstruction* insn, size_t i) const;
+
+  /* The phis at the top of `b`. */
+  const std::vector<SSAPhi*>& phis(Block* b) const {
+    return m_phis[b->id()];
+  }
+
+  /* The value held by argument register `i` (0 is `this` if there's one). */
+  SSAValue* param(size_t i) const { return m_params[i]; }
+
+  /*
+   * Make every reader of `from` read `to` instead.  `to` must be available
+   * wherever `from` is used, e.g. because its definition dominates the
+   * definition of `from`.
+   */
+  void replace_all_uses(SSAValue* from, SSAValue* to);
+
+  /*
+   * Delete `insn` from the method.  Its result, if any, must be unused by
+   * then.  Branches can't be removed this way.
+   */
+  void remove(DexInstruction* insn);
+
+  bool is_removed(DexInstruction* insn) const {
+    return m_removed.count(insn) != 0;
+  }
+
+  /*
+   * Write the SSA form back to the method.  Returns false and leaves the
+   * method untouched if the result wouldn't fit the instructions' register
+   * fields.  The SSA form can't be used afterwards either way.
+   */
+  bool destruct();
+
+ private:
+  struct InsnInfo {
+    SSAValue* def{nullptr};
+    std::vector<SSAValue*> uses;
+  };
+
+  SSAValue* make_value(SSAValue::Kind kind, uint16_t reg);
+  void place_phis(const std::vector<Block*>& cfg);
+  void rename(const std::vector<Block*>& cfg);
+  void infer_objects();
+  void add_use(SSAValue* v, SSAUse use);
+  void remove_use(SSAValue* v, SSAUse use);
+
+  DexMethod* m_method;
+  MethodTransform* m_transform;
+  uint16_t m_nregs;
+  std::vector<SSAValue*> m_values;
+  std::vector<SSAValue*> m_params;
+  std::vector<SSAValue*> m_undef;
+  std::vector<std::vector<SSAPhi*>> m_phis;
+  std::unordered_map<DexInstruction*, InsnInfo> m_insns;
+  std::unordered_set<DexInstruction*> m_removed;
+  bool m_destructed{false};
+
+  friend class SSADestructor;
+};
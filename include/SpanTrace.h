@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Spans of wall time on each thread, written out at exit as Chrome
+ * trace_event JSON for chrome://tracing.  Set SPANTRACE=<file> to turn it
+ * on.
+ *
+ * Unlike TRACE this is compiled into release builds.  While off, a span
+ * costs a load and a branch.  While on, it costs two clock reads and a
+ * store into a ring buffer owned by the thread, so threads share nothing
+ * on the way.  Each thread keeps its last kSpansPerThread spans.
+ *
+ * Names are kept by pointer until the trace is written, so pass string
+ * literals, or std::strings, which are interned.
+ */
+class SpanTrace {
+ public:
+  static constexpr size_t kSpansPerThread = 1 << 16;
+
+  static bool enabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+
+  /* Microseconds since the process started. */
+  static uint64_t now();
+
+  static void record(const char* name, uint64_t start, uint64_t end);
+
+  static const char* intern(const std::string& name);
+
+  /* Label the calling thread in the trace. */
+  static void set_thread_name(const char* name);
+
+  /*
+   * Write the trace and stop recording.  Runs at exit on its own; spans
+   * still being recorded by other threads at that point may be torn.
+   */
+  static void flush();
+
+ private:
+  // Cleared by flush() while other threads may still be checking it.
+  static std::atomic<bool> s_enabled;
+};
+
+/* Records the lifetime of the object as a span. */
+class ScopedSpan {
+ public:
+  explicit ScopedSpan(const char* name)
+    : m_name(SpanTrace::enabled() ? name : nullptr),
+      m_start(m_name != nullptr ? SpanTrace::now() : 0) {}
+
+  explicit ScopedSpan(const std::string& name)
+    : ScopedSpan(SpanTrace::enabled() ? SpanTrace::intern(name) : nullptr) {}
+
+  ~ScopedSpan() {
+    if (m_name != nullptr) {
+      SpanTrace::record(m_name, m_start, SpanTrace::now());
+    }
+  }
+
+  ScopedSpan(const ScopedSpan&) = delete;
+  ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+ private:
+  const char* m_name;
+  uint64_t m_start;
+};
@@ -13,7 +13,9 @@
   TM(ANNO)                                      \
   TM(BIND)                                      \
   TM(BRIDGE)                                    \
+  TM(CALLGRAPH)                                 \
   TM(CFG)                                       \
+  TM(CH)                                        \
   TM(CLASSKILL)                                 \
   TM(DC)                                        \
   TM(DCE)                                       \
@@ -27,17 +29,21 @@
   TM(INTF)                                      \
   TM(LOC)                                       \
   TM(MAIN)                                      \
+  TM(MEM)                                       \
   TM(MMINL)                                     \
   TM(MTRANS)                                    \
   TM(PEEPHOLE)                                  \
   TM(PM)                                        \
   TM(PGR)                                       \
+  TM(PURITY)                                    \
+  TM(REFIDX)                                    \
   TM(REG)                                       \
   TM(RELO)                                      \
   TM(RENAME)                                    \
   TM(SHORTEN)                                   \
   TM(SINK)                                      \
   TM(SINL)                                      \
+  TM(SSA)                                       \
   TM(SUPER)                                     \
   TM(SYNT)                                      \
   TM(UNTF)
@@ -49,15 +55,28 @@ TMS
   N_TRACE_MODULES,
 };
 
+/*
+ * Trace output is buffered per thread and written out a batch of whole
+ * lines at a time.  This writes out what every thread still holds.
+ */
+void flush_trace();
+
+/*
+ * flush_trace() for the crash handler.  The crashing thread may hold any
+ * lock, so this never waits for one: output that another thread is in the
+ * middle of handling is lost.
+ */
+void flush_trace_on_crash();
+
 #ifdef NDEBUG
 #define TRACE(...)
 #else
 bool traceEnabled(TraceModule module, int level);
-void trace(const char* fmt, ...);
-#define TRACE(module, level, fmt, ...) \
-  do {                                 \
-    if (traceEnabled(module, level)) { \
-      trace(fmt, ##__VA_ARGS__);       \
-    }                                  \
+void trace(TraceModule module, const char* fmt, ...);
+#define TRACE(module, level, fmt, ...)   \
+  do {                                   \
+    if (traceEnabled(module, level)) {   \
+      trace(module, fmt, ##__VA_ARGS__); \
+    }                                    \
   } while (0)
 #endif // NDEBUG
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -18,6 +19,9 @@
 
 #include "DexClass.h"
 
+class DominatorTree;
+class LoopInfo;
+
 enum TryEntryType {
   TRY_START = 0,
   TRY_END = 1,
@@ -26,7 +30,7 @@ enum TryEntryType {
 
 std::string show(TryEntryType t);
 
-struct TryEntry {
+struct TryEntry : MemoryAccounted<MemoryAccounting::METHOD_ITEMS> {
   TryEntryType type;
   DexTryItem* tentry; /* The pointer is used to identify which DexTryEntry
                        * the TryEntry is associated with. */
@@ -51,7 +55,7 @@ enum BranchTargetType {
 };
 
 struct MethodItemEntry;
-struct BranchTarget {
+struct BranchTarget : MemoryAccounted<MemoryAccounting::METHOD_ITEMS> {
   BranchTargetType type;
   MethodItemEntry* src;
   int32_t index;
@@ -65,7 +69,7 @@ enum MethodItemType {
   MFLOW_FALLTHROUGH = 4,
 };
 
-struct MethodItemEntry {
+struct MethodItemEntry : MemoryAccounted<MemoryAccounting::METHOD_ITEMS> {
   boost::intrusive::list_member_hook<> list_hook_;
   MethodItemType type;
   uint16_t addr;
@@ -156,6 +160,13 @@ inline bool is_catch(Block* b) {
 
 bool ends_with_may_throw(Block* b);
 
+/*
+ * The instruction ending `b` if it can throw into one of b's catch handlers,
+ * or nullptr.  Such an instruction doesn't write its destination when it
+ * throws, so the handlers see the register's previous value.
+ */
+MethodItemEntry* throwing_insn(Block* b);
+
 /*
  * Build a postorder sorted vector of blocks from the given CFG.  Uses a
  * standard depth-first search with a side table of already-visited nodes.
@@ -191,7 +202,7 @@ struct InlineContext {
   }
 };
 
-class MethodTransform {
+class MethodTransform : public MemoryAccounted<MemoryAccounting::METHOD_ITEMS> {
  private:
   using FatMethodCache = std::unordered_map<DexMethod*, MethodTransform*>;
 
@@ -212,13 +223,59 @@ class MethodTransform {
   bool try_sync();
 
   void build_cfg();
+  void clear_cfg();
+  void clear_cfg_analyses();
+
+  /*
+   * Incremental CFG maintenance.  These keep m_blocks consistent with the
+   * FatMethod as instructions are inserted, replaced and removed, so that
+   * analyses can share one CFG per method instead of rebuilding it.
+   * m_block_of maps each item to its block, so that an edit costs time in
+   * the size of the blocks it touches rather than of the method.
+   */
+  Block* containing_block(FatMethod::iterator it);
+  void assign_block(Block* b, FatMethod::iterator begin,
+                    FatMethod::iterator end);
+  bool ends_block(FatMethod::iterator it);
+  void renumber_blocks();
+  void relink_block(Block* b);
+  void split_block(Block* b, FatMethod::iterator at);
+  void merge_with_next(Block* b);
+  void remove_empty_block(Block* b);
+  void update_cfg_at(FatMethod::iterator it);
+  void update_cfg_after_insert(
+      const std::vector<FatMethod::iterator>& inserted);
 
-  static FatMethodCache s_cache;
-  static std::mutex s_lock;
+  /*
+   * The cache is split by method into shards with a lock each, so that
+   * passes running on the WorkQueue don't all line up behind one mutex.
+   * A method being ballooned maps to nullptr; other threads asking for it
+   * wait on `ballooned` rather than balloon it again, since ballooning
+   * rewrites the DexCode's debug info in place.
+   */
+  struct alignas(64) CacheShard {
+    std::mutex lock;
+    std::condition_variable ballooned;
+    FatMethodCache cache;
+  };
+  static constexpr size_t kCacheShards = 64;
+  static CacheShard s_cache[kCacheShards];
+
+  static std::atomic<size_t> s_balloons;
+  static std::atomic<size_t> s_syncs;
+
+  static CacheShard& cache_shard(DexMethod* method) {
+    return s_cache[(reinterpret_cast<uintptr_t>(method) >> 4) % kCacheShards];
+  }
 
   DexMethod* m_method;
   FatMethod* m_fmethod;
   std::vector<Block*> m_blocks;
+  std::unordered_map<const MethodItemEntry*, Block*> m_block_of;
+  bool m_cfg_valid{false};
+  DominatorTree* m_dominators{nullptr};
+  DominatorTree* m_post_dominators{nullptr};
+  LoopInfo* m_loops{nullptr};
 
  private:
   FatMethod::iterator main_block();
@@ -242,6 +299,8 @@ class MethodTransform {
   /*
    * Static factory method that checks the cache first.  Optionally builds a
    * control-flow graph, which makes the transform slightly more expensive.
+   * The CFG is built on demand by cfg() regardless, so want_cfg only asks
+   * for it to be built eagerly.
    */
   static MethodTransform* get_method_transform(DexMethod* method,
                                                bool want_cfg = false);
@@ -254,6 +313,10 @@ class MethodTransform {
    */
   static void sync_all();
 
+  /* Running totals of methods ballooned and synced, for reporting. */
+  static size_t balloon_count() { return s_balloons.load(); }
+  static size_t sync_count() { return s_syncs.load(); }
+
   /*
    * Inline tail-called `callee` into `caller` at instruction `invoke`.
    *
@@ -270,8 +333,30 @@ class MethodTransform {
       DexMethod *callee,
       DexOpcodeMethod *invoke);
 
-  /* Return the control flow graph of this method as a vector of blocks. */
-  std::vector<Block*>& cfg() { return m_blocks; }
+  /*
+   * Return the control flow graph of this method as a vector of blocks, in
+   * bytecode order, with Block::id() equal to the block's index.  The graph
+   * is built on first use and kept up to date by replace_opcode, insert_after,
+   * insert_before and remove_opcode, which split and merge blocks as needed.
+   * Those calls may delete Blocks, so don't hold on to Block pointers across
+   * them.
+   */
+  std::vector<Block*>& cfg();
+
+  /*
+   * Dominators, post-dominators and loop nesting of cfg(), computed on first
+   * use and cached until the CFG changes shape.  Any edit that goes through
+   * this transform can discard them, so don't hold on to the references.
+   */
+  const DominatorTree& dominators();
+  const DominatorTree& post_dominators();
+  const LoopInfo& loops();
+
+  /*
+   * Discard the CFG so that the next call to cfg() rebuilds it.  Required
+   * after editing the FatMethod directly through begin()/end().
+   */
+  void invalidate_cfg() { m_cfg_valid = false; }
 
   /* Write-back FatMethod to DexMethod */
   void sync();
@@ -282,14 +367,19 @@ class MethodTransform {
   /* position = nullptr means at the head */
   void insert_after(DexInstruction* position, std::list<DexInstruction*>& opcodes);
 
+  /*
+   * Insert `insn` in front of the item at `position`, which may be end().
+   * Returns the new item.  Memory ownership of "insn" passes to callee.
+   */
+  FatMethod::iterator insert_before(FatMethod::iterator position,
+                                    DexInstruction* insn);
+
   /* Memory ownership of "op" passes to callee, it will delete it. */
   void remove_opcode(DexInstruction* insn);
 
   FatMethod::iterator begin() { return m_fmethod->begin(); }
   FatMethod::iterator end() { return m_fmethod->end(); }
-  FatMethod::iterator erase(FatMethod::iterator it) {
-    return m_fmethod->erase(it);
-  }
+  FatMethod::iterator erase(FatMethod::iterator it);
   friend std::string show(const MethodTransform*);
 };
 
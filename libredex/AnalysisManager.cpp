@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "AnalysisManager.h"
+
+#include "CallGraph.h"
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "Purity.h"
+#include "ReferenceIndex.h"
+#include "Trace.h"
+#include "Transform.h"
+
+namespace {
+
+size_t index_of(AnalysisManager::Analysis analysis) {
+  return __builtin_ctz(analysis);
+}
+
+const char* name_of(AnalysisManager::Analysis analysis) {
+  switch (analysis) {
+  case AnalysisManager::SCOPE:
+    return "scope";
+  case AnalysisManager::CLASS_HIERARCHY:
+    return "class hierarchy";
+  case AnalysisManager::CALL_GRAPH:
+    return "call graph";
+  case AnalysisManager::REFERENCE_INDEX:
+    return "reference index";
+  case AnalysisManager::PURITY:
+    return "purity";
+  default:
+    return "?";
+  }
+}
+
+}
+
+AnalysisManager::AnalysisManager(DexClassesVector& dexen) : m_dexen(dexen) {}
+
+AnalysisManager::~AnalysisManager() {}
+
+void AnalysisManager::count_build(Analysis analysis) {
+  auto n = ++m_builds[index_of(analysis)];
+  TRACE(PM, 2, "Building %s (build %lu)\n", name_of(analysis), n);
+}
+
+size_t AnalysisManager::builds(Analysis analysis) const {
+  return m_builds[index_of(analysis)];
+}
+
+const Scope& AnalysisManager::scope() {
+  if (!m_scope) {
+    count_build(SCOPE);
+    m_scope.reset(new Scope(build_class_scope(m_dexen)));
+  }
+  return *m_scope;
+}
+
+std::shared_ptr<const ClassHierarchy> AnalysisManager::class_hierarchy() {
+  // The snapshot caches itself and is rebuilt on demand once invalidate()
+  // drops it, so there's nothing to hold here.
+  return ClassHierarchy::get();
+}
+
+CallGraph& AnalysisManager::call_graph() {
+  if (!m_call_graph) {
+    auto& classes = scope();
+    MethodTransform::sync_all();
+    count_build(CALL_GRAPH);
+    m_call_graph.reset(new CallGraph(classes));
+  }
+  return *m_call_graph;
+}
+
+ReferenceIndex& AnalysisManager::reference_index() {
+  if (!m_reference_index) {
+    auto& classes = scope();
+    MethodTransform::sync_all();
+    count_build(REFERENCE_INDEX);
+    m_reference_index.reset(new ReferenceIndex(classes));
+  }
+  return *m_reference_index;
+}
+
+const PurityAnalysis& AnalysisManager::purity() {
+  if (!m_purity) {
+    auto& classes = scope();
+    MethodTransform::sync_all();
+    count_build(PURITY);
+    m_purity.reset(new PurityAnalysis(classes));
+  }
+  return *m_purity;
+}
+
+void AnalysisManager::invalidate(uint32_t preserved) {
+  if (!(preserved & SCOPE)) {
+    preserved = 0;
+  }
+  if (!(preserved & CLASS_HIERARCHY)) {
+    ClassHierarchy::invalidate();
+    preserved &= ~(CALL_GRAPH | PURITY);
+  }
+  if (!(preserved & SCOPE)) {
+    m_scope.reset();
+  }
+  if (!(preserved & CALL_GRAPH)) {
+    m_call_graph.reset();
+  }
+  if (!(preserved & REFERENCE_INDEX)) {
+    m_reference_index.reset();
+  }
+  if (!(preserved & PURITY)) {
+    m_purity.reset();
+  }
+}
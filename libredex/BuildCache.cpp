@@ -0,0 +1,359 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "BuildCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Debug.h"
+#include "Trace.h"
+#include "dexdefs.h"
+
+// Bump when what goes into a key changes.
+#define BUILD_CACHE_VERSION "redex-build-cache 1"
+
+ContentHash::ContentHash() {
+  sha1_init(&m_ctx);
+}
+
+void ContentHash::add(const void* data, size_t size) {
+  auto bytes = static_cast<const unsigned char*>(data);
+  while (size > 0) {
+    auto chunk = std::min(size, size_t(1) << 30);
+    sha1_update(&m_ctx, bytes, chunk);
+    bytes += chunk;
+    size -= chunk;
+  }
+}
+
+void ContentHash::add(const std::string& s) {
+  add(uint32_t(s.size()));
+  add(s.data(), s.size());
+}
+
+void ContentHash::add(uint32_t n) {
+  add(&n, sizeof(n));
+}
+
+void ContentHash::add_json(const folly::dynamic& value) {
+  if (value.isObject()) {
+    std::vector<std::pair<std::string, const folly::dynamic*>> members;
+    for (auto& item : value.items()) {
+      members.emplace_back(item.first.asString().toStdString(), &item.second);
+    }
+    std::sort(members.begin(), members.end());
+    add("{");
+    for (auto& member : members) {
+      add(member.first);
+      add_json(*member.second);
+    }
+    add("}");
+  } else if (value.isArray()) {
+    add("[");
+    for (auto& element : value) {
+      add_json(element);
+    }
+    add("]");
+  } else if (value.isNull()) {
+    add("null");
+  } else {
+    // Tell the string "1" from the number 1.
+    add(value.isString() ? "s" : "n");
+    add(value.asString().toStdString());
+  }
+}
+
+bool ContentHash::add_file(const std::string& path) {
+  FILE* fd = fopen(path.c_str(), "rb");
+  if (fd == nullptr) {
+    return false;
+  }
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fd)) > 0) {
+    add(buf, n);
+  }
+  fclose(fd);
+  return true;
+}
+
+std::string ContentHash::digest() {
+  unsigned char sha1[20];
+  sha1_final(sha1, &m_ctx);
+  return std::string(reinterpret_cast<char*>(sha1), sizeof(sha1));
+}
+
+std::string ContentHash::hex_digest() {
+  static const char hex[] = "0123456789abcdef";
+  std::string result;
+  for (unsigned char c : digest()) {
+    result += hex[c >> 4];
+    result += hex[c & 0xf];
+  }
+  return result;
+}
+
+namespace {
+
+bool is_regular_file(const std::string& path) {
+  struct stat buf;
+  return stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode);
+}
+
+bool is_directory(const std::string& path) {
+  struct stat buf;
+  return stat(path.c_str(), &buf) == 0 && S_ISDIR(buf.st_mode);
+}
+
+/* The names in `dir`, sorted, without "." and "..". */
+std::vector<std::string> list_dir(const std::string& dir) {
+  std::vector<std::string> names;
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return names;
+  }
+  while (auto entry = readdir(d)) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+void hash_named_file(ContentHash& hash, const std::string& path) {
+  hash.add(path);
+  hash.add_file(path);
+}
+
+void hash_tree(ContentHash& hash, const std::string& dir) {
+  for (auto& name : list_dir(dir)) {
+    auto path = dir + "/" + name;
+    if (is_directory(path)) {
+      hash_tree(hash, path);
+    } else if (is_regular_file(path)) {
+      hash_named_file(hash, path);
+    }
+  }
+}
+
+/* What ReachableClasses reads from the unzipped APK. */
+void hash_apk_dir(ContentHash& hash, const std::string& apk_dir) {
+  hash_named_file(hash, apk_dir + "/AndroidManifest.xml");
+  auto res = apk_dir + "/res";
+  for (auto& name : list_dir(res)) {
+    if (name.compare(0, strlen("layout"), "layout") == 0) {
+      hash_tree(hash, res + "/" + name);
+    }
+  }
+  hash_tree(hash, apk_dir + "/lib");
+}
+
+bool is_output_key(const std::string& key) {
+  auto& keys = BuildCache::build_output_keys();
+  return key == "pass_perf_output" ||
+    std::find(keys.begin(), keys.end(), key) != keys.end();
+}
+
+/* The contents of the files config strings name, other than outputs. */
+void hash_config_files(ContentHash& hash,
+                       const folly::dynamic& value,
+                       const std::string& key) {
+  if (value.isObject()) {
+    std::vector<std::pair<std::string, const folly::dynamic*>> members;
+    for (auto& item : value.items()) {
+      members.emplace_back(item.first.asString().toStdString(), &item.second);
+    }
+    std::sort(members.begin(), members.end());
+    for (auto& member : members) {
+      if (!is_output_key(member.first)) {
+        hash_config_files(hash, *member.second, member.first);
+      }
+    }
+  } else if (value.isArray()) {
+    for (auto& element : value) {
+      hash_config_files(hash, element, key);
+    }
+  } else if (value.isString()) {
+    auto path = value.asString().toStdString();
+    if (key == "apk_dir") {
+      hash_apk_dir(hash, path);
+    } else if (is_regular_file(path)) {
+      hash_named_file(hash, path);
+    }
+  }
+}
+
+bool copy_file(const std::string& from, const std::string& to) {
+  FILE* in = fopen(from.c_str(), "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  FILE* out = fopen(to.c_str(), "wb");
+  if (out == nullptr) {
+    fclose(in);
+    return false;
+  }
+  char buf[1 << 16];
+  size_t n;
+  bool ok = true;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    if (fwrite(buf, 1, n, out) != n) {
+      ok = false;
+      break;
+    }
+  }
+  fclose(in);
+  return fclose(out) == 0 && ok;
+}
+
+void remove_dir(const std::string& dir) {
+  for (auto& name : list_dir(dir)) {
+    unlink((dir + "/" + name).c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+bool is_dex_name(const std::string& name) {
+  auto dex = strlen(".dex");
+  return name.compare(0, strlen("classes"), "classes") == 0 &&
+    name.size() > dex && name.compare(name.size() - dex, dex, ".dex") == 0;
+}
+
+/*
+ * The output files `config` names, as (name in the cache, path) pairs.
+ * Pass outputs are named "<pass>.<key>".
+ */
+std::vector<std::pair<std::string, std::string>> output_files(
+    const folly::dynamic& config) {
+  std::vector<std::pair<std::string, std::string>> files;
+  auto add_outputs = [&](const folly::dynamic& cfg, const std::string& prefix) {
+    for (auto& key : BuildCache::build_output_keys()) {
+      auto path = cfg.getDefault(key, "").asString().toStdString();
+      if (!path.empty()) {
+        files.emplace_back(prefix + key, path);
+      }
+    }
+  };
+  add_outputs(config, "");
+  for (auto& item : config.items()) {
+    if (item.second.isObject()) {
+      add_outputs(item.second, item.first.asString().toStdString() + ".");
+    }
+  }
+  return files;
+}
+
+}
+
+std::string BuildCache::build_key(const folly::dynamic& config,
+                                  const std::vector<std::string>& dexes,
+                                  const std::vector<std::string>& input_files) {
+  ContentHash hash;
+  hash.add(BUILD_CACHE_VERSION);
+  if (!hash.add_file("/proc/self/exe")) {
+    return "";
+  }
+  hash.add(uint32_t(dexes.size()));
+  for (auto& dex : dexes) {
+    dex_header header;
+    FILE* fd = fopen(dex.c_str(), "rb");
+    if (fd == nullptr) {
+      return "";
+    }
+    auto n = fread(&header, 1, sizeof(header), fd);
+    fclose(fd);
+    if (n != sizeof(header)) {
+      return "";
+    }
+    hash.add(&header, sizeof(header));
+  }
+  for (auto& file : input_files) {
+    hash.add(file);
+    if (!file.empty()) {
+      hash.add_file(file);
+    }
+  }
+  hash.add_json(config);
+  hash_config_files(hash, config, "");
+  return hash.hex_digest();
+}
+
+const std::vector<std::string>& BuildCache::build_output_keys() {
+  static const std::vector<std::string> keys = {
+    "stats_output",
+    "method_mapping",
+    "method_move_map",
+    "class_rename",
+    "filename_mappings",
+  };
+  return keys;
+}
+
+bool BuildCache::restore(const std::string& out_dir,
+                         const folly::dynamic& config) {
+  auto entry = m_dir + "/" + m_key;
+  if (!is_directory(entry)) {
+    TRACE(MAIN, 1, "Build cache miss: %s\n", m_key.c_str());
+    return false;
+  }
+  for (auto& name : list_dir(entry)) {
+    if (is_dex_name(name)) {
+      always_assert_log(copy_file(entry + "/" + name, out_dir + "/" + name),
+                        "Cannot copy cached %s to %s\n",
+                        name.c_str(), out_dir.c_str());
+    }
+  }
+  for (auto& file : output_files(config)) {
+    auto cached = entry + "/" + file.first;
+    if (is_regular_file(cached)) {
+      always_assert_log(copy_file(cached, file.second),
+                        "Cannot copy cached %s to %s\n",
+                        file.first.c_str(), file.second.c_str());
+    }
+  }
+  TRACE(MAIN, 1, "Build cache hit: %s\n", m_key.c_str());
+  return true;
+}
+
+void BuildCache::store(const std::vector<std::string>& dexes,
+                       const folly::dynamic& config) {
+  mkdir(m_dir.c_str(), 0755);
+  auto entry = m_dir + "/" + m_key;
+  auto tmp = entry + ".tmp." + std::to_string(getpid());
+  remove_dir(tmp);
+  if (mkdir(tmp.c_str(), 0755) != 0) {
+    fprintf(stderr, "WARNING: cannot create build cache entry %s\n",
+            tmp.c_str());
+    return;
+  }
+  bool ok = true;
+  for (auto& dex : dexes) {
+    auto slash = dex.rfind('/');
+    auto name = slash == std::string::npos ? dex : dex.substr(slash + 1);
+    ok = ok && copy_file(dex, tmp + "/" + name);
+  }
+  for (auto& file : output_files(config)) {
+    if (is_regular_file(file.second)) {
+      ok = ok && copy_file(file.second, tmp + "/" + file.first);
+    }
+  }
+  // Another run may have stored the same build meanwhile; either will do.
+  if (!ok || rename(tmp.c_str(), entry.c_str()) != 0) {
+    remove_dir(tmp);
+  }
+  TRACE(MAIN, 1, "Build cache %s: %s\n",
+        ok ? "stored" : "failed to store", m_key.c_str());
+}
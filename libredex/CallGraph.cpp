@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "CallGraph.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "DexAccess.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+#include "walkers.h"
+
+namespace {
+
+const std::vector<CallGraph::Call> no_calls;
+const std::vector<CallGraph::CallSite> no_call_sites;
+
+bool is_target(const DexMethod* method) {
+  return method != nullptr && method->is_concrete() &&
+         !(method->get_access() & ACC_ABSTRACT);
+}
+
+/* The virtual method `cls` itself declares with this name and proto. */
+DexMethod* declared_vmethod(const DexClass* cls,
+                            const DexString* name,
+                            const DexProto* proto) {
+  for (auto m : cls->get_vmethods()) {
+    if (m->get_name() == name && m->get_proto() == proto) {
+      return m;
+    }
+  }
+  return nullptr;
+}
+}
+
+constexpr size_t CallGraph::kTargetShards;
+
+struct CallGraph::Scan {
+  const CallGraph* graph;
+  DexMethod* method;
+  std::vector<Call> calls;
+};
+
+void CallGraph::scan(Scan* s) {
+  s->calls = s->graph->calls(s->method);
+}
+
+void* CallGraph::operator new(size_t size) {
+  void* p;
+  if (posix_memalign(&p, alignof(CallGraph), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void CallGraph::operator delete(void* p) {
+  free(p);
+}
+
+CallGraph::CallGraph(const Scope& scope)
+    : m_hierarchy(ClassHierarchy::get()) {
+  for (auto cls : scope) {
+    for (auto intf : cls->get_interfaces()->get_type_list()) {
+      m_implementors[intf].push_back(cls);
+    }
+  }
+  std::vector<Scan> scans;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      scans.push_back(Scan{this, m, {}});
+    }
+  });
+  if (!scans.empty()) {
+    std::vector<WorkItem<Scan>> workitems(scans.size());
+    for (size_t i = 0; i < scans.size(); i++) {
+      workitems[i].init(scan, &scans[i]);
+    }
+    WorkQueue wq;
+    wq.run_work_items(&workitems[0], workitems.size());
+  }
+  for (auto& s : scans) {
+    add_calls(s.method, std::move(s.calls));
+  }
+  TRACE(CALLGRAPH, 1, "Call graph of %lu methods, %lu callees, %lu edges\n",
+        scans.size(), m_callers.size(), m_edges);
+}
+
+const std::vector<CallGraph::Call>& CallGraph::callees(
+    const DexMethod* caller) const {
+  auto it = m_callees.find(caller);
+  return it != m_callees.end() ? it->second : no_calls;
+}
+
+const std::vector<CallGraph::CallSite>& CallGraph::callers(
+    const DexMethod* callee) const {
+  auto it = m_callers.find(callee);
+  return it != m_callers.end() ? it->second : no_call_sites;
+}
+
+void CallGraph::update_method(DexMethod* caller) {
+  remove_calls(caller);
+  if (caller->get_code()) {
+    add_calls(caller, calls(caller));
+  }
+}
+
+void CallGraph::remove_method(DexMethod* method) {
+  remove_calls(method);
+  auto it = m_callers.find(method);
+  if (it != m_callers.end()) {
+    for (auto& site : it->second) {
+      for (auto& call : m_callees.at(site.caller)) {
+        if (call.insn == site.insn) {
+          auto& targets = call.targets;
+          targets.erase(std::remove(targets.begin(), targets.end(), method),
+                        targets.end());
+        }
+      }
+    }
+    m_edges -= it->second.size();
+    m_callers.erase(it);
+  }
+  m_removed.insert(method);
+}
+
+std::vector<CallGraph::Call> CallGraph::calls(const DexMethod* caller) const {
+  std::vector<Call> calls;
+  for (auto insn : caller->get_code()->get_instructions()) {
+    if (is_invoke(insn->opcode())) {
+      calls.push_back(Call{insn, targets(insn)});
+    }
+  }
+  return calls;
+}
+
+std::vector<DexMethod*> CallGraph::targets(DexInstruction* insn) const {
+  auto ref = static_cast<DexOpcodeMethod*>(insn)->get_method();
+  DexMethod* callee;
+  switch (insn->opcode()) {
+  case OPCODE_INVOKE_DIRECT:
+  case OPCODE_INVOKE_DIRECT_RANGE:
+    callee = resolve_method(ref, MethodSearch::Direct);
+    break;
+  case OPCODE_INVOKE_STATIC:
+  case OPCODE_INVOKE_STATIC_RANGE:
+    callee = resolve_method(ref, MethodSearch::Static);
+    break;
+  case OPCODE_INVOKE_SUPER:
+  case OPCODE_INVOKE_SUPER_RANGE:
+    callee = resolve_method(ref, MethodSearch::Virtual);
+    break;
+  default: {
+    std::vector<DexMethod*> targets;
+    for (auto m : virtual_targets(ref)) {
+      if (!m_removed.count(m)) {
+        targets.push_back(m);
+      }
+    }
+    return targets;
+  }
+  }
+  if (is_target(callee) && !m_removed.count(callee)) {
+    return {callee};
+  }
+  return {};
+}
+
+/*
+ * Every concrete method a virtual or interface call to `ref` may dispatch
+ * to: the one the receiver type inherits and each override below it.
+ */
+const std::vector<DexMethod*>& CallGraph::virtual_targets(
+    DexMethod* ref) const {
+  auto& shard =
+    m_targets[(reinterpret_cast<uintptr_t>(ref) >> 4) % kTargetShards];
+  {
+    std::lock_guard<std::mutex> g(shard.lock);
+    auto it = shard.targets.find(ref);
+    if (it != shard.targets.end()) {
+      return *it->second;
+    }
+  }
+
+  std::unique_ptr<std::vector<DexMethod*>> targets(
+    new std::vector<DexMethod*>());
+  std::unordered_set<DexMethod*> seen;
+  auto name = ref->get_name();
+  auto proto = ref->get_proto();
+  auto add = [&](DexMethod* m) {
+    if (is_target(m) && seen.insert(m).second) {
+      targets->push_back(m);
+    }
+  };
+  auto add_overrides = [&](const DexType* type) {
+    for (auto sub : m_hierarchy->subclasses(type)) {
+      auto cls = type_class(sub);
+      if (cls != nullptr) {
+        add(declared_vmethod(cls, name, proto));
+      }
+    }
+  };
+
+  auto cls = type_class(ref->get_class());
+  if (cls != nullptr && (cls->get_access() & ACC_INTERFACE)) {
+    std::vector<const DexType*> intfs{ref->get_class()};
+    std::unordered_set<const DexType*> seen_intfs{ref->get_class()};
+    while (!intfs.empty()) {
+      auto intf = intfs.back();
+      intfs.pop_back();
+      auto it = m_implementors.find(intf);
+      if (it == m_implementors.end()) {
+        continue;
+      }
+      for (auto impl : it->second) {
+        if (impl->get_access() & ACC_INTERFACE) {
+          if (seen_intfs.insert(impl->get_type()).second) {
+            intfs.push_back(impl->get_type());
+          }
+          continue;
+        }
+        add(resolve_virtual(impl, name, proto));
+        add_overrides(impl->get_type());
+      }
+    }
+  } else {
+    add(resolve_method(ref, MethodSearch::Virtual));
+    add_overrides(ref->get_class());
+  }
+
+  std::lock_guard<std::mutex> g(shard.lock);
+  auto& slot = shard.targets[ref];
+  if (!slot) {
+    slot = std::move(targets);
+  }
+  return *slot;
+}
+
+void CallGraph::add_calls(DexMethod* caller, std::vector<Call> calls) {
+  for (auto& call : calls) {
+    for (auto target : call.targets) {
+      m_callers[target].push_back(CallSite{caller, call.insn});
+    }
+    m_edges += call.targets.size();
+  }
+  m_callees[caller] = std::move(calls);
+}
+
+void CallGraph::remove_calls(DexMethod* caller) {
+  auto it = m_callees.find(caller);
+  if (it == m_callees.end()) {
+    return;
+  }
+  for (auto& call : it->second) {
+    for (auto target : call.targets) {
+      auto& sites = m_callers[target];
+      sites.erase(std::remove_if(sites.begin(),
+                                 sites.end(),
+                                 [&](const CallSite& site) {
+                                   return site.caller == caller &&
+                                          site.insn == call.insn;
+                                 }),
+                  sites.end());
+    }
+    m_edges -= call.targets.size();
+  }
+  m_callees.erase(it);
+}
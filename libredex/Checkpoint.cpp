@@ -0,0 +1,400 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "Debug.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "RedexContext.h"
+#include "ReferencedState.h"
+#include "Show.h"
+#include "Trace.h"
+
+#define CHECKPOINT_MAGIC "redexckp"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_NO_INDEX 0xffffffff
+
+/*
+ * Counts of records and the offsets of their sections.  Records are
+ * 32-bit words:
+ *
+ *   type:        name string
+ *   class:       type, state
+ *   field:       class type, name string, type, state
+ *   method:      class type, name string, return type, args offset, state
+ *   move:        class string, method string, source file string or
+ *                CHECKPOINT_NO_INDEX, type of the class it moved to
+ *   type list:   count, types...
+ *   string:      offset of its NUL-terminated characters
+ */
+struct checkpoint_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t pass_index;
+  uint32_t pass_name;
+  uint32_t dex_count;
+  uint32_t string_count;
+  uint32_t strings_off;
+  uint32_t type_count;
+  uint32_t types_off;
+  uint32_t class_count;
+  uint32_t classes_off;
+  uint32_t field_count;
+  uint32_t fields_off;
+  uint32_t method_count;
+  uint32_t methods_off;
+  uint32_t move_count;
+  uint32_t moves_off;
+  uint32_t type_lists_off;
+};
+
+namespace {
+
+std::string dex_path(const std::string& dir, size_t i) {
+  return dir + "/classes" + (i > 0 ? std::to_string(i + 1) : "") + ".dex";
+}
+
+std::string state_path(const std::string& dir) {
+  return dir + "/state";
+}
+
+const uint8_t k_default_state = ReferencedState().encode();
+
+class StateWriter {
+ public:
+  StateWriter() {
+    std::vector<DexString*> strings;
+    g_redex->visit_all_dexstring([&](DexString* s) { strings.push_back(s); });
+    for (auto s : strings) {
+      m_string_ids.emplace(s, m_strings.size());
+      m_strings.push_back(s);
+    }
+    std::vector<DexType*> types;
+    g_redex->visit_all_dextype([&](DexType* t) { types.push_back(t); });
+    for (auto t : types) {
+      // Renamed types are in the map under their old names too.
+      if (m_type_ids.emplace(t, m_type_names.size()).second) {
+        m_type_names.push_back(string_id(t->get_name()));
+      }
+    }
+  }
+
+  void add_states(DexClass* cls) {
+    if (cls->rstate.encode() != k_default_state) {
+      m_classes.insert(m_classes.end(),
+                       {type_id(cls->get_type()), cls->rstate.encode()});
+    }
+    auto add_field = [&](DexField* f) {
+      if (f->rstate.encode() == k_default_state) return;
+      m_fields.insert(m_fields.end(),
+                      {type_id(f->get_class()), string_id(f->get_name()),
+                       type_id(f->get_type()), f->rstate.encode()});
+    };
+    auto add_method = [&](DexMethod* m) {
+      if (m->rstate.encode() == k_default_state) return;
+      auto proto = m->get_proto();
+      m_methods.insert(m_methods.end(),
+                       {type_id(m->get_class()), string_id(m->get_name()),
+                        type_id(proto->get_rtype()),
+                        type_list_id(proto->get_args()), m->rstate.encode()});
+    };
+    for (auto f : cls->get_sfields()) add_field(f);
+    for (auto f : cls->get_ifields()) add_field(f);
+    for (auto m : cls->get_dmethods()) add_method(m);
+    for (auto m : cls->get_vmethods()) add_method(m);
+  }
+
+  void add_moves(ConfigFiles& cfg) {
+    for (auto const& it : *cfg.get_moved_methods_map()) {
+      auto src = std::get<2>(it.first);
+      m_moves.insert(m_moves.end(),
+                     {string_id(std::get<0>(it.first)),
+                      string_id(std::get<1>(it.first)),
+                      src != nullptr ? string_id(src) : CHECKPOINT_NO_INDEX,
+                      type_id(it.second->get_type())});
+    }
+  }
+
+  void write(const std::string& path,
+             size_t pass_index,
+             const std::string& pass_name,
+             size_t dex_count) {
+    checkpoint_header hdr;
+    memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.pass_index = pass_index;
+    hdr.pass_name = string_id(DexString::get_string(pass_name.c_str()));
+    hdr.dex_count = dex_count;
+
+    std::vector<uint32_t> words;
+    uint32_t offset = sizeof(hdr);
+    auto section = [&](const std::vector<uint32_t>& records) {
+      words.insert(words.end(), records.begin(), records.end());
+      auto start = offset;
+      offset += records.size() * sizeof(uint32_t);
+      return start;
+    };
+    hdr.type_count = m_type_names.size();
+    hdr.types_off = section(m_type_names);
+    hdr.class_count = m_classes.size() / 2;
+    hdr.classes_off = section(m_classes);
+    hdr.field_count = m_fields.size() / 4;
+    hdr.fields_off = section(m_fields);
+    hdr.method_count = m_methods.size() / 5;
+    hdr.methods_off = section(m_methods);
+    hdr.move_count = m_moves.size() / 4;
+    hdr.moves_off = section(m_moves);
+    hdr.type_lists_off = section(m_type_lists);
+    // Method records hold offsets into the type list section; make them
+    // file offsets.
+    for (uint32_t i = 0; i < hdr.method_count; ++i) {
+      auto& args = words[(hdr.methods_off - sizeof(hdr)) / sizeof(uint32_t) +
+                         i * 5 + 3];
+      args += hdr.type_lists_off;
+    }
+    std::vector<uint32_t> string_offs;
+    uint32_t string_off = offset + m_strings.size() * sizeof(uint32_t);
+    for (auto s : m_strings) {
+      string_offs.push_back(string_off);
+      string_off += strlen(s->c_str()) + 1;
+    }
+    hdr.string_count = m_strings.size();
+    hdr.strings_off = section(string_offs);
+
+    auto tmp = path + ".tmp";
+    FILE* fd = fopen(tmp.c_str(), "wb");
+    always_assert_log(fd != nullptr, "Cannot write checkpoint %s\n",
+                      tmp.c_str());
+    fwrite(&hdr, sizeof(hdr), 1, fd);
+    fwrite(words.data(), sizeof(uint32_t), words.size(), fd);
+    for (auto s : m_strings) {
+      fwrite(s->c_str(), strlen(s->c_str()) + 1, 1, fd);
+    }
+    always_assert_log(fclose(fd) == 0, "Cannot write checkpoint %s\n",
+                      tmp.c_str());
+    always_assert_log(rename(tmp.c_str(), path.c_str()) == 0,
+                      "Cannot write checkpoint %s\n", path.c_str());
+  }
+
+ private:
+  uint32_t string_id(DexString* s) {
+    auto it = m_string_ids.find(s);
+    always_assert_log(it != m_string_ids.end(), "String %s isn't interned\n",
+                      s->c_str());
+    return it->second;
+  }
+
+  uint32_t type_id(DexType* t) {
+    auto it = m_type_ids.find(t);
+    always_assert_log(it != m_type_ids.end(), "Type %s isn't interned\n",
+                      SHOW(t));
+    return it->second;
+  }
+
+  uint32_t type_list_id(DexTypeList* list) {
+    auto it = m_type_list_ids.find(list);
+    if (it != m_type_list_ids.end()) {
+      return it->second;
+    }
+    uint32_t id = m_type_lists.size() * sizeof(uint32_t);
+    auto const& types = list->get_type_list();
+    m_type_lists.push_back(types.size());
+    for (auto t : types) {
+      m_type_lists.push_back(type_id(t));
+    }
+    m_type_list_ids.emplace(list, id);
+    return id;
+  }
+
+  std::vector<DexString*> m_strings;
+  std::unordered_map<DexString*, uint32_t> m_string_ids;
+  std::vector<uint32_t> m_type_names;
+  std::unordered_map<DexType*, uint32_t> m_type_ids;
+  std::vector<uint32_t> m_type_lists;
+  std::unordered_map<DexTypeList*, uint32_t> m_type_list_ids;
+  std::vector<uint32_t> m_classes;
+  std::vector<uint32_t> m_fields;
+  std::vector<uint32_t> m_methods;
+  std::vector<uint32_t> m_moves;
+};
+
+}
+
+void write_checkpoint(const std::string& dir,
+                      size_t pass_index,
+                      const std::string& pass_name,
+                      DexClassesVector& dexen,
+                      ConfigFiles& cfg) {
+  TRACE(PM, 1, "Writing checkpoint after %s to %s\n",
+        pass_name.c_str(), dir.c_str());
+  mkdir(dir.c_str(), 0755);
+  // Until the new state is in place, the old one mustn't be taken for a
+  // checkpoint of the new dexes.
+  unlink(state_path(dir).c_str());
+  DexString::make_string(pass_name.c_str());
+  for (size_t i = 0; i < dexen.size(); ++i) {
+    write_classes_to_dex(dex_path(dir, i), &dexen[i], nullptr, i, "");
+  }
+  StateWriter writer;
+  for (auto cls : get_all_classes()) {
+    writer.add_states(cls);
+  }
+  writer.add_moves(cfg);
+  writer.write(state_path(dir), pass_index, pass_name, dexen.size());
+}
+
+CheckpointReader::CheckpointReader(const std::string& dir)
+    : m_dir(dir), m_mapping(nullptr), m_size(0), m_header(nullptr) {
+  auto path = state_path(dir);
+  int fd = open(path.c_str(), O_RDONLY);
+  always_assert_log(fd >= 0, "Cannot open checkpoint %s\n", path.c_str());
+  struct stat buf;
+  always_assert_log(fstat(fd, &buf) == 0, "Cannot fstat checkpoint %s\n",
+                    path.c_str());
+  m_size = buf.st_size;
+  always_assert_log(m_size >= sizeof(checkpoint_header),
+                    "Checkpoint %s is truncated\n", path.c_str());
+  auto mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  always_assert_log(mapping != MAP_FAILED, "Cannot mmap checkpoint %s\n",
+                    path.c_str());
+  m_mapping = static_cast<const uint8_t*>(mapping);
+  m_header = reinterpret_cast<const checkpoint_header*>(m_mapping);
+  always_assert_log(
+      !memcmp(m_header->magic, CHECKPOINT_MAGIC, sizeof(m_header->magic)) &&
+          m_header->version == CHECKPOINT_VERSION,
+      "%s isn't a version %d checkpoint\n", path.c_str(), CHECKPOINT_VERSION);
+}
+
+CheckpointReader::~CheckpointReader() {
+  munmap(const_cast<uint8_t*>(m_mapping), m_size);
+}
+
+size_t CheckpointReader::pass_index() const {
+  return m_header->pass_index;
+}
+
+std::string CheckpointReader::pass_name() const {
+  return string(m_header->pass_name);
+}
+
+const uint32_t* CheckpointReader::words(uint32_t offset) const {
+  always_assert_log(offset % sizeof(uint32_t) == 0 && offset < m_size,
+                    "Bad offset %u in checkpoint %s\n", offset,
+                    m_dir.c_str());
+  return reinterpret_cast<const uint32_t*>(m_mapping + offset);
+}
+
+const char* CheckpointReader::string(uint32_t index) const {
+  always_assert(index < m_header->string_count);
+  auto offset = words(m_header->strings_off)[index];
+  always_assert_log(offset < m_size, "Bad string in checkpoint %s\n",
+                    m_dir.c_str());
+  return reinterpret_cast<const char*>(m_mapping + offset);
+}
+
+DexType* CheckpointReader::type(uint32_t index) const {
+  always_assert(index < m_header->type_count);
+  return DexType::get_type(string(words(m_header->types_off)[index]));
+}
+
+DexTypeList* CheckpointReader::type_list(uint32_t offset) const {
+  auto list = words(offset);
+  std::list<DexType*> types;
+  for (uint32_t i = 0; i < list[0]; ++i) {
+    types.push_back(type(list[i + 1]));
+  }
+  return DexTypeList::get_type_list(std::move(types));
+}
+
+DexClassesVector CheckpointReader::load_classes() {
+  for (uint32_t i = 0; i < m_header->string_count; ++i) {
+    DexString::make_string(string(i));
+  }
+  auto type_names = words(m_header->types_off);
+  for (uint32_t i = 0; i < m_header->type_count; ++i) {
+    DexType::make_type(string(type_names[i]));
+  }
+  DexClassesVector dexen;
+  for (uint32_t i = 0; i < m_header->dex_count; ++i) {
+    dexen.emplace_back(load_classes_from_dex(dex_path(m_dir, i).c_str()));
+  }
+
+  // States of members gone from the classes since, or of library classes
+  // not loaded this time, have nowhere to go.
+  size_t unmatched = 0;
+  auto classes = words(m_header->classes_off);
+  for (uint32_t i = 0; i < m_header->class_count; ++i, classes += 2) {
+    auto cls = type_class(type(classes[0]));
+    if (cls == nullptr) {
+      unmatched++;
+      continue;
+    }
+    cls->rstate.decode(classes[1]);
+  }
+  auto fields = words(m_header->fields_off);
+  for (uint32_t i = 0; i < m_header->field_count; ++i, fields += 4) {
+    auto field = DexField::get_field(type(fields[0]),
+                                     DexString::get_string(string(fields[1])),
+                                     type(fields[2]));
+    if (field == nullptr) {
+      unmatched++;
+      continue;
+    }
+    field->rstate.decode(fields[3]);
+  }
+  auto methods = words(m_header->methods_off);
+  for (uint32_t i = 0; i < m_header->method_count; ++i, methods += 5) {
+    auto args = type_list(methods[3]);
+    auto proto = args ? DexProto::get_proto(type(methods[2]), args) : nullptr;
+    auto method =
+        proto ? DexMethod::get_method(type(methods[0]),
+                                      DexString::get_string(string(methods[1])),
+                                      proto)
+              : nullptr;
+    if (method == nullptr) {
+      unmatched++;
+      continue;
+    }
+    method->rstate.decode(methods[4]);
+  }
+  TRACE(PM, 1, "Loaded checkpoint %s taken after %s: %lu dexes, "
+        "%lu states unmatched\n", m_dir.c_str(), pass_name().c_str(),
+        dexen.size(), unmatched);
+  return dexen;
+}
+
+void CheckpointReader::restore_config(ConfigFiles& cfg) {
+  auto moves = words(m_header->moves_off);
+  for (uint32_t i = 0; i < m_header->move_count; ++i, moves += 4) {
+    auto cls = type_class(type(moves[3]));
+    if (cls == nullptr) {
+      continue;
+    }
+    auto src = moves[2] != CHECKPOINT_NO_INDEX
+        ? DexString::get_string(string(moves[2]))
+        : nullptr;
+    cfg.add_moved_methods(
+        MethodTuple(DexString::get_string(string(moves[0])),
+                    DexString::get_string(string(moves[1])),
+                    src),
+        cls);
+  }
+}
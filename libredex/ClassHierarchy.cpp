@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ClassHierarchy.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "DexAccess.h"
+#include "DexUtil.h"
+#include "Trace.h"
+
+namespace {
+
+// Readers go through atomic_load; building and invalidating also take the
+// lock, so a build can't publish a hierarchy that's already stale.
+std::mutex s_lock;
+std::shared_ptr<const ClassHierarchy> s_current;
+
+}
+
+constexpr uint32_t ClassHierarchy::kNone;
+
+std::shared_ptr<const ClassHierarchy> ClassHierarchy::get() {
+  auto current = std::atomic_load(&s_current);
+  if (current) {
+    return current;
+  }
+  std::lock_guard<std::mutex> g(s_lock);
+  current = std::atomic_load(&s_current);
+  if (!current) {
+    current = std::make_shared<const ClassHierarchy>(get_all_classes());
+    TRACE(CH, 2, "Built class hierarchy of %lu types\n", current->size());
+    std::atomic_store(&s_current, current);
+  }
+  return current;
+}
+
+void ClassHierarchy::invalidate() {
+  std::lock_guard<std::mutex> g(s_lock);
+  std::atomic_store(&s_current, std::shared_ptr<const ClassHierarchy>());
+}
+
+ClassHierarchy::ClassHierarchy(const std::vector<DexClass*>& classes) {
+  // Give every type that's mentioned a temporary number: classes first, in
+  // order, so that siblings keep the order of `classes`.
+  TypeIds tmp;
+  std::vector<DexType*> types;
+  std::vector<DexClass*> cls;
+  std::vector<bool> is_intf;
+  auto add = [&](DexType* t) {
+    auto ins = tmp.emplace(t, types.size());
+    if (ins.second) {
+      types.push_back(t);
+      cls.push_back(nullptr);
+      is_intf.push_back(false);
+    }
+    return ins.first->second;
+  };
+  for (auto c : classes) {
+    auto n = add(c->get_type());
+    if (cls[n] == nullptr) {
+      cls[n] = c;
+      is_intf[n] = c->get_access() & ACC_INTERFACE;
+    }
+  }
+  auto ntypes = types.size();
+  std::vector<uint32_t> parent(ntypes, kNone);
+  for (uint32_t n = 0; n < ntypes; n++) {
+    if (cls[n] == nullptr) {
+      continue;
+    }
+    if (cls[n]->get_super_class() != nullptr) {
+      parent[n] = add(cls[n]->get_super_class());
+    }
+    if (cls[n]->get_interfaces() != nullptr) {
+      for (auto intf : cls[n]->get_interfaces()->get_type_list()) {
+        is_intf[add(intf)] = true;
+      }
+    }
+  }
+  ntypes = types.size();
+  parent.resize(ntypes, kNone);
+  std::vector<std::vector<uint32_t>> children(ntypes);
+  for (uint32_t n = 0; n < ntypes; n++) {
+    if (parent[n] != kNone) {
+      children[parent[n]].push_back(n);
+    }
+  }
+
+  // Lay the forest out in preorder.  A malformed superclass cycle has no
+  // root, so its types are left out and only match themselves.
+  std::vector<uint32_t> pre(ntypes, kNone);
+  m_order.reserve(ntypes);
+  m_end.resize(ntypes);
+  std::vector<std::pair<uint32_t, size_t>> stack;
+  for (uint32_t root = 0; root < ntypes; root++) {
+    if (parent[root] != kNone) {
+      continue;
+    }
+    pre[root] = m_order.size();
+    m_order.push_back(types[root]);
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto n = stack.back().first;
+      auto& next = stack.back().second;
+      if (next < children[n].size()) {
+        auto c = children[n][next++];
+        pre[c] = m_order.size();
+        m_order.push_back(types[c]);
+        stack.emplace_back(c, 0);
+      } else {
+        m_end[pre[n]] = m_order.size();
+        stack.pop_back();
+      }
+    }
+  }
+  m_end.resize(m_order.size());
+
+  uint32_t nintfs = 0;
+  m_intf_bit.assign(m_order.size(), kNone);
+  for (size_t i = 0; i < m_order.size(); i++) {
+    m_id[m_order[i]] = i;
+    if (is_intf[tmp.at(m_order[i])]) {
+      m_intf_bit[i] = nintfs++;
+    }
+  }
+
+  // Closure 0 is the empty set, shared by everything that implements
+  // nothing.
+  m_closures.emplace_back(nintfs);
+  m_closure.assign(m_order.size(), kNone);
+  std::vector<uint32_t> state(ntypes, kNone);
+  for (uint32_t n = 0; n < ntypes; n++) {
+    if (pre[n] != kNone) {
+      m_closure[pre[n]] = closure(n, cls, parent, tmp, state);
+    }
+  }
+}
+
+/*
+ * The interfaces `n` implements: its superclass's, plus each of its own
+ * interfaces and theirs.  `state` memoizes closures by temporary number;
+ * kNone - 1 marks one being computed, to cut malformed cycles short.
+ */
+uint32_t ClassHierarchy::closure(uint32_t n,
+                                 const std::vector<DexClass*>& cls,
+                                 const std::vector<uint32_t>& parent,
+                                 const TypeIds& tmp,
+                                 std::vector<uint32_t>& state) {
+  const uint32_t kVisiting = kNone - 1;
+  if (state[n] == kVisiting) {
+    return 0;
+  }
+  if (state[n] != kNone) {
+    return state[n];
+  }
+  state[n] = kVisiting;
+  uint32_t base =
+    parent[n] != kNone ? closure(parent[n], cls, parent, tmp, state)
+                       : 0;
+  auto intfs = cls[n] ? cls[n]->get_interfaces() : nullptr;
+  if (intfs == nullptr || intfs->get_type_list().empty()) {
+    state[n] = base;
+    return base;
+  }
+  BitVector bits = m_closures[base];
+  for (auto intf : intfs->get_type_list()) {
+    auto i = m_id.find(intf);
+    if (i == m_id.end()) {
+      continue;
+    }
+    bits.set(m_intf_bit[i->second]);
+    bits |= m_closures[closure(tmp.at(intf), cls, parent, tmp, state)];
+  }
+  m_closures.push_back(std::move(bits));
+  state[n] = m_closures.size() - 1;
+  return state[n];
+}
+
+bool ClassHierarchy::is_subclass(const DexType* type,
+                                 const DexType* base) const {
+  if (type == base) {
+    return true;
+  }
+  auto t = id(type);
+  auto b = id(base);
+  if (t == kNone || b == kNone) {
+    return false;
+  }
+  return b <= t && t < m_end[b];
+}
+
+bool ClassHierarchy::is_subtype(const DexType* type,
+                                const DexType* base) const {
+  if (type == base) {
+    return true;
+  }
+  auto t = id(type);
+  auto b = id(base);
+  if (t == kNone || b == kNone) {
+    return false;
+  }
+  if (b <= t && t < m_end[b]) {
+    return true;
+  }
+  auto bit = m_intf_bit[b];
+  return bit != kNone && m_closures[m_closure[t]].test(bit);
+}
+
+ClassHierarchy::Range ClassHierarchy::subclasses(const DexType* type) const {
+  auto t = id(type);
+  if (t == kNone) {
+    return Range{nullptr, nullptr};
+  }
+  return Range{m_order.data() + t + 1, m_order.data() + m_end[t]};
+}
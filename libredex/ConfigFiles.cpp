@@ -22,7 +22,9 @@ ConfigFiles::ConfigFiles(const folly::dynamic& config) :
     m_coldstart_class_filename(
         config.getDefault("coldstart_classes", "").asString().toStdString()),
     m_coldstart_method_filename(
-        config.getDefault("coldstart_methods", "").asString().toStdString())
+        config.getDefault("coldstart_methods", "").asString().toStdString()),
+    m_build_cache_dir(
+        config.getDefault("build_cache_dir", "").asString().toStdString())
 {
   auto no_optimizations_anno = config.find("no_optimizations_annotations");
   if (no_optimizations_anno != config.items().end()) {
@@ -160,7 +160,7 @@ void MethodBlock::ifield_op(DexOpcode opcode,
   if (is_iget(opcode)) {
     auto iget = new DexOpcodeField(opcode, field);
     iget->set_dest(reg_num(src_or_dst));
-    src_or_dst.type = field->get_class();
+    src_or_dst.type = field->get_type();
     iget->set_src(0, reg_num(obj));
     push_instruction(iget);
   } else {
@@ -250,7 +250,7 @@ void MethodBlock::sfield_op(DexOpcode opcode,
   if (is_sget(opcode)) {
     auto sget = new DexOpcodeField(opcode, field);
     sget->set_dest(reg_num(src_or_dst));
-    src_or_dst.type = field->get_class();
+    src_or_dst.type = field->get_type();
     push_instruction(sget);
   } else {
     auto sput = new DexOpcodeField(opcode, field);
@@ -356,6 +356,20 @@ void MethodBlock::load_null(Location& loc) {
   push_instruction(load);
 }
 
+void MethodBlock::binop(DexOpcode op,
+                        Location src1,
+                        Location src2,
+                        Location& dst) {
+  always_assert(op >= OPCODE_ADD_INT && op <= OPCODE_USHR_INT);
+  always_assert(!src1.is_wide() && !src2.is_wide() && !dst.is_wide());
+  DexInstruction* insn = new DexInstruction(op);
+  insn->set_dest(reg_num(dst));
+  insn->set_src(0, reg_num(src1));
+  insn->set_src(1, reg_num(src2));
+  dst.type = get_int_type();
+  push_instruction(insn);
+}
+
 MethodBlock* MethodBlock::if_test(DexOpcode if_op,
                                   Location first,
                                   Location second) {
@@ -401,7 +415,7 @@ MethodBlock* MethodBlock::swtich_op(Location test,
 }
 
 void MethodCreator::load_locals(DexMethod* meth) {
-  if (!(meth->get_access() & ACC_STATIC)) {
+  if (!(access & ACC_STATIC)) {
     make_local(meth->get_class());
   }
   auto proto = meth->get_proto();
@@ -418,7 +432,7 @@ uint16_t MethodCreator::ins_count() const {
   auto args = proto->get_args();
   uint16_t ins =
       args == nullptr ? 0 : static_cast<uint16_t>(args->get_type_list().size());
-  if (!(method->get_access() & ACC_STATIC)) ins++;
+  if (!(access & ACC_STATIC)) ins++;
   return ins;
 }
 
@@ -487,7 +501,8 @@ MethodCreator::MethodCreator(DexMethod* meth)
     : method(meth),
       meth_code(MethodTransform::get_new_method(method)),
       out_count(0),
-      top_reg(0) {
+      top_reg(0),
+      access(meth->get_access()) {
   always_assert_log(meth->is_concrete(),
                     "Method must be concrete or use the other ctor");
   load_locals(meth);
@@ -501,7 +516,8 @@ MethodCreator::MethodCreator(DexType* cls,
     : method(DexMethod::make_method(cls, name, proto)),
       meth_code(MethodTransform::get_new_method(method)),
       out_count(0),
-      top_reg(0) {
+      top_reg(0),
+      access(access) {
   always_assert_log(!method->is_concrete(), "Method already defined");
   method->set_access(access);
   load_locals(method);
@@ -512,7 +528,6 @@ DexMethod* MethodCreator::create() {
   if (method->is_concrete()) {
     method->set_code(to_code());
   } else {
-    auto access = method->get_access();
     bool is_virtual = !(access & (ACC_STATIC | ACC_PRIVATE | ACC_CONSTRUCTOR));
     method->make_concrete(access, to_code(), is_virtual);
   }
@@ -526,7 +541,7 @@ DexCode* MethodCreator::to_code() {
   code->set_outs_size(out_count);
   code->set_debug_item(nullptr);
   method->set_code(code);
-  for (auto mi : *meth_code->m_fmethod) {
+  for (auto& mi : *meth_code->m_fmethod) {
     if (mi.type == MFLOW_OPCODE) {
       DexInstruction* insn = mi.insn;
       if (insn->dests_size()) {
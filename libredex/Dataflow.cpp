@@ -0,0 +1,20 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Dataflow.h"
+
+std::string show(const BitVector& bits) {
+  // Highest bit first, like boost::dynamic_bitset's to_string.
+  std::string ret;
+  ret.reserve(bits.size());
+  for (size_t i = bits.size(); i > 0; --i) {
+    ret.push_back(bits.test(i - 1) ? '1' : '0');
+  }
+  return ret;
+}
@@ -16,12 +16,15 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "Trace.h"
+
 void assert_fail(const char* expr,
                  const char* file,
                  unsigned line,
                  const char* func,
                  const char* fmt,
                  ...) {
+  flush_trace();
   va_list ap;
   va_start(ap, fmt);
   fprintf(
@@ -33,6 +36,8 @@ void assert_fail(const char* expr,
 }
 
 void crash_backtrace(int sig) {
+  flush_trace_on_crash();
+
   constexpr int max_bt_frames = 256;
   void* buf[max_bt_frames];
   auto frames = backtrace(buf, max_bt_frames);
@@ -442,6 +442,10 @@ DexAnnotation* DexAnnotation::get_annotation(DexIdx* idx, uint32_t anno_off) {
   return anno;
 }
 
+void DexAnnotation::add_element(const char* key, DexEncodedValue* value) {
+  m_anno_elems.emplace_back(DexString::make_string(key), value);
+}
+
 DexAnnotationSet* DexAnnotationSet::get_annotation_set(DexIdx* idx,
                                                        uint32_t aset_off) {
   if (aset_off == 0) return nullptr;
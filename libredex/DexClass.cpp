@@ -19,6 +19,7 @@
 #include "DexDebugInstruction.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
+#include "Resolver.h"
 #include "Warning.h"
 
 int DexTypeList::encode(DexOutputIdx* dodx, uint32_t* output) {
@@ -210,6 +211,7 @@ void DexMethod::become_virtual() {
   auto& vmethods = cls->get_vmethods();
   dmethods.remove(this);
   insert_sorted(vmethods, this, compare_dexmethods);
+  invalidate_resolve_cache();
 }
 
 void DexMethod::make_concrete(DexAccessFlags access,
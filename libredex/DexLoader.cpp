@@ -15,6 +15,7 @@
 #include "DexLoader.h"
 #include "dexdefs.h"
 #include "DexAccess.h"
+#include "SpanTrace.h"
 #include "Trace.h"
 #include "WorkQueue.h"
 
@@ -87,6 +88,7 @@ void DexLoader::load_dex_class(int num) {
 }
 
 DexClasses DexLoader::load_dex(const char* location) {
+  ScopedSpan span("DexLoader::load_dex");
   dex_header* dh;
   if (open_dex_file(location, m_dexmmap, m_dex_size) != DL_SUCCESS) {
     exit(1); // FIXME(snay)
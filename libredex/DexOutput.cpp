@@ -22,6 +22,7 @@
 #include "DexOutput.h"
 #include "DexUtil.h"
 #include "Sha1.h"
+#include "SpanTrace.h"
 #include "Trace.h"
 #include "Transform.h"
 #include "walkers.h"
@@ -396,6 +397,7 @@ DexOutput::locator_for_descriptor(
 }
 
 void DexOutput::generate_string_data() {
+  ScopedSpan span("DexOutput::generate_string_data");
   /*
    * This is a index to position within the string data.  There
    * is no specific ordering specified here for the dex spec.
@@ -443,6 +445,7 @@ void DexOutput::generate_string_data() {
 }
 
 void DexOutput::generate_type_data() {
+  ScopedSpan span("DexOutput::generate_type_data");
   dex_type_id* typeids = (dex_type_id*)(m_output + hdr.type_ids_off);
   for (auto& p : dodx->type_to_idx()) {
     auto t = p.first;
@@ -453,6 +456,7 @@ void DexOutput::generate_type_data() {
 }
 
 void DexOutput::generate_typelist_data() {
+  ScopedSpan span("DexOutput::generate_typelist_data");
   std::vector<DexTypeList*> typel;
   for (auto& it : dodx->proto_to_idx()) {
     auto proto = it.first;
@@ -482,6 +486,7 @@ void DexOutput::generate_typelist_data() {
 }
 
 void DexOutput::generate_proto_data() {
+  ScopedSpan span("DexOutput::generate_proto_data");
   auto protoids = (dex_proto_id*)(m_output + hdr.proto_ids_off);
 
   for (auto& it : dodx->proto_to_idx()) {
@@ -495,6 +500,7 @@ void DexOutput::generate_proto_data() {
 }
 
 void DexOutput::generate_field_data() {
+  ScopedSpan span("DexOutput::generate_field_data");
   auto fieldids = (dex_field_id*)(m_output + hdr.field_ids_off);
   for (auto& it : dodx->field_to_idx()) {
     auto field = it.first;
@@ -540,6 +546,7 @@ void write_method_mapping(
 }
 
 void DexOutput::generate_method_data() {
+  ScopedSpan span("DexOutput::generate_method_data");
   constexpr size_t kMaxMethodRefs = 64 * 1024;
   constexpr size_t kMaxFieldRefs = 64 * 1024;
   always_assert_log(
@@ -566,6 +573,7 @@ void DexOutput::generate_method_data() {
 }
 
 void DexOutput::generate_class_data() {
+  ScopedSpan span("DexOutput::generate_class_data");
   dex_class_def* cdefs = (dex_class_def*)(m_output + hdr.class_defs_off);
   for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
     m_stats.num_classes++;
@@ -595,6 +603,7 @@ void DexOutput::generate_class_data() {
 }
 
 void DexOutput::generate_class_data_items() {
+  ScopedSpan span("DexOutput::generate_class_data_items");
   /*
    * First generate a dexcode_to_offset needed for the encoding
    * of class_data_items
@@ -617,6 +626,7 @@ void DexOutput::generate_class_data_items() {
 }
 
 void DexOutput::generate_code_items() {
+  ScopedSpan span("DexOutput::generate_code_items");
   /*
    * Optimization note:  We should pass a sort routine to the
    * emitlist to optimize pagecache efficiency.
@@ -643,6 +653,7 @@ void DexOutput::generate_code_items() {
 }
 
 void DexOutput::generate_static_values() {
+  ScopedSpan span("DexOutput::generate_static_values");
   uint32_t sv_start = m_offset;
   for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
     DexClass* clz = m_classes->get(i);
@@ -787,6 +798,7 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
 }
 
 void DexOutput::generate_annotations() {
+  ScopedSpan span("DexOutput::generate_annotations");
   /*
    * There are five phases to generating annotations:
    * 1) Emit annotations
@@ -839,6 +851,7 @@ void DexOutput::generate_annotations() {
 }
 
 void DexOutput::generate_debug_items() {
+  ScopedSpan span("DexOutput::generate_debug_items");
   uint32_t dbg_start = m_offset;
   int dbgcount = 0;
   for (auto& it : m_code_item_emits) {
@@ -856,6 +869,7 @@ void DexOutput::generate_debug_items() {
 }
 
 void DexOutput::generate_map() {
+  ScopedSpan span("DexOutput::generate_map");
   align_output();
   uint32_t* mapout = (uint32_t*)(m_output + m_offset);
   hdr.map_off = m_offset;
@@ -908,10 +922,12 @@ static void fix_method_jumbos(DexMethod* method, const DexOutputIdx* dodx) {
 }
 
 static void fix_jumbos(DexClasses* classes, DexOutputIdx* dodx) {
+  ScopedSpan span("fix_jumbos");
   walk_methods(*classes, [&](DexMethod* m) { fix_method_jumbos(m, dodx); });
 }
 
 void DexOutput::init_header_offsets() {
+  ScopedSpan span("DexOutput::init_header_offsets");
   memcpy(hdr.magic, DEX_HEADER_DEXMAGIC, sizeof(hdr.magic));
   insert_map_item(TYPE_HEADER_ITEM, 1, 0);
 
@@ -957,6 +973,7 @@ void DexOutput::init_header_offsets() {
 }
 
 void DexOutput::finalize_header() {
+  ScopedSpan span("DexOutput::finalize_header");
   hdr.data_size = m_offset - hdr.data_off;
   hdr.file_size = m_offset;
   int skip;
@@ -975,6 +992,7 @@ void DexOutput::finalize_header() {
 }
 
 void DexOutput::prepare() {
+  ScopedSpan span("DexOutput::prepare");
   fix_jumbos(m_classes, dodx);
   init_header_offsets();
   generate_static_values();
@@ -995,6 +1013,7 @@ void DexOutput::prepare() {
 }
 
 void DexOutput::write() {
+  ScopedSpan span("DexOutput::write");
   int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
   if (fd == -1) {
     perror("Error writing dex");
@@ -14,14 +14,16 @@
 #include <regex.h>
 #include <unordered_set>
 
+#include "ClassHierarchy.h"
 #include "Debug.h"
+#include "Resolver.h"
 #include "DexClass.h"
 
 namespace {
 static std::mutex type_system_mutex;
 
-static std::unordered_map<const DexType*, DexClass*> type_to_class;
 static std::unordered_map<const DexType*, TypeVector> class_hierarchy;
+static std::vector<DexClass*> all_classes;
 TypeVector empty_types;
 
 }
@@ -121,16 +123,32 @@ DataType type_to_datatype(const DexType* t) {
 }
 
 void build_type_system(DexClass* cls) {
-  std::lock_guard<std::mutex> l(type_system_mutex);
-  const DexType* type = cls->get_type();
-  type_to_class.emplace(type, cls);
-  const auto& super = cls->get_super_class();
-  if (super) class_hierarchy[super].push_back(type);
+  {
+    std::lock_guard<std::mutex> l(type_system_mutex);
+    DexType* type = cls->get_type();
+    DexClass* none = nullptr;
+    type->m_class.compare_exchange_strong(none, cls, std::memory_order_release);
+    all_classes.push_back(cls);
+    const auto& super = cls->get_super_class();
+    if (super) class_hierarchy[super].push_back(type);
+  }
+  // Outside the lock: building a ClassHierarchy takes its lock, then ours.
+  ClassHierarchy::invalidate();
+  invalidate_resolve_cache();
 }
 
-DexClass* type_class(const DexType* t) {
-  auto it = type_to_class.find(t);
-  return it != type_to_class.end() ? it->second : nullptr;
+void clear_type_system() {
+  {
+    std::lock_guard<std::mutex> l(type_system_mutex);
+    all_classes.clear();
+    class_hierarchy.clear();
+  }
+  ClassHierarchy::invalidate();
+}
+
+std::vector<DexClass*> get_all_classes() {
+  std::lock_guard<std::mutex> l(type_system_mutex);
+  return all_classes;
 }
 
 char type_shorty(DexType* type) {
@@ -155,14 +173,7 @@ char type_shorty(DexType* type) {
 
 bool check_cast(DexType* type, DexType* base_type) {
   if (type == base_type) return true;
-  const auto cls = type_class(type);
-  if (cls == nullptr) return false;
-  if (check_cast(cls->get_super_class(), base_type)) return true;
-  auto intfs = cls->get_interfaces();
-  for (auto intf : intfs->get_type_list()) {
-    if (check_cast(intf, base_type)) return true;
-  }
-  return false;
+  return ClassHierarchy::get()->is_subtype(type, base_type);
 }
 
 bool has_hierarchy_in_scope(DexClass* cls) {
@@ -181,11 +192,9 @@ const TypeVector& get_children(const DexType* type) {
 }
 
 void get_all_children(const DexType* type, TypeVector& children) {
-  const auto& direct = get_children(type);
-  for (const auto& child : direct) {
-    children.push_back(child);
-    get_all_children(child, children);
-  }
+  auto ch = ClassHierarchy::get();
+  auto subclasses = ch->subclasses(type);
+  children.insert(children.end(), subclasses.begin(), subclasses.end());
 }
 
 bool is_init(const DexMethod* method) {
@@ -0,0 +1,273 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Dominators.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "Debug.h"
+
+constexpr size_t DominatorTree::kUndefined;
+
+DominatorTree::DominatorTree(const std::vector<Block*>& cfg, bool post)
+    : m_cfg(cfg), m_post(post) {
+  auto nblocks = cfg.size();
+  auto nnodes = post ? nblocks + 1 : nblocks;
+  m_root = post ? nblocks : 0;
+  m_rpo_number.assign(nnodes, kUndefined);
+  m_idom.assign(nnodes, kUndefined);
+  m_children.resize(nblocks);
+  m_frontier.resize(nblocks);
+  m_tree_in.assign(nnodes, kUndefined);
+  m_tree_out.assign(nnodes, kUndefined);
+  if (nblocks == 0) {
+    return;
+  }
+
+  // Edges of the graph being analyzed: the CFG, or the reversed CFG rooted
+  // at the virtual exit.
+  std::vector<Block*> exits;
+  if (post) {
+    for (auto b : cfg) {
+      if (b->succs().empty()) {
+        exits.push_back(b);
+      }
+    }
+  }
+  auto succs = [&](size_t n) -> const std::vector<Block*>& {
+    if (n == m_root && post) {
+      return exits;
+    }
+    return post ? cfg[n]->preds() : cfg[n]->succs();
+  };
+  auto preds = [&](size_t n) -> const std::vector<Block*>& {
+    return post ? cfg[n]->succs() : cfg[n]->preds();
+  };
+
+  // Number the nodes in postorder with an explicit stack, since methods can
+  // have thousands of blocks.
+  std::vector<size_t> postorder;
+  std::vector<bool> visited(nnodes);
+  std::vector<std::pair<size_t, size_t>> stack{{m_root, 0}};
+  visited[m_root] = true;
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    auto& next = succs(top.first);
+    if (top.second < next.size()) {
+      auto s = next[top.second++]->id();
+      if (!visited[s]) {
+        visited[s] = true;
+        stack.emplace_back(s, 0);
+      }
+    } else {
+      postorder.push_back(top.first);
+      stack.pop_back();
+    }
+  }
+  std::vector<size_t> rpo(postorder.rbegin(), postorder.rend());
+  for (size_t i = 0; i < rpo.size(); ++i) {
+    m_rpo_number[rpo[i]] = i;
+    if (rpo[i] != m_root || !post) {
+      m_rpo.push_back(cfg[rpo[i]]);
+    }
+  }
+
+  // Iterate to a fixed point.  Nodes are visited in reverse postorder, so
+  // reducible graphs settle in two passes.
+  m_idom[m_root] = m_root;
+  bool changed;
+  do {
+    changed = false;
+    for (size_t i = 1; i < rpo.size(); ++i) {
+      auto n = rpo[i];
+      auto new_idom = kUndefined;
+      auto consider = [&](size_t p) {
+        if (m_idom[p] == kUndefined) {
+          return;
+        }
+        new_idom = new_idom == kUndefined ? p : intersect(p, new_idom);
+      };
+      for (auto p : preds(n)) {
+        consider(p->id());
+      }
+      if (post && cfg[n]->succs().empty()) {
+        consider(m_root);
+      }
+      if (m_idom[n] != new_idom) {
+        m_idom[n] = new_idom;
+        changed = true;
+      }
+    }
+  } while (changed);
+
+  for (size_t i = 1; i < rpo.size(); ++i) {
+    auto n = rpo[i];
+    if (m_idom[n] != m_root || !post) {
+      m_children[m_idom[n]].push_back(cfg[n]);
+    }
+  }
+
+  // Number the dominator tree in preorder so that dominance queries are an
+  // interval check.
+  std::vector<std::vector<size_t>> tree(nnodes);
+  for (size_t i = 1; i < rpo.size(); ++i) {
+    tree[m_idom[rpo[i]]].push_back(rpo[i]);
+  }
+  size_t counter = 0;
+  stack.assign(1, {m_root, 0});
+  m_tree_in[m_root] = counter++;
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    auto& kids = tree[top.first];
+    if (top.second < kids.size()) {
+      auto k = kids[top.second++];
+      m_tree_in[k] = counter++;
+      stack.emplace_back(k, 0);
+    } else {
+      m_tree_out[top.first] = counter;
+      stack.pop_back();
+    }
+  }
+
+  // Dominance frontiers: walk up from the predecessors of each join point
+  // until reaching its immediate dominator.  The entry block has an implicit
+  // extra predecessor, so it's a join point as soon as anything branches back
+  // to it, and the walk only stops above the root.
+  for (auto n : rpo) {
+    if (n == m_root && post) {
+      continue;
+    }
+    auto& ps = preds(n);
+    if (ps.size() < (n == m_root ? 1 : 2)) {
+      continue;
+    }
+    auto stop = n == m_root ? kUndefined : m_idom[n];
+    for (auto p : ps) {
+      auto runner = p->id();
+      if (m_idom[runner] == kUndefined) {
+        continue;
+      }
+      while (runner != stop && !(post && runner == m_root)) {
+        auto& df = m_frontier[runner];
+        if (df.empty() || df.back() != cfg[n]) {
+          df.push_back(cfg[n]);
+        }
+        if (runner == m_root) {
+          break;
+        }
+        runner = m_idom[runner];
+      }
+    }
+  }
+}
+
+size_t DominatorTree::intersect(size_t a, size_t b) const {
+  while (a != b) {
+    while (m_rpo_number[a] > m_rpo_number[b]) {
+      a = m_idom[a];
+    }
+    while (m_rpo_number[b] > m_rpo_number[a]) {
+      b = m_idom[b];
+    }
+  }
+  return a;
+}
+
+Block* DominatorTree::idom(Block* b) const {
+  auto n = b->id();
+  auto d = m_idom[n];
+  if (d == kUndefined || d == n || (m_post && d == m_root)) {
+    return nullptr;
+  }
+  return m_cfg[d];
+}
+
+bool DominatorTree::dominates(Block* a, Block* b) const {
+  auto an = a->id();
+  auto bn = b->id();
+  if (m_tree_in[an] == kUndefined || m_tree_in[bn] == kUndefined) {
+    return false;
+  }
+  return m_tree_in[an] <= m_tree_in[bn] && m_tree_out[bn] <= m_tree_out[an];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+LoopInfo::LoopInfo(const std::vector<Block*>& cfg, const DominatorTree& doms)
+    : m_innermost(cfg.size(), nullptr) {
+  always_assert(!doms.is_post());
+  // Find the back edges, grouped by header.
+  std::vector<Loop*> by_header(cfg.size(), nullptr);
+  for (auto b : doms.reverse_postorder()) {
+    for (auto s : b->succs()) {
+      if (!doms.dominates(s, b)) {
+        continue;
+      }
+      auto& loop = by_header[s->id()];
+      if (loop == nullptr) {
+        loop = new Loop();
+        loop->header = s;
+        loop->m_members.resize(cfg.size());
+        m_loops.push_back(loop);
+      }
+      loop->latches.push_back(b);
+    }
+  }
+
+  // Collect each loop's body by walking backwards from its latches.
+  for (auto loop : m_loops) {
+    auto& body = loop->blocks;
+    loop->m_members[loop->header->id()] = true;
+    body.push_back(loop->header);
+    for (auto latch : loop->latches) {
+      if (!loop->m_members[latch->id()]) {
+        loop->m_members[latch->id()] = true;
+        body.push_back(latch);
+      }
+    }
+    for (size_t i = 1; i < body.size(); ++i) {
+      for (auto p : body[i]->preds()) {
+        if (doms.is_reachable(p) && !loop->m_members[p->id()]) {
+          loop->m_members[p->id()] = true;
+          body.push_back(p);
+        }
+      }
+    }
+    std::sort(body.begin(), body.end(), [](Block* a, Block* b) {
+      return a->id() < b->id();
+    });
+  }
+
+  // Nested loops are strictly smaller than the loops containing them, so
+  // visiting loops from largest to smallest finds each loop's parent as the
+  // current innermost loop of its header.
+  std::stable_sort(m_loops.begin(), m_loops.end(), [](Loop* a, Loop* b) {
+    return a->blocks.size() > b->blocks.size();
+  });
+  for (auto loop : m_loops) {
+    auto parent = m_innermost[loop->header->id()];
+    if (parent) {
+      loop->parent = parent;
+      loop->depth = parent->depth + 1;
+      parent->children.push_back(loop);
+    } else {
+      m_top_level.push_back(loop);
+    }
+    for (auto b : loop->blocks) {
+      m_innermost[b->id()] = loop;
+    }
+  }
+}
+
+LoopInfo::~LoopInfo() {
+  for (auto loop : m_loops) {
+    delete loop;
+  }
+}
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "MemoryAccounting.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <mutex>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "RedexContext.h"
+#include "Trace.h"
+
+namespace {
+
+/*
+ * One thread's counts.  Only the owning thread writes them, so updates are
+ * plain relaxed loads and stores; usage() may read them at any time.
+ * Objects freed on another thread than the one that allocated them leave
+ * a count negative on one thread and positive on the other.
+ */
+struct ThreadCounts {
+  std::atomic<int64_t> objects[MemoryAccounting::CATEGORIES];
+  std::atomic<int64_t> bytes[MemoryAccounting::CATEGORIES];
+
+  ThreadCounts() {
+    for (size_t i = 0; i < MemoryAccounting::CATEGORIES; ++i) {
+      objects[i].store(0, std::memory_order_relaxed);
+      bytes[i].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+void add(std::atomic<int64_t>& counter, int64_t delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
+
+std::mutex s_lock;
+
+/*
+ * Made on first use, as objects may be created during static
+ * initialization.  Never freed, like the worker threads that own most of
+ * the counts, so objects deleted during static destruction still have
+ * somewhere to be counted.
+ */
+std::vector<ThreadCounts*>& all_threads() {
+  static auto threads = new std::vector<ThreadCounts*>;
+  return *threads;
+}
+
+thread_local ThreadCounts* t_counts = nullptr;
+
+ThreadCounts* thread_counts() {
+  if (t_counts == nullptr) {
+    auto counts = new ThreadCounts;
+    std::lock_guard<std::mutex> g(s_lock);
+    all_threads().push_back(counts);
+    t_counts = counts;
+  }
+  return t_counts;
+}
+
+const char* const s_names[] = {
+  "strings",
+  "types",
+  "fields",
+  "methods",
+  "protos",
+  "classes",
+  "code",
+  "instructions",
+  "method_items",
+  "annotations",
+  "context_maps",
+};
+static_assert(sizeof(s_names) / sizeof(s_names[0]) ==
+                MemoryAccounting::CATEGORIES,
+              "Every category needs a name");
+
+}
+
+const char* MemoryAccounting::name(Category category) {
+  return s_names[category];
+}
+
+void MemoryAccounting::record(Category category,
+                              int64_t objects,
+                              int64_t bytes) {
+  auto counts = thread_counts();
+  add(counts->objects[category], objects);
+  add(counts->bytes[category], bytes);
+}
+
+MemoryAccounting::Usage MemoryAccounting::usage(Category category) {
+  if (category == CONTEXT_MAPS) {
+    return g_redex != nullptr ? g_redex->map_usage() : Usage();
+  }
+  Usage usage;
+  std::lock_guard<std::mutex> g(s_lock);
+  for (auto counts : all_threads()) {
+    usage.objects += counts->objects[category].load(std::memory_order_relaxed);
+    usage.bytes += counts->bytes[category].load(std::memory_order_relaxed);
+  }
+  return usage;
+}
+
+folly::dynamic MemoryAccounting::report() {
+  folly::dynamic report = folly::dynamic::object;
+  int64_t total = 0;
+  for (size_t i = 0; i < CATEGORIES; ++i) {
+    auto category = static_cast<Category>(i);
+    auto u = usage(category);
+    folly::dynamic entry = folly::dynamic::object;
+    entry["objects"] = u.objects;
+    entry["bytes"] = u.bytes;
+    report[name(category)] = std::move(entry);
+    total += u.bytes;
+  }
+  report["total_bytes"] = total;
+  return report;
+}
+
+void MemoryAccounting::trace_report(const char* when) {
+#ifndef NDEBUG
+  if (!traceEnabled(MEM, 1)) {
+    return;
+  }
+  TRACE(MEM, 1, "Live IR memory %s:\n", when);
+  int64_t total = 0;
+  for (size_t i = 0; i < CATEGORIES; ++i) {
+    auto category = static_cast<Category>(i);
+    auto u = usage(category);
+    TRACE(MEM, 1, "  %-14s %12" PRId64 " objects %10.1f MB\n",
+          name(category), u.objects, u.bytes / 1048576.0);
+    total += u.bytes;
+  }
+  TRACE(MEM, 1, "  %-14s %31.1f MB\n", "total", total / 1048576.0);
+#endif
+}
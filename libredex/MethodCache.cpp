@@ -0,0 +1,486 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "MethodCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BuildCache.h"
+#include "Debug.h"
+#include "DexIdx.h"
+#include "DexInstruction.h"
+#include "DexOutput.h"
+#include "ReferenceIndex.h"
+#include "Show.h"
+
+#define METHOD_CACHE_MAGIC "redexmtc"
+#define METHOD_CACHE_VERSION 2
+
+struct method_cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+};
+
+struct method_cache_entry {
+  uint8_t key[20];
+  uint32_t offset;
+  uint32_t size;
+};
+
+namespace {
+
+uint32_t align4(uint32_t n) {
+  return (n + 3) & ~3;
+}
+
+/* The refs a method's code makes, numbered in the order it makes them. */
+struct RefTables {
+  std::vector<DexString*> strings;
+  std::vector<DexType*> types;
+  std::vector<DexProto*> protos;
+  std::vector<DexField*> fields;
+  std::vector<DexMethod*> methods;
+  dexstring_to_idx string_ids;
+  dextype_to_idx type_ids;
+  dexproto_to_idx proto_ids;
+  dexfield_to_idx field_ids;
+  dexmethod_to_idx method_ids;
+
+  template <typename T, typename Map>
+  static bool intern(T* item, std::vector<T*>& items, Map& ids) {
+    if (ids.count(item)) {
+      return false;
+    }
+    ids.emplace(item, items.size());
+    items.push_back(item);
+    return true;
+  }
+
+  void add(DexString* s) {
+    intern(s, strings, string_ids);
+  }
+
+  void add(DexType* t) {
+    if (intern(t, types, type_ids)) {
+      add(t->get_name());
+    }
+  }
+
+  void add(DexProto* p) {
+    if (intern(p, protos, proto_ids)) {
+      add(p->get_shorty());
+      add(p->get_rtype());
+      for (auto arg : p->get_args()->get_type_list()) {
+        add(arg);
+      }
+    }
+  }
+
+  void add(DexField* f) {
+    if (intern(f, fields, field_ids)) {
+      add(f->get_class());
+      add(f->get_name());
+      add(f->get_type());
+    }
+  }
+
+  void add(DexMethod* m) {
+    if (intern(m, methods, method_ids)) {
+      add(m->get_class());
+      add(m->get_name());
+      add(m->get_proto());
+    }
+  }
+};
+
+/* Bytes enough for DexCode::encode(), which doesn't bounds-check. */
+size_t code_size_bound(DexCode* code) {
+  size_t size = sizeof(dex_code_item) + sizeof(uint16_t);
+  for (auto insn : code->get_instructions()) {
+    size += insn->size() * sizeof(uint16_t);
+  }
+  size += 5;
+  for (auto tri : code->get_tries()) {
+    size += sizeof(dex_tries_item) + 15 + 10 * tri->m_catches.size();
+  }
+  return size;
+}
+
+size_t debug_size_bound(DexDebugItem* dbg) {
+  return 11 + 5 * dbg->get_param_names().size() +
+    16 * dbg->get_instructions().size();
+}
+
+template <typename T>
+T* at(std::string& image, uint32_t offset) {
+  return reinterpret_cast<T*>(&image[offset]);
+}
+
+}
+
+std::string encode_method_code(DexCode* code) {
+  RefTables refs;
+  std::vector<DexString*> strings;
+  std::vector<DexType*> types;
+  std::vector<DexField*> fields;
+  std::vector<DexMethod*> methods;
+  code->gather_strings(strings);
+  code->gather_types(types);
+  code->gather_fields(fields);
+  code->gather_methods(methods);
+  for (auto s : strings) refs.add(s);
+  for (auto t : types) refs.add(t);
+  for (auto f : fields) refs.add(f);
+  for (auto m : methods) refs.add(m);
+
+  DexOutputIdx dodx(new dexstring_to_idx(refs.string_ids),
+                    new dextype_to_idx(refs.type_ids),
+                    new dexproto_to_idx(refs.proto_ids),
+                    new dexfield_to_idx(refs.field_ids),
+                    new dexmethod_to_idx(refs.method_ids),
+                    nullptr);
+  std::vector<uint32_t> code_item((code_size_bound(code) + 3) / 4);
+  uint32_t code_size = code->encode(&dodx, code_item.data());
+  std::vector<uint8_t> debug_item;
+  auto dbg = code->get_debug_item();
+  if (dbg) {
+    debug_item.resize(debug_size_bound(dbg));
+    debug_item.resize(dbg->encode(&dodx, debug_item.data()));
+  }
+
+  dex_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DEX_HEADER_DEXMAGIC, sizeof(header.magic));
+  header.header_size = sizeof(dex_header);
+  header.endian_tag = ENDIAN_CONSTANT;
+  uint32_t off = sizeof(dex_header);
+  header.string_ids_size = refs.strings.size();
+  header.string_ids_off = off;
+  off += refs.strings.size() * sizeof(dex_string_id);
+  header.type_ids_size = refs.types.size();
+  header.type_ids_off = off;
+  off += refs.types.size() * sizeof(dex_type_id);
+  header.proto_ids_size = refs.protos.size();
+  header.proto_ids_off = off;
+  off += refs.protos.size() * sizeof(dex_proto_id);
+  header.field_ids_size = refs.fields.size();
+  header.field_ids_off = off;
+  off += refs.fields.size() * sizeof(dex_field_id);
+  header.method_ids_size = refs.methods.size();
+  header.method_ids_off = off;
+  off += refs.methods.size() * sizeof(dex_method_id);
+  // The code item comes first in the data section.
+  header.data_off = align4(off);
+  uint32_t debug_off = header.data_off + code_size;
+  uint32_t strings_off = debug_off + debug_item.size();
+  uint32_t end = strings_off;
+  for (auto s : refs.strings) {
+    end += s->get_entry_size();
+  }
+  uint32_t type_lists_off = align4(end);
+  end = type_lists_off;
+  for (auto p : refs.protos) {
+    auto nargs = p->get_args()->get_type_list().size();
+    if (nargs) {
+      end += align4(sizeof(uint32_t) + nargs * sizeof(uint16_t));
+    }
+  }
+  header.data_size = end - header.data_off;
+  header.file_size = end;
+
+  std::string image(end, '\0');
+  memcpy(&image[0], &header, sizeof(header));
+  memcpy(&image[header.data_off], code_item.data(), code_size);
+  if (dbg) {
+    at<dex_code_item>(image, header.data_off)->debug_info_off = debug_off;
+    memcpy(&image[debug_off], debug_item.data(), debug_item.size());
+  }
+  off = strings_off;
+  for (size_t i = 0; i < refs.strings.size(); i++) {
+    at<dex_string_id>(image, header.string_ids_off)[i].offset = off;
+    refs.strings[i]->encode(at<uint8_t>(image, off));
+    off += refs.strings[i]->get_entry_size();
+  }
+  for (size_t i = 0; i < refs.types.size(); i++) {
+    at<dex_type_id>(image, header.type_ids_off)[i].string_idx =
+      refs.string_ids.at(refs.types[i]->get_name());
+  }
+  off = type_lists_off;
+  for (size_t i = 0; i < refs.protos.size(); i++) {
+    auto proto = refs.protos[i];
+    auto& id = at<dex_proto_id>(image, header.proto_ids_off)[i];
+    id.shortyidx = refs.string_ids.at(proto->get_shorty());
+    id.rtypeidx = refs.type_ids.at(proto->get_rtype());
+    auto& args = proto->get_args()->get_type_list();
+    id.param_off = 0;
+    if (args.empty()) {
+      continue;
+    }
+    id.param_off = off;
+    *at<uint32_t>(image, off) = args.size();
+    auto arg_ids = at<uint16_t>(image, off + sizeof(uint32_t));
+    for (auto arg : args) {
+      *arg_ids++ = refs.type_ids.at(arg);
+    }
+    off += align4(sizeof(uint32_t) + args.size() * sizeof(uint16_t));
+  }
+  for (size_t i = 0; i < refs.fields.size(); i++) {
+    auto field = refs.fields[i];
+    auto& id = at<dex_field_id>(image, header.field_ids_off)[i];
+    id.classidx = refs.type_ids.at(field->get_class());
+    id.typeidx = refs.type_ids.at(field->get_type());
+    id.nameidx = refs.string_ids.at(field->get_name());
+  }
+  for (size_t i = 0; i < refs.methods.size(); i++) {
+    auto method = refs.methods[i];
+    auto& id = at<dex_method_id>(image, header.method_ids_off)[i];
+    id.classidx = refs.type_ids.at(method->get_class());
+    id.protoidx = refs.proto_ids.at(method->get_proto());
+    id.nameidx = refs.string_ids.at(method->get_name());
+  }
+  return image;
+}
+
+DexCode* decode_method_code(const uint8_t* image) {
+  auto header = reinterpret_cast<dex_header*>(const_cast<uint8_t*>(image));
+  DexIdx idx(header);
+  return DexCode::get_dex_code(&idx, header->data_off);
+}
+
+namespace {
+
+/* The redex binary, hashed once; empty if it can't be read. */
+const std::string& exe_digest() {
+  static const std::string digest = [] {
+    ContentHash hash;
+    return hash.add_file("/proc/self/exe") ? hash.digest() : std::string();
+  }();
+  return digest;
+}
+
+/*
+ * An entry's counters: a uint32 count, four bytes of padding to keep the
+ * code 8-aligned, and the uint64 values.
+ */
+std::string encode_counters(const std::vector<uint64_t>& counters) {
+  std::string data(8 + counters.size() * sizeof(uint64_t), '\0');
+  uint32_t count = counters.size();
+  memcpy(&data[0], &count, sizeof(count));
+  if (count > 0) {
+    memcpy(&data[8], counters.data(), count * sizeof(uint64_t));
+  }
+  return data;
+}
+
+bool key_less(const method_cache_entry& entry, const std::string& key) {
+  return memcmp(entry.key, key.data(), sizeof(entry.key)) < 0;
+}
+
+}
+
+MethodCache::MethodCache(const std::string& dir,
+                         const std::string& pass_name,
+                         const folly::dynamic& pass_config)
+  : m_mapping(nullptr), m_size(0) {
+  if (dir.empty()) {
+    return;
+  }
+  if (exe_digest().empty()) {
+    fprintf(stderr, "WARNING: cannot read the redex binary, not caching %s\n",
+            pass_name.c_str());
+    return;
+  }
+  ContentHash salt;
+  salt.add(METHOD_CACHE_MAGIC);
+  salt.add(METHOD_CACHE_VERSION);
+  salt.add(exe_digest());
+  salt.add(pass_name);
+  salt.add_json(pass_config);
+  m_salt = salt.digest();
+  mkdir(dir.c_str(), 0755);
+  m_path = dir + "/" + pass_name + ".methods";
+
+  int fd = open(m_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat buf;
+  if (fstat(fd, &buf) == 0 && buf.st_size >= (off_t)sizeof(method_cache_header)) {
+    auto mapping = mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      m_mapping = static_cast<const uint8_t*>(mapping);
+      m_size = buf.st_size;
+    }
+  }
+  close(fd);
+  if (m_mapping == nullptr) {
+    return;
+  }
+  auto header = reinterpret_cast<const method_cache_header*>(m_mapping);
+  if (memcmp(header->magic, METHOD_CACHE_MAGIC, sizeof(header->magic)) ||
+      header->version != METHOD_CACHE_VERSION ||
+      sizeof(method_cache_header) +
+          header->count * sizeof(method_cache_entry) > m_size) {
+    fprintf(stderr, "WARNING: ignoring bad method cache %s\n", m_path.c_str());
+    munmap(const_cast<uint8_t*>(m_mapping), m_size);
+    m_mapping = nullptr;
+    m_size = 0;
+  }
+}
+
+MethodCache::~MethodCache() {
+  if (m_mapping) {
+    munmap(const_cast<uint8_t*>(m_mapping), m_size);
+  }
+}
+
+std::string MethodCache::key(DexMethod* method, const std::string& deps) const {
+  ContentHash hash;
+  hash.add(m_salt);
+  hash.add(show(method->get_class()));
+  hash.add(show(method->get_name()));
+  hash.add(show(method->get_proto()));
+  hash.add(uint32_t(method->get_access()));
+  hash.add(encode_method_code(method->get_code()));
+  hash.add(deps);
+  return hash.digest();
+}
+
+const method_cache_entry* MethodCache::find(const std::string& key) const {
+  if (m_mapping == nullptr) {
+    return nullptr;
+  }
+  auto header = reinterpret_cast<const method_cache_header*>(m_mapping);
+  auto begin = reinterpret_cast<const method_cache_entry*>(header + 1);
+  auto end = begin + header->count;
+  auto it = std::lower_bound(begin, end, key, key_less);
+  if (it == end || memcmp(it->key, key.data(), sizeof(it->key)) ||
+      it->offset + it->size > m_size) {
+    return nullptr;
+  }
+  return it;
+}
+
+bool MethodCache::restore(DexMethod* method,
+                          const std::string& key,
+                          std::vector<uint64_t>* counters) {
+  if (!enabled()) {
+    return false;
+  }
+  auto entry = find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  auto data = m_mapping + entry->offset;
+  uint32_t count = 0;
+  if (entry->size >= sizeof(count)) {
+    memcpy(&count, data, sizeof(count));
+  }
+  size_t code_offset = 8 + size_t(count) * sizeof(uint64_t);
+  if (entry->size < code_offset) {
+    return false;
+  }
+  if (counters != nullptr) {
+    counters->resize(count);
+    if (count > 0) {
+      memcpy(counters->data(), data + 8, count * sizeof(uint64_t));
+    }
+  }
+  delete method->get_code();
+  method->set_code(decode_method_code(data + code_offset));
+  // Every instruction was just replaced, so the index would otherwise point
+  // at deleted ones.
+  if (auto index = ReferenceIndex::current()) {
+    index->update_method(method);
+  }
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_hits.emplace(key, entry);
+  return true;
+}
+
+void MethodCache::save(DexMethod* method,
+                       const std::string& key,
+                       const std::vector<uint64_t>& counters) {
+  if (!enabled()) {
+    return;
+  }
+  auto data =
+    encode_counters(counters) + encode_method_code(method->get_code());
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_misses[key] = std::move(data);
+}
+
+void MethodCache::write() {
+  if (!enabled()) {
+    return;
+  }
+  struct Entry {
+    const std::string* key;
+    const uint8_t* data;
+    uint32_t size;
+  };
+  std::vector<Entry> entries;
+  for (auto& hit : m_hits) {
+    if (!m_misses.count(hit.first)) {
+      entries.push_back(Entry{&hit.first, m_mapping + hit.second->offset,
+                              hit.second->size});
+    }
+  }
+  for (auto& miss : m_misses) {
+    entries.push_back(Entry{&miss.first,
+                            reinterpret_cast<const uint8_t*>(miss.second.data()),
+                            uint32_t(miss.second.size())});
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return *a.key < *b.key; });
+
+  method_cache_header header;
+  memcpy(header.magic, METHOD_CACHE_MAGIC, sizeof(header.magic));
+  header.version = METHOD_CACHE_VERSION;
+  header.count = entries.size();
+  std::vector<method_cache_entry> index(entries.size());
+  // Entries start 8-aligned so their words can be read in place.
+  uint32_t off = (sizeof(header) + index.size() * sizeof(method_cache_entry) +
+                  7) & ~7;
+  for (size_t i = 0; i < entries.size(); i++) {
+    memcpy(index[i].key, entries[i].key->data(), sizeof(index[i].key));
+    index[i].offset = off;
+    index[i].size = entries[i].size;
+    off = (off + entries[i].size + 7) & ~7;
+  }
+
+  auto tmp = m_path + ".tmp." + std::to_string(getpid());
+  FILE* fd = fopen(tmp.c_str(), "wb");
+  if (fd == nullptr) {
+    fprintf(stderr, "WARNING: cannot write method cache %s\n", tmp.c_str());
+    return;
+  }
+  static const char padding[8] = {};
+  bool ok = fwrite(&header, sizeof(header), 1, fd) == 1 &&
+    fwrite(index.data(), sizeof(method_cache_entry), index.size(), fd) ==
+        index.size();
+  uint32_t pos = sizeof(header) + index.size() * sizeof(method_cache_entry);
+  for (size_t i = 0; ok && i < entries.size(); i++) {
+    ok = fwrite(padding, 1, index[i].offset - pos, fd) == index[i].offset - pos &&
+      fwrite(entries[i].data, 1, entries[i].size, fd) == entries[i].size;
+    pos = index[i].offset + entries[i].size;
+  }
+  ok = fclose(fd) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), m_path.c_str()) != 0) {
+    fprintf(stderr, "WARNING: cannot write method cache %s\n", m_path.c_str());
+    unlink(tmp.c_str());
+  }
+}
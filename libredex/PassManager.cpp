@@ -11,22 +11,127 @@
 
 #include <cstdio>
 #include <chrono>
+#include <list>
+#include <memory>
+#include <sys/resource.h>
+#include <unistd.h>
 
+#include "AnalysisManager.h"
+#include "Checkpoint.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
+#include "MemoryAccounting.h"
 #include "ConfigFiles.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
+#include "SpanTrace.h"
+#include "Trace.h"
 #include "Transform.h"
 
+namespace {
+
+double cpu_secs() {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+  auto secs = [](const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+  return secs(ru.ru_utime) + secs(ru.ru_stime);
+}
+
+/* Resident set size in KB, or 0 where /proc isn't available. */
+int64_t rss_kb() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  long size = 0;
+  long resident = 0;
+  if (fscanf(statm, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(statm);
+  return int64_t(resident) * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * Start peak_rss_kb() counting again.  Linux-only; elsewhere the peak is
+ * over the life of the process.
+ */
+void reset_peak_rss() {
+  FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (clear_refs != nullptr) {
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+  }
+}
+
+/* Peak resident set size in KB since the last reset_peak_rss(). */
+int64_t peak_rss_kb() {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+  int64_t peak = ru.ru_maxrss;
+#ifdef __APPLE__
+  peak /= 1024;
+#endif
+  // After a reset, ru_maxrss still reports the lifetime peak, but VmHWM
+  // starts over.
+  FILE* status = fopen("/proc/self/status", "r");
+  if (status != nullptr) {
+    char line[128];
+    long hwm;
+    while (fgets(line, sizeof(line), status) != nullptr) {
+      if (sscanf(line, "VmHWM: %ld kB", &hwm) == 1) {
+        peak = hwm;
+        break;
+      }
+    }
+    fclose(status);
+  }
+  return peak;
+}
+
+folly::dynamic count_ir(const DexClassesVector& dexen) {
+  int64_t classes = 0;
+  int64_t methods = 0;
+  int64_t insns = 0;
+  for (auto& dex : dexen) {
+    for (auto cls : dex) {
+      classes++;
+      auto count = [&](const std::list<DexMethod*>& ms) {
+        for (auto m : ms) {
+          methods++;
+          if (m->get_code()) {
+            insns += m->get_code()->get_instructions().size();
+          }
+        }
+      };
+      count(cls->get_dmethods());
+      count(cls->get_vmethods());
+    }
+  }
+  folly::dynamic counts = folly::dynamic::object;
+  counts["classes"] = classes;
+  counts["methods"] = methods;
+  counts["instructions"] = insns;
+  return counts;
+}
+
+}
+
 PassManager::PassManager(
     const std::vector<Pass*>& passes,
     const std::vector<KeepRule>& rules,
     const folly::dynamic& config)
   : m_config(config),
+    m_perf_report(folly::dynamic::object),
     m_registered_passes(passes),
+    m_first_pass(0),
     m_proguard_rules(rules) {
   try {
     auto passes = config["redex"]["passes"];
@@ -40,26 +145,107 @@ PassManager::PassManager(
 }
 
 void PassManager::run_passes(DexClassesVector& dexen, ConfigFiles& cfg) {
-  init_reachable_classes(build_class_scope(dexen), m_config,
-      m_proguard_rules, cfg.get_no_optimizations_annos());
+  ScopedSpan run_span("PassManager::run_passes");
+  if (m_first_pass == 0) {
+    init_reachable_classes(build_class_scope(dexen), m_config,
+        m_proguard_rules, cfg.get_no_optimizations_annos());
+  }
+  auto checkpoint_after =
+    m_config.getDefault("checkpoint_after", "").asString().toStdString();
+  auto checkpoint_dir =
+    m_config.getDefault("checkpoint_dir", "redex-checkpoint")
+      .asString().toStdString();
   Scope scope = build_class_scope(dexen);
   // reportReachableClasses(scope, "reachable");
-  for (auto pass : m_activated_passes) {
+  std::unique_ptr<AnalysisManager> analyses(new AnalysisManager(dexen));
+  folly::dynamic pass_reports = folly::dynamic::array;
+  double total_wall = 0;
+  double total_cpu = 0;
+  for (size_t i = m_first_pass; i < m_activated_passes.size(); ++i) {
+    auto pass = m_activated_passes[i];
     using namespace std::chrono;
     TRACE(PM, 1, "Running %s...\n", pass->name().c_str());
+    reset_peak_rss();
+    auto rss_before = rss_kb();
+    auto balloons_before = MethodTransform::balloon_count();
+    auto syncs_before = MethodTransform::sync_count();
+    // Counted up front so that walking every method isn't billed to the pass.
+    auto ir_before = count_ir(dexen);
+    auto cpu_start = cpu_secs();
     auto start = high_resolution_clock::now();
+    ScopedSpan pass_span(pass->name());
     if (pass->assumes_sync()) {
       MethodTransform::sync_all();
     }
+    // Passes that move members are expected to invalidate it themselves, but
+    // don't let one that forgets leak stale resolutions into the next.
+    invalidate_resolve_cache();
+    auto name = run_name(i);
+    pass->m_analyses = analyses.get();
+    pass->m_run_name = name;
     pass->run_pass(dexen, cfg);
+    pass->m_analyses = nullptr;
+    analyses->invalidate(pass->preserved_analyses());
     auto end = high_resolution_clock::now();
+    auto wall = duration<double>(end - start).count();
+    auto cpu = cpu_secs() - cpu_start;
     TRACE(PM, 1, "Pass %s completed in %.1lf seconds\n",
-          pass->name().c_str(), duration<double>(end - start).count());
+          pass->name().c_str(), wall);
+    flush_trace();
+
+    folly::dynamic report = folly::dynamic::object;
+    report["name"] = pass->name();
+    report["wall_secs"] = wall;
+    report["cpu_secs"] = cpu;
+    report["peak_rss_kb"] = peak_rss_kb();
+    report["rss_delta_kb"] = rss_kb() - rss_before;
+    report["methods_ballooned"] =
+      int64_t(MethodTransform::balloon_count() - balloons_before);
+    report["methods_synced"] =
+      int64_t(MethodTransform::sync_count() - syncs_before);
+    report["before"] = std::move(ir_before);
+    report["after"] = count_ir(dexen);
+    report["memory"] = MemoryAccounting::report();
+    MemoryAccounting::trace_report(("after " + pass->name()).c_str());
+    pass_reports.push_back(std::move(report));
+    total_wall += wall;
+    total_cpu += cpu;
+
+    if (name == checkpoint_after) {
+      MethodTransform::sync_all();
+      write_checkpoint(checkpoint_dir, i, name, dexen, cfg);
+    }
   }
+  m_perf_report = folly::dynamic::object;
+  m_perf_report["passes"] = std::move(pass_reports);
+  m_perf_report["wall_secs"] = total_wall;
+  m_perf_report["cpu_secs"] = total_cpu;
+  analyses.reset();
 
   MethodTransform::sync_all();
 }
 
+void PassManager::resume_after(size_t pass_index,
+                               const std::string& pass_name) {
+  always_assert_log(pass_index < m_activated_passes.size() &&
+                        run_name(pass_index) == pass_name,
+                    "The checkpoint was taken after %s, which isn't pass %lu "
+                    "of this config\n",
+                    pass_name.c_str(), pass_index);
+  m_first_pass = pass_index + 1;
+}
+
+std::string PassManager::run_name(size_t index) const {
+  auto name = m_activated_passes[index]->name();
+  size_t runs = 1;
+  for (size_t i = 0; i < index; ++i) {
+    if (m_activated_passes[i]->name() == name) {
+      runs++;
+    }
+  }
+  return runs > 1 ? name + "#" + std::to_string(runs) : name;
+}
+
 void PassManager::activate_pass(const char* name, const folly::dynamic& cfg) {
   for (auto pass : m_registered_passes) {
     if (name == pass->name()) {
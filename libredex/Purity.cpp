@@ -0,0 +1,469 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Purity.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "DexAccess.h"
+#include "DexInstruction.h"
+#include "DexUtil.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "walkers.h"
+
+namespace {
+
+struct ModeledMethod {
+  const char* cls;
+  const char* name;
+  const char* rtype;
+  std::vector<const char*> args;
+  Purity purity;
+};
+
+const Purity PURE = Purity::PURE;
+const Purity SEF = Purity::SIDE_EFFECT_FREE;
+
+/*
+ * Framework methods we know the behavior of.  Only methods of final classes,
+ * or that nothing in the framework overrides; app overrides are caught by
+ * find_overrides().
+ */
+const ModeledMethod kModel[] = {
+  {"Ljava/lang/Object;", "<init>", "V", {}, PURE},
+  {"Ljava/lang/Object;", "getClass", "Ljava/lang/Class;", {}, PURE},
+  {"Ljava/lang/Class;", "getName", "Ljava/lang/String;", {}, SEF},
+  {"Ljava/lang/Class;", "getSimpleName", "Ljava/lang/String;", {}, SEF},
+
+  {"Ljava/lang/String;", "length", "I", {}, PURE},
+  {"Ljava/lang/String;", "isEmpty", "Z", {}, PURE},
+  {"Ljava/lang/String;", "charAt", "C", {"I"}, PURE},
+  {"Ljava/lang/String;", "equals", "Z", {"Ljava/lang/Object;"}, PURE},
+  {"Ljava/lang/String;", "hashCode", "I", {}, PURE},
+  {"Ljava/lang/String;", "compareTo", "I", {"Ljava/lang/String;"}, PURE},
+  {"Ljava/lang/String;", "indexOf", "I", {"I"}, PURE},
+  {"Ljava/lang/String;", "indexOf", "I", {"Ljava/lang/String;"}, PURE},
+  {"Ljava/lang/String;", "startsWith", "Z", {"Ljava/lang/String;"}, PURE},
+  {"Ljava/lang/String;", "endsWith", "Z", {"Ljava/lang/String;"}, PURE},
+  {"Ljava/lang/String;", "toString", "Ljava/lang/String;", {}, PURE},
+  {"Ljava/lang/String;", "substring", "Ljava/lang/String;", {"I"}, SEF},
+  {"Ljava/lang/String;", "substring", "Ljava/lang/String;", {"I", "I"}, SEF},
+  {"Ljava/lang/String;", "concat", "Ljava/lang/String;",
+   {"Ljava/lang/String;"}, SEF},
+  {"Ljava/lang/String;", "trim", "Ljava/lang/String;", {}, SEF},
+  {"Ljava/lang/String;", "valueOf", "Ljava/lang/String;", {"I"}, SEF},
+  {"Ljava/lang/String;", "valueOf", "Ljava/lang/String;", {"J"}, SEF},
+  {"Ljava/lang/String;", "valueOf", "Ljava/lang/String;", {"Z"}, SEF},
+  {"Ljava/lang/String;", "valueOf", "Ljava/lang/String;", {"C"}, SEF},
+
+  {"Ljava/lang/Boolean;", "valueOf", "Ljava/lang/Boolean;", {"Z"}, SEF},
+  {"Ljava/lang/Boolean;", "booleanValue", "Z", {}, PURE},
+  {"Ljava/lang/Byte;", "valueOf", "Ljava/lang/Byte;", {"B"}, SEF},
+  {"Ljava/lang/Byte;", "byteValue", "B", {}, PURE},
+  {"Ljava/lang/Character;", "valueOf", "Ljava/lang/Character;", {"C"}, SEF},
+  {"Ljava/lang/Character;", "charValue", "C", {}, PURE},
+  {"Ljava/lang/Short;", "valueOf", "Ljava/lang/Short;", {"S"}, SEF},
+  {"Ljava/lang/Short;", "shortValue", "S", {}, PURE},
+  {"Ljava/lang/Integer;", "valueOf", "Ljava/lang/Integer;", {"I"}, SEF},
+  {"Ljava/lang/Integer;", "intValue", "I", {}, PURE},
+  {"Ljava/lang/Integer;", "toString", "Ljava/lang/String;", {"I"}, SEF},
+  {"Ljava/lang/Long;", "valueOf", "Ljava/lang/Long;", {"J"}, SEF},
+  {"Ljava/lang/Long;", "longValue", "J", {}, PURE},
+  {"Ljava/lang/Float;", "valueOf", "Ljava/lang/Float;", {"F"}, SEF},
+  {"Ljava/lang/Float;", "floatValue", "F", {}, PURE},
+  {"Ljava/lang/Double;", "valueOf", "Ljava/lang/Double;", {"D"}, SEF},
+  {"Ljava/lang/Double;", "doubleValue", "D", {}, PURE},
+
+  {"Ljava/lang/Math;", "abs", "I", {"I"}, PURE},
+  {"Ljava/lang/Math;", "abs", "J", {"J"}, PURE},
+  {"Ljava/lang/Math;", "abs", "F", {"F"}, PURE},
+  {"Ljava/lang/Math;", "abs", "D", {"D"}, PURE},
+  {"Ljava/lang/Math;", "min", "I", {"I", "I"}, PURE},
+  {"Ljava/lang/Math;", "max", "I", {"I", "I"}, PURE},
+  {"Ljava/lang/Math;", "min", "J", {"J", "J"}, PURE},
+  {"Ljava/lang/Math;", "max", "J", {"J", "J"}, PURE},
+
+  {"Ljava/util/ArrayList;", "size", "I", {}, SEF},
+  {"Ljava/util/ArrayList;", "isEmpty", "Z", {}, SEF},
+  {"Ljava/util/ArrayList;", "get", "Ljava/lang/Object;", {"I"}, SEF},
+  {"Ljava/util/HashMap;", "size", "I", {}, SEF},
+  {"Ljava/util/HashMap;", "isEmpty", "Z", {}, SEF},
+  {"Ljava/util/HashSet;", "size", "I", {}, SEF},
+  {"Ljava/util/HashSet;", "isEmpty", "Z", {}, SEF},
+  {"Ljava/util/Collections;", "emptyList", "Ljava/util/List;", {}, SEF},
+  {"Ljava/util/Collections;", "emptyMap", "Ljava/util/Map;", {}, SEF},
+  {"Ljava/util/Collections;", "emptySet", "Ljava/util/Set;", {}, SEF},
+};
+
+bool is_virtual_invoke(DexOpcode op) {
+  return op == OPCODE_INVOKE_VIRTUAL || op == OPCODE_INVOKE_VIRTUAL_RANGE;
+}
+
+bool is_static_invoke(DexOpcode op) {
+  return op == OPCODE_INVOKE_STATIC || op == OPCODE_INVOKE_STATIC_RANGE;
+}
+
+/* Whether any target of the switch at `addr` lies at or before it. */
+bool switch_goes_back(
+    DexInstruction* insn,
+    uint32_t addr,
+    const std::unordered_map<uint32_t, DexInstruction*>& insn_at) {
+  auto it = insn_at.find(addr + insn->offset());
+  if (it == insn_at.end()) {
+    return true;
+  }
+  auto payload = static_cast<DexOpcodeData*>(it->second);
+  const uint16_t* data = payload->data();
+  uint16_t entries = *data++;
+  auto targets = (const int32_t*)data;
+  if (payload->opcode() == FOPCODE_PACKED_SWITCH) {
+    // Skip the first key.
+    targets += 1;
+  } else if (payload->opcode() == FOPCODE_SPARSE_SWITCH) {
+    targets += entries;
+  } else {
+    return true;
+  }
+  for (size_t i = 0; i < entries; i++) {
+    if (targets[i] <= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+PurityAnalysis::PurityAnalysis(const Scope& scope) {
+  add_model();
+  find_overrides(scope);
+  find_initializers(scope);
+
+  std::vector<DexMethod*> methods;
+  std::unordered_map<DexMethod*, size_t> index;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      index[m] = methods.size();
+      methods.push_back(m);
+    }
+  });
+  std::vector<std::vector<size_t>> callees(methods.size());
+  std::vector<bool> self_call(methods.size());
+  for (size_t i = 0; i < methods.size(); i++) {
+    for (auto insn : methods[i]->get_code()->get_instructions()) {
+      if (!is_invoke(insn->opcode())) {
+        continue;
+      }
+      auto callee = resolve_callee(insn);
+      auto it = index.find(callee);
+      if (it == index.end()) {
+        continue;
+      }
+      if (it->second == i) {
+        self_call[i] = true;
+      } else {
+        callees[i].push_back(it->second);
+      }
+    }
+  }
+
+  // Tarjan's algorithm, without recursion since call chains can be long.
+  // Components come out callees first, so everything a method calls outside
+  // its own component has been summarized by the time it is.
+  const size_t kUnvisited = std::numeric_limits<size_t>::max();
+  std::vector<size_t> order(methods.size(), kUnvisited);
+  std::vector<size_t> low(methods.size());
+  std::vector<bool> on_stack(methods.size());
+  std::vector<size_t> stack;
+  std::vector<std::pair<size_t, size_t>> calls;
+  size_t next_order = 0;
+  auto visit = [&](size_t v) {
+    order[v] = low[v] = next_order++;
+    stack.push_back(v);
+    on_stack[v] = true;
+    calls.emplace_back(v, 0);
+  };
+  for (size_t root = 0; root < methods.size(); root++) {
+    if (order[root] != kUnvisited) {
+      continue;
+    }
+    visit(root);
+    while (!calls.empty()) {
+      auto v = calls.back().first;
+      auto& edge = calls.back().second;
+      if (edge < callees[v].size()) {
+        auto w = callees[v][edge++];
+        if (order[w] == kUnvisited) {
+          visit(w);
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], order[w]);
+        }
+        continue;
+      }
+      calls.pop_back();
+      if (!calls.empty()) {
+        auto parent = calls.back().first;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+      if (low[v] != order[v]) {
+        continue;
+      }
+      auto top = stack.back();
+      if (top == v && !self_call[v]) {
+        stack.pop_back();
+        on_stack[v] = false;
+        auto m = methods[v];
+        auto p = local_purity(m);
+        for (auto insn : m->get_code()->get_instructions()) {
+          if (p == Purity::IMPURE) {
+            break;
+          }
+          if (is_invoke(insn->opcode())) {
+            p = std::min(p, invoke_purity(m, insn));
+          }
+        }
+        m_summaries[m] = p;
+        ++m_counts[static_cast<int>(p)];
+        continue;
+      }
+      // Recursion might not terminate.
+      size_t w;
+      do {
+        w = stack.back();
+        stack.pop_back();
+        on_stack[w] = false;
+        m_summaries[methods[w]] = Purity::IMPURE;
+        ++m_counts[static_cast<int>(Purity::IMPURE)];
+      } while (w != v);
+    }
+  }
+  TRACE(PURITY, 1, "%lu pure, %lu side-effect-free, %lu impure methods\n",
+        count(Purity::PURE), count(Purity::SIDE_EFFECT_FREE),
+        count(Purity::IMPURE));
+}
+
+Purity PurityAnalysis::purity(DexMethod* method) const {
+  auto it = m_summaries.find(method);
+  return it == m_summaries.end() ? Purity::IMPURE : it->second;
+}
+
+Purity PurityAnalysis::invoke_purity(const DexMethod* caller,
+                                     DexInstruction* insn) const {
+  auto callee = resolve_callee(insn);
+  if (callee == nullptr) {
+    return Purity::IMPURE;
+  }
+  if (is_static_invoke(insn->opcode()) &&
+      needs_init(caller, callee->get_class())) {
+    return Purity::IMPURE;
+  }
+  return purity(callee);
+}
+
+void PurityAnalysis::add_model() {
+  for (auto& mm : kModel) {
+    auto m = DexMethod::make_method(mm.cls, mm.name, mm.rtype, mm.args);
+    m_summaries[m] = mm.purity;
+  }
+}
+
+/*
+ * An app method overrides every method with its name and prototype in the
+ * classes above it, whether or not those classes are part of the scope.
+ */
+void PurityAnalysis::find_overrides(const Scope& scope) {
+  for (auto cls : scope) {
+    for (auto m : cls->get_vmethods()) {
+      auto super = cls->get_super_class();
+      while (super != nullptr) {
+        auto overridden =
+          DexMethod::get_method(super, m->get_name(), m->get_proto());
+        if (overridden != nullptr) {
+          m_overridden.insert(overridden);
+        }
+        auto super_cls = type_class(super);
+        super = super_cls ? super_cls->get_super_class() : nullptr;
+      }
+    }
+  }
+}
+
+void PurityAnalysis::find_initializers(const Scope& scope) {
+  for (auto cls : scope) {
+    for (auto c = cls; c != nullptr; c = type_class(c->get_super_class())) {
+      if (c->is_external()) {
+        break;
+      }
+      auto& dmethods = c->get_dmethods();
+      if (std::any_of(dmethods.begin(), dmethods.end(), is_clinit)) {
+        m_initializers.insert(cls->get_type());
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Static initializers run the first time a class is used, which is never
+ * inside the class itself or its subclasses: they're initialized already.
+ */
+bool PurityAnalysis::needs_init(const DexMethod* caller, DexType* type) const {
+  if (m_initializers.count(type) == 0) {
+    return false;
+  }
+  if (caller == nullptr) {
+    return true;
+  }
+  auto t = caller->get_class();
+  while (t != nullptr) {
+    if (t == type) {
+      return false;
+    }
+    auto cls = type_class(t);
+    t = cls ? cls->get_super_class() : nullptr;
+  }
+  return true;
+}
+
+/*
+ * The definition an invoke runs, or the modeled method it names if that
+ * can't be found; nullptr if the call could dispatch to more than one place.
+ */
+DexMethod* PurityAnalysis::resolve_callee(DexInstruction* insn) const {
+  auto ref = static_cast<DexOpcodeMethod*>(insn)->get_method();
+  DexMethod* callee;
+  switch (insn->opcode()) {
+  case OPCODE_INVOKE_STATIC:
+  case OPCODE_INVOKE_STATIC_RANGE:
+    callee = resolve_method(ref, MethodSearch::Static);
+    break;
+  case OPCODE_INVOKE_DIRECT:
+  case OPCODE_INVOKE_DIRECT_RANGE:
+    callee = resolve_method(ref, MethodSearch::Direct);
+    break;
+  case OPCODE_INVOKE_VIRTUAL:
+  case OPCODE_INVOKE_VIRTUAL_RANGE:
+  case OPCODE_INVOKE_SUPER:
+  case OPCODE_INVOKE_SUPER_RANGE:
+    callee = resolve_method(ref, MethodSearch::Virtual);
+    break;
+  default:
+    return nullptr;
+  }
+  if (callee == nullptr) {
+    callee = ref;
+  }
+  if (is_virtual_invoke(insn->opcode()) && m_overridden.count(callee)) {
+    return nullptr;
+  }
+  return callee;
+}
+
+/* Everything but invokes, which need their callees' summaries. */
+Purity PurityAnalysis::instruction_purity(const DexMethod* caller,
+                                          DexInstruction* insn) const {
+  auto op = insn->opcode();
+  if ((op >= OPCODE_NOP && op <= OPCODE_CONST_CLASS) ||
+      op == OPCODE_CHECK_CAST || op == OPCODE_INSTANCE_OF ||
+      op == OPCODE_ARRAY_LENGTH ||
+      (op >= OPCODE_CMPL_FLOAT && op <= OPCODE_CMP_LONG) ||
+      (op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8) ||
+      op == FOPCODE_PACKED_SWITCH || op == FOPCODE_SPARSE_SWITCH ||
+      op == FOPCODE_FILLED_ARRAY) {
+    return Purity::PURE;
+  }
+  if (is_invoke(op) || (is_branch(op) && op != OPCODE_FILL_ARRAY_DATA)) {
+    return Purity::PURE;
+  }
+  if (op >= OPCODE_AGET && op <= OPCODE_AGET_SHORT) {
+    return Purity::SIDE_EFFECT_FREE;
+  }
+  switch (op) {
+  case OPCODE_NEW_INSTANCE: {
+    auto type = static_cast<DexOpcodeType*>(insn)->get_type();
+    return needs_init(caller, type) ? Purity::IMPURE
+                                    : Purity::SIDE_EFFECT_FREE;
+  }
+  case OPCODE_NEW_ARRAY:
+  case OPCODE_FILLED_NEW_ARRAY:
+  case OPCODE_FILLED_NEW_ARRAY_RANGE:
+    return Purity::SIDE_EFFECT_FREE;
+  default:
+    break;
+  }
+  if (is_iget(op) || is_sget(op)) {
+    auto ref = static_cast<DexOpcodeField*>(insn)->field();
+    auto field = resolve_field(
+      ref, is_sget(op) ? FieldSearch::Static : FieldSearch::Instance);
+    if (field == nullptr) {
+      return Purity::SIDE_EFFECT_FREE;
+    }
+    if (is_sget(op) && needs_init(caller, field->get_class())) {
+      return Purity::IMPURE;
+    }
+    return field->is_concrete() && (field->get_access() & ACC_FINAL)
+      ? Purity::PURE
+      : Purity::SIDE_EFFECT_FREE;
+  }
+  // Writes, monitors, throws, fill-array-data and the jumbo opcodes.
+  return Purity::IMPURE;
+}
+
+/*
+ * The purity of `method` ignoring what its callees do.  Backward branches
+ * and exception handlers that start before the end of their try range make
+ * a method impure, since they might loop forever.
+ */
+Purity PurityAnalysis::local_purity(const DexMethod* method) const {
+  auto code = method->get_code();
+  auto& insns = code->get_instructions();
+  std::unordered_map<uint32_t, DexInstruction*> insn_at;
+  std::vector<uint32_t> addrs;
+  uint32_t addr = 0;
+  bool has_switch = false;
+  for (auto insn : insns) {
+    addrs.push_back(addr);
+    insn_at[addr] = insn;
+    addr += insn->size();
+    has_switch |= is_multi_branch(insn->opcode());
+  }
+  if (!has_switch) {
+    insn_at.clear();
+  }
+  for (auto tri : code->get_tries()) {
+    auto end = tri->m_start_addr + tri->m_insn_count;
+    for (auto& c : tri->m_catches) {
+      if (c.second < end) {
+        return Purity::IMPURE;
+      }
+    }
+    if (tri->m_catchall != DEX_NO_INDEX && tri->m_catchall < end) {
+      return Purity::IMPURE;
+    }
+  }
+  auto p = Purity::PURE;
+  for (size_t i = 0; i < insns.size() && p != Purity::IMPURE; i++) {
+    auto insn = insns[i];
+    auto op = insn->opcode();
+    if (is_multi_branch(op)) {
+      if (switch_goes_back(insn, addrs[i], insn_at)) {
+        return Purity::IMPURE;
+      }
+    } else if (is_goto(op) || is_conditional_branch(op)) {
+      if (insn->offset() <= 0) {
+        return Purity::IMPURE;
+      }
+    }
+    p = std::min(p, instruction_purity(method, insn));
+  }
+  return p;
+}
@@ -13,10 +13,15 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "DexUtil.h"
+#include "Resolver.h"
 
 RedexContext* g_redex;
 
 RedexContext::~RedexContext() {
+  // Cached resolutions and class lists point at what is about to be deleted.
+  invalidate_resolve_cache();
+  clear_type_system();
   // Delete DexStrings.
   for (auto const& p : s_string_map) {
     delete p.second;
@@ -257,6 +262,7 @@ void RedexContext::mutate_method_class(DexMethod* method, DexType* cls) {
   method->m_class = cls;
   s_method_map[method->m_class][method->m_name][method->m_proto] = method;
   pthread_mutex_unlock(&s_method_lock);
+  invalidate_resolve_cache();
 }
 
 void RedexContext::mutate_method_proto(DexMethod* method, DexProto* proto) {
@@ -265,4 +271,68 @@ void RedexContext::mutate_method_proto(DexMethod* method, DexProto* proto) {
   method->m_proto = proto;
   s_method_map[method->m_class][method->m_name][method->m_proto] = method;
   pthread_mutex_unlock(&s_method_lock);
+  invalidate_resolve_cache();
+}
+
+namespace {
+
+// A std::map node: the value plus color, parent, left and right.
+template <typename Map>
+constexpr size_t node_bytes() {
+  return sizeof(typename Map::value_type) + 4 * sizeof(void*);
+}
+
+template <typename Map>
+void add_nodes(MemoryAccounting::Usage& usage, const Map& map) {
+  usage.objects += map.size();
+  usage.bytes += map.size() * node_bytes<Map>();
+}
+
+}
+
+MemoryAccounting::Usage RedexContext::map_usage() {
+  MemoryAccounting::Usage usage;
+  pthread_mutex_lock(&s_string_lock);
+  add_nodes(usage, s_string_map);
+  pthread_mutex_unlock(&s_string_lock);
+
+  pthread_mutex_lock(&s_type_lock);
+  add_nodes(usage, s_type_map);
+  pthread_mutex_unlock(&s_type_lock);
+
+  pthread_mutex_lock(&s_field_lock);
+  add_nodes(usage, s_field_map);
+  for (auto const& p1 : s_field_map) {
+    add_nodes(usage, p1.second);
+    for (auto const& p2 : p1.second) {
+      add_nodes(usage, p2.second);
+    }
+  }
+  pthread_mutex_unlock(&s_field_lock);
+
+  pthread_mutex_lock(&s_typelist_lock);
+  add_nodes(usage, s_typelist_map);
+  for (auto const& p : s_typelist_map) {
+    // The key's list nodes: the type plus next and prev.
+    usage.bytes += p.first.size() * 3 * sizeof(void*);
+  }
+  pthread_mutex_unlock(&s_typelist_lock);
+
+  pthread_mutex_lock(&s_proto_lock);
+  add_nodes(usage, s_proto_map);
+  for (auto const& p : s_proto_map) {
+    add_nodes(usage, p.second);
+  }
+  pthread_mutex_unlock(&s_proto_lock);
+
+  pthread_mutex_lock(&s_method_lock);
+  add_nodes(usage, s_method_map);
+  for (auto const& p1 : s_method_map) {
+    add_nodes(usage, p1.second);
+    for (auto const& p2 : p1.second) {
+      add_nodes(usage, p2.second);
+    }
+  }
+  pthread_mutex_unlock(&s_method_lock);
+  return usage;
 }
@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "ReferenceIndex.h"
+
+#include <cstdlib>
+#include <new>
+
+#include "Debug.h"
+#include "Trace.h"
+#include "Transform.h"
+#include "WorkQueue.h"
+#include "walkers.h"
+
+namespace {
+
+const ReferenceIndex::Sites no_sites;
+
+}
+
+ReferenceIndex* ReferenceIndex::s_current = nullptr;
+constexpr size_t ReferenceIndex::kShards;
+
+struct ReferenceIndex::Scan {
+  DexMethod* method;
+  std::vector<std::pair<DexInstruction*, const void*>> refs;
+};
+
+void ReferenceIndex::scan(Scan* s) {
+  for (auto insn : s->method->get_code()->get_instructions()) {
+    auto entity = referenced(insn);
+    if (entity != nullptr) {
+      s->refs.emplace_back(insn, entity);
+    }
+  }
+}
+
+void* ReferenceIndex::operator new(size_t size) {
+  void* p;
+  if (posix_memalign(&p, alignof(ReferenceIndex), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void ReferenceIndex::operator delete(void* p) {
+  free(p);
+}
+
+ReferenceIndex::ReferenceIndex(const Scope& scope) {
+  always_assert_log(s_current == nullptr,
+                    "Only one ReferenceIndex may exist at a time");
+  std::vector<Scan> scans;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      scans.push_back(Scan{m, {}});
+    }
+  });
+  if (!scans.empty()) {
+    std::vector<WorkItem<Scan>> workitems(scans.size());
+    for (size_t i = 0; i < scans.size(); i++) {
+      workitems[i].init(scan, &scans[i]);
+    }
+    WorkQueue wq;
+    wq.run_work_items(&workitems[0], workitems.size());
+  }
+  size_t nrefs = 0;
+  for (auto& s : scans) {
+    auto& refs = m_methods[shard(s.method)].map[s.method];
+    for (auto& ref : s.refs) {
+      add_site(ref.second, s.method, ref.first);
+      refs.emplace(ref.first, ref.second);
+    }
+    nrefs += s.refs.size();
+  }
+  TRACE(REFIDX, 1, "Indexed %lu references from %lu methods\n",
+        nrefs, scans.size());
+  s_current = this;
+}
+
+ReferenceIndex::~ReferenceIndex() {
+  s_current = nullptr;
+}
+
+const void* ReferenceIndex::referenced(DexInstruction* insn) {
+  if (insn->has_fields()) {
+    return static_cast<DexOpcodeField*>(insn)->field();
+  }
+  if (insn->has_methods()) {
+    return static_cast<DexOpcodeMethod*>(insn)->get_method();
+  }
+  if (insn->has_types()) {
+    return static_cast<DexOpcodeType*>(insn)->get_type();
+  }
+  if (insn->has_strings()) {
+    return static_cast<DexOpcodeString*>(insn)->get_string();
+  }
+  return nullptr;
+}
+
+const ReferenceIndex::Sites& ReferenceIndex::find(const void* entity) const {
+  auto& s = m_sites[shard(entity)];
+  std::lock_guard<std::mutex> g(s.lock);
+  auto it = s.map.find(entity);
+  return it != s.map.end() ? it->second : no_sites;
+}
+
+void ReferenceIndex::add(DexMethod* method, DexInstruction* insn) {
+  auto entity = referenced(insn);
+  if (entity == nullptr) {
+    return;
+  }
+  add_site(entity, method, insn);
+  auto& s = m_methods[shard(method)];
+  std::lock_guard<std::mutex> g(s.lock);
+  s.map[method].emplace(insn, entity);
+}
+
+void ReferenceIndex::remove(DexMethod* method, DexInstruction* insn) {
+  const void* entity = nullptr;
+  {
+    auto& s = m_methods[shard(method)];
+    std::lock_guard<std::mutex> g(s.lock);
+    auto it = s.map.find(method);
+    if (it == s.map.end()) {
+      return;
+    }
+    auto& refs = it->second;
+    auto ref = refs.find(insn);
+    if (ref == refs.end()) {
+      return;
+    }
+    entity = ref->second;
+    refs.erase(ref);
+  }
+  remove_site(entity, method, insn);
+}
+
+void ReferenceIndex::update_method(DexMethod* method,
+                                   MethodTransform* transform) {
+  remove_method(method);
+  MethodRefs refs;
+  auto record = [&](DexInstruction* insn) {
+    auto entity = referenced(insn);
+    if (entity != nullptr) {
+      add_site(entity, method, insn);
+      refs.emplace(insn, entity);
+    }
+  };
+  if (transform != nullptr) {
+    for (auto& mei : *transform) {
+      if (mei.type == MFLOW_OPCODE) {
+        record(mei.insn);
+      }
+    }
+  } else if (method->get_code()) {
+    for (auto insn : method->get_code()->get_instructions()) {
+      record(insn);
+    }
+  }
+  auto& s = m_methods[shard(method)];
+  std::lock_guard<std::mutex> g(s.lock);
+  s.map[method] = std::move(refs);
+}
+
+void ReferenceIndex::remove_method(DexMethod* method) {
+  MethodRefs refs;
+  {
+    auto& s = m_methods[shard(method)];
+    std::lock_guard<std::mutex> g(s.lock);
+    auto it = s.map.find(method);
+    if (it == s.map.end()) {
+      return;
+    }
+    refs = std::move(it->second);
+    s.map.erase(it);
+  }
+  for (auto& ref : refs) {
+    remove_site(ref.second, method, ref.first);
+  }
+}
+
+void ReferenceIndex::add_site(const void* entity,
+                              DexMethod* method,
+                              DexInstruction* insn) {
+  auto& s = m_sites[shard(entity)];
+  std::lock_guard<std::mutex> g(s.lock);
+  auto& sites = s.map[entity];
+  if (s.position.emplace(SiteKey{method, insn}, sites.size()).second) {
+    sites.push_back(Site{method, insn});
+  }
+}
+
+void ReferenceIndex::remove_site(const void* entity,
+                                 const DexMethod* method,
+                                 const DexInstruction* insn) {
+  auto& s = m_sites[shard(entity)];
+  std::lock_guard<std::mutex> g(s.lock);
+  auto pos = s.position.find(SiteKey{method, insn});
+  if (pos == s.position.end()) {
+    return;
+  }
+  auto& sites = s.map.at(entity);
+  auto& last = sites.back();
+  sites[pos->second] = last;
+  s.position.at(SiteKey{last.method, last.insn}) = pos->second;
+  s.position.erase(pos);
+  sites.pop_back();
+}
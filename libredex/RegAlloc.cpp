@@ -9,211 +9,438 @@
 
 #include "RegAlloc.h"
 
-#include <set>
-#include <boost/dynamic_bitset.hpp>
+#include <algorithm>
+#include <numeric>
 
+#include "DexDebugInstruction.h"
+#include "Dominators.h"
 #include "Transform.h"
 
-using LiveSet = boost::dynamic_bitset<>;
-
-std::vector<DexInstruction*> get_instruction_vector(
-  const std::vector<Block*>& blocks
-) {
-  std::vector<DexInstruction*> insns;
-  uint16_t id = 0;
-  for (auto& block : blocks) {
-    for (auto& i : *block) {
-      if (i.type == MFLOW_OPCODE) {
-        i.addr = id++;
-        insns.push_back(i.insn);
-      }
+using LiveSet = BitVector;
+
+InterferenceGraph::InterferenceGraph(size_t nnodes)
+    : m_bits((nnodes * (nnodes ? nnodes - 1 : 0) / 2 + 63) / 64),
+      m_adj(nnodes) {}
+
+void InterferenceGraph::add_edge(size_t a, size_t b) {
+  if (a == b) {
+    return;
+  }
+  auto bit = index(a, b);
+  auto& word = m_bits[bit / 64];
+  auto mask = uint64_t(1) << (bit % 64);
+  if (word & mask) {
+    return;
+  }
+  word |= mask;
+  m_adj[a].push_back(b);
+  m_adj[b].push_back(a);
+}
+
+void InterferenceGraph::add_edges(size_t n, const BitVector& nodes) {
+  nodes.for_each([&](size_t m) { add_edge(n, m); });
+}
+
+void InterferenceGraph::add_clique(const BitVector& nodes) {
+  std::vector<size_t> members;
+  nodes.for_each([&](size_t n) { members.push_back(n); });
+  for (size_t i = 0; i < members.size(); ++i) {
+    for (size_t j = i + 1; j < members.size(); ++j) {
+      add_edge(members[i], members[j]);
     }
   }
-  return insns;
 }
 
-static bool candidate(DexMethod* m) {
-  auto code = m->get_code();
-  if (!code) {
-    return false;
+namespace {
+
+size_t dest_width(DexInstruction* insn) {
+  return insn->dest_is_wide() ? 2 : 1;
+}
+
+/*
+ * Call fn(reg) for every register `insn` reads.  The only source of a range
+ * instruction is its base.
+ */
+template <typename Fn>
+void for_each_src(DexInstruction* insn, Fn fn) {
+  if (insn->has_range_base()) {
+    for (size_t i = 0; i < insn->range_size(); i++) {
+      fn(insn->range_base() + i);
+    }
+    return;
   }
-  auto const& insts = code->get_instructions();
-  for (auto const& inst : insts) {
-    switch (inst->opcode()) {
-    case OPCODE_MOVE_WIDE:
-    case OPCODE_MOVE_WIDE_FROM16:
-    case OPCODE_MOVE_WIDE_16:
-    case OPCODE_MOVE_RESULT_WIDE:
-    case OPCODE_RETURN_WIDE:
-    case OPCODE_CONST_WIDE_16:
-    case OPCODE_CONST_WIDE_32:
-    case OPCODE_CONST_WIDE:
-    case OPCODE_CONST_WIDE_HIGH16:
-    case OPCODE_AGET_WIDE:
-    case OPCODE_APUT_WIDE:
-    case OPCODE_IGET_WIDE:
-    case OPCODE_IPUT_WIDE:
-    case OPCODE_SGET_WIDE:
-    case OPCODE_SPUT_WIDE:
-    case OPCODE_CMPL_DOUBLE:
-    case OPCODE_CMPG_DOUBLE:
-    case OPCODE_NEG_DOUBLE:
-    case OPCODE_INT_TO_DOUBLE:
-    case OPCODE_LONG_TO_DOUBLE:
-    case OPCODE_FLOAT_TO_DOUBLE:
-    case OPCODE_DOUBLE_TO_INT:
-    case OPCODE_DOUBLE_TO_LONG:
-    case OPCODE_DOUBLE_TO_FLOAT:
-    case OPCODE_ADD_DOUBLE:
-    case OPCODE_SUB_DOUBLE:
-    case OPCODE_MUL_DOUBLE:
-    case OPCODE_DIV_DOUBLE:
-    case OPCODE_REM_DOUBLE:
-    case OPCODE_ADD_DOUBLE_2ADDR:
-    case OPCODE_SUB_DOUBLE_2ADDR:
-    case OPCODE_MUL_DOUBLE_2ADDR:
-    case OPCODE_DIV_DOUBLE_2ADDR:
-    case OPCODE_REM_DOUBLE_2ADDR:
-    case OPCODE_CMP_LONG:
-    case OPCODE_NEG_LONG:
-    case OPCODE_NOT_LONG:
-    case OPCODE_INT_TO_LONG:
-    case OPCODE_LONG_TO_INT:
-    case OPCODE_LONG_TO_FLOAT:
-    case OPCODE_FLOAT_TO_LONG:
-    case OPCODE_ADD_LONG:
-    case OPCODE_SUB_LONG:
-    case OPCODE_MUL_LONG:
-    case OPCODE_DIV_LONG:
-    case OPCODE_REM_LONG:
-    case OPCODE_AND_LONG:
-    case OPCODE_OR_LONG:
-    case OPCODE_XOR_LONG:
-    case OPCODE_SHL_LONG:
-    case OPCODE_SHR_LONG:
-    case OPCODE_USHR_LONG:
-    case OPCODE_ADD_LONG_2ADDR:
-    case OPCODE_SUB_LONG_2ADDR:
-    case OPCODE_MUL_LONG_2ADDR:
-    case OPCODE_DIV_LONG_2ADDR:
-    case OPCODE_REM_LONG_2ADDR:
-    case OPCODE_AND_LONG_2ADDR:
-    case OPCODE_OR_LONG_2ADDR:
-    case OPCODE_XOR_LONG_2ADDR:
-    case OPCODE_SHL_LONG_2ADDR:
-    case OPCODE_SHR_LONG_2ADDR:
-    case OPCODE_USHR_LONG_2ADDR:
-    case OPCODE_FILLED_NEW_ARRAY_RANGE:
-    case OPCODE_INVOKE_VIRTUAL_RANGE:
-    case OPCODE_INVOKE_SUPER_RANGE:
-    case OPCODE_INVOKE_DIRECT_RANGE:
-    case OPCODE_INVOKE_STATIC_RANGE:
-    case OPCODE_INVOKE_INTERFACE_RANGE:
-      return false;
-    default:
-      break;
+  for (size_t i = 0; i < insn->srcs_size(); i++) {
+    fn(insn->src(i));
+    if (insn->src_is_wide(i)) {
+      fn(insn->src(i) + 1);
     }
   }
-  return true;
 }
 
-void allocate_registers(DexMethod* m) {
-  if (!candidate(m)) {
-    return;
+void transfer(Block* block, LiveSet& live) {
+  auto throwing = throwing_insn(block);
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto inst = it->insn;
+    if (inst->dests_size() && &*it != throwing) {
+      for (size_t i = 0; i < dest_width(inst); i++) {
+        live.reset(inst->dest() + i);
+      }
+    }
+    for_each_src(inst, [&](uint16_t r) { live.set(r); });
   }
-  TRACE(REG, 5, "Allocating: %s\n", SHOW(m));
-  auto transform =
-    MethodTransform::get_method_transform(m, true /* want_cfg */);
+}
+
+struct Move {
+  DexInstruction* insn;
+  size_t depth;
+};
+
+/*
+ * Registers interfere if one is written while the other is live, except
+ * that each half of a move's destination doesn't interfere with the same
+ * half of its source.  Values a throwing instruction would have written are
+ * live in its catch handlers anyway, so its destination stays live above
+ * it.
+ */
+InterferenceGraph build_interference(MethodTransform* transform,
+                                     uint16_t nregs,
+                                     uint16_t ins,
+                                     std::vector<Move>& moves) {
   auto& cfg = transform->cfg();
-  auto blocks = PostOrderSort(cfg).get();
-  auto nregs = m->get_code()->get_registers_size();
-  auto ins = m->get_code()->get_ins_size();
-
-  TRACE(REG, 5, "%s\n", SHOW(blocks));
-
-  auto opcode_vector = get_instruction_vector(blocks);
-  std::vector<LiveSet> liveness(opcode_vector.size(), LiveSet(nregs));
-  std::vector<LiveSet> block_liveness(blocks.size(), LiveSet(nregs));
-  bool changed;
-  do {
-    changed = false;
-    for (auto& block : blocks) {
-      auto& bliveness = block_liveness[block->id()];
-      auto prev_liveness = bliveness;
-      bliveness.reset();
-      for (auto& succ : block->succs()) {
-        bliveness |= block_liveness[succ->id()];
+  auto& loops = transform->loops();
+  auto block_liveness = run_dataflow(
+      cfg,
+      DataflowDirection::BACKWARD,
+      LiveSet(nregs),
+      [](Block* block, const LiveSet& liveout, LiveSet& livein) {
+        livein = liveout;
+        transfer(block, livein);
+      },
+      [](const LiveSet& from, LiveSet& into) { into |= from; });
+  TRACE(REG, 5, "Liveness converged after %lu block visits\n",
+        block_liveness.visits);
+
+  InterferenceGraph graph(nregs);
+  for (auto block : cfg) {
+    auto live = block_liveness.out[block->id()];
+    auto throwing = throwing_insn(block);
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
       }
-      auto livein = bliveness;
-      for (auto it = block->rbegin(); it != block->rend(); ++it) {
-        if (it->type != MFLOW_OPCODE) {
-          continue;
+      auto inst = it->insn;
+      if (inst->dests_size()) {
+        auto dest = inst->dest();
+        auto width = dest_width(inst);
+        bool move = is_move(inst->opcode());
+        for (size_t i = 0; i < width; i++) {
+          if (move) {
+            auto src = inst->src(0) + i;
+            bool src_live = live.test(src);
+            live.reset(src);
+            graph.add_edges(dest + i, live);
+            if (src_live) {
+              live.set(src);
+            }
+          } else {
+            graph.add_edges(dest + i, live);
+          }
         }
-        auto inst = it->insn;
-        auto& iliveness = liveness[it->addr];
-        iliveness = livein;
-        for (size_t i = 0; i < inst->srcs_size(); i++) {
-          iliveness.set(inst->src(i));
+        if (move) {
+          moves.push_back(Move{inst, loops.depth(block)});
         }
-        livein = iliveness;
-        if (inst->dests_size()) {
-          iliveness.set(inst->dest());
+        if (&*it != throwing) {
+          for (size_t i = 0; i < width; i++) {
+            live.reset(dest + i);
+          }
+        }
+      }
+      for_each_src(inst, [&](uint16_t r) { live.set(r); });
+    }
+  }
+
+  // The arguments are all written on entry, along with whatever garbage the
+  // registers read before being written hold.
+  auto entry = block_liveness.in[0];
+  for (size_t i = nregs - ins; i < nregs; ++i) {
+    entry.set(i);
+  }
+  graph.add_clique(entry);
+  return graph;
+}
+
+/*
+ * Registers are renumbered in classes that keep their layout: each register
+ * sits at a fixed offset from the start of its class, and the class as a
+ * whole is moved.  That keeps the halves of wide values and the operands of
+ * range instructions next to each other.
+ */
+struct Classes {
+  std::vector<uint16_t> cls;
+  std::vector<int> off;
+  std::vector<std::vector<uint16_t>> members;
+  // The class holding the arguments, which must stay at the top.
+  int arg_cls{-1};
+
+  int width(size_t c) const {
+    int w = 0;
+    for (auto r : members[c]) {
+      w = std::max(w, off[r] + 1);
+    }
+    return w;
+  }
+};
+
+/*
+ * Start with one class per run of registers that must stay together.
+ * Returns false if an operand runs past the end of the frame.
+ */
+bool initial_classes(MethodTransform* transform,
+                     uint16_t nregs,
+                     uint16_t ins,
+                     Classes& classes) {
+  // glued[r]: r and r + 1 must stay next to each other.
+  std::vector<bool> glued(nregs);
+  bool ok = true;
+  auto glue = [&](size_t first, size_t count) {
+    if (first + count > nregs) {
+      ok = false;
+      return;
+    }
+    for (size_t r = first; r + 1 < first + count; ++r) {
+      glued[r] = true;
+    }
+  };
+  glue(nregs - ins, ins);
+  for (auto& mie : *transform) {
+    if (mie.type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = mie.insn;
+    if (insn->dests_size()) {
+      glue(insn->dest(), dest_width(insn));
+    }
+    if (insn->has_range_base()) {
+      glue(insn->range_base(), insn->range_size());
+      continue;
+    }
+    for (size_t i = 0; i < insn->srcs_size(); i++) {
+      glue(insn->src(i), insn->src_is_wide(i) ? 2 : 1);
+    }
+  }
+  if (!ok) {
+    return false;
+  }
+  classes.cls.resize(nregs);
+  classes.off.resize(nregs);
+  classes.members.resize(nregs);
+  for (size_t r = 0; r < nregs; ++r) {
+    auto c = r > 0 && glued[r - 1] ? classes.cls[r - 1] : r;
+    classes.cls[r] = c;
+    classes.off[r] = r - c;
+    classes.members[c].push_back(r);
+  }
+  if (ins > 0) {
+    classes.arg_cls = classes.cls[nregs - 1];
+  }
+  return true;
+}
+
+/*
+ * Merge the classes of the two ends of each move, innermost loops first,
+ * lining them up so that the move's destination and source land on the
+ * same register.  Merging is skipped if it would put interfering registers
+ * on top of each other, or grow the argument class past the last argument.
+ */
+void coalesce_moves(const InterferenceGraph& graph,
+                    std::vector<Move>& moves,
+                    uint16_t nregs,
+                    Classes& classes) {
+  auto& cls = classes.cls;
+  auto& off = classes.off;
+  auto& members = classes.members;
+  std::stable_sort(moves.begin(), moves.end(),
+                   [](const Move& a, const Move& b) {
+                     return a.depth > b.depth;
+                   });
+  for (auto& move : moves) {
+    uint16_t d = move.insn->dest();
+    uint16_t s = move.insn->src(0);
+    size_t a = cls[d];
+    size_t b = cls[s];
+    if (a == b) {
+      continue;
+    }
+    // Move b's members so that s lines up with d.
+    int shift = off[d] - off[s];
+    if (static_cast<int>(b) == classes.arg_cls) {
+      std::swap(a, b);
+      shift = -shift;
+    }
+    bool conflict = false;
+    int low = 0;
+    int high = 0;
+    for (auto x : members[b]) {
+      auto ox = off[x] + shift;
+      low = std::min(low, ox);
+      high = std::max(high, ox);
+      for (auto y : members[a]) {
+        if (off[y] == ox && graph.interferes(x, y)) {
+          conflict = true;
+          break;
         }
       }
-      bliveness = livein;
-      if (bliveness != prev_liveness) {
-        changed = true;
+      if (conflict) {
+        break;
       }
     }
-  } while (changed);
+    if (conflict) {
+      continue;
+    }
+    if (static_cast<int>(a) == classes.arg_cls && high > off[nregs - 1]) {
+      continue;
+    }
+    for (auto x : members[b]) {
+      cls[x] = a;
+      off[x] += shift;
+    }
+    members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+    members[b].clear();
+    if (low < 0) {
+      for (auto x : members[a]) {
+        off[x] -= low;
+      }
+    }
+  }
+}
 
-  // Dump the liveness analysis.
-  auto DEBUG_ONLY dumpLiveness = [&] {
-    for (auto& block : blocks) {
-      for (auto& mie : *block) {
-        if (mie.type != MFLOW_OPCODE) {
+/*
+ * Place the classes greedily, lowest first, each at the lowest position
+ * where none of its registers lands on an interfering one.  The argument
+ * class goes last, as low as it can while staying at the top of the frame.
+ * Returns the number of each register and sets `new_regs` to the frame
+ * size.
+ */
+std::vector<uint16_t> place(const InterferenceGraph& graph,
+                            const Classes& classes,
+                            uint16_t nregs,
+                            uint16_t ins,
+                            uint16_t& new_regs) {
+  auto& cls = classes.cls;
+  auto& off = classes.off;
+  std::vector<int> pos(nregs, -1);
+  std::vector<size_t> forbidden;
+  // Lowest position >= `start` where class c fits.
+  auto lowest = [&](size_t c, int start) {
+    for (auto x : classes.members[c]) {
+      for (auto n : graph.adj(x)) {
+        if (pos[cls[n]] < 0) {
           continue;
         }
-        auto& live = liveness[mie.addr];
-        TRACE(REG, 5, "%04x:", mie.addr);
-        for (size_t i = 0; i < live.size(); i++) {
-          if (live.test(i)) {
-            TRACE(REG, 5, " %lu", i);
+        auto p = pos[cls[n]] + off[n] - off[x];
+        if (p >= start) {
+          if (forbidden.size() <= static_cast<size_t>(p)) {
+            forbidden.resize(p + 1, nregs);
           }
+          forbidden[p] = c;
         }
-        TRACE(REG, 5, "\n");
       }
     }
-    return "";
+    auto p = start;
+    while (static_cast<size_t>(p) < forbidden.size() && forbidden[p] == c) {
+      ++p;
+    }
+    return p;
   };
-  TRACE(REG, 5, "%s", dumpLiveness());
 
-  // Use liveness to build a conflict graph.
-  std::vector<std::set<uint16_t>> conflicts(nregs);
-  for (auto& block : blocks) {
-    for (auto& mie : *block) {
-      if (mie.type != MFLOW_OPCODE) {
-        continue;
-      }
-      auto& live = liveness[mie.addr];
-      // These are probably sparse so this loop isn't the best choice, but it's
-      // easy, and I bet the regsets aren't so big anyways.
-      for (size_t i = 0; i < live.size(); i++) {
-        for (size_t j = i; j < live.size(); j++) {
-          if (live.test(i) && live.test(j)) {
-            conflicts[i].emplace(j);
-            conflicts[j].emplace(i);
-          }
-        }
+  int top = 0;
+  for (size_t c = 0; c < nregs; ++c) {
+    if (classes.members[c].empty() || static_cast<int>(c) == classes.arg_cls) {
+      continue;
+    }
+    pos[c] = lowest(c, 0);
+    top = std::max(top, pos[c] + classes.width(c));
+  }
+  new_regs = top;
+  if (classes.arg_cls >= 0) {
+    auto first_arg = off[nregs - ins];
+    auto c = classes.arg_cls;
+    pos[c] = lowest(c, std::max(0, top - ins - first_arg));
+    new_regs = pos[c] + first_arg + ins;
+  }
+
+  std::vector<uint16_t> reg(nregs);
+  for (size_t r = 0; r < nregs; ++r) {
+    reg[r] = pos[cls[r]] + off[r];
+  }
+  return reg;
+}
+
+bool is_self_move(DexInstruction* insn, const std::vector<uint16_t>& reg) {
+  return is_move(insn->opcode()) && reg[insn->dest()] == reg[insn->src(0)];
+}
+
+bool fits(MethodTransform* transform, const std::vector<uint16_t>& reg) {
+  for (auto& mie : *transform) {
+    if (mie.type != MFLOW_OPCODE || is_self_move(mie.insn, reg)) {
+      continue;
+    }
+    auto insn = mie.insn;
+    if (insn->dests_size() &&
+        (reg[insn->dest()] >> insn->dest_bit_width()) != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < insn->srcs_size(); i++) {
+      if ((reg[insn->src(i)] >> insn->src_bit_width(i)) != 0) {
+        return false;
       }
     }
   }
+  return true;
+}
+
+}
+
+RegAllocStats allocate_registers(DexMethod* m, bool coalesce) {
+  RegAllocStats stats;
+  auto code = m->get_code();
+  if (!code) {
+    return stats;
+  }
+  auto nregs = code->get_registers_size();
+  auto ins = code->get_ins_size();
+  stats.regs_before = nregs;
+  stats.regs_after = nregs;
+  if (nregs == 0) {
+    stats.skipped = "no registers";
+    return stats;
+  }
+  if (ins > nregs) {
+    stats.skipped = "arguments outside the frame";
+    return stats;
+  }
+  TRACE(REG, 5, "Allocating: %s\n", SHOW(m));
+  auto transform =
+    MethodTransform::get_method_transform(m, true /* want_cfg */);
+  Classes initial;
+  if (!initial_classes(transform, nregs, ins, initial)) {
+    TRACE(REG, 2, "Operand out of range in %s\n", SHOW(m));
+    stats.skipped = "operand out of range";
+    return stats;
+  }
+  TRACE(REG, 5, "%s\n", SHOW(transform->cfg()));
+
+  std::vector<Move> moves;
+  auto graph = build_interference(transform, nregs, ins, moves);
 
   // Dump the conflict graph.
   auto DEBUG_ONLY dumpConflicts = [&] {
-    for (size_t i = 0; i < conflicts.size(); ++i) {
+    for (size_t i = 0; i < graph.size(); ++i) {
       TRACE(REG, 5, "%lu:", i);
-      for (auto& DEBUG_ONLY r : conflicts[i]) {
+      for (auto DEBUG_ONLY r : graph.adj(i)) {
         TRACE(REG, 5, " %d", r);
       }
       TRACE(REG, 5, "\n");
@@ -222,76 +449,81 @@ void allocate_registers(DexMethod* m) {
   };
   TRACE(REG, 5, "%s", dumpConflicts());
 
-  // Re-allocate everything but arguments
-  std::unordered_map<uint16_t, uint16_t> reg_map;
-  for (size_t i = 0; i < (size_t)(nregs - ins); ++i) {
-    boost::dynamic_bitset<> conflicted(nregs);
-    for (auto& r : conflicts[i]) {
-      auto it = reg_map.find(r);
-      if (it != reg_map.end()) {
-        conflicted.set(it->second);
-      }
-    }
-    for (size_t j = 0; j < conflicted.size(); ++j) {
-      if (!conflicted.test(j)) {
-        reg_map[i] = j;
-        break;
-      }
-    }
-  }
-
-  // handle the arg registers
-  boost::dynamic_bitset<> arg_conflicts(nregs);
-  for (size_t i = nregs - ins; i < nregs; ++i) {
-    for (auto& r : conflicts[i]) {
-      auto it = reg_map.find(r);
-      if (it != reg_map.end()) {
-        arg_conflicts.set(it->second);
-      }
-    }
-  }
-  size_t least_arg = 0;
-  for (size_t j = nregs; j > 0; --j) {
-    if (arg_conflicts.test(j - 1)) {
-      least_arg = j;
-      break;
+  uint16_t new_regs;
+  std::vector<uint16_t> reg;
+  if (coalesce && !moves.empty()) {
+    auto classes = initial;
+    coalesce_moves(graph, moves, nregs, classes);
+    reg = place(graph, classes, nregs, ins, new_regs);
+    if (!fits(transform, reg)) {
+      TRACE(REG, 3, "Not coalescing %s, operands would overflow\n", SHOW(m));
+      reg.clear();
     }
   }
-  for (size_t i = 0; i < ins; ++i) {
-    reg_map[nregs - ins + i] = least_arg++;
-  }
-
-  // Resize the code item's register set.
-  size_t new_regs = 0;
-  for (auto& rr : reg_map) {
-    if (rr.second > new_regs) {
-      new_regs = rr.second;
+  if (reg.empty()) {
+    reg = place(graph, initial, nregs, ins, new_regs);
+    // Single registers never move up, but runs of them can.
+    if (!fits(transform, reg)) {
+      TRACE(REG, 2, "Not allocating %s, operands would overflow\n", SHOW(m));
+      stats.skipped = "operands would overflow";
+      return stats;
     }
   }
-  m->get_code()->set_registers_size(new_regs + 1);
 
   // Dump allocation
   auto DEBUG_ONLY dumpAllocation = [&] {
-    for (auto& DEBUG_ONLY rr : reg_map) {
-      TRACE(REG, 5, "%hu -> %hu\n", rr.first, rr.second);
+    for (size_t i = 0; i < reg.size(); ++i) {
+      TRACE(REG, 5, "%lu -> %hu\n", i, reg[i]);
     }
     TRACE(REG, 5, "\n");
     return "";
   };
   TRACE(REG, 5, "%s", dumpAllocation());
 
-  for (auto& block : blocks) {
-    for (auto& item : *block) {
-      if (item.type != MFLOW_OPCODE) {
-        continue;
-      }
-      auto insn = item.insn;
-      if (insn->dests_size()) {
-        insn->set_dest(reg_map[insn->dest()]);
-      }
-      for (size_t i = 0; i < insn->srcs_size(); i++) {
-        insn->set_src(i, reg_map[insn->src(i)]);
+  std::vector<DexInstruction*> self_moves;
+  for (auto& item : *transform) {
+    if (item.type == MFLOW_DEBUG) {
+      switch (item.dbgop->opcode()) {
+      case DBG_START_LOCAL:
+      case DBG_START_LOCAL_EXTENDED:
+      case DBG_END_LOCAL:
+      case DBG_RESTART_LOCAL:
+        if (item.dbgop->uvalue() < nregs) {
+          item.dbgop->set_uvalue(reg[item.dbgop->uvalue()]);
+        }
+        break;
+      default:
+        break;
       }
+      continue;
+    }
+    if (item.type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = item.insn;
+    if (is_self_move(insn, reg)) {
+      self_moves.push_back(insn);
+      continue;
+    }
+    if (insn->dests_size()) {
+      insn->set_dest(reg[insn->dest()]);
+    }
+    // Source 0 of the two-address forms is the destination, which has
+    // been mapped already.
+    size_t first_src = insn->dest_is_src() ? 1 : 0;
+    for (size_t i = first_src; i < insn->srcs_size(); i++) {
+      insn->set_src(i, reg[insn->src(i)]);
     }
   }
+  for (auto insn : self_moves) {
+    transform->remove_opcode(insn);
+  }
+  code->set_registers_size(new_regs);
+
+  stats.allocated = true;
+  stats.regs_after = new_regs;
+  stats.moves_removed = self_moves.size();
+  TRACE(REG, 3, "%s: %u -> %u registers, %lu moves removed\n",
+        SHOW(m), nregs, new_regs, self_moves.size());
+  return stats;
 }
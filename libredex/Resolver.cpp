@@ -3,8 +3,73 @@
 #include "Resolver.h"
 #include "DexUtil.h"
 
+#include <atomic>
+#include <mutex>
+
 namespace {
 
+/*
+ * Resolutions of refs, keyed by the ref and the kind of search.  Spread over
+ * shards, each with its own lock, so threads resolving different refs rarely
+ * contend.  Invalidation just moves to a new epoch; a shard drops what it
+ * holds the first time it's used in the new one.
+ */
+struct ResolveKey {
+  const void* ref;
+  int search;
+  bool operator==(const ResolveKey& other) const {
+    return ref == other.ref && search == other.search;
+  }
+};
+
+struct ResolveKeyHash {
+  size_t operator()(const ResolveKey& key) const {
+    return std::hash<const void*>()(key.ref) * 31 + key.search;
+  }
+};
+
+struct alignas(64) ResolveShard {
+  std::mutex lock;
+  uint64_t epoch{0};
+  std::unordered_map<ResolveKey, void*, ResolveKeyHash> cache;
+};
+
+constexpr size_t kResolveShards = 64;
+ResolveShard s_resolve_cache[kResolveShards];
+std::atomic<uint64_t> s_resolve_epoch{0};
+
+/*
+ * Look `ref` up in the cache, calling `resolve` on a miss.  The epoch is
+ * read before resolving, so a result computed while the hierarchy changes
+ * is already stale, and isn't stored.
+ */
+template <typename Ref, typename Search, typename Fn>
+Ref* cached_resolve(Ref* ref, Search search, Fn resolve) {
+  ResolveKey key{ref, static_cast<int>(search)};
+  auto& shard =
+    s_resolve_cache[(reinterpret_cast<uintptr_t>(ref) >> 4) % kResolveShards];
+  auto epoch = s_resolve_epoch.load(std::memory_order_acquire);
+  {
+    std::lock_guard<std::mutex> g(shard.lock);
+    if (shard.epoch < epoch) {
+      shard.cache.clear();
+      shard.epoch = epoch;
+    }
+    if (shard.epoch == epoch) {
+      auto it = shard.cache.find(key);
+      if (it != shard.cache.end()) {
+        return static_cast<Ref*>(it->second);
+      }
+    }
+  }
+  Ref* def = resolve();
+  std::lock_guard<std::mutex> g(shard.lock);
+  if (shard.epoch == epoch) {
+    shard.cache[key] = def;
+  }
+  return def;
+}
+
 inline bool match(const DexString* name,
                   const DexProto* proto,
                   const DexMethod* cls_meth) {
@@ -85,6 +150,16 @@ DexMethod* resolve_method(
   return nullptr;
 }
 
+DexMethod* resolve_method(DexMethod* method, MethodSearch search) {
+  if (method->is_def()) return method;
+  return cached_resolve(method, search, [&] {
+    auto cls = type_class(method->get_class());
+    if (cls == nullptr) return static_cast<DexMethod*>(nullptr);
+    return resolve_method(
+        cls, method->get_name(), method->get_proto(), search);
+  });
+}
+
 DexMethod* find_top_impl(
     const DexClass* cls, const DexString* name, const DexProto* proto) {
   DexMethod* top_impl = nullptr;
@@ -168,3 +243,15 @@ DexField* resolve_field(
   return nullptr;
 }
 
+DexField* resolve_field(DexField* field, FieldSearch) {
+  if (field->is_def()) return field;
+  // Any search, whatever the caller asked for, as it has always been.
+  return cached_resolve(field, FieldSearch::Any, [&] {
+    return resolve_field(
+        field->get_class(), field->get_name(), field->get_type());
+  });
+}
+
+void invalidate_resolve_cache() {
+  s_resolve_epoch.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,1106 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SSA.h"
+
+#include <algorithm>
+
+#include "Dataflow.h"
+#include "Debug.h"
+#include "DexDebugInstruction.h"
+#include "DexUtil.h"
+#include "Dominators.h"
+#include "RegAlloc.h"
+#include "Trace.h"
+
+namespace {
+
+bool defines_object(DexOpcode op) {
+  switch (op) {
+  case OPCODE_MOVE_OBJECT:
+  case OPCODE_MOVE_OBJECT_FROM16:
+  case OPCODE_MOVE_OBJECT_16:
+  case OPCODE_MOVE_RESULT_OBJECT:
+  case OPCODE_MOVE_EXCEPTION:
+  case OPCODE_CONST_STRING:
+  case OPCODE_CONST_STRING_JUMBO:
+  case OPCODE_CONST_CLASS:
+  case OPCODE_CONST_CLASS_JUMBO:
+  case OPCODE_NEW_INSTANCE:
+  case OPCODE_NEW_INSTANCE_JUMBO:
+  case OPCODE_NEW_ARRAY:
+  case OPCODE_NEW_ARRAY_JUMBO:
+  case OPCODE_AGET_OBJECT:
+  case OPCODE_IGET_OBJECT:
+  case OPCODE_IGET_OBJECT_JUMBO:
+  case OPCODE_SGET_OBJECT:
+  case OPCODE_SGET_OBJECT_JUMBO:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* The last instruction of `b`, or nullptr if it has none. */
+MethodItemEntry* last_insn(Block* b) {
+  for (auto it = b->rbegin(); it != b->rend(); ++it) {
+    if (it->type == MFLOW_OPCODE) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+bool has_catch_succ(Block* b) {
+  for (auto s : b->succs()) {
+    if (is_catch(s)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool falls_through(Block* b) {
+  auto last = last_insn(b);
+  if (last == nullptr) {
+    return true;
+  }
+  auto op = last->insn->opcode();
+  return !is_goto(op) && !is_return(op) && op != OPCODE_THROW;
+}
+
+/*
+ * The register written by the instruction ending `b` if that instruction can
+ * throw into a catch handler of `b`, which then sees the register's previous
+ * value.  -1 if there's no such register.
+ */
+int throwing_dest(Block* b) {
+  auto last = last_insn(b);
+  if (last == nullptr || !has_catch_succ(b) || !last->insn->dests_size()) {
+    return -1;
+  }
+  return last->insn->dest();
+}
+
+/* Each distinct successor of `b` once, in order. */
+std::vector<Block*> unique_succs(Block* b) {
+  std::vector<Block*> succs;
+  for (auto s : b->succs()) {
+    if (std::find(succs.begin(), succs.end(), s) == succs.end()) {
+      succs.push_back(s);
+    }
+  }
+  return succs;
+}
+
+bool is_static(DexMethod* method) {
+  return method->get_access() & ACC_STATIC;
+}
+}
+
+bool SSAForm::can_build(DexMethod* method) {
+  auto code = method->get_code();
+  if (code == nullptr) {
+    return false;
+  }
+  size_t nparams = is_static(method) ? 0 : 1;
+  for (auto arg : method->get_proto()->get_args()->get_type_list()) {
+    auto shorty = type_shorty(arg);
+    if (shorty == 'J' || shorty == 'D') {
+      return false;
+    }
+    ++nparams;
+  }
+  if (nparams != code->get_ins_size()) {
+    return false;
+  }
+  auto transform = MethodTransform::get_method_transform(method);
+  for (auto& mie : *transform) {
+    if (mie.type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = mie.insn;
+    if (insn->has_range_base()) {
+      return false;
+    }
+    if (insn->dests_size() && insn->dest_is_wide()) {
+      return false;
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      if (insn->src_is_wide(i)) {
+        return false;
+      }
+    }
+  }
+  // Catch handlers must only be entered by throwing, so that every edge
+  // into them carries the registers as they were before the instruction
+  // that threw.
+  for (auto b : transform->cfg()) {
+    if (!is_catch(b)) {
+      continue;
+    }
+    auto& preds = b->preds();
+    for (size_t i = 0; i < preds.size(); ++i) {
+      auto p = preds[i];
+      if (!ends_with_may_throw(p) ||
+          (p->id() + 1 == b->id() && falls_through(p)) ||
+          std::find(preds.begin(), preds.begin() + i, p) !=
+              preds.begin() + i) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+SSAForm::SSAForm(DexMethod* method)
+    : m_method(method),
+      m_transform(MethodTransform::get_method_transform(method)) {
+  always_assert_log(can_build(method),
+                    "Can't build the SSA form of %s",
+                    SHOW(method));
+  auto code = method->get_code();
+  m_nregs = code->get_registers_size();
+  uint16_t reg = m_nregs - code->get_ins_size();
+  if (!is_static(method)) {
+    m_params.push_back(make_value(SSAValue::PARAM, reg++));
+    m_params.back()->is_object = true;
+  }
+  for (auto arg : method->get_proto()->get_args()->get_type_list()) {
+    m_params.push_back(make_value(SSAValue::PARAM, reg++));
+    m_params.back()->is_object = type_shorty(arg) == 'L';
+  }
+  for (uint16_t r = 0; r < m_nregs; ++r) {
+    m_undef.push_back(make_value(SSAValue::UNDEF, r));
+  }
+  auto& cfg = m_transform->cfg();
+  m_phis.resize(cfg.size());
+  place_phis(cfg);
+  rename(cfg);
+  infer_objects();
+  TRACE(SSA, 5, "SSA form of %s: %lu values\n", SHOW(method), m_values.size());
+}
+
+SSAForm::~SSAForm() {
+  for (auto& phis : m_phis) {
+    for (auto phi : phis) {
+      delete phi;
+    }
+  }
+  for (auto v : m_values) {
+    delete v;
+  }
+}
+
+SSAValue* SSAForm::make_value(SSAValue::Kind kind, uint16_t reg) {
+  m_values.push_back(new SSAValue(m_values.size(), kind, reg));
+  return m_values.back();
+}
+
+/*
+ * Pruned phi placement: a register gets a phi at the iterated dominance
+ * frontier of its definitions, wherever it's live.
+ */
+void SSAForm::place_phis(const std::vector<Block*>& cfg) {
+  auto& doms = m_transform->dominators();
+  auto liveness = run_dataflow(
+      cfg,
+      DataflowDirection::BACKWARD,
+      BitVector(m_nregs),
+      [&](Block* b, const BitVector& out, BitVector& in) {
+        if (!doms.is_reachable(b)) {
+          return;
+        }
+        in = out;
+        auto throwing = throwing_insn(b);
+        for (auto it = b->rbegin(); it != b->rend(); ++it) {
+          if (it->type != MFLOW_OPCODE) {
+            continue;
+          }
+          auto insn = it->insn;
+          // A throwing instruction doesn't write its destination, so the
+          // catch handlers may still read the old value.
+          if (insn->dests_size() && &*it != throwing) {
+            in.reset(insn->dest());
+          }
+          for (size_t i = 0; i < insn->srcs_size(); ++i) {
+            in.set(insn->src(i));
+          }
+        }
+      },
+      [](const BitVector& from, BitVector& into) { into |= from; });
+
+  std::vector<std::vector<Block*>> defsites(m_nregs);
+  std::vector<std::vector<Block*>> catch_sites(m_nregs);
+  for (auto b : doms.reverse_postorder()) {
+    for (auto& mie : *b) {
+      if (mie.type == MFLOW_OPCODE && mie.insn->dests_size()) {
+        auto& sites = defsites[mie.insn->dest()];
+        if (sites.empty() || sites.back() != b) {
+          sites.push_back(b);
+        }
+      }
+    }
+    auto reg = throwing_dest(b);
+    if (reg >= 0) {
+      for (auto s : unique_succs(b)) {
+        if (is_catch(s)) {
+          catch_sites[reg].push_back(s);
+        }
+      }
+    }
+  }
+
+  std::vector<int> has_phi(cfg.size(), -1);
+  std::vector<int> queued(cfg.size(), -1);
+  for (int r = 0; r < m_nregs; ++r) {
+    std::vector<Block*> worklist;
+    auto add_phi = [&](Block* b) {
+      if (has_phi[b->id()] == r || !liveness.in[b->id()].test(r)) {
+        return;
+      }
+      has_phi[b->id()] = r;
+      auto phi = new SSAPhi();
+      phi->block = b;
+      phi->dest = make_value(SSAValue::PHI, r);
+      phi->dest->phi = phi;
+      phi->srcs.resize(b->preds().size() + (b == cfg[0] ? 1 : 0), nullptr);
+      m_phis[b->id()].push_back(phi);
+      if (queued[b->id()] != r) {
+        queued[b->id()] = r;
+        worklist.push_back(b);
+      }
+    };
+    for (auto b : defsites[r]) {
+      queued[b->id()] = r;
+      worklist.push_back(b);
+    }
+    for (auto b : catch_sites[r]) {
+      add_phi(b);
+    }
+    while (!worklist.empty()) {
+      auto b = worklist.back();
+      worklist.pop_back();
+      for (auto f : doms.frontier(b)) {
+        add_phi(f);
+      }
+    }
+  }
+}
+
+/*
+ * Rename registers to values with a walk over the dominator tree, keeping a
+ * stack of the reaching values of each register.
+ */
+void SSAForm::rename(const std::vector<Block*>& cfg) {
+  auto& doms = m_transform->dominators();
+  std::vector<std::vector<SSAValue*>> stacks(m_nregs);
+  for (uint16_t r = 0; r < m_nregs; ++r) {
+    stacks[r].push_back(m_undef[r]);
+  }
+  for (auto v : m_params) {
+    stacks[v->reg].back() = v;
+  }
+  for (auto phi : m_phis[0]) {
+    auto v = stacks[phi->dest->reg].back();
+    phi->srcs.back() = v;
+    add_use(v, SSAUse{nullptr, phi, phi->srcs.size() - 1});
+  }
+
+  struct Frame {
+    Block* block;
+    size_t next_child;
+    std::vector<uint16_t> pushed;
+  };
+  std::vector<Frame> frames;
+  auto enter = [&](Block* b) {
+    frames.push_back(Frame{b, 0, {}});
+    auto& pushed = frames.back().pushed;
+    for (auto phi : m_phis[b->id()]) {
+      stacks[phi->dest->reg].push_back(phi->dest);
+      pushed.push_back(phi->dest->reg);
+    }
+    auto throwing = throwing_insn(b);
+    SSAValue* before_throw = nullptr;
+    for (auto& mie : *b) {
+      if (mie.type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = mie.insn;
+      auto& info = m_insns[insn];
+      info.uses.resize(insn->srcs_size());
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        auto v = stacks[insn->src(i)].back();
+        info.uses[i] = v;
+        add_use(v, SSAUse{insn, nullptr, i});
+      }
+      if (insn->dests_size()) {
+        auto reg = insn->dest();
+        if (&mie == throwing) {
+          before_throw = stacks[reg].back();
+        }
+        info.def = make_value(SSAValue::INSN, reg);
+        info.def->insn = insn;
+        stacks[reg].push_back(info.def);
+        pushed.push_back(reg);
+      }
+    }
+    auto throw_reg = throwing_dest(b);
+    for (auto s : unique_succs(b)) {
+      auto& preds = s->preds();
+      for (size_t j = 0; j < preds.size(); ++j) {
+        if (preds[j] != b) {
+          continue;
+        }
+        for (auto phi : m_phis[s->id()]) {
+          auto reg = phi->dest->reg;
+          auto v = is_catch(s) && reg == throw_reg ? before_throw
+                                                   : stacks[reg].back();
+          phi->srcs[j] = v;
+          add_use(v, SSAUse{nullptr, phi, j});
+        }
+      }
+    }
+  };
+  enter(cfg[0]);
+  while (!frames.empty()) {
+    auto& top = frames.back();
+    auto& children = doms.children(top.block);
+    if (top.next_child < children.size()) {
+      enter(children[top.next_child++]);
+    } else {
+      for (auto reg : top.pushed) {
+        stacks[reg].pop_back();
+      }
+      frames.pop_back();
+    }
+  }
+
+  // Operands coming from unreachable blocks.
+  for (auto& phis : m_phis) {
+    for (auto phi : phis) {
+      for (size_t j = 0; j < phi->srcs.size(); ++j) {
+        if (phi->srcs[j] == nullptr) {
+          phi->srcs[j] = m_undef[phi->dest->reg];
+          add_use(phi->srcs[j], SSAUse{nullptr, phi, j});
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Track which values are references, so that destruct() knows which move
+ * opcode to copy them with.  A phi holds a reference if any operand does.
+ */
+void SSAForm::infer_objects() {
+  for (auto v : m_values) {
+    if (v->kind == SSAValue::INSN) {
+      v->is_object = defines_object(v->insn->opcode());
+    }
+  }
+  bool changed;
+  do {
+    changed = false;
+    for (auto& phis : m_phis) {
+      for (auto phi : phis) {
+        if (phi->dest->is_object) {
+          continue;
+        }
+        for (auto v : phi->srcs) {
+          if (v->is_object) {
+            phi->dest->is_object = true;
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+  } while (changed);
+}
+
+void SSAForm::add_use(SSAValue* v, SSAUse use) { v->uses.push_back(use); }
+
+void SSAForm::remove_use(SSAValue* v, SSAUse use) {
+  auto& uses = v->uses;
+  for (auto it = uses.begin(); it != uses.end(); ++it) {
+    if (it->insn == use.insn && it->phi == use.phi && it->index == use.index) {
+      uses.erase(it);
+      return;
+    }
+  }
+  always_assert_log(false, "Use of v%lu not found", v->id);
+}
+
+SSAValue* SSAForm::def(DexInstruction* insn) const {
+  auto it = m_insns.find(insn);
+  always_assert_log(it != m_insns.end(), "%s not in SSA form", SHOW(insn));
+  return it->second.def;
+}
+
+SSAValue* SSAForm::use(DexInstruction* insn, size_t i) const {
+  auto it = m_insns.find(insn);
+  always_assert_log(it != m_insns.end(), "%s not in SSA form", SHOW(insn));
+  return it->second.uses.at(i);
+}
+
+void SSAForm::replace_all_uses(SSAValue* from, SSAValue* to) {
+  if (from == to) {
+    return;
+  }
+  for (auto& use : from->uses) {
+    if (use.insn) {
+      m_insns[use.insn].uses[use.index] = to;
+    } else {
+      use.phi->srcs[use.index] = to;
+    }
+    to->uses.push_back(use);
+  }
+  from->uses.clear();
+}
+
+void SSAForm::remove(DexInstruction* insn) {
+  always_assert(!is_branch(insn->opcode()));
+  auto& info = m_insns.at(insn);
+  always_assert_log(info.def == nullptr || info.def->uses.empty(),
+                    "Removing %s, whose result is still used",
+                    SHOW(insn));
+  for (size_t i = 0; i < info.uses.size(); ++i) {
+    remove_use(info.uses[i], SSAUse{insn, nullptr, i});
+  }
+  m_removed.insert(insn);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Out-of-SSA translation; see the comment on SSAForm.
+ *
+ * The copies are "virtual" until the very end: each block gets a list of
+ * operations, instructions and copies in program order, over which liveness
+ * and interference are computed.  Only the copies whose ends end up in
+ * different registers are materialized.
+ */
+class SSADestructor {
+ public:
+  explicit SSADestructor(SSAForm& ssa)
+      : m_ssa(ssa),
+        m_transform(ssa.m_transform),
+        m_cfg(ssa.m_transform->cfg()),
+        m_doms(ssa.m_transform->dominators()),
+        m_blocks(m_cfg.size()) {}
+
+  bool run();
+
+ private:
+  static constexpr size_t kNone = static_cast<size_t>(-1);
+
+  struct Op {
+    // The instruction, or nullptr for a copy.
+    DexInstruction* insn;
+    SSAValue* def;
+    std::vector<SSAValue*> uses;
+    // Copies are inserted in front of this item.
+    FatMethod::iterator where;
+    bool is_copy() const { return insn == nullptr; }
+  };
+
+  struct BlockOps {
+    std::vector<SSAValue*> phi_defs;
+    std::vector<Op> ops;
+    // Index in ops of the instruction that can throw to a catch handler.
+    size_t throw_index{kNone};
+    // Phi operands read on the way out of the block, along normal and
+    // exceptional edges.
+    std::vector<SSAValue*> normal_uses;
+    std::vector<SSAValue*> catch_uses;
+  };
+
+  SSAValue* make_copy_value(SSAValue* like) {
+    auto v = m_ssa.make_value(SSAValue::INSN, like->reg);
+    v->is_object = like->is_object;
+    return v;
+  }
+
+  Op make_copy(SSAValue* dest, SSAValue* src, FatMethod::iterator where) {
+    return Op{nullptr, dest, {src}, where};
+  }
+
+  void build_ops();
+  void compute_interference();
+  void add_interference(SSAValue* def, const BitVector& live);
+  void number_copies();
+  void live_through(size_t b, BitVector& live, bool interfere);
+  void coalesce();
+  size_t find(size_t v) {
+    while (m_parent[v] != v) {
+      m_parent[v] = m_parent[m_parent[v]];
+      v = m_parent[v];
+    }
+    return v;
+  }
+  void unite(size_t a, size_t b);
+  bool classes_interfere(size_t a, size_t b);
+  void assign_registers();
+  uint16_t final_reg(SSAValue* v);
+  bool fits();
+  void rewrite();
+
+  SSAForm& m_ssa;
+  MethodTransform* m_transform;
+  const std::vector<Block*>& m_cfg;
+  const DominatorTree& m_doms;
+  std::vector<BlockOps> m_blocks;
+  // Copies of the operands of the entry block's phis that come from the
+  // method entry, which are placed before the method's first item.
+  std::vector<Op> m_entry_copies;
+  std::vector<SSAValue*> m_entry_uses;
+  // Classes of values that must share a register.
+  std::vector<size_t> m_parent;
+  std::vector<std::vector<size_t>> m_members;
+  std::vector<std::vector<uint32_t>> m_interference;
+  // The value each value is a copy of, following chains of copies and moves;
+  // values that aren't copies are their own.
+  std::vector<size_t> m_copy_of;
+  std::vector<BitVector> m_live_out;
+  // Register of each class root, numbered as in the original method, with
+  // fresh registers after the original ones.
+  std::vector<int> m_reg;
+  uint16_t m_nfresh{0};
+};
+
+constexpr size_t SSADestructor::kNone;
+
+void SSADestructor::unite(size_t a, size_t b) {
+  a = find(a);
+  b = find(b);
+  if (a == b) {
+    return;
+  }
+  if (m_members[a].size() < m_members[b].size()) {
+    std::swap(a, b);
+  }
+  m_parent[b] = a;
+  m_members[a].insert(m_members[a].end(), m_members[b].begin(),
+                      m_members[b].end());
+  m_members[b].clear();
+}
+
+void SSADestructor::build_ops() {
+  auto& ssa = m_ssa;
+  std::vector<std::pair<size_t, size_t>> must_share;
+
+  // Phi results are copied out of their phi right at the top of the block.
+  std::unordered_map<SSAPhi*, SSAValue*> phi_copy;
+  for (auto b : m_doms.reverse_postorder()) {
+    for (auto phi : ssa.phis(b)) {
+      auto v = make_copy_value(phi->dest);
+      phi_copy[phi] = v;
+      m_blocks[b->id()].phi_defs.push_back(v);
+    }
+  }
+
+  for (auto phi : ssa.phis(m_cfg[0])) {
+    auto src = phi->srcs.back();
+    if (src->kind == SSAValue::UNDEF) {
+      continue;
+    }
+    auto v = make_copy_value(phi->dest);
+    m_entry_copies.push_back(make_copy(v, src, m_transform->begin()));
+    m_entry_uses.push_back(v);
+    must_share.emplace_back(v->id, phi_copy[phi]->id);
+  }
+
+  for (auto b : m_doms.reverse_postorder()) {
+    auto& bops = m_blocks[b->id()];
+    auto& ops = bops.ops;
+
+    // Operand copies, one per phi and predecessor.
+    std::vector<Op> normal_copies;
+    std::vector<Op> catch_copies;
+    for (auto s : unique_succs(b)) {
+      auto& preds = s->preds();
+      auto j = std::find(preds.begin(), preds.end(), b) - preds.begin();
+      for (auto phi : ssa.phis(s)) {
+        auto src = phi->srcs[j];
+        if (src->kind == SSAValue::UNDEF) {
+          continue;
+        }
+        auto v = make_copy_value(phi->dest);
+        must_share.emplace_back(v->id, phi_copy[phi]->id);
+        if (is_catch(s)) {
+          catch_copies.push_back(make_copy(v, src, b->end()));
+          bops.catch_uses.push_back(v);
+        } else {
+          normal_copies.push_back(make_copy(v, src, b->end()));
+          bops.normal_uses.push_back(v);
+        }
+      }
+    }
+
+    auto last = last_insn(b);
+    bool copies_before_last = last && is_branch(last->insn->opcode());
+    std::vector<Op> result_copies;
+    for (auto phi : ssa.phis(b)) {
+      result_copies.push_back(make_copy(phi->dest, phi_copy[phi], b->end()));
+    }
+    auto emit_result_copies = [&](FatMethod::iterator where) {
+      for (auto& op : result_copies) {
+        op.where = where;
+        ops.push_back(op);
+      }
+      result_copies.clear();
+    };
+
+    bool first = true;
+    for (auto it = b->begin(); it != b->end(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = it->insn;
+      auto op = insn->opcode();
+      bool leading = first && (op == OPCODE_MOVE_EXCEPTION || is_move_result(op));
+      if (first && !leading) {
+        emit_result_copies(it);
+      }
+      first = false;
+      if (&*it == last) {
+        for (auto& copy : catch_copies) {
+          copy.where = it;
+          ops.push_back(copy);
+        }
+        if (copies_before_last) {
+          for (auto& copy : normal_copies) {
+            copy.where = it;
+            ops.push_back(copy);
+          }
+        }
+      }
+      Op insn_op{insn, nullptr, {}, it};
+      if (!ssa.is_removed(insn)) {
+        auto& info = ssa.m_insns.at(insn);
+        insn_op.def = info.def;
+        insn_op.uses = info.uses;
+        // The two-address forms read and write the same register.
+        if (insn->dest_is_src() &&
+            info.uses[0]->kind != SSAValue::UNDEF) {
+          auto v = make_copy_value(info.uses[0]);
+          ops.push_back(make_copy(v, info.uses[0], it));
+          insn_op.uses[0] = v;
+          must_share.emplace_back(v->id, info.def->id);
+        }
+      }
+      if (&*it == last && has_catch_succ(b)) {
+        bops.throw_index = ops.size();
+      }
+      ops.push_back(insn_op);
+      if (leading) {
+        emit_result_copies(std::next(it));
+      }
+    }
+    emit_result_copies(b->end());
+    if (last == nullptr) {
+      ops.insert(ops.end(), catch_copies.begin(), catch_copies.end());
+    }
+    if (!copies_before_last) {
+      ops.insert(ops.end(), normal_copies.begin(), normal_copies.end());
+    }
+  }
+
+  auto nvalues = ssa.m_values.size();
+  m_parent.resize(nvalues);
+  m_members.resize(nvalues);
+  for (size_t i = 0; i < nvalues; ++i) {
+    m_parent[i] = i;
+    m_members[i].push_back(i);
+  }
+  for (auto& p : must_share) {
+    unite(p.first, p.second);
+  }
+}
+
+/*
+ * Number each value after the definition it copies.  In strict SSA, two
+ * copies of the same definition that are live at the same time hold the same
+ * bits, so they can share a register even though their live ranges overlap
+ * (Boissinot et al., "Revisiting Out-of-SSA Translation").  This matters for
+ * a block feeding the same value to phis in several successors.
+ */
+void SSADestructor::number_copies() {
+  auto nvalues = m_ssa.m_values.size();
+  std::vector<SSAValue*> src(nvalues, nullptr);
+  auto note = [&](const Op& op) {
+    if (op.def &&
+        (op.is_copy() ||
+         (!m_ssa.is_removed(op.insn) && is_move(op.insn->opcode())))) {
+      src[op.def->id] = op.uses[0];
+    }
+  };
+  for (auto& op : m_entry_copies) {
+    note(op);
+  }
+  for (auto& bops : m_blocks) {
+    for (auto& op : bops.ops) {
+      note(op);
+    }
+  }
+  m_copy_of.assign(nvalues, kNone);
+  std::vector<size_t> chain;
+  for (size_t i = 0; i < nvalues; ++i) {
+    auto v = i;
+    while (m_copy_of[v] == kNone && src[v] != nullptr) {
+      chain.push_back(v);
+      v = src[v]->id;
+    }
+    auto root = m_copy_of[v] == kNone ? v : m_copy_of[v];
+    m_copy_of[v] = root;
+    for (auto c : chain) {
+      m_copy_of[c] = root;
+    }
+    chain.clear();
+  }
+}
+
+void SSADestructor::add_interference(SSAValue* def, const BitVector& live) {
+  auto value = m_copy_of[def->id];
+  live.for_each([&](size_t v) {
+    if (m_copy_of[v] != value) {
+      m_interference[def->id].push_back(v);
+      m_interference[v].push_back(def->id);
+    }
+  });
+}
+
+/*
+ * Walk block `b` backwards, turning the values live out of it into the
+ * values live into it.  Records interferences along the way if asked to.
+ */
+void SSADestructor::live_through(size_t b, BitVector& live, bool interfere) {
+  auto& bops = m_blocks[b];
+  for (auto v : bops.normal_uses) {
+    live.set(v->id);
+  }
+  if (bops.throw_index == kNone) {
+    for (auto v : bops.catch_uses) {
+      live.set(v->id);
+    }
+  }
+  for (size_t i = bops.ops.size(); i-- > 0;) {
+    auto& op = bops.ops[i];
+    if (op.def) {
+      if (interfere) {
+        add_interference(op.def, live);
+      }
+      live.reset(op.def->id);
+    }
+    if (i == bops.throw_index) {
+      for (auto v : bops.catch_uses) {
+        live.set(v->id);
+      }
+    }
+    for (auto v : op.uses) {
+      if (v->kind != SSAValue::UNDEF) {
+        live.set(v->id);
+      }
+    }
+  }
+  for (auto v : bops.phi_defs) {
+    if (interfere) {
+      add_interference(v, live);
+    }
+  }
+  for (auto v : bops.phi_defs) {
+    live.reset(v->id);
+  }
+}
+
+void SSADestructor::compute_interference() {
+  auto nvalues = m_ssa.m_values.size();
+  auto liveness = run_dataflow(
+      m_cfg,
+      DataflowDirection::BACKWARD,
+      BitVector(nvalues),
+      [&](Block* b, const BitVector& out, BitVector& in) {
+        if (!m_doms.is_reachable(b)) {
+          return;
+        }
+        in = out;
+        live_through(b->id(), in, false);
+      },
+      [](const BitVector& from, BitVector& into) { into |= from; });
+
+  m_interference.resize(nvalues);
+  for (auto b : m_doms.reverse_postorder()) {
+    auto live = liveness.out[b->id()];
+    live_through(b->id(), live, true);
+  }
+
+  // The method entry: parameters are defined, then the entry block's phis
+  // get their operands.
+  auto live = liveness.in[0];
+  for (auto v : m_entry_uses) {
+    live.set(v->id);
+  }
+  for (size_t i = m_entry_copies.size(); i-- > 0;) {
+    auto& op = m_entry_copies[i];
+    add_interference(op.def, live);
+    live.reset(op.def->id);
+    live.set(op.uses[0]->id);
+  }
+  for (auto v : m_ssa.m_params) {
+    add_interference(v, live);
+  }
+
+  for (auto& adj : m_interference) {
+    std::sort(adj.begin(), adj.end());
+    adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+  }
+}
+
+bool SSADestructor::classes_interfere(size_t a, size_t b) {
+  if (m_members[a].size() > m_members[b].size()) {
+    std::swap(a, b);
+  }
+  for (auto v : m_members[a]) {
+    for (auto n : m_interference[v]) {
+      if (find(n) == b) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Coalesce copies whose ends don't interfere, those in inner loops first.
+ * Classes holding different parameters are never merged, since parameters
+ * have fixed registers.
+ */
+void SSADestructor::coalesce() {
+  auto& loops = m_transform->loops();
+  std::vector<std::pair<size_t, Op*>> copies;
+  for (auto& op : m_entry_copies) {
+    copies.emplace_back(0, &op);
+  }
+  for (auto b : m_doms.reverse_postorder()) {
+    for (auto& op : m_blocks[b->id()].ops) {
+      if (op.is_copy()) {
+        copies.emplace_back(loops.depth(b), &op);
+      }
+    }
+  }
+  std::stable_sort(copies.begin(), copies.end(),
+                   [](const std::pair<size_t, Op*>& a,
+                      const std::pair<size_t, Op*>& b) {
+                     return a.first > b.first;
+                   });
+
+  std::vector<int> param_reg(m_parent.size(), -1);
+  for (auto v : m_ssa.m_params) {
+    param_reg[find(v->id)] = v->reg;
+  }
+  for (auto& copy : copies) {
+    auto a = find(copy.second->def->id);
+    auto b = find(copy.second->uses[0]->id);
+    if (a == b) {
+      continue;
+    }
+    if (param_reg[a] >= 0 && param_reg[b] >= 0 &&
+        param_reg[a] != param_reg[b]) {
+      continue;
+    }
+    if (classes_interfere(a, b)) {
+      continue;
+    }
+    auto pin = std::max(param_reg[a], param_reg[b]);
+    unite(a, b);
+    param_reg[find(a)] = pin;
+  }
+}
+
+/*
+ * Give each class a register: parameters keep theirs, other classes get the
+ * original register of one of their values if no interfering class took it
+ * already, and a fresh register otherwise.
+ */
+void SSADestructor::assign_registers() {
+  auto& values = m_ssa.m_values;
+  m_reg.assign(values.size(), -1);
+  for (auto v : m_ssa.m_params) {
+    m_reg[find(v->id)] = v->reg;
+  }
+  std::vector<size_t> taken_stamp;
+  for (auto v : values) {
+    auto root = find(v->id);
+    if (m_reg[root] >= 0) {
+      continue;
+    }
+    if (v->kind == SSAValue::UNDEF) {
+      m_reg[root] = v->reg;
+      continue;
+    }
+    auto nregs = m_ssa.m_nregs + m_nfresh;
+    taken_stamp.resize(nregs + 1, kNone);
+    for (auto m : m_members[root]) {
+      for (auto n : m_interference[m]) {
+        auto r = m_reg[find(n)];
+        if (r >= 0) {
+          taken_stamp[r] = root;
+        }
+      }
+    }
+    for (auto m : m_members[root]) {
+      auto r = values[m]->reg;
+      if (taken_stamp[r] != root) {
+        m_reg[root] = r;
+        break;
+      }
+    }
+    for (int r = m_ssa.m_nregs; m_reg[root] < 0 && r < nregs; ++r) {
+      if (taken_stamp[r] != root) {
+        m_reg[root] = r;
+      }
+    }
+    if (m_reg[root] < 0) {
+      m_reg[root] = m_ssa.m_nregs + m_nfresh++;
+    }
+  }
+  for (auto v : values) {
+    for (auto n : m_interference[v->id]) {
+      always_assert_log(m_reg[find(v->id)] != m_reg[find(n)],
+                        "v%lu and v%u interfere but share a register",
+                        v->id,
+                        n);
+    }
+  }
+}
+
+/*
+ * Fresh registers go after the original locals, pushing the parameters up.
+ */
+uint16_t SSADestructor::final_reg(SSAValue* v) {
+  auto r = m_reg[find(v->id)];
+  auto nregs = m_ssa.m_nregs;
+  auto locals = nregs - m_ssa.m_method->get_code()->get_ins_size();
+  if (r >= nregs) {
+    return locals + (r - nregs);
+  }
+  return r >= locals ? r + m_nfresh : r;
+}
+
+bool SSADestructor::fits() {
+  for (auto b : m_doms.reverse_postorder()) {
+    for (auto& op : m_blocks[b->id()].ops) {
+      if (op.is_copy() || m_ssa.is_removed(op.insn)) {
+        continue;
+      }
+      if (op.def && (final_reg(op.def) >> op.insn->dest_bit_width()) != 0) {
+        return false;
+      }
+      for (size_t i = 0; i < op.uses.size(); ++i) {
+        if ((final_reg(op.uses[i]) >> op.insn->src_bit_width(i)) != 0) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void SSADestructor::rewrite() {
+  auto code = m_ssa.m_method->get_code();
+  auto nregs = m_ssa.m_nregs;
+  uint32_t locals = nregs - code->get_ins_size();
+  std::vector<Op*> copies;
+  for (auto& op : m_entry_copies) {
+    copies.push_back(&op);
+  }
+  for (auto b : m_cfg) {
+    for (auto& op : m_blocks[b->id()].ops) {
+      if (op.is_copy()) {
+        copies.push_back(&op);
+      } else if (!m_ssa.is_removed(op.insn)) {
+        if (op.def) {
+          op.insn->set_dest(final_reg(op.def));
+        }
+        // Source 0 of the two-address forms is the destination.
+        size_t first_src = op.insn->dest_is_src() ? 1 : 0;
+        for (size_t i = first_src; i < op.uses.size(); ++i) {
+          op.insn->set_src(i, final_reg(op.uses[i]));
+        }
+      }
+    }
+  }
+  if (m_nfresh > 0) {
+    for (auto& mie : *m_transform) {
+      if (mie.type != MFLOW_DEBUG) {
+        continue;
+      }
+      switch (mie.dbgop->opcode()) {
+      case DBG_START_LOCAL:
+      case DBG_START_LOCAL_EXTENDED:
+      case DBG_END_LOCAL:
+      case DBG_RESTART_LOCAL:
+        if (mie.dbgop->uvalue() >= locals) {
+          mie.dbgop->set_uvalue(mie.dbgop->uvalue() + m_nfresh);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  // Every position was computed up front; inserting never invalidates them.
+  size_t materialized = 0;
+  for (auto op : copies) {
+    auto dest = final_reg(op->def);
+    auto src = final_reg(op->uses[0]);
+    if (dest == src) {
+      continue;
+    }
+    auto move = new DexInstruction(op->def->is_object ? OPCODE_MOVE_OBJECT_16
+                                                      : OPCODE_MOVE_16);
+    move->set_dest(dest);
+    move->set_src(0, src);
+    m_transform->insert_before(op->where, move);
+    ++materialized;
+  }
+  for (auto insn : m_ssa.m_removed) {
+    m_transform->remove_opcode(insn);
+  }
+  TRACE(SSA, 3, "%s: %lu copies, %u fresh registers, %lu removed\n",
+        SHOW(m_ssa.m_method), materialized, m_nfresh,
+        m_ssa.m_removed.size());
+  if (m_nfresh > 0) {
+    code->set_registers_size(nregs + m_nfresh);
+    allocate_registers(m_ssa.m_method);
+  }
+}
+
+bool SSADestructor::run() {
+  build_ops();
+  number_copies();
+  compute_interference();
+  coalesce();
+  assign_registers();
+  if (!fits()) {
+    TRACE(SSA, 2, "Registers of %s don't fit after SSA\n",
+          SHOW(m_ssa.m_method));
+    return false;
+  }
+  rewrite();
+  return true;
+}
+
+bool SSAForm::destruct() {
+  always_assert(!m_destructed);
+  m_destructed = true;
+  return SSADestructor(*this).run();
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SpanTrace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+struct Span {
+  const char* name;
+  uint64_t start;
+  uint64_t end;
+};
+
+/*
+ * One thread's spans.  Only the owning thread writes; the count is
+ * published with release so flush() sees whole spans.
+ */
+struct ThreadSpans {
+  uint32_t tid;
+  char name[32];
+  std::atomic<uint64_t> count{0};
+  Span spans[SpanTrace::kSpansPerThread];
+};
+
+const auto s_epoch = std::chrono::steady_clock::now();
+
+std::mutex s_lock;
+// Never freed: worker threads outlive everything, and their spans are
+// written after main() returns.
+std::vector<ThreadSpans*> s_threads;
+std::unordered_set<std::string> s_names;
+bool s_flushed = false;
+
+thread_local ThreadSpans* t_spans = nullptr;
+
+ThreadSpans* thread_spans() {
+  if (t_spans == nullptr) {
+    auto spans = new ThreadSpans;
+    std::lock_guard<std::mutex> g(s_lock);
+    spans->tid = s_threads.size();
+    snprintf(spans->name, sizeof(spans->name), "thread %u", spans->tid);
+    s_threads.push_back(spans);
+    t_spans = spans;
+  }
+  return t_spans;
+}
+
+void write_string(FILE* out, const char* s) {
+  fputc('"', out);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', out);
+      fputc(*s, out);
+    } else if (static_cast<unsigned char>(*s) < 0x20) {
+      fprintf(out, "\\u%04x", static_cast<unsigned char>(*s));
+    } else {
+      fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+void write_trace(FILE* out) {
+  auto pid = 1;
+  const char* sep = "\n";
+  fprintf(out, "{\"traceEvents\":[");
+  for (auto thread : s_threads) {
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%u,\"args\":{\"name\":", sep, pid, thread->tid);
+    write_string(out, thread->name);
+    fprintf(out, "}}");
+    sep = ",\n";
+    uint64_t count = thread->count.load(std::memory_order_acquire);
+    uint64_t first = count > SpanTrace::kSpansPerThread
+      ? count - SpanTrace::kSpansPerThread : 0;
+    for (uint64_t i = first; i < count; i++) {
+      auto& span = thread->spans[i % SpanTrace::kSpansPerThread];
+      fprintf(out, "%s{\"name\":", sep);
+      write_string(out, span.name);
+      fprintf(out, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+              "\"ts\":%lu,\"dur\":%lu}",
+              pid, thread->tid, (unsigned long)span.start,
+              (unsigned long)(span.end - span.start));
+    }
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+struct Flusher {
+  ~Flusher() { SpanTrace::flush(); }
+};
+
+Flusher s_flusher;
+
+}
+
+std::atomic<bool> SpanTrace::s_enabled{getenv("SPANTRACE") != nullptr};
+constexpr size_t SpanTrace::kSpansPerThread;
+
+uint64_t SpanTrace::now() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now() - s_epoch).count();
+}
+
+void SpanTrace::record(const char* name, uint64_t start, uint64_t end) {
+  auto spans = thread_spans();
+  auto count = spans->count.load(std::memory_order_relaxed);
+  spans->spans[count % kSpansPerThread] = Span{name, start, end};
+  spans->count.store(count + 1, std::memory_order_release);
+}
+
+const char* SpanTrace::intern(const std::string& name) {
+  std::lock_guard<std::mutex> g(s_lock);
+  return s_names.insert(name).first->c_str();
+}
+
+void SpanTrace::set_thread_name(const char* name) {
+  if (!enabled()) {
+    return;
+  }
+  auto spans = thread_spans();
+  std::lock_guard<std::mutex> g(s_lock);
+  snprintf(spans->name, sizeof(spans->name), "%s", name);
+}
+
+void SpanTrace::flush() {
+  std::lock_guard<std::mutex> g(s_lock);
+  if (!enabled() || s_flushed) {
+    return;
+  }
+  s_enabled.store(false, std::memory_order_relaxed);
+  s_flushed = true;
+  auto path = getenv("SPANTRACE");
+  FILE* out = fopen(path, "w");
+  if (out == nullptr) {
+    perror("Error writing span trace");
+    return;
+  }
+  write_trace(out);
+  fclose(out);
+}
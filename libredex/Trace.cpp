@@ -14,12 +14,37 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include <unistd.h>
 
 namespace {
 
+const char* module_names[] = {
+#define TM(x) #x,
+  TMS
+#undef TM
+};
+
+// Lines a thread buffers before writing them out.
+constexpr size_t kFlushBytes = 64 * 1024;
+
+/*
+ * One thread's pending output.  Only whole lines are written, each prefixed
+ * with the thread and module, so threads don't interleave mid-line.  The
+ * lock is only contended while flush_trace() drains the buffer.
+ */
+struct ThreadBuffer {
+  std::mutex lock;
+  std::string text;
+  unsigned tid;
+  bool at_line_start{true};
+};
+
 struct Tracer {
   Tracer() {
     const char* traceenv = getenv("TRACE");
@@ -32,21 +57,136 @@ struct Tracer {
   }
 
   ~Tracer() {
-    if (m_file) {
+    flush();
+    if (m_file && m_file != stderr) {
       fclose(m_file);
     }
+    m_file = nullptr;
   }
 
   bool traceEnabled(TraceModule module, int level) {
     return level <= m_level || level <= m_traces[module];
   }
 
-  void trace(const char* fmt, va_list ap) {
-    vfprintf(m_file, fmt, ap);
-    fflush(m_file);
+  void trace(TraceModule module, const char* fmt, va_list ap) {
+    if (!m_file) {
+      return;
+    }
+    char small[512];
+    va_list ap2;
+    va_copy(ap2, ap);
+    int len = vsnprintf(small, sizeof(small), fmt, ap);
+    std::string large;
+    const char* text = small;
+    if (len >= int(sizeof(small))) {
+      large.resize(len + 1);
+      vsnprintf(&large[0], len + 1, fmt, ap2);
+      text = large.c_str();
+    }
+    va_end(ap2);
+    if (len <= 0) {
+      return;
+    }
+
+    auto buf = thread_buffer();
+    std::lock_guard<std::mutex> g(buf->lock);
+    append(buf, module, text);
+    if (buf->at_line_start && buf->text.size() >= kFlushBytes) {
+      write(buf);
+    }
+  }
+
+  void flush() {
+    if (!m_file) {
+      return;
+    }
+    std::vector<ThreadBuffer*> buffers;
+    {
+      std::lock_guard<std::mutex> g(m_buffers_lock);
+      buffers = m_buffers;
+    }
+    for (auto buf : buffers) {
+      std::lock_guard<std::mutex> g(buf->lock);
+      write(buf);
+    }
+  }
+
+  void flush_on_crash() {
+    if (!m_file) {
+      return;
+    }
+    std::unique_lock<std::mutex> buffers(m_buffers_lock, std::try_to_lock);
+    std::unique_lock<std::mutex> file(m_file_lock, std::try_to_lock);
+    if (!buffers || !file) {
+      return;
+    }
+    // Straight to the descriptor: stdio may be what crashed.  write()
+    // fflushes after each batch, so nothing is left in the FILE.
+    int fd = fileno(m_file);
+    for (auto buf : m_buffers) {
+      std::unique_lock<std::mutex> g(buf->lock, std::try_to_lock);
+      if (!g) {
+        continue;
+      }
+      const char* p = buf->text.data();
+      size_t left = buf->text.size();
+      while (left > 0) {
+        auto n = ::write(fd, p, left);
+        if (n <= 0) {
+          break;
+        }
+        p += n;
+        left -= n;
+      }
+      buf->text.clear();
+    }
   }
 
  private:
+  ThreadBuffer* thread_buffer() {
+    static thread_local ThreadBuffer* t_buffer = nullptr;
+    if (t_buffer == nullptr) {
+      // Never freed: worker threads live as long as the process.
+      auto buf = new ThreadBuffer();
+      buf->text.reserve(kFlushBytes);
+      std::lock_guard<std::mutex> g(m_buffers_lock);
+      buf->tid = m_buffers.size();
+      m_buffers.push_back(buf);
+      t_buffer = buf;
+    }
+    return t_buffer;
+  }
+
+  static void append(ThreadBuffer* buf, TraceModule module, const char* text) {
+    while (*text != '\0') {
+      if (buf->at_line_start) {
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "[%u:%s] ", buf->tid,
+                 module_names[module]);
+        buf->text += prefix;
+        buf->at_line_start = false;
+      }
+      auto eol = strchr(text, '\n');
+      if (eol == nullptr) {
+        buf->text += text;
+        return;
+      }
+      buf->text.append(text, eol + 1);
+      buf->at_line_start = true;
+      text = eol + 1;
+    }
+  }
+
+  void write(ThreadBuffer* buf) {
+    if (buf->text.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> g(m_file_lock);
+    fwrite(buf->text.data(), 1, buf->text.size(), m_file);
+    fflush(m_file);
+    buf->text.clear();
+  }
+
   void init_trace_modules(const char* traceenv) {
     std::unordered_map<std::string, int> module_id_map;
 #define TM(x) module_id_map[ #x ] = x;
@@ -91,6 +231,9 @@ struct Tracer {
   FILE* m_file{nullptr};
   int m_level{0};
   std::array<int, N_TRACE_MODULES> m_traces;
+  std::mutex m_file_lock;
+  std::mutex m_buffers_lock;
+  std::vector<ThreadBuffer*> m_buffers;
 };
 
 static Tracer tracer;
@@ -100,9 +243,17 @@ bool traceEnabled(TraceModule module, int level) {
   return tracer.traceEnabled(module, level);
 }
 
-void trace(const char* fmt, ...) {
+void trace(TraceModule module, const char* fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
-  tracer.trace(fmt, ap);
+  tracer.trace(module, fmt, ap);
   va_end(ap);
 }
+
+void flush_trace() {
+  tracer.flush();
+}
+
+void flush_trace_on_crash() {
+  tracer.flush_on_crash();
+}
@@ -15,12 +15,17 @@
 #include "DexClass.h"
 #include "DexDebugInstruction.h"
 #include "DexInstruction.h"
+#include "Dominators.h"
+#include "ReferenceIndex.h"
+#include "SpanTrace.h"
 #include "WorkQueue.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::mutex MethodTransform::s_lock;
-MethodTransform::FatMethodCache MethodTransform::s_cache;
+constexpr size_t MethodTransform::kCacheShards;
+MethodTransform::CacheShard MethodTransform::s_cache[kCacheShards];
+std::atomic<size_t> MethodTransform::s_balloons{0};
+std::atomic<size_t> MethodTransform::s_syncs{0};
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -51,33 +56,44 @@ std::vector<Block*>&& PostOrderSort::get() {
 MethodTransform::~MethodTransform() {
   m_fmethod->clear_and_dispose(FatMethodDisposer());
   delete m_fmethod;
-  for (auto block : m_blocks) {
-    delete block;
-  }
+  clear_cfg();
 }
 
 MethodTransform* MethodTransform::get_method_transform(
     DexMethod* method,
     bool want_cfg /* = false */
 ) {
+  auto& shard = cache_shard(method);
+  MethodTransform* mt = nullptr;
   {
-    std::lock_guard<std::mutex> g(s_lock);
-    auto it = s_cache.find(method);
-    if (it != s_cache.end()) {
-      MethodTransform* mt = it->second;
-      return mt;
+    std::unique_lock<std::mutex> lock(shard.lock);
+    while (true) {
+      auto it = shard.cache.find(method);
+      if (it == shard.cache.end()) {
+        // Claim it, so that no other thread balloons it meanwhile.
+        shard.cache.emplace(method, nullptr);
+        break;
+      }
+      if (it->second != nullptr) {
+        mt = it->second;
+        break;
+      }
+      shard.ballooned.wait(lock);
     }
   }
-  FatMethod* fm = balloon(method);
-  MethodTransform* mt = new MethodTransform(method, fm);
-  if (want_cfg) {
-    mt->build_cfg();
+  if (mt == nullptr) {
+    FatMethod* fm = balloon(method);
+    mt = new MethodTransform(method, fm);
+    {
+      std::lock_guard<std::mutex> g(shard.lock);
+      shard.cache[method] = mt;
+    }
+    shard.ballooned.notify_all();
   }
-  {
-    std::lock_guard<std::mutex> g(s_lock);
-    s_cache[method] = mt;
-    return mt;
+  if (want_cfg) {
+    mt->cfg();
   }
+  return mt;
 }
 
 MethodTransform* MethodTransform::get_new_method(DexMethod* method) {
@@ -362,6 +378,7 @@ FatMethod* MethodTransform::balloon(DexMethod* method) {
     return nullptr;
   }
   TRACE(MTRANS, 2, "Ballooning %s\n", SHOW(method));
+  s_balloons.fetch_add(1, std::memory_order_relaxed);
   auto opcodes = code->get_instructions();
   addr_mei_t addr_to_mei;
 
@@ -389,8 +406,23 @@ void MethodTransform::replace_opcode(DexInstruction* from, DexInstruction* to) {
   for (auto miter = m_fmethod->begin(); miter != m_fmethod->end(); miter++) {
     MethodItemEntry* mentry = &*miter;
     if (mentry->type == MFLOW_OPCODE && mentry->insn == from) {
+      // Branches always end their block, but which edges leave it depends
+      // on the kind of branch, so any branch in or out means relinking.
+      bool reshape = m_cfg_valid &&
+                     (is_branch(from->opcode()) || is_branch(to->opcode()) ||
+                      may_throw(from->opcode()) != may_throw(to->opcode()) ||
+                      is_return(from->opcode()) != is_return(to->opcode()) ||
+                      (from->opcode() == OPCODE_THROW) !=
+                          (to->opcode() == OPCODE_THROW));
       mentry->insn = to;
+      if (auto index = ReferenceIndex::current()) {
+        index->remove(m_method, from);
+        index->add(m_method, to);
+      }
       delete from;
+      if (reshape) {
+        update_cfg_at(miter);
+      }
       return;
     }
   }
@@ -417,9 +449,17 @@ void MethodTransform::insert_after(DexInstruction* position,
         (position == nullptr || mei.insn == position)) {
       auto insertat = m_fmethod->iterator_to(mei);
       if (position != nullptr) insertat++;
+      std::vector<FatMethod::iterator> inserted;
+      auto index = ReferenceIndex::current();
       for (auto opcode : opcodes) {
         MethodItemEntry* mentry = new MethodItemEntry(opcode);
-        m_fmethod->insert(insertat, *mentry);
+        inserted.push_back(m_fmethod->insert(insertat, *mentry));
+        if (index) {
+          index->add(m_method, opcode);
+        }
+      }
+      if (m_cfg_valid && !inserted.empty()) {
+        update_cfg_after_insert(inserted);
       }
       return;
     }
@@ -427,11 +467,66 @@ void MethodTransform::insert_after(DexInstruction* position,
   always_assert_log(false, "No match found");
 }
 
+FatMethod::iterator MethodTransform::insert_before(FatMethod::iterator position,
+                                                  DexInstruction* insn) {
+  auto it = m_fmethod->insert(position, *new MethodItemEntry(insn));
+  if (auto index = ReferenceIndex::current()) {
+    index->add(m_method, insn);
+  }
+  if (m_cfg_valid) {
+    std::vector<FatMethod::iterator> inserted{it};
+    update_cfg_after_insert(inserted);
+  }
+  return it;
+}
+
+FatMethod::iterator MethodTransform::erase(FatMethod::iterator it) {
+  invalidate_cfg();
+  auto index = ReferenceIndex::current();
+  if (index && it->type == MFLOW_OPCODE) {
+    index->remove(m_method, it->insn);
+  }
+  return m_fmethod->erase(it);
+}
+
 void MethodTransform::remove_opcode(DexInstruction* insn) {
-  for (auto const& mei : *m_fmethod) {
-    if (mei.type == MFLOW_OPCODE && mei.insn == insn) {
-      m_fmethod->erase(m_fmethod->iterator_to(mei));
+  for (auto it = m_fmethod->begin(); it != m_fmethod->end(); ++it) {
+    if (it->type == MFLOW_OPCODE && it->insn == insn) {
+      if (auto index = ReferenceIndex::current()) {
+        index->remove(m_method, insn);
+      }
+      if (!m_cfg_valid) {
+        m_fmethod->erase(it);
+        delete insn;
+        return;
+      }
+      auto b = containing_block(it);
+      auto next = std::next(it);
+      bool was_last = true;
+      for (auto later = next; later != b->end(); ++later) {
+        if (later->type == MFLOW_OPCODE) {
+          was_last = false;
+          break;
+        }
+      }
+      // Only b can start at the item, and only the block before it end there.
+      if (b->m_begin == it) {
+        b->m_begin = next;
+        if (b->id() > 0) {
+          m_blocks[b->id() - 1]->m_end = next;
+        }
+      }
+      m_block_of.erase(&*it);
+      m_fmethod->erase(it);
       delete insn;
+      if (b->begin() == b->end()) {
+        remove_empty_block(b);
+      } else if (was_last) {
+        // The block's terminator went away, so its out-edges may change
+        // (e.g. it no longer throws into a catch handler).
+        relink_block(b);
+        merge_with_next(b);
+      }
       return;
     }
   }
@@ -733,6 +828,8 @@ void MethodTransform::inline_tail_call(DexMethod* caller,
   MethodTransformer tcallee(callee);
   auto fcaller = tcaller->m_fmethod;
   auto fcallee = tcallee->m_fmethod;
+  tcaller->invalidate_cfg();
+  tcallee->invalidate_cfg();
 
   auto bregs = caller->get_code()->get_registers_size();
   auto eregs = callee->get_code()->get_registers_size();
@@ -771,6 +868,10 @@ void MethodTransform::inline_tail_call(DexMethod* caller,
   }
 
   caller->get_code()->set_outs_size(callee->get_code()->get_outs_size());
+  if (auto index = ReferenceIndex::current()) {
+    index->update_method(caller, tcaller.operator->());
+    index->update_method(callee, tcallee.operator->());
+  }
 }
 
 bool MethodTransform::inline_16regs(InlineContext& context,
@@ -783,6 +884,7 @@ bool MethodTransform::inline_16regs(InlineContext& context,
   MethodTransformer mtcallee(callee);
   auto fcaller = mtcaller->m_fmethod;
   auto fcallee = mtcallee->m_fmethod;
+  mtcaller->invalidate_cfg();
 
   auto callee_code = callee->get_code();
   auto temps_needed =
@@ -855,6 +957,9 @@ bool MethodTransform::inline_16regs(InlineContext& context,
   caller->get_code()->set_outs_size(
       std::max(callee->get_code()->get_outs_size(),
       caller->get_code()->get_outs_size()));
+  if (auto index = ReferenceIndex::current()) {
+    index->update_method(caller, mtcaller.operator->());
+  }
   return true;
 }
 
@@ -878,6 +983,38 @@ bool end_of_block(const FatMethod* fm, FatMethod::iterator it, bool in_try) {
   }
   return false;
 }
+
+/*
+ * Return the try item covering `it`, or nullptr if it's outside any try
+ * region.  Matches the in_try tracking done by build_cfg.
+ */
+DexTryItem* enclosing_try(FatMethod* fm, FatMethod::iterator it) {
+  while (true) {
+    if (it->type == MFLOW_TRY) {
+      if (it->tentry->type == TRY_START) {
+        return it->tentry->tentry;
+      } else if (it->tentry->type == TRY_END) {
+        return nullptr;
+      }
+    }
+    if (it == fm->begin()) {
+      return nullptr;
+    }
+    --it;
+  }
+}
+
+void add_edge(Block* p, Block* s) {
+  p->succs().push_back(s);
+  s->preds().push_back(p);
+}
+
+void remove_all_edges(Block* p, Block* s) {
+  auto& succs = p->succs();
+  succs.erase(std::remove(succs.begin(), succs.end(), s), succs.end());
+  auto& preds = s->preds();
+  preds.erase(std::remove(preds.begin(), preds.end(), p), preds.end());
+}
 }
 
 bool ends_with_may_throw(Block* p) {
@@ -890,6 +1027,22 @@ bool ends_with_may_throw(Block* p) {
   return true;
 }
 
+MethodItemEntry* throwing_insn(Block* b) {
+  bool catches = false;
+  for (auto s : b->succs()) {
+    catches = catches || is_catch(s);
+  }
+  if (!catches) {
+    return nullptr;
+  }
+  for (auto it = b->rbegin(); it != b->rend(); ++it) {
+    if (it->type == MFLOW_OPCODE) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
 void MethodTransform::build_cfg() {
   // Find the block boundaries
   std::unordered_map<MethodItemEntry*, std::vector<Block*>> branch_to_targets;
@@ -1005,14 +1158,288 @@ void MethodTransform::build_cfg() {
       --bid;
     }
   }
+  for (auto b : m_blocks) {
+    assign_block(b, b->begin(), b->end());
+  }
+  m_cfg_valid = true;
   TRACE(CFG, 5, "%s\n", show(m_method).c_str());
   TRACE(CFG, 5, "%s", show(m_blocks).c_str());
 }
 
+void MethodTransform::clear_cfg() {
+  clear_cfg_analyses();
+  for (auto block : m_blocks) {
+    delete block;
+  }
+  m_blocks.clear();
+  m_block_of.clear();
+  m_cfg_valid = false;
+}
+
+void MethodTransform::clear_cfg_analyses() {
+  delete m_loops;
+  delete m_dominators;
+  delete m_post_dominators;
+  m_loops = nullptr;
+  m_dominators = nullptr;
+  m_post_dominators = nullptr;
+}
+
+std::vector<Block*>& MethodTransform::cfg() {
+  if (!m_cfg_valid) {
+    clear_cfg();
+    build_cfg();
+  }
+  return m_blocks;
+}
+
+const DominatorTree& MethodTransform::dominators() {
+  cfg();
+  if (m_dominators == nullptr) {
+    m_dominators = new DominatorTree(m_blocks);
+  }
+  return *m_dominators;
+}
+
+const DominatorTree& MethodTransform::post_dominators() {
+  cfg();
+  if (m_post_dominators == nullptr) {
+    m_post_dominators = new DominatorTree(m_blocks, true /* post */);
+  }
+  return *m_post_dominators;
+}
+
+const LoopInfo& MethodTransform::loops() {
+  auto& doms = dominators();
+  if (m_loops == nullptr) {
+    m_loops = new LoopInfo(m_blocks, doms);
+  }
+  return *m_loops;
+}
+
+Block* MethodTransform::containing_block(FatMethod::iterator it) {
+  auto b = m_block_of.find(&*it);
+  always_assert_log(b != m_block_of.end(),
+                    "Item not covered by the CFG of %s",
+                    show_short(m_method).c_str());
+  return b->second;
+}
+
+void MethodTransform::assign_block(Block* b,
+                                   FatMethod::iterator begin,
+                                   FatMethod::iterator end) {
+  for (auto it = begin; it != end; ++it) {
+    m_block_of[&*it] = b;
+  }
+}
+
+bool MethodTransform::ends_block(FatMethod::iterator it) {
+  if (it->type != MFLOW_OPCODE) {
+    return false;
+  }
+  auto op = it->insn->opcode();
+  if (is_branch(op)) {
+    return true;
+  }
+  return may_throw(op) && enclosing_try(m_fmethod, it) != nullptr;
+}
+
+void MethodTransform::renumber_blocks() {
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    m_blocks[i]->m_id = i;
+  }
+}
+
+/*
+ * Recompute the out-edges of `b` from its last item, the same way build_cfg
+ * does it for the whole method.
+ */
+void MethodTransform::relink_block(Block* b) {
+  clear_cfg_analyses();
+  auto succs = b->m_succs; // copy
+  for (auto s : succs) {
+    remove_all_edges(b, s);
+  }
+  auto lastmei = b->rbegin();
+  bool fallthrough = true;
+  if (lastmei->type == MFLOW_OPCODE) {
+    auto lastop = lastmei->insn->opcode();
+    if (is_goto(lastop) || is_conditional_branch(lastop) ||
+        is_multi_branch(lastop)) {
+      fallthrough = !is_goto(lastop);
+      for (auto target : m_blocks) {
+        auto first = target->begin();
+        if (first->type == MFLOW_TARGET && first->target->src == &*lastmei) {
+          add_edge(b, target);
+        }
+      }
+    } else if (is_return(lastop) || lastop == OPCODE_THROW) {
+      fallthrough = false;
+    }
+  }
+  if (fallthrough && b->id() + 1 < m_blocks.size()) {
+    add_edge(b, m_blocks[b->id() + 1]);
+  }
+  auto tryitem = enclosing_try(m_fmethod, b->begin());
+  if (tryitem != nullptr && ends_with_may_throw(b)) {
+    for (auto catchblock : m_blocks) {
+      auto first = catchblock->begin();
+      if (first->type == MFLOW_TRY && first->tentry->type == TRY_CATCH &&
+          first->tentry->tentry == tryitem) {
+        add_edge(b, catchblock);
+      }
+    }
+  }
+}
+
+/*
+ * Split `b` so that a new block starts at `at`.  Like build_cfg, the new
+ * block is headed by a fallthrough entry when it would otherwise start with
+ * an opcode.
+ */
+void MethodTransform::split_block(Block* b, FatMethod::iterator at) {
+  if (at->type == MFLOW_OPCODE) {
+    insert_fallthrough(m_fmethod, &*at);
+    at = std::prev(at);
+  }
+  auto next_block = new Block(0);
+  next_block->m_begin = at;
+  next_block->m_end = b->m_end;
+  b->m_end = at;
+  assign_block(next_block, next_block->m_begin, next_block->m_end);
+  m_blocks.insert(m_blocks.begin() + b->id() + 1, next_block);
+  renumber_blocks();
+  relink_block(next_block);
+  relink_block(b);
+}
+
+/*
+ * Fold the block following `b` into `b` if nothing but a fallthrough
+ * separates them any more.
+ */
+void MethodTransform::merge_with_next(Block* b) {
+  if (b->id() + 1 >= m_blocks.size()) {
+    return;
+  }
+  auto next = m_blocks[b->id() + 1];
+  if (b->m_succs.size() != 1 || b->m_succs[0] != next ||
+      next->m_preds.size() != 1 || next->begin() == next->end() ||
+      next->begin()->type != MFLOW_FALLTHROUGH) {
+    return;
+  }
+  clear_cfg_analyses();
+  remove_all_edges(b, next);
+  auto succs = next->m_succs; // copy
+  for (auto s : succs) {
+    remove_all_edges(next, s);
+    add_edge(b, s);
+  }
+  assign_block(b, next->m_begin, next->m_end);
+  b->m_end = next->m_end;
+  m_blocks.erase(m_blocks.begin() + next->id());
+  delete next;
+  renumber_blocks();
+}
+
+/*
+ * Drop a block that no longer covers any items, routing its predecessors
+ * straight to its successors.
+ */
+void MethodTransform::remove_empty_block(Block* b) {
+  clear_cfg_analyses();
+  auto preds = b->m_preds; // copy
+  auto succs = b->m_succs; // copy
+  for (auto p : preds) {
+    remove_all_edges(p, b);
+  }
+  for (auto s : succs) {
+    remove_all_edges(b, s);
+  }
+  for (auto p : preds) {
+    for (auto s : succs) {
+      if (s != b) add_edge(p, s);
+    }
+  }
+  m_blocks.erase(m_blocks.begin() + b->id());
+  delete b;
+  renumber_blocks();
+}
+
+/*
+ * Repair the CFG after the opcode at `it` was inserted or replaced: split
+ * its block if it now ends one, and recompute the block's edges if it's the
+ * block's last instruction.
+ */
+void MethodTransform::update_cfg_at(FatMethod::iterator it) {
+  auto b = containing_block(it);
+  auto next = std::next(it);
+  if (next != b->end() && ends_block(it)) {
+    split_block(b, next);
+    return;
+  }
+  for (auto later = next; later != b->end(); ++later) {
+    if (later->type == MFLOW_OPCODE) {
+      return;
+    }
+  }
+  relink_block(b);
+  merge_with_next(b);
+}
+
+/*
+ * Repair the CFG after the contiguous opcodes `inserted` were added to the
+ * FatMethod.  They belong to the block of whatever precedes them, so that
+ * block may have to be split in front of them (if it used to end with a
+ * branch or throwing instruction) as well as after any of them that ends a
+ * block.
+ */
+void MethodTransform::update_cfg_after_insert(
+    const std::vector<FatMethod::iterator>& inserted) {
+  auto first = inserted.front();
+  auto after = std::next(inserted.back());
+  auto entry = m_blocks.front();
+  if (entry->m_begin == after) {
+    // Inserting at the head lands in front of the entry block's first item;
+    // pull the block boundary back to cover the new instructions.  If the
+    // entry block can be branched to, the new instructions must not be part
+    // of the loop, so they get a block of their own.
+    entry->m_begin = first;
+    assign_block(entry, first, after);
+    if (after->type == MFLOW_TARGET || after->type == MFLOW_TRY) {
+      auto preds = entry->m_preds; // copy
+      split_block(entry, after);
+      for (auto p : preds) {
+        relink_block(p);
+      }
+    }
+  } else {
+    auto b = containing_block(std::prev(first));
+    assign_block(b, first, after);
+    for (auto it = first; it != b->begin();) {
+      --it;
+      if (it->type == MFLOW_OPCODE) {
+        if (ends_block(it)) {
+          update_cfg_at(it);
+        }
+        break;
+      }
+    }
+  }
+  for (auto it : inserted) {
+    if (ends_block(it)) {
+      update_cfg_at(it);
+    }
+  }
+  update_cfg_at(inserted.back());
+}
+
 void MethodTransform::sync_all() {
+  ScopedSpan span("MethodTransform::sync_all");
   std::vector<MethodTransform*> transforms;
-  for (auto& centry : s_cache) {
-    transforms.push_back(centry.second);
+  for (auto& shard : s_cache) {
+    for (auto& centry : shard.cache) {
+      transforms.push_back(centry.second);
+    }
   }
   std::vector<WorkItem<MethodTransform>> workitems(transforms.size());
   auto mt_sync = [](MethodTransform* mt) { mt->sync(); };
@@ -1026,9 +1453,11 @@ void MethodTransform::sync_all() {
 void MethodTransform::sync() {
   while (try_sync() == false)
     ;
+  s_syncs.fetch_add(1, std::memory_order_relaxed);
   {
-    std::lock_guard<std::mutex> g(s_lock);
-    s_cache.erase(m_method);
+    auto& shard = cache_shard(m_method);
+    std::lock_guard<std::mutex> g(shard.lock);
+    shard.cache.erase(m_method);
   }
   delete this;
 }
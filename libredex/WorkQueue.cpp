@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 
+#include "SpanTrace.h"
 #include "Trace.h"
 
 /*
@@ -66,16 +67,30 @@ bool WorkQueue::steal_work(per_thread* self) {
 
 void* WorkQueue::worker_thread(void* priv) {
   per_thread* self = (per_thread*)priv;
+  char name[16];
+  snprintf(name, sizeof(name), "worker %d", self->thread_num);
+  SpanTrace::set_thread_name(name);
+  // When the current batch started, for the span trace.
+  bool busy = false;
+  uint64_t busy_since = 0;
   while (1) {
     pthread_mutex_lock(&self->lock);
     if (self->next < self->last) {
       work_item* todo = &self->wi[self->next++];
       pthread_mutex_unlock(&self->lock);
+      if (!busy && SpanTrace::enabled()) {
+        busy = true;
+        busy_since = SpanTrace::now();
+      }
       todo->function(todo->arg);
       continue;
     }
     pthread_mutex_unlock(&self->lock);
     if (steal_work(self)) continue;
+    if (busy) {
+      SpanTrace::record("WorkQueue batch", busy_since, SpanTrace::now());
+      busy = false;
+    }
     /* Nothing to do..., wait for it. */
     pthread_mutex_lock(&s_lock);
     s_threads_complete++;
@@ -113,6 +128,7 @@ WorkQueue::WorkQueue() {
 
 /* Caller owns memory for witems.  WorkQueue does not free it. */
 void WorkQueue::run_work_items(work_item* witems, int count) {
+  ScopedSpan span("WorkQueue::run_work_items");
   pthread_mutex_lock(&s_work_running);
   pthread_mutex_lock(&s_lock);
   while (s_threads_complete < WORKER_THREADS)
@@ -138,4 +154,7 @@ void WorkQueue::run_work_items(work_item* witems, int count) {
   }
   pthread_mutex_unlock(&s_lock);
   pthread_mutex_unlock(&s_work_running);
+  // The workers are idle, so this is a good point to get their traces out
+  // in order with the caller's.
+  flush_trace();
 }
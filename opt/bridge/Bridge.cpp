@@ -25,6 +25,7 @@
 #include "DexOutput.h"
 #include "DexUtil.h"
 #include "PassManager.h"
+#include "Resolver.h"
 #include "Trace.h"
 #include "Transform.h"
 #include "walkers.h"
@@ -296,6 +297,7 @@ class BridgeRemover {
       auto cls = type_class(bridgee->get_class());
       cls->get_dmethods().remove(bridgee);
     }
+    invalidate_resolve_cache();
   }
 
  public:
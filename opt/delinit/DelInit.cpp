@@ -132,6 +132,7 @@ int DeadRefs::find_new_unreachable(Scope& scope) {
         SHOW(init->get_name()), SHOW(init->get_proto()));
     init_deleted++;
   }
+  invalidate_resolve_cache();
   TRACE(DELINIT, 2, "Removed %d <init> methods\n", init_deleted);
   TRACE(DELINIT, 3, "%d <init> methods called\n", init_called);
   TRACE(DELINIT, 3, "%d <init> methods do not delete\n", init_cant_delete);
@@ -314,6 +315,7 @@ int DeadRefs::remove_unreachable() {
         SHOW(meth->get_class()), SHOW(meth->get_name()),
         SHOW(meth->get_proto()));
   }
+  invalidate_resolve_cache();
   del_init_res.deleted_dmeths += dmethodcnt;
   TRACE(DELINIT, 2, "Removed %d dmethods\n", dmethodcnt);
   TRACE(DELINIT, 3, "%d called dmethods\n", called_dmeths);
@@ -21,6 +21,7 @@
 #include "DexInstruction.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
 
 
 namespace {
@@ -278,6 +279,7 @@ public:
         TRACE(SUPER, 5, "Deleted trivial return invoke-super: %s\n",
           SHOW(meth));
       }
+      invalidate_resolve_cache();
     }
     print_stats(do_delete);
   }
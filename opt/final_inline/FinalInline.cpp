@@ -15,12 +15,15 @@
 #include <unordered_set>
 #include <vector>
 
+#include "AnalysisManager.h"
+#include "ClassHierarchy.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
+#include "ReferenceIndex.h"
 #include "Resolver.h"
 #include "Transform.h"
 #include "walkers.h"
@@ -80,14 +83,20 @@ std::unordered_set<DexField*> keep_class_members(const folly::dynamic& config) {
   return keep;
 }
 
-std::unordered_set<DexField*> get_called_field_defs(Scope& scope) {
+std::unordered_set<DexField*> get_anno_field_defs(Scope& scope) {
   std::vector<DexField*> field_refs;
-  walk_methods(scope,
-               [&](DexMethod* method) { method->gather_fields(field_refs); });
+  walk_methods(scope, [&](DexMethod* method) {
+    if (method->get_anno_set()) {
+      method->get_anno_set()->gather_fields(field_refs);
+    }
+    auto param_anno = method->get_param_anno();
+    if (param_anno) {
+      for (auto pair : *param_anno) {
+        pair.second->gather_fields(field_refs);
+      }
+    }
+  });
   sort_unique(field_refs);
-  /* Okay, now we have a complete list of field refs
-   * for this particular dex.  Map to the def actually invoked.
-   */
   std::unordered_set<DexField*> field_defs;
   for (auto field_ref : field_refs) {
     auto field_def = resolve_field(field_ref);
@@ -97,12 +106,41 @@ std::unordered_set<DexField*> get_called_field_defs(Scope& scope) {
   return field_defs;
 }
 
+/*
+ * Code can only reach a field through a ref on its class or a subclass,
+ * so look those refs up in the index rather than walking every opcode.
+ */
+bool is_referenced_by_code(DexField* field,
+                           const ReferenceIndex& index,
+                           const ClassHierarchy& hierarchy) {
+  auto referenced = [&](const DexType* container) {
+    auto ref = DexField::get_field(const_cast<DexType*>(container),
+                                   field->get_name(),
+                                   field->get_type());
+    return ref != nullptr && !index.sites(ref).empty() &&
+           resolve_field(ref) == field;
+  };
+  if (referenced(field->get_class())) {
+    return true;
+  }
+  for (auto sub : hierarchy.subclasses(field->get_class())) {
+    if (referenced(sub)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 std::unordered_set<DexField*> get_field_target(
-    Scope& scope, const std::vector<DexField*>& fields) {
-  std::unordered_set<DexField*> field_defs = get_called_field_defs(scope);
+    Scope& scope,
+    const ReferenceIndex& index,
+    const ClassHierarchy& hierarchy,
+    const std::vector<DexField*>& fields) {
+  std::unordered_set<DexField*> field_defs = get_anno_field_defs(scope);
   std::unordered_set<DexField*> ftarget;
   for (auto field : fields) {
-    if (field_defs.count(field) > 0) {
+    if (field_defs.count(field) > 0 ||
+        is_referenced_by_code(field, index, hierarchy)) {
       ftarget.insert(field);
     }
   }
@@ -130,6 +168,8 @@ bool is_kept_member(DexField* sfield,
 }
 
 void remove_unused_fields(Scope& scope,
+                          const ReferenceIndex& index,
+                          const ClassHierarchy& hierarchy,
                           const std::unordered_set<DexType*>& keep_annos,
                           const std::unordered_set<DexField*>& keep_members) {
   std::vector<DexField*> moveable_fields;
@@ -154,7 +194,7 @@ void remove_unused_fields(Scope& scope,
   sort_unique(smallscope);
 
   std::unordered_set<DexField*> field_target =
-      get_field_target(scope, moveable_fields);
+      get_field_target(scope, index, hierarchy, moveable_fields);
   std::unordered_set<DexField*> dead_fields;
   for (auto field : moveable_fields) {
     if (field_target.count(field) == 0) {
@@ -177,6 +217,7 @@ void remove_unused_fields(Scope& scope,
       }
     }
   }
+  invalidate_resolve_cache();
 }
 
 static bool validate_sget(DexMethod* context, DexOpcodeField* opfield) {
@@ -340,5 +381,9 @@ void FinalInlinePass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
   auto keep_members = keep_class_members(m_config);
   auto scope = build_class_scope(dexen);
   inline_field_values(scope);
-  remove_unused_fields(scope, keep_annos, keep_members);
+  remove_unused_fields(scope,
+                       analyses().reference_index(),
+                       *analyses().class_hierarchy(),
+                       keep_annos,
+                       keep_members);
 }
@@ -9,17 +9,22 @@
 
 #include "LocalDce.h"
 
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <array>
 #include <unordered_set>
 #include <vector>
 
-#include <boost/dynamic_bitset.hpp>
-
+#include "AnalysisManager.h"
+#include "Dataflow.h"
 #include "DexClass.h"
 #include "DexInstruction.h"
 #include "DexUtil.h"
+#include "MethodCache.h"
+#include "Purity.h"
 #include "Transform.h"
+#include "WorkQueue.h"
 #include "walkers.h"
 
 namespace {
@@ -96,37 +101,68 @@ static bool has_side_effects(DexOpcode opc) {
   not_reached();
 }
 
-/*
- * Pure methods have no observable side effects, so they can be removed if
- * their outputs are not used.
- *
- * TODO: Derive this list with static analysis rather than hard-coding it.
- */
-std::unordered_set<DexMethod*> init_pure_methods() {
-  std::unordered_set<DexMethod*> pure_methods;
-  pure_methods.emplace(DexMethod::make_method(
-      "Ljava/lang/Class;", "getSimpleName", "Ljava/lang/String;", {}));
-  return pure_methods;
-}
+////////////////////////////////////////////////////////////////////////////////
 
-bool is_pure(DexMethod* method) {
-  static std::unordered_set<DexMethod*> pure_methods = init_pure_methods();
-  return pure_methods.find(method) != pure_methods.end();
-}
+using Clock = std::chrono::steady_clock;
 
-template <typename... T>
-std::string show(const boost::dynamic_bitset<T...>& bits) {
-  std::string ret;
-  to_string(bits, ret);
-  return ret;
+double usecs(Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() /
+         1000.0;
 }
 
-////////////////////////////////////////////////////////////////////////////////
+/*
+ * Counters for one method, or summed over many.  Each method gets its own,
+ * so the threads never write to shared state.
+ */
+struct DceStats {
+  size_t instructions_eliminated{0};
+  size_t liveness_visits{0};
+  double cfg_usecs{0};
+  double liveness_usecs{0};
+  double deletion_usecs{0};
+
+  DceStats& operator+=(const DceStats& that) {
+    instructions_eliminated += that.instructions_eliminated;
+    liveness_visits += that.liveness_visits;
+    cfg_usecs += that.cfg_usecs;
+    liveness_usecs += that.liveness_usecs;
+    deletion_usecs += that.deletion_usecs;
+    return *this;
+  }
+};
 
 class LocalDce {
  private:
   const Scope& m_scope;
-  size_t m_instructions_eliminated{0};
+  const PurityAnalysis& m_purity;
+  MethodCache& m_cache;
+  DceStats m_stats;
+  double m_wall_usecs{0};
+
+  struct MethodDce {
+    DexMethod* method;
+    const PurityAnalysis* purity;
+    MethodCache* cache;
+    DceStats stats;
+    std::string key;
+    bool cached;
+  };
+
+  /*
+   * What dce() asks of the purity analysis for this method: whether each
+   * call in it is impure.
+   */
+  static std::string purity_deps(const MethodDce& md) {
+    std::string deps;
+    for (auto insn : md.method->get_code()->get_instructions()) {
+      if (is_invoke(insn->opcode())) {
+        auto impure =
+          md.purity->invoke_purity(md.method, insn) == Purity::IMPURE;
+        deps += impure ? '1' : '0';
+      }
+    }
+    return deps;
+  }
 
   /*
    * Eliminate dead code using a standard backward dataflow analysis for
@@ -142,10 +178,10 @@ class LocalDce {
    *   An instruction's input registers are live if (a) it has side effects, or
    *   (b) its output registers are live.
    *
-   * - If the liveness of any block changes during a pass, repeat it.  Since
-   *   anything live in one pass is guaranteed to be live in the next, this is
-   *   guaranteed to reach a fixed point and terminate.  Visiting blocks in
-   *   postorder guarantees a minimum number of passes.
+   * - Whenever a block's input state changes, revisit its predecessors (see
+   *   run_dataflow).  Since anything live in one visit is guaranteed to be
+   *   live in the next, this is guaranteed to reach a fixed point and
+   *   terminate.
    *
    * - Catch blocks are handled slightly differently; since any instruction
    *   inside a `try` region can jump to a catch block, we assume that any
@@ -153,87 +189,89 @@ class LocalDce {
    *   the `try` region.  (This is actually conservative, since only
    *   potentially-excepting instructions can jump to a catch.)
    */
-  void dce(DexMethod* method) {
+  static void dce(MethodDce* md) {
+    auto method = md->method;
+    auto& stats = md->stats;
+    if (md->cache->enabled()) {
+      md->key = md->cache->key(method, purity_deps(*md));
+      std::vector<uint64_t> counters;
+      md->cached = md->cache->restore(method, md->key, &counters);
+      if (md->cached) {
+        // Only the outcome is counted; the liveness work wasn't done.
+        if (counters.size() == 1) {
+          stats.instructions_eliminated = counters[0];
+        }
+        return;
+      }
+    }
+    auto start = Clock::now();
     auto transform =
         MethodTransform::get_method_transform(method, true /* want_cfg */);
     auto& cfg = transform->cfg();
     auto blocks = PostOrderSort(cfg).get();
     auto regs = method->get_code()->get_registers_size();
-    std::vector<boost::dynamic_bitset<>> liveness(
-        cfg.size(), boost::dynamic_bitset<>(regs + 1));
-    bool changed;
-    std::vector<DexInstruction*> dead_instructions;
+    auto cfg_done = Clock::now();
+    stats.cfg_usecs = usecs(cfg_done - start);
 
     TRACE(DCE, 5, "%s\n", show(method).c_str());
     TRACE(DCE, 5, "%s", show(cfg).c_str());
 
     // Iterate liveness analysis to a fixed point.
-    do {
-      changed = false;
-      dead_instructions.clear();
-      for (auto& b : blocks) {
-        auto prev_liveness = liveness.at(b->id());
-        auto& bliveness = liveness.at(b->id());
-        bliveness.reset();
-        TRACE(DCE, 5, "B%lu: %s\n", b->id(), show(bliveness).c_str());
-
-        // Compute live-out for this block from its successors.
-        for (auto& s : b->succs()) {
-          TRACE(DCE,
-                5,
-                "  S%lu: %s\n",
-                s->id(),
-                show(liveness[s->id()]).c_str());
-          bliveness |= liveness[s->id()];
-        }
-
-        // Compute live-in for this block by walking its instruction list in
-        // reverse and applying the liveness rules.
-        for (auto it = b->rbegin(); it != b->rend(); ++it) {
-          if (it->type != MFLOW_OPCODE) {
-            continue;
-          }
-          bool required = is_required(it->insn, bliveness);
-          if (required) {
-            update_liveness(it->insn, bliveness);
-          } else {
-            dead_instructions.push_back(it->insn);
+    auto liveness = run_dataflow(
+        cfg,
+        DataflowDirection::BACKWARD,
+        BitVector(regs + 1),
+        [&](Block* b, const BitVector& liveout, BitVector& livein) {
+          livein = liveout;
+          for (auto it = b->rbegin(); it != b->rend(); ++it) {
+            if (it->type == MFLOW_OPCODE && is_required(*md, it->insn, livein)) {
+              update_liveness(it->insn, livein);
+            }
           }
-          TRACE(CFG,
-                5,
-                "%s\n%s\n",
-                show(it->insn).c_str(),
-                show(bliveness).c_str());
+        },
+        [](const BitVector& from, BitVector& into) { into |= from; });
+    stats.liveness_visits = liveness.visits;
+
+    // Walk each block once more with its converged live-out to find the
+    // instructions whose results are never used.
+    std::vector<DexInstruction*> dead_instructions;
+    for (auto& b : blocks) {
+      auto bliveness = liveness.out[b->id()];
+      TRACE(DCE, 5, "B%lu: %s\n", b->id(), show(bliveness).c_str());
+      for (auto it = b->rbegin(); it != b->rend(); ++it) {
+        if (it->type != MFLOW_OPCODE) {
+          continue;
         }
-        if (bliveness != prev_liveness) {
-          changed = true;
+        bool required = is_required(*md, it->insn, bliveness);
+        if (required) {
+          update_liveness(it->insn, bliveness);
+        } else {
+          dead_instructions.push_back(it->insn);
         }
+        TRACE(CFG,
+              5,
+              "%s\n%s\n",
+              show(it->insn).c_str(),
+              show(bliveness).c_str());
       }
-    } while (changed);
+    }
+
+    auto liveness_done = Clock::now();
+    stats.liveness_usecs = usecs(liveness_done - cfg_done);
 
     // Remove dead instructions.
     TRACE(DCE, 2, "%s\n", show(method).c_str());
     for (auto dead : dead_instructions) {
       TRACE(DCE, 2, "DEAD: %s\n", show(dead).c_str());
       transform->remove_opcode(dead);
-      m_instructions_eliminated++;
+      stats.instructions_eliminated++;
     }
 
-    remove_unreachable_blocks(method, transform, cfg);
+    remove_unreachable_blocks(transform);
+    stats.deletion_usecs = usecs(Clock::now() - liveness_done);
   }
 
-  void remove_edge(Block* p, Block* s) {
-    p->succs().erase(std::remove_if(p->succs().begin(),
-                                    p->succs().end(),
-                                    [&](Block* b) { return b == s; }),
-                     p->succs().end());
-    s->preds().erase(std::remove_if(s->preds().begin(),
-                                    s->preds().end(),
-                                    [&](Block* b) { return b == p; }),
-                     s->preds().end());
-  }
-
-  bool can_delete(Block* b) {
+  static bool can_delete(Block* b) {
     auto first = b->begin();
     if (first == b->end()) {
       return false;
@@ -258,13 +296,16 @@ class LocalDce {
     return false;
   }
 
-  void remove_block(MethodTransform* transform, Block* b) {
+  /*
+   * Gather the instructions and try items of an unreachable block.  The
+   * block itself isn't touched, since removing instructions reshapes the CFG.
+   */
+  static void collect_block(Block* b,
+                     std::unordered_set<DexInstruction*>& delete_ops,
+                     std::unordered_set<DexTryItem*>& delete_tries) {
     if (!can_delete(b)) {
       return;
     }
-    // Gather the ops to delete.
-    std::unordered_set<DexInstruction*> delete_ops;
-    std::unordered_set<DexTryItem*> delete_tries;
     for (auto& mei : *b) {
       if (mei.type == MFLOW_OPCODE) {
         delete_ops.insert(mei.insn);
@@ -272,7 +313,41 @@ class LocalDce {
         delete_tries.insert(mei.tentry->tentry);
       }
     }
-    // Remove branch targets.
+  }
+
+  /*
+   * Remove blocks that can't be reached from the method entry.  The transform
+   * already dropped the edges to catch blocks whose throwing instructions we
+   * deleted, so a plain reachability walk over the CFG finds them.
+   */
+  static void remove_unreachable_blocks(MethodTransform* transform) {
+    auto& blocks = transform->cfg();
+    std::vector<bool> reachable(blocks.size());
+    std::vector<Block*> worklist{blocks[0]};
+    reachable[blocks[0]->id()] = true;
+    while (worklist.size() > 0) {
+      auto b = worklist.back();
+      worklist.pop_back();
+      for (auto& s : b->succs()) {
+        if (!reachable[s->id()]) {
+          reachable[s->id()] = true;
+          worklist.push_back(s);
+        }
+      }
+    }
+    std::unordered_set<DexInstruction*> delete_ops;
+    std::unordered_set<DexTryItem*> delete_tries;
+    for (auto& b : blocks) {
+      if (!reachable[b->id()]) {
+        collect_block(b, delete_ops, delete_tries);
+      }
+    }
+    if (delete_ops.empty() && delete_tries.empty()) {
+      return;
+    }
+    // Remove branch targets.  This edits the FatMethod directly, so the CFG
+    // has to be rebuilt by whoever needs it next.
+    transform->invalidate_cfg();
     for (auto it = transform->begin(); it != transform->end(); ++it) {
       if (it->type == MFLOW_TARGET && delete_ops.count(it->target->src->insn)) {
         delete it->target;
@@ -293,62 +368,20 @@ class LocalDce {
     }
   }
 
-  void remove_unreachable_blocks(DexMethod* method,
-                                 MethodTransform* transform,
-                                 std::vector<Block*>& blocks) {
-    // Remove edges to catch blocks that no longer exist.
-    std::vector<std::pair<Block*, Block*>> remove_edges;
-    for (auto& b : blocks) {
-      if (!is_catch(b)) {
-        continue;
-      }
-      for (auto& p : b->preds()) {
-        if (!ends_with_may_throw(p)) {
-          // We removed whatever instruction could throw to this catch.
-          remove_edges.emplace_back(p, b);
-        }
-      }
-    }
-    for (auto& e : remove_edges) {
-      remove_edge(e.first, e.second);
-    }
-    // Iteratively remove blocks with no incoming edges.  Skip the first block
-    // since it's the method entry point.
-    std::vector<Block*> unreachables;
-    for (size_t i = 1; i < blocks.size(); ++i) {
-      if (blocks[i]->preds().size() == 0) {
-        unreachables.push_back(blocks[i]);
-      }
-    }
-    while (unreachables.size() > 0) {
-      remove_edges.clear();
-      auto& b = unreachables.back();
-      auto succs = b->succs(); // copy
-      for (auto& s : succs) {
-        remove_edges.emplace_back(b, s);
-      }
-      for (auto& p : remove_edges) {
-        remove_edge(p.first, p.second);
-      }
-      remove_block(transform, b);
-      unreachables.pop_back();
-      for (auto& s : succs) {
-        if (s->preds().size() == 0) {
-          unreachables.push_back(s);
-        }
-      }
-    }
-  }
-
   /*
    * An instruction is required (i.e., live) if it has side effects or if its
-   * destination register is live.
+   * destination register is live.  Calls to side-effect-free methods are
+   * only required if their result is used, except for constructors: the
+   * verifier won't let an object be used before its <init> runs.
    */
-  bool is_required(DexInstruction* inst, const boost::dynamic_bitset<>& bliveness) {
+  static bool is_required(const MethodDce& md,
+                          DexInstruction* inst,
+                          const BitVector& bliveness) {
     if (has_side_effects(inst->opcode())) {
       if (is_invoke(inst->opcode())) {
         auto invoke = static_cast<DexOpcodeMethod*>(inst);
-        if (!is_pure(invoke->get_method())) {
+        if (is_init(invoke->get_method()) ||
+            md.purity->invoke_purity(md.method, inst) == Purity::IMPURE) {
           return true;
         }
         return bliveness.test(bliveness.size() - 1);
@@ -367,8 +400,7 @@ class LocalDce {
   /*
    * Update the liveness vector given that `inst` is live.
    */
-  void update_liveness(const DexInstruction* inst,
-                       boost::dynamic_bitset<>& bliveness) {
+  static void update_liveness(const DexInstruction* inst, BitVector& bliveness) {
     // The destination register is killed, so it isn't live before this.
     if (inst->dests_size()) {
       bliveness.reset(inst->dest());
@@ -397,19 +429,63 @@ class LocalDce {
   }
 
  public:
-  LocalDce(const Scope& scope) : m_scope(scope) {}
+  LocalDce(const Scope& scope,
+           const PurityAnalysis& purity,
+           MethodCache& cache)
+    : m_scope(scope), m_purity(purity), m_cache(cache) {}
 
   void run() {
+    auto start = Clock::now();
+    std::vector<MethodDce> methods;
     walk_methods(m_scope,
                  [&](DexMethod* m) {
                    if (!m->get_code()) {
                      return;
                    }
-                   dce(m);
+                   methods.push_back(MethodDce{
+                       m, &m_purity, &m_cache, DceStats(), "", false});
                  });
+    if (!methods.empty()) {
+      std::vector<WorkItem<MethodDce>> workitems(methods.size());
+      for (size_t i = 0; i < methods.size(); i++) {
+        workitems[i].init(dce, &methods[i]);
+      }
+      WorkQueue wq;
+      wq.run_work_items(&workitems[0], workitems.size());
+    }
+    for (auto& md : methods) {
+      m_stats += md.stats;
+    }
+    if (m_cache.enabled()) {
+      MethodTransform::sync_all();
+      for (auto& md : methods) {
+        if (!md.cached) {
+          m_cache.save(md.method, md.key, {md.stats.instructions_eliminated});
+        }
+      }
+      m_cache.write();
+      TRACE(DCE, 1, "Method cache: %lu hits, %lu misses\n",
+            m_cache.hits(), m_cache.misses());
+    }
+    m_wall_usecs = usecs(Clock::now() - start);
     TRACE(DCE, 1,
             "Dead instructions eliminated: %lu\n",
-            m_instructions_eliminated);
+            m_stats.instructions_eliminated);
+    TRACE(DCE, 2, "Liveness block visits: %lu\n", m_stats.liveness_visits);
+  }
+
+  /*
+   * Where the time went, summed over all threads, so the three add up to
+   * about the number of threads times the wall time.
+   */
+  void print_timing(FILE* out) const {
+    fprintf(out,
+            "LocalDce: %.1lfms wall; cfg %.1lfms, liveness %.1lfms, "
+            "deletion %.1lfms\n",
+            m_wall_usecs / 1000,
+            m_stats.cfg_usecs / 1000,
+            m_stats.liveness_usecs / 1000,
+            m_stats.deletion_usecs / 1000);
   }
 };
 }
@@ -417,6 +493,15 @@ class LocalDce {
 ////////////////////////////////////////////////////////////////////////////////
 
 void LocalDcePass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
-  auto scope = build_class_scope(dexen);
-  LocalDce(scope).run();
+  MethodCache cache(cfg.get_build_cache_dir(), run_name(), m_config);
+  LocalDce dce(analyses().scope(), analyses().purity(), cache);
+  dce.run();
+  if (m_config.isObject() && m_config.getDefault("print_timing", 0).asInt()) {
+    dce.print_timing(stderr);
+  }
+}
+
+uint32_t LocalDcePass::preserved_analyses() const {
+  return AnalysisManager::SCOPE | AnalysisManager::CLASS_HIERARCHY |
+    AnalysisManager::REFERENCE_INDEX | AnalysisManager::PURITY;
 }
@@ -11,10 +11,12 @@
 
 #include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "DexClass.h"
 #include "DexInstruction.h"
+#include "MethodCache.h"
 #include "PassManager.h"
 #include "Transform.h"
 #include "DexUtil.h"
@@ -193,6 +195,55 @@ class PeepholeOptimizer {
     apply_peepholes(transform);
   }
 
+  /*
+   * What the check-cast pattern asks of the class hierarchy for this
+   * method: whether each type a call returns is a kind of each type it
+   * checks casts to.
+   */
+  static std::string check_cast_deps(DexMethod* method) {
+    std::vector<DexType*> rtypes;
+    std::vector<DexType*> cast_types;
+    std::unordered_set<DexType*> seen;
+    for (auto insn : method->get_code()->get_instructions()) {
+      DexType* type;
+      if (is_invoke(insn->opcode())) {
+        auto callee = static_cast<DexOpcodeMethod*>(insn)->get_method();
+        type = callee->get_proto()->get_rtype();
+        if (seen.insert(type).second) {
+          rtypes.push_back(type);
+        }
+      } else if (insn->opcode() == OPCODE_CHECK_CAST) {
+        type = static_cast<DexOpcodeType*>(insn)->get_type();
+        if (seen.insert(type).second) {
+          cast_types.push_back(type);
+        }
+      }
+    }
+    std::string deps;
+    for (auto cast_type : cast_types) {
+      for (auto rtype : rtypes) {
+        deps += check_cast(rtype, cast_type) ? '1' : '0';
+      }
+    }
+    return deps;
+  }
+
+  /* The stats, in the order MethodCache keeps them for each method. */
+  std::vector<uint64_t> counters() const {
+    return {uint64_t(m_stats_simple_name),
+            uint64_t(m_stats_check_casts_removed),
+            uint64_t(m_stats_check_casts_super_removed)};
+  }
+
+  void add_counters(const std::vector<uint64_t>& counters) {
+    if (counters.size() != 3) {
+      return;
+    }
+    m_stats_simple_name += counters[0];
+    m_stats_check_casts_removed += counters[1];
+    m_stats_check_casts_super_removed += counters[2];
+  }
+
   void print_stats() {
     TRACE(PEEPHOLE, 1,
             "%d SimpleClassName instances removed \n", m_stats_simple_name);
@@ -211,13 +262,45 @@ class PeepholeOptimizer {
         m_stats_check_casts_super_removed(0),
         m_stats_simple_name(0) {}
 
-  void run() {
+  void run(MethodCache& cache) {
+    struct Missed {
+      DexMethod* method;
+      std::string key;
+      std::vector<uint64_t> counters;
+    };
+    std::vector<Missed> missed;
     walk_methods(m_scope,
                  [&](DexMethod* m) {
-                   if (m->get_code()) {
+                   if (!m->get_code()) {
+                     return;
+                   }
+                   if (!cache.enabled()) {
                      peephole(m);
+                     return;
                    }
+                   auto key = cache.key(m, check_cast_deps(m));
+                   std::vector<uint64_t> cached;
+                   if (cache.restore(m, key, &cached)) {
+                     add_counters(cached);
+                     return;
+                   }
+                   auto before = counters();
+                   peephole(m);
+                   auto after = counters();
+                   for (size_t i = 0; i < after.size(); i++) {
+                     after[i] -= before[i];
+                   }
+                   missed.push_back(Missed{m, key, after});
                  });
+    if (cache.enabled()) {
+      MethodTransform::sync_all();
+      for (auto& mk : missed) {
+        cache.save(mk.method, mk.key, mk.counters);
+      }
+      cache.write();
+      TRACE(PEEPHOLE, 1, "Method cache: %lu hits, %lu misses\n",
+            cache.hits(), cache.misses());
+    }
     print_stats();
   }
 };
@@ -227,5 +310,10 @@ class PeepholeOptimizer {
 
 void PeepholePass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
   auto scope = build_class_scope(dexen);
-  PeepholeOptimizer(scope).run();
+  MethodCache cache(cfg.get_build_cache_dir(), run_name(), m_config);
+  if (cache.enabled()) {
+    // Keys are over synced code.
+    MethodTransform::sync_all();
+  }
+  PeepholeOptimizer(scope).run(cache);
 }
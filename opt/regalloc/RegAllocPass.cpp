@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "RegAllocPass.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DexClass.h"
+#include "MethodCache.h"
+#include "RegAlloc.h"
+#include "Trace.h"
+#include "Transform.h"
+#include "WorkQueue.h"
+#include "walkers.h"
+
+namespace {
+
+const size_t kDefaultMaxInstructions = 20000;
+const size_t kDefaultMaxRegisters = 4096;
+// How many of the slowest methods to report.
+const size_t kSlowestReported = 10;
+
+struct Limits {
+  size_t max_instructions;
+  size_t max_registers;
+  bool coalesce;
+};
+
+/* One method's work item; filled in by whichever thread runs it. */
+struct MethodAlloc {
+  DexMethod* method;
+  const Limits* limits;
+  MethodCache* cache;
+  RegAllocStats stats;
+  double usecs;
+  std::string key;
+  bool cached;
+};
+
+void allocate(MethodAlloc* ma) {
+  using namespace std::chrono;
+  auto& limits = *ma->limits;
+  auto regs = ma->method->get_code()->get_registers_size();
+  ma->stats.regs_before = regs;
+  ma->stats.regs_after = regs;
+  auto start = steady_clock::now();
+  if (ma->cache->enabled()) {
+    // Nothing but the code goes into the allocation.  Only allocated
+    // methods are cached, and the limits are part of the key, so a hit is
+    // within them.
+    ma->key = ma->cache->key(ma->method, "");
+    ma->cached = ma->cache->restore(ma->method, ma->key);
+    if (ma->cached) {
+      ma->stats.skipped = "cached";
+      return;
+    }
+  }
+  // Earlier passes don't sync, so the DexCode's instruction list may be
+  // stale; count the transform's.
+  auto transform = MethodTransform::get_method_transform(ma->method);
+  size_t insns = 0;
+  for (auto& mie : *transform) {
+    if (mie.type == MFLOW_OPCODE) {
+      ++insns;
+    }
+  }
+  if (insns > limits.max_instructions) {
+    ma->stats.skipped = "too many instructions";
+    return;
+  }
+  if (regs > limits.max_registers) {
+    ma->stats.skipped = "too many registers";
+    return;
+  }
+  ma->stats = allocate_registers(ma->method, limits.coalesce);
+  ma->usecs =
+    duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0;
+}
+
+size_t get_limit(const folly::dynamic& config, const char* key, size_t dflt) {
+  if (config.isObject()) {
+    auto it = config.find(key);
+    if (it != config.items().end()) {
+      return it->second.asInt();
+    }
+  }
+  return dflt;
+}
+
+}
+
+void RegAllocPass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
+  Limits limits;
+  limits.max_instructions =
+    get_limit(m_config, "max_instructions", kDefaultMaxInstructions);
+  limits.max_registers =
+    get_limit(m_config, "max_registers", kDefaultMaxRegisters);
+  limits.coalesce = get_limit(m_config, "coalesce", 1) != 0;
+
+  MethodCache cache(cfg.get_build_cache_dir(), run_name(), m_config);
+  if (cache.enabled()) {
+    // Keys are over synced code.
+    MethodTransform::sync_all();
+  }
+  auto& scope = analyses().scope();
+  std::vector<MethodAlloc> allocs;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      allocs.push_back(
+        MethodAlloc{m, &limits, &cache, RegAllocStats(), 0, "", false});
+    }
+  });
+  if (allocs.empty()) {
+    return;
+  }
+  std::vector<WorkItem<MethodAlloc>> workitems(allocs.size());
+  for (size_t i = 0; i < allocs.size(); i++) {
+    workitems[i].init(allocate, &allocs[i]);
+  }
+  auto start = std::chrono::steady_clock::now();
+  WorkQueue wq;
+  wq.run_work_items(&workitems[0], workitems.size());
+  auto wall = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  if (cache.enabled()) {
+    MethodTransform::sync_all();
+    for (auto& ma : allocs) {
+      if (ma.stats.allocated) {
+        cache.save(ma.method, ma.key);
+      }
+    }
+    cache.write();
+    TRACE(REG, 1, "Method cache: %lu hits, %lu misses\n",
+          cache.hits(), cache.misses());
+  }
+
+  size_t allocated = 0;
+  size_t regs_before = 0;
+  size_t regs_after = 0;
+  size_t moves_removed = 0;
+  double total_usecs = 0;
+  std::map<std::string, size_t> skipped;
+  for (auto& ma : allocs) {
+    total_usecs += ma.usecs;
+    if (!ma.stats.allocated) {
+      ++skipped[ma.stats.skipped];
+      continue;
+    }
+    ++allocated;
+    regs_before += ma.stats.regs_before;
+    regs_after += ma.stats.regs_after;
+    moves_removed += ma.stats.moves_removed;
+  }
+  TRACE(REG, 1, "Allocated %lu of %lu methods in %.2lfs (%.2lfs of work)\n",
+        allocated, allocs.size(), wall, total_usecs / 1000000);
+  TRACE(REG, 1, "Registers: %lu -> %lu, %lu moves removed\n",
+        regs_before, regs_after, moves_removed);
+  for (auto& reason : skipped) {
+    TRACE(REG, 1, "Skipped %lu methods: %s\n",
+          reason.second, reason.first.c_str());
+  }
+
+  auto slowest = std::min(kSlowestReported, allocs.size());
+  std::partial_sort(allocs.begin(), allocs.begin() + slowest, allocs.end(),
+                    [](const MethodAlloc& a, const MethodAlloc& b) {
+                      return a.usecs > b.usecs;
+                    });
+  for (size_t i = 0; i < slowest; i++) {
+    TRACE(REG, 2, "%.1lfms: %s\n", allocs[i].usecs / 1000,
+          SHOW(allocs[i].method));
+  }
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include "AnalysisManager.h"
+#include "Pass.h"
+
+/*
+ * Runs allocate_registers() over every method, in parallel.  Methods with
+ * more than "max_instructions" instructions or "max_registers" registers are
+ * left alone, since the interference graph grows with the square of the
+ * register count.  "coalesce": 0 turns move coalescing off.  With a
+ * "build_cache_dir", methods whose code is as in an earlier build get that
+ * build's allocation from the MethodCache.
+ */
+class RegAllocPass : public Pass {
+ public:
+  RegAllocPass()
+    : Pass("RegAllocPass", DoesNotSync{}) {}
+
+  virtual void run_pass(DexClassesVector&, ConfigFiles&) override;
+
+  // Removes self-moves and may swap in cached code, so only what doesn't
+  // point at instructions survives.
+  virtual uint32_t preserved_analyses() const override {
+    return AnalysisManager::SCOPE | AnalysisManager::CLASS_HIERARCHY |
+      AnalysisManager::PURITY;
+  }
+};
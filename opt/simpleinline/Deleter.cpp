@@ -29,9 +29,13 @@ size_t delete_methods(
       });
 
   size_t deleted = 0;
-  for (auto callee : removable) {
-    if (!callee->is_concrete()) continue;
-    if (do_not_strip(callee)) continue;
+  for (auto it = removable.begin(); it != removable.end();) {
+    auto callee = *it;
+    if (!callee->is_concrete() || do_not_strip(callee)) {
+      it = removable.erase(it);
+      continue;
+    }
+    ++it;
     auto cls = type_class(callee->get_class());
     always_assert_log(cls != nullptr,
         "%s is concrete but does not have a DexClass\n",
@@ -44,5 +48,8 @@ size_t delete_methods(
     deleted++;
     TRACE(DELMET, 4, "removing %s\n", SHOW(callee));
   }
+  if (deleted) {
+    invalidate_resolve_cache();
+  }
   return deleted;
 }
@@ -20,6 +20,7 @@
  * the method and the method is not marked as "do not delete".
  * Walks all opcodes in scope to check if the method is called.
  * A resolver must be provided to map a method reference to a method definition.
+ * On return removable holds the methods actually deleted.
  */
 size_t delete_methods(
     std::vector<DexClass*>& scope,
@@ -31,6 +32,7 @@ size_t delete_methods(
  * the method and the method is not marked as "do not delete".
  * Walks all opcodes in scope to check if the method is called.
  * Uses the default resolver to map method references to method definitions.
+ * On return removable holds the methods actually deleted.
  */
 inline size_t delete_methods(
     std::vector<DexClass*>& scope,
@@ -250,6 +250,7 @@ void MultiMethodInliner::inline_callees(
     MethodTransform::inline_16regs(inline_context, callee, mop);
     info.calls_inlined++;
     inlined.insert(callee);
+    changed_callers.insert(caller);
   }
 }
 
@@ -47,6 +47,13 @@ class MultiMethodInliner {
     return inlined;
   }
 
+  /**
+   * Return the methods that had calls inlined into them.
+   */
+  const std::unordered_set<DexMethod*>& get_changed_callers() const {
+    return changed_callers;
+  }
+
  private:
   /**
    * Inline all callees into caller.
@@ -161,6 +168,11 @@ class MultiMethodInliner {
    */
   std::unordered_set<DexMethod*> inlined;
 
+  /**
+   * Methods inlined into.
+   */
+  std::unordered_set<DexMethod*> changed_callers;
+
   //
   // Maps from callee to callers and reverse map from caller to callees.
   // Those are used to perform bottom up inlining.
@@ -8,6 +8,8 @@
  */
 
 #include "SimpleInline.h"
+#include "AnalysisManager.h"
+#include "CallGraph.h"
 #include "InlineHelper.h"
 #include "Deleter.h"
 #include "DexClass.h"
@@ -116,10 +118,10 @@ void SimpleInlinePass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
   auto scope = build_class_scope(dexen);
   // gather all inlinable candidates
   auto methods = gather_non_virtual_methods(scope, no_inline);
-  select_single_called(scope, methods);
+  select_single_called(methods);
 
-  auto resolver = [&](DexMethod* method, MethodSearch search) {
-    return resolve_method(method, search, resolved_refs);
+  auto resolver = [](DexMethod* method, MethodSearch search) {
+    return resolve_method(method, search);
   };
 
   // inline candidates
@@ -129,7 +131,23 @@ void SimpleInlinePass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
   // delete all methods that can be deleted
   auto inlined = inliner.get_inlined();
   size_t inlined_count = inlined.size();
-  size_t deleted = delete_methods(scope, inlined, resolver);
+  auto removed = inlined;
+  size_t deleted = delete_methods(scope, removed, resolver);
+
+  // keep the call graph current, so the passes that follow can share it
+  auto& graph = analyses().call_graph();
+  for (auto caller : inliner.get_changed_callers()) {
+    if (removed.count(caller) == 0) {
+      graph.update_method(caller);
+    }
+  }
+  for (auto callee : inlined) {
+    if (removed.count(callee) > 0) {
+      graph.remove_method(callee);
+    } else {
+      graph.update_method(callee);
+    }
+  }
 
   TRACE(SINL, 3, "recursive %ld\n", inliner.get_info().recursive);
   TRACE(SINL, 3, "invoke range %ld\n", inliner.get_info().invoke_range);
@@ -259,24 +277,13 @@ std::unordered_set<DexMethod*> SimpleInlinePass::gather_non_virtual_methods(
  * Add to the list the single called.
  */
 void SimpleInlinePass::select_single_called(
-    Scope& scope, std::unordered_set<DexMethod*>& methods) {
+    std::unordered_set<DexMethod*>& methods) {
+  // count call sites for each method
+  auto& graph = analyses().call_graph();
   std::unordered_map<DexMethod*, int> calls;
   for (const auto& method : methods) {
-    calls[method] = 0;
+    calls[method] = graph.callers(method).size();
   }
-  // count call sites for each method
-  walk_opcodes(scope, [](DexMethod* meth) { return true; },
-      [&](DexMethod* meth, DexInstruction* insn) {
-        if (is_invoke(insn->opcode())) {
-          auto mop = static_cast<DexOpcodeMethod*>(insn);
-          auto callee = resolve_method(
-              mop->get_method(), opcode_to_search(insn), resolved_refs);
-          if (callee != nullptr && callee->is_concrete()
-              && methods.count(callee) > 0) {
-            calls[callee]++;
-          }
-        }
-      });
 
   // pick methods with a single call site and add to candidates.
   // This vector usage is only because of logging we should remove it
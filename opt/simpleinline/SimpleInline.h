@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include "AnalysisManager.h"
 #include "Pass.h"
 #include "DexClass.h"
 #include "Resolver.h"
@@ -23,11 +24,16 @@ public:
 
   virtual void run_pass(DexClassesVector&, ConfigFiles&) override;
 
+  // Inlines and deletes methods, but keeps the call graph up to date.
+  virtual uint32_t preserved_analyses() const override {
+    return AnalysisManager::SCOPE | AnalysisManager::CLASS_HIERARCHY |
+      AnalysisManager::CALL_GRAPH;
+  }
+
 private:
   std::unordered_set<DexMethod*> gather_non_virtual_methods(
       Scope& scope, const std::unordered_set<DexType*>& no_inline);
-  void select_single_called(
-      Scope& scope, std::unordered_set<DexMethod*>& methods);
+  void select_single_called(std::unordered_set<DexMethod*>& methods);
 
 private:
   // count of instructions that define a method as inlinable always
@@ -38,7 +44,4 @@ private:
 
   // set of inlinable methods
   std::unordered_set<DexMethod*> inlinable;
-
-  // keep a map from refs to defs or nullptr if no method was found
-  MethodRefCache resolved_refs;
 };
@@ -17,6 +17,7 @@
 
 #include "SingleImpl.h"
 #include "SingleImplUtil.h"
+#include "ClassHierarchy.h"
 #include "Debug.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
@@ -127,6 +128,7 @@ void remove_interface(DexType* intf, SingleImplData& data) {
       new_intfs.begin(), new_intfs.end(), std::back_inserter(revisited_intfs));
   revisited_intfs.sort(compare_dextypes);
   cls->set_interfaces(DexTypeList::make_type_list(std::move(revisited_intfs)));
+  ClassHierarchy::invalidate();
   TRACE(INTF, 3, "(REMI)\t=> %s\n", SHOW(cls));
 }
 }
@@ -349,6 +351,7 @@ void OptimizationImpl::rewrite_interface_methods(DexType* intf,
       assert(new_meth->is_virtual());
       impl->get_vmethods().push_back(new_meth);
       impl->get_vmethods().sort(compare_dexmethods);
+      invalidate_resolve_cache();
       TRACE(INTF, 3, "(MITF) moved interface method %s\n", SHOW(new_meth));
     } else {
       TRACE(INTF, 3, "(MITF) found method impl %s\n", SHOW(new_meth));
@@ -16,12 +16,14 @@
 #include <unordered_set>
 #include <vector>
 
+#include "AnalysisManager.h"
 #include "Creators.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "Resolver.h"
 #include "ConfigFiles.h"
 #include "ReachableClasses.h"
+#include "ReferenceIndex.h"
 #include "walkers.h"
 #include "Warning.h"
 
@@ -308,6 +310,7 @@ DexClass* move_statics_out(
     insert_sorted(sink_class->get_dmethods(), meth, compare_dexmethods);
     moved_count++;
   }
+  invalidate_resolve_cache();
 
   TRACE(SINK, 1,
     "cannot move:\n"
@@ -320,28 +323,19 @@ DexClass* move_statics_out(
 }
 
 std::unordered_map<DexMethod*, DexClass*> get_sink_map(
-    const DexClassesVector& dexen,
+    const ReferenceIndex& index,
     const std::vector<DexClass*>& classes,
     const std::vector<DexMethod*>& statics) {
   std::unordered_map<DexMethod*, DexClass*> statics_to_callers;
   std::unordered_set<DexClass*> class_set(classes.begin(), classes.end());
-  std::unordered_set<DexMethod*> static_set(statics.begin(), statics.end());
-  auto scope = build_class_scope(dexen);
-  walk_opcodes(
-    scope,
-    [&](DexMethod* m) {
-      auto cls = type_class(m->get_class());
-      return class_set.count(cls) == 0 && is_public(cls);
-    },
-    [&](DexMethod* m, DexInstruction* insn) {
-      if (insn->has_methods()) {
-        auto callee = static_cast<DexOpcodeMethod*>(insn)->get_method();
-        if (static_set.count(callee)) {
-          statics_to_callers[callee] = type_class(m->get_class());
-        }
+  for (auto callee : statics) {
+    for (auto& site : index.sites(callee)) {
+      auto cls = type_class(site.method->get_class());
+      if (class_set.count(cls) == 0 && is_public(cls)) {
+        statics_to_callers[callee] = cls;
       }
     }
-  );
+  }
   return statics_to_callers;
 }
 
@@ -375,7 +369,8 @@ void StaticSinkPass::run_pass(DexClassesVector& dexen, ConfigFiles& cfg) {
   TRACE(SINK, 1, "statics not used in coldstart: %lu\n", statics.size());
   remove_primary_dex_refs(dexen[0], statics);
   TRACE(SINK, 1, "statics after removing primary dex: %lu\n", statics.size());
-  auto sink_map = get_sink_map(dexen, coldstart_classes, statics);
+  auto sink_map =
+    get_sink_map(analyses().reference_index(), coldstart_classes, statics);
   TRACE(SINK, 1, "statics with sinkable callsite: %lu\n", sink_map.size());
   auto holder = move_statics_out(statics, sink_map);
   TRACE(SINK, 1, "methods in static holder: %lu\n",
@@ -562,6 +562,7 @@ void do_mutations(
   for (auto& meth : meth_deletes) {
     type_class(meth->get_class())->get_dmethods().remove(meth);
   }
+  invalidate_resolve_cache();
 
   // Do method moves. All the moves we're instructed to perform should
   // be valid here; all moves are obeyed.
@@ -595,6 +596,7 @@ void do_mutations(
       s_meth_move_count++;
     }
   }
+  invalidate_resolve_cache();
 
   // Do class deletes
   s_cls_delete_count = cls_deletes.size();
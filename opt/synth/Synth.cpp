@@ -721,6 +721,7 @@ void remove_dead_methods(WrapperMethods& ssms, const SynthConfig& synthConfig) {
     if (is_public(meth)) pub_meth++;
     auto cls = type_class(meth->get_class());
     cls->get_dmethods().remove(meth);
+    invalidate_resolve_cache();
     meth->get_access() & ACC_SYNTHETIC ? synth_removed++ : other_removed++;
   };
 
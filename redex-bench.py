@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import timeit
+
+from collections import OrderedDict
+from os.path import abspath, dirname, isfile, join
+
+timer = timeit.default_timer
+
+PERCENTILES = [50, 90, 99]
+
+
+def find_redex_all(executable_path):
+    if executable_path is None:
+        executable_path = shutil.which('redex-all')
+        if executable_path is None:
+            executable_path = join(dirname(abspath(__file__)), 'redex-all')
+    if not isfile(executable_path) or not os.access(executable_path, os.X_OK):
+        sys.exit('redex-all is not found or is not executable')
+    return executable_path
+
+
+def redex_command(binary, args, out_dir, perf_path):
+    cmd = [binary, '--outdir', out_dir, '-Spass_perf_output=' + perf_path]
+    if args.config:
+        cmd += ['--config', args.config]
+    if args.apkdir:
+        cmd += ['--apkdir', args.apkdir]
+    if args.jarpath:
+        cmd += ['--jarpath', args.jarpath]
+    if args.proguard_config:
+        cmd += ['--proguard-config', args.proguard_config]
+    if args.keep:
+        cmd += ['--seeds', args.keep]
+    cmd += ['-S' + x for x in args.passthru]
+    cmd += ['-J' + x for x in args.passthru_json]
+    return cmd + args.dexes
+
+
+def run_once(binary, args):
+    """
+    Run redex-all once and return what it took: seconds per phase, in
+    pipeline order, with peak RSS and the size of the dexes written.
+    """
+    out_dir = tempfile.mkdtemp('.redex_bench')
+    try:
+        perf_path = join(out_dir, 'redex-pass-perf.json')
+        cmd = redex_command(binary, args, out_dir, perf_path)
+        output = None if args.verbose else subprocess.DEVNULL
+        start = timer()
+        subprocess.check_call(cmd, stdout=output, stderr=output)
+        wall = timer() - start
+        with open(perf_path) as perf_file:
+            perf = json.load(perf_file)
+    finally:
+        shutil.rmtree(out_dir)
+
+    phases = OrderedDict()
+    phases['load'] = perf['load_secs']
+    seen = {}
+    for p in perf['passes']:
+        # A pass may run more than once; number the later runs.
+        seen[p['name']] = seen.get(p['name'], 0) + 1
+        name = p['name']
+        if seen[name] > 1:
+            name += '#' + str(seen[name])
+        phases[name] = p['wall_secs']
+    phases['output'] = perf['output_secs']
+    phases['total'] = wall
+    return {
+        'phases': phases,
+        'peak_rss_kb': perf['peak_rss_kb'],
+        'output_bytes': perf['output_bytes'],
+    }
+
+
+def percentile(values, p):
+    """ The p-th percentile of values, interpolating between ranks. """
+    values = sorted(values)
+    rank = (len(values) - 1) * p / 100.0
+    lo = int(rank)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (rank - lo)
+
+
+def distribution(values):
+    d = OrderedDict()
+    d['min'] = min(values)
+    for p in PERCENTILES:
+        d['p' + str(p)] = percentile(values, p)
+    d['max'] = max(values)
+    d['mean'] = sum(values) / len(values)
+    return d
+
+
+def summarize(runs):
+    phases = OrderedDict()
+    for run in runs:
+        for name, secs in run['phases'].items():
+            phases.setdefault(name, []).append(secs)
+    summary = OrderedDict()
+    summary['runs'] = len(runs)
+    summary['phases'] = OrderedDict(
+        (name, distribution(secs)) for name, secs in phases.items())
+    summary['peak_rss_kb'] = distribution([r['peak_rss_kb'] for r in runs])
+    summary['output_bytes'] = runs[-1]['output_bytes']
+    return summary
+
+
+def print_summary(summary):
+    columns = ['min'] + ['p' + str(p) for p in PERCENTILES] + ['max']
+    print('{:<40}'.format('phase (secs)') +
+          ''.join('{:>10}'.format(c) for c in columns))
+    for name, d in summary['phases'].items():
+        print('{:<40}'.format(name) +
+              ''.join('{:>10.3f}'.format(d[c]) for c in columns))
+    rss = summary['peak_rss_kb']
+    print('peak RSS: {:.1f} MB median, {:.1f} MB max'.format(
+        rss['p50'] / 1024, rss['max'] / 1024))
+    print('output size: {} bytes'.format(summary['output_bytes']))
+
+
+def compare(summary, baseline, threshold, min_secs):
+    """
+    Print how the medians moved since the baseline and return the phases
+    (and memory or size) that grew by more than the threshold.
+    """
+    regressions = []
+
+    def check(what, old, new, slack=0):
+        change = (new - old) / old if old else 0
+        flag = ''
+        if new > old * (1 + threshold) and new - old > slack:
+            regressions.append(what)
+            flag = '  REGRESSION'
+        print('{:<40}{:>12.3f}{:>12.3f}{:>+9.1f}%{}'.format(
+            what, old, new, change * 100, flag))
+
+    print('{:<40}{:>12}{:>12}{:>10}'.format(
+        'median vs. baseline', 'baseline', 'now', 'change'))
+    old_phases = baseline['phases']
+    for name, d in summary['phases'].items():
+        if name in old_phases:
+            check(name, old_phases[name]['p50'], d['p50'], min_secs)
+        else:
+            print('{:<40}{:>12}{:>12.3f}'.format(name, '-', d['p50']))
+    for name in old_phases:
+        if name not in summary['phases']:
+            print('{:<40}{:>12.3f}{:>12}'.format(
+                name, old_phases[name]['p50'], '-'))
+    check('peak RSS (MB)', baseline['peak_rss_kb']['p50'] / 1024,
+          summary['peak_rss_kb']['p50'] / 1024)
+    check('output size (KB)', baseline['output_bytes'] / 1024,
+          summary['output_bytes'] / 1024)
+    return regressions
+
+
+def arg_parser():
+    description = """
+Run redex-all on the given dexes several times and report percentiles of how
+long loading, each pass and writing the output take, along with peak RSS and
+output size.  With --baseline, compare the medians against an earlier
+--save report and exit with status 1 if any grew by more than --threshold.
+"""
+    parser = argparse.ArgumentParser(
+            formatter_class=argparse.RawDescriptionHelpFormatter,
+            description=description)
+
+    parser.add_argument('dexes', nargs='+', help='Input dex files')
+    parser.add_argument('-n', '--runs', type=int, default=5,
+            help='Number of measured runs (defaults to 5)')
+    parser.add_argument('--warmup', type=int, default=1,
+            help='Unmeasured runs before the measured ones (defaults to 1)')
+
+    parser.add_argument('--redex-binary', nargs='?',
+            help='Path to redex-all')
+    parser.add_argument('-c', '--config', help='Configuration file')
+    parser.add_argument('-a', '--apkdir', help='Unzipped APK directory')
+    parser.add_argument('-j', '--jarpath', nargs='?')
+    parser.add_argument('-P', '--proguard-config', nargs='?',
+            help='Path to proguard config')
+    parser.add_argument('-k', '--keep', nargs='?',
+            help='Path to file containing classes to keep')
+    parser.add_argument('-S', dest='passthru', action='append', default=[],
+            help='Arguments passed through to redex')
+    parser.add_argument('-J', dest='passthru_json', action='append', default=[],
+            help='JSON-formatted arguments passed through to redex')
+
+    parser.add_argument('--save', help='Write the report as JSON to this file')
+    parser.add_argument('--baseline',
+            help='Compare against a report written by --save')
+    parser.add_argument('--threshold', type=float, default=0.1,
+            help='Fractional growth of a median counted as a regression '
+                    '(defaults to 0.1)')
+    parser.add_argument('--min-secs', type=float, default=0.1,
+            help='Ignore phases that slowed down by less than this many '
+                    'seconds (defaults to 0.1)')
+    parser.add_argument('-v', '--verbose', action='store_true',
+            help='Show the output of redex-all')
+
+    return parser
+
+
+def run_bench(args):
+    binary = find_redex_all(args.redex_binary)
+    for i in range(args.warmup):
+        run_once(binary, args)
+    runs = []
+    for i in range(max(args.runs, 1)):
+        runs.append(run_once(binary, args))
+        print('run {}: {:.2f} seconds'.format(
+            i + 1, runs[-1]['phases']['total']), file=sys.stderr)
+    summary = summarize(runs)
+    print_summary(summary)
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(summary, f, indent=2)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        print()
+        regressions = compare(summary, baseline, args.threshold,
+                              args.min_secs)
+        if regressions:
+            sys.exit('Regressed: ' + ', '.join(regressions))
+
+
+if __name__ == '__main__':
+    run_bench(arg_parser().parse_args())
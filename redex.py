@@ -578,6 +578,10 @@ def copy_stats_to_out_dir(tmp, apk_output_path):
         log('Copying stats to output dir')
     else:
         log('Skipping stats copy, since no file found to copy')
+    if os.path.isfile(tmp + '/redex-pass-perf.json'):
+        subprocess.check_call(['cp', tmp + '/redex-pass-perf.json',
+            os.path.join(output_dir, 'redex-pass-perf.json')])
+        log('Copying pass perf report to output dir')
 
 def copy_filename_map_to_out_dir(tmp, apk_output_path):
     output_dir = os.path.dirname(apk_output_path)
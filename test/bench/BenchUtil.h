@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "DexUtil.h"
+#include "RedexContext.h"
+#include "walkers.h"
+
+/*
+ * Helpers shared by the benchmark programs in this directory.
+ */
+
+using BenchClock = std::chrono::steady_clock;
+
+inline double usecs(BenchClock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() /
+         1000.0;
+}
+
+/* How long `fn()` takes, in microseconds. */
+template <typename Fn>
+double time_usecs(Fn fn) {
+  auto start = BenchClock::now();
+  fn();
+  return usecs(BenchClock::now() - start);
+}
+
+/*
+ * Timings of repeated runs of one benchmark, printed as a row of the table
+ * print_header() starts.
+ */
+class BenchSamples {
+ public:
+  void add(double usecs) { m_usecs.push_back(usecs); }
+
+  static void print_header() {
+    printf("%-40s %10s %10s %10s %10s\n",
+           "benchmark", "min-ms", "median-ms", "mean-ms", "max-ms");
+  }
+
+  void print(const char* name) const {
+    if (m_usecs.empty()) {
+      return;
+    }
+    auto sorted = m_usecs;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (auto u : sorted) {
+      total += u;
+    }
+    printf("%-40s %10.2f %10.2f %10.2f %10.2f\n",
+           name,
+           sorted.front() / 1000,
+           sorted[sorted.size() / 2] / 1000,
+           total / sorted.size() / 1000,
+           sorted.back() / 1000);
+  }
+
+ private:
+  std::vector<double> m_usecs;
+};
+
+/*
+ * Load the dex files named by argv[first..argc) and return the `n` methods
+ * with the most instructions, largest first.
+ */
+inline std::vector<DexMethod*> load_largest_methods(int argc,
+                                                    char* argv[],
+                                                    int first,
+                                                    size_t n) {
+  g_redex = new RedexContext();
+  DexClassesVector dexen;
+  for (int i = first; i < argc; ++i) {
+    dexen.emplace_back(load_classes_from_dex(argv[i]));
+  }
+  auto scope = build_class_scope(dexen);
+  std::vector<DexMethod*> methods;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      methods.push_back(m);
+    }
+  });
+  std::sort(methods.begin(), methods.end(), [](DexMethod* a, DexMethod* b) {
+    return a->get_code()->get_instructions().size() >
+           b->get_code()->get_instructions().size();
+  });
+  if (methods.size() > n) {
+    methods.resize(n);
+  }
+  return methods;
+}
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Compares the worklist dataflow solver against the round-robin iteration
+ * RegAlloc and LocalDce used to do, by computing register liveness for the
+ * largest methods of the given dex files.
+ *
+ * Usage: dataflow_bench [-n <methods>] [-r <repeats>] <classes.dex>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "BenchUtil.h"
+#include "Dataflow.h"
+#include "Transform.h"
+
+namespace {
+
+template <typename Bits>
+void transfer(Block* b, Bits& live) {
+  for (auto it = b->rbegin(); it != b->rend(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = it->insn;
+    if (insn->dests_size()) {
+      live.reset(insn->dest());
+    }
+    for (size_t i = 0; i < insn->srcs_size(); i++) {
+      live.set(insn->src(i));
+    }
+    if (insn->has_range_base()) {
+      for (size_t i = 0; i < insn->range_size(); i++) {
+        live.set(insn->range_base() + i);
+      }
+    }
+  }
+}
+
+/*
+ * The do { for all blocks } while (changed) loop that the passes used before
+ * run_dataflow existed.
+ */
+std::vector<boost::dynamic_bitset<>> round_robin(std::vector<Block*>& cfg,
+                                                 size_t nregs,
+                                                 size_t& visits) {
+  auto blocks = PostOrderSort(cfg).get();
+  std::vector<boost::dynamic_bitset<>> livein(
+      cfg.size(), boost::dynamic_bitset<>(nregs));
+  bool changed;
+  do {
+    changed = false;
+    for (auto& b : blocks) {
+      auto prev = livein[b->id()];
+      auto& live = livein[b->id()];
+      live.reset();
+      for (auto& s : b->succs()) {
+        live |= livein[s->id()];
+      }
+      transfer(b, live);
+      ++visits;
+      if (live != prev) {
+        changed = true;
+      }
+    }
+  } while (changed);
+  return livein;
+}
+
+DataflowResult<BitVector> worklist(std::vector<Block*>& cfg, size_t nregs) {
+  return run_dataflow(
+      cfg,
+      DataflowDirection::BACKWARD,
+      BitVector(nregs),
+      [](Block* b, const BitVector& liveout, BitVector& livein) {
+        livein = liveout;
+        transfer(b, livein);
+      },
+      [](const BitVector& from, BitVector& into) { into |= from; });
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t nmethods = 20;
+  size_t repeats = 10;
+  int c;
+  while ((c = getopt(argc, argv, "n:r:")) != -1) {
+    switch (c) {
+    case 'n':
+      nmethods = atoi(optarg);
+      break;
+    case 'r':
+      repeats = std::max(1, atoi(optarg));
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n <methods>] [-r <repeats>] <classes.dex>...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "No dex files given\n");
+    return 1;
+  }
+
+  auto methods = load_largest_methods(argc, argv, optind, nmethods);
+
+  printf("%6s %6s %5s | %8s %10s | %8s %10s | %s\n",
+         "insns", "blocks", "regs", "rr-visit", "rr-us",
+         "wl-visit", "wl-us", "method");
+  double rr_total = 0;
+  double wl_total = 0;
+  for (auto m : methods) {
+    auto insns = m->get_code()->get_instructions().size();
+    auto nregs = m->get_code()->get_registers_size();
+    auto transform = MethodTransform::get_method_transform(m, true);
+    auto& cfg = transform->cfg();
+
+    size_t rr_visits = 0;
+    std::vector<boost::dynamic_bitset<>> rr_result;
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+      rr_visits = 0;
+      rr_result = round_robin(cfg, nregs, rr_visits);
+    }
+    auto rr_time = usecs(BenchClock::now() - start) / repeats;
+
+    DataflowResult<BitVector> wl_result;
+    start = BenchClock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+      wl_result = worklist(cfg, nregs);
+    }
+    auto wl_time = usecs(BenchClock::now() - start) / repeats;
+
+    for (auto b : cfg) {
+      for (size_t r = 0; r < nregs; ++r) {
+        if (rr_result[b->id()].test(r) != wl_result.in[b->id()].test(r)) {
+          fprintf(stderr, "Liveness mismatch in %s\n", SHOW(m));
+          return 1;
+        }
+      }
+    }
+    rr_total += rr_time;
+    wl_total += wl_time;
+    printf("%6lu %6lu %5u | %8lu %10.1f | %8lu %10.1f | %s\n",
+           insns, cfg.size(), nregs, rr_visits, rr_time,
+           wl_result.visits, wl_time, SHOW(m));
+  }
+  printf("total: round-robin %.1fus, worklist %.1fus\n", rr_total, wl_total);
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Times dominator, post-dominator and loop nesting construction on the
+ * largest methods of the given dex files.
+ *
+ * Usage: dominators_bench [-n <methods>] [-r <repeats>] <classes.dex>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "BenchUtil.h"
+#include "Dominators.h"
+#include "Transform.h"
+
+int main(int argc, char* argv[]) {
+  size_t nmethods = 20;
+  size_t repeats = 10;
+  int c;
+  while ((c = getopt(argc, argv, "n:r:")) != -1) {
+    switch (c) {
+    case 'n':
+      nmethods = atoi(optarg);
+      break;
+    case 'r':
+      repeats = std::max(1, atoi(optarg));
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n <methods>] [-r <repeats>] <classes.dex>...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "No dex files given\n");
+    return 1;
+  }
+
+  auto methods = load_largest_methods(argc, argv, optind, nmethods);
+  printf("%6s %6s | %9s %9s %9s | %5s %5s | %s\n",
+         "insns", "blocks", "dom-us", "pdom-us", "loops-us",
+         "loops", "depth", "method");
+  double dom_total = 0;
+  double pdom_total = 0;
+  double loops_total = 0;
+  for (auto m : methods) {
+    auto insns = m->get_code()->get_instructions().size();
+    auto transform = MethodTransform::get_method_transform(m, true);
+    auto& cfg = transform->cfg();
+
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+      DominatorTree doms(cfg);
+    }
+    auto dom_time = usecs(BenchClock::now() - start) / repeats;
+
+    start = BenchClock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+      DominatorTree pdoms(cfg, true /* post */);
+    }
+    auto pdom_time = usecs(BenchClock::now() - start) / repeats;
+
+    DominatorTree doms(cfg);
+    size_t nloops = 0;
+    size_t max_depth = 0;
+    start = BenchClock::now();
+    for (size_t i = 0; i < repeats; ++i) {
+      LoopInfo loops(cfg, doms);
+      nloops = loops.loops().size();
+      for (auto loop : loops.loops()) {
+        max_depth = std::max(max_depth, loop->depth);
+      }
+    }
+    auto loops_time = usecs(BenchClock::now() - start) / repeats;
+
+    dom_total += dom_time;
+    pdom_total += pdom_time;
+    loops_total += loops_time;
+    printf("%6lu %6lu | %9.1f %9.1f %9.1f | %5lu %5lu | %s\n",
+           insns, cfg.size(), dom_time, pdom_time, loops_time,
+           nloops, max_depth, SHOW(m));
+  }
+  printf("total: dominators %.1fus, post-dominators %.1fus, loops %.1fus\n",
+         dom_total, pdom_total, loops_total);
+  return 0;
+}
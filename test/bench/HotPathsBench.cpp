@@ -0,0 +1,440 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Times the libredex hot paths:
+ * - loading dex files and jars;
+ * - interning strings and types from several threads at once;
+ * - ballooning methods, building their CFGs and syncing them back;
+ * - register allocation;
+ * - parsing and matching keep rules;
+ * - writing dex files.
+ *
+ * Runs on the given dex files, or on a synthetic app (see SyntheticDex.h)
+ * when there are none.  The jar and keep rules are always generated.  Each
+ * benchmark reports the min, median, mean and max over the repeats.
+ *
+ * Usage: hot_paths_bench [-r <repeats>] [-c <classes>] [-m <methods>]
+ *                        [<classes.dex>...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <string>
+
+#include "BenchUtil.h"
+#include "DexOutput.h"
+#include "JarLoader.h"
+#include "RegAlloc.h"
+#include "SyntheticDex.h"
+#include "Transform.h"
+#include "WorkQueue.h"
+#include "keeprules.h"
+
+namespace {
+
+std::string class_name(size_t i) {
+  return "LBench/p" + std::to_string(i % 16) + "/C" + std::to_string(i) + ";";
+}
+
+void put16(std::string& out, uint16_t v) {
+  out += char(v >> 8);
+  out += char(v & 0xff);
+}
+
+/*
+ * A class file declaring Bench/jar/C<i> with a static int field and
+ * `nmethods` static int(int) methods, without code: that's all the
+ * JarLoader reads.
+ */
+std::string make_class_file(size_t i, size_t nmethods) {
+  std::string out;
+  std::vector<std::string> utf8 = {
+    "Bench/jar/C" + std::to_string(i), "java/lang/Object", "f", "I", "(I)I"};
+  for (size_t m = 0; m < nmethods; ++m) {
+    utf8.push_back("m" + std::to_string(m));
+  }
+  out += std::string("\xca\xfe\xba\xbe", 4);
+  put16(out, 0);
+  put16(out, 50);
+  // Two Class entries after the UTF8 ones, plus the unused entry 0.
+  put16(out, utf8.size() + 3);
+  for (auto& s : utf8) {
+    out += char(1);
+    put16(out, s.size());
+    out += s;
+  }
+  uint16_t this_class = utf8.size() + 1;
+  out += char(7);
+  put16(out, 1);
+  out += char(7);
+  put16(out, 2);
+  put16(out, 0x0001);
+  put16(out, this_class);
+  put16(out, this_class + 1);
+  put16(out, 0);
+  put16(out, 1);
+  put16(out, 0x0009);
+  put16(out, 3);
+  put16(out, 4);
+  put16(out, 0);
+  put16(out, nmethods);
+  for (size_t m = 0; m < nmethods; ++m) {
+    put16(out, 0x0109);
+    put16(out, 6 + m);
+    put16(out, 5);
+    put16(out, 0);
+  }
+  return out;
+}
+
+template <typename T>
+void put_le(std::string& out, T v) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out += char((v >> (8 * i)) & 0xff);
+  }
+}
+
+/* A deflated jar of make_class_file()s, as the JarLoader requires. */
+bool write_jar(const std::string& path, size_t nclasses, size_t nmethods) {
+  std::string jar;
+  std::string cdir;
+  for (size_t i = 0; i < nclasses; ++i) {
+    auto name = "Bench/jar/C" + std::to_string(i) + ".class";
+    auto data = make_class_file(i, nmethods);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+    std::string packed(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = (Bytef*)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef*)&packed[0];
+    zs.avail_out = packed.size();
+    deflate(&zs, Z_FINISH);
+    packed.resize(zs.total_out);
+    deflateEnd(&zs);
+    uint32_t crc = crc32(0, (const Bytef*)data.data(), data.size());
+    uint32_t offset = jar.size();
+
+    put_le<uint32_t>(jar, 0x04034b50);
+    put_le<uint16_t>(jar, 20);
+    put_le<uint16_t>(jar, 0);
+    put_le<uint16_t>(jar, 8);
+    put_le<uint32_t>(jar, 0);
+    put_le<uint32_t>(jar, crc);
+    put_le<uint32_t>(jar, packed.size());
+    put_le<uint32_t>(jar, data.size());
+    put_le<uint16_t>(jar, name.size());
+    put_le<uint16_t>(jar, 0);
+    jar += name;
+    jar += packed;
+
+    put_le<uint32_t>(cdir, 0x02014b50);
+    put_le<uint16_t>(cdir, 20);
+    put_le<uint16_t>(cdir, 20);
+    put_le<uint16_t>(cdir, 0);
+    put_le<uint16_t>(cdir, 8);
+    put_le<uint32_t>(cdir, 0);
+    put_le<uint32_t>(cdir, crc);
+    put_le<uint32_t>(cdir, packed.size());
+    put_le<uint32_t>(cdir, data.size());
+    put_le<uint16_t>(cdir, name.size());
+    put_le<uint16_t>(cdir, 0);
+    put_le<uint16_t>(cdir, 0);
+    put_le<uint16_t>(cdir, 0);
+    put_le<uint16_t>(cdir, 0);
+    put_le<uint32_t>(cdir, 0);
+    put_le<uint32_t>(cdir, offset);
+    cdir += name;
+  }
+  uint32_t cdir_offset = jar.size();
+  jar += cdir;
+  put_le<uint32_t>(jar, 0x06054b50);
+  put_le<uint16_t>(jar, 0);
+  put_le<uint16_t>(jar, 0);
+  put_le<uint16_t>(jar, nclasses);
+  put_le<uint16_t>(jar, nclasses);
+  put_le<uint32_t>(jar, cdir.size());
+  put_le<uint32_t>(jar, cdir_offset);
+  put_le<uint16_t>(jar, 0);
+
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    return false;
+  }
+  fwrite(jar.data(), 1, jar.size(), f);
+  fclose(f);
+  return true;
+}
+
+/* Keep rules for some of the generated packages and names. */
+bool write_keep_rules(const std::string& path, size_t nrules) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < nrules; ++i) {
+    switch (i % 3) {
+    case 0:
+      fprintf(f, "-keep class Synth.p%lu.C%lu { *; }\n", i % 64, i);
+      break;
+    case 1:
+      fprintf(f, "-keep class Synth.p%lu.C*%lu\n", i % 64, i % 10);
+      break;
+    case 2:
+      fprintf(f, "-keep class Synth.**.C%lu*\n", i);
+      break;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/* The matching init_reachable_classes does for class keep rules. */
+size_t match_keep_rules(const Scope& scope,
+                        const std::vector<KeepRule>& rules) {
+  std::vector<std::string> patterns;
+  for (auto& r : rules) {
+    if (r.classname != nullptr &&
+        r.class_type == keeprules::ClassType::CLASS &&
+        strlen(r.classname) > 2) {
+      std::string pattern(r.classname);
+      std::replace(pattern.begin(), pattern.end(), '.', '/');
+      patterns.push_back('L' + pattern);
+    }
+  }
+  size_t matched = 0;
+  for (auto cls : scope) {
+    auto name = cls->get_type()->get_name()->c_str();
+    auto len = strlen(name);
+    for (auto& pattern : patterns) {
+      if (type_matches(pattern.c_str(), name, pattern.size(), len)) {
+        matched++;
+        break;
+      }
+    }
+  }
+  return matched;
+}
+
+struct InternWork {
+  const std::vector<std::string>* names;
+  size_t first;
+  size_t count;
+};
+
+/*
+ * Each item interns a window of the names, and the windows overlap, so the
+ * threads race to create the same strings and types.
+ */
+void intern(InternWork* work) {
+  auto& names = *work->names;
+  for (size_t i = 0; i < work->count; ++i) {
+    auto& name = names[(work->first + i) % names.size()];
+    DexType::make_type(DexString::make_string(name.c_str()));
+  }
+}
+
+void fresh_context() {
+  delete g_redex;
+  g_redex = new RedexContext();
+}
+
+DexClassesVector load(const std::vector<std::string>& dexes) {
+  DexClassesVector dexen;
+  for (auto& dex : dexes) {
+    dexen.emplace_back(load_classes_from_dex(dex.c_str()));
+  }
+  return dexen;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t repeats = 5;
+  size_t nclasses = 2000;
+  size_t nmethods = 10;
+  int c;
+  while ((c = getopt(argc, argv, "r:c:m:")) != -1) {
+    switch (c) {
+    case 'r':
+      repeats = std::max(1, atoi(optarg));
+      break;
+    case 'c':
+      nclasses = std::max(1, atoi(optarg));
+      break;
+    case 'm':
+      nmethods = std::max(1, atoi(optarg));
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-r <repeats>] [-c <classes>] [-m <methods>] "
+              "[<classes.dex>...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  char tmpdir[] = "/tmp/hot_paths_bench.XXXXXX";
+  if (mkdtemp(tmpdir) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string dir(tmpdir);
+  std::vector<std::string> dexes;
+  std::vector<std::string> generated;
+  for (int i = optind; i < argc; ++i) {
+    dexes.push_back(argv[i]);
+  }
+  g_redex = new RedexContext();
+  if (dexes.empty()) {
+    SyntheticDexConfig config;
+    config.classes = nclasses;
+    config.methods_per_class = nmethods;
+    auto dexen = make_synthetic_dexen(config);
+    generated = write_synthetic_dexen(dexen, dir);
+    dexes = generated;
+    printf("Generated %lu classes of %lu methods\n", nclasses, nmethods);
+  }
+  auto jar = dir + "/classes.jar";
+  auto rules_file = dir + "/rules.pro";
+  if (!write_jar(jar, nclasses, nmethods) ||
+      !write_keep_rules(rules_file, 300)) {
+    fprintf(stderr, "Can't write fixtures to %s\n", tmpdir);
+    return 1;
+  }
+
+  BenchSamples::print_header();
+
+  BenchSamples intern_samples;
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 100000; ++i) {
+    names.push_back(class_name(i));
+  }
+  const size_t kInternItems = 64;
+  std::vector<InternWork> intern_work(kInternItems);
+  std::vector<WorkItem<InternWork>> intern_items(kInternItems);
+  for (size_t i = 0; i < kInternItems; ++i) {
+    intern_work[i] = InternWork{&names, i * names.size() / 16, names.size() / 4};
+    intern_items[i].init(intern, &intern_work[i]);
+  }
+  WorkQueue wq;
+  for (size_t r = 0; r < repeats; ++r) {
+    fresh_context();
+    intern_samples.add(time_usecs(
+      [&] { wq.run_work_items(&intern_items[0], kInternItems); }));
+  }
+  intern_samples.print("intern strings and types (contended)");
+
+  BenchSamples load_samples;
+  for (size_t r = 0; r < repeats; ++r) {
+    fresh_context();
+    load_samples.add(time_usecs([&] { load(dexes); }));
+  }
+  load_samples.print("load_classes_from_dex");
+
+  BenchSamples jar_samples;
+  for (size_t r = 0; r < repeats; ++r) {
+    fresh_context();
+    jar_samples.add(time_usecs([&] {
+      if (!load_jar_file(jar.c_str())) {
+        fprintf(stderr, "Failed to load %s\n", jar.c_str());
+        exit(1);
+      }
+    }));
+  }
+  jar_samples.print("load_jar_file");
+
+  fresh_context();
+  auto dexen = load(dexes);
+  auto scope = build_class_scope(dexen);
+  std::vector<DexMethod*> methods;
+  walk_methods(scope, [&](DexMethod* m) {
+    if (m->get_code()) {
+      methods.push_back(m);
+    }
+  });
+
+  BenchSamples balloon_samples;
+  BenchSamples cfg_samples;
+  BenchSamples sync_samples;
+  for (size_t r = 0; r < repeats; ++r) {
+    std::vector<MethodTransform*> transforms;
+    balloon_samples.add(time_usecs([&] {
+      for (auto m : methods) {
+        transforms.push_back(MethodTransform::get_method_transform(m));
+      }
+    }));
+    cfg_samples.add(time_usecs([&] {
+      for (auto t : transforms) {
+        t->cfg();
+      }
+    }));
+    sync_samples.add(time_usecs([&] { MethodTransform::sync_all(); }));
+  }
+  balloon_samples.print("MethodTransform balloon");
+  cfg_samples.print("build_cfg");
+  sync_samples.print("MethodTransform::sync_all");
+
+  BenchSamples regalloc_samples;
+  for (size_t r = 0; r < repeats; ++r) {
+    regalloc_samples.add(time_usecs([&] {
+      for (auto m : methods) {
+        allocate_registers(m);
+      }
+    }));
+  }
+  regalloc_samples.print("allocate_registers");
+
+  BenchSamples parse_samples;
+  BenchSamples match_samples;
+  size_t matched = 0;
+  for (size_t r = 0; r < repeats; ++r) {
+    std::vector<KeepRule> rules;
+    std::vector<std::string> library_jars;
+    parse_samples.add(time_usecs([&] {
+      parse_proguard_file(rules_file.c_str(), &rules, &library_jars);
+    }));
+    match_samples.add(
+      time_usecs([&] { matched = match_keep_rules(scope, rules); }));
+  }
+  parse_samples.print("parse_proguard_file");
+  match_samples.print("keep rule matching");
+
+  BenchSamples output_samples;
+  for (size_t r = 0; r < repeats; ++r) {
+    output_samples.add(time_usecs([&] {
+      for (size_t i = 0; i < dexen.size(); ++i) {
+        auto out = dir + "/out" + std::to_string(i) + ".dex";
+        write_classes_to_dex(out, &dexen[i], nullptr, i, "");
+      }
+    }));
+  }
+  output_samples.print("write_classes_to_dex");
+
+  printf("%lu methods, %lu classes matched by keep rules\n",
+         methods.size(), matched);
+  delete g_redex;
+
+  for (size_t i = 0; i < dexen.size(); ++i) {
+    unlink((dir + "/out" + std::to_string(i) + ".dex").c_str());
+  }
+  for (auto& dex : generated) {
+    unlink(dex.c_str());
+  }
+  unlink(jar.c_str());
+  unlink(rules_file.c_str());
+  rmdir(tmpdir);
+  return 0;
+}
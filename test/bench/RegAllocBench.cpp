@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Measures the register allocator on the given dex files.  First compares
+ * building the conflict graph out of per-instruction live sets the way
+ * allocate_registers used to, testing every pair of registers into
+ * std::sets, against the InterferenceGraph, on the largest methods.  Then
+ * allocates every method and reports how many registers that saved.  -C
+ * turns move coalescing off, for comparison.
+ *
+ * Usage: regalloc_bench [-n <methods>] [-r <repeats>] [-C] <classes.dex>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <limits>
+#include <set>
+
+#include "BenchUtil.h"
+#include "Dataflow.h"
+#include "RegAlloc.h"
+#include "Transform.h"
+
+namespace {
+
+/* The live registers after each instruction, in a flat list. */
+std::vector<BitVector> instruction_liveness(MethodTransform* transform,
+                                            size_t nregs) {
+  auto& cfg = transform->cfg();
+  auto transfer = [](Block* b, BitVector& live, std::vector<BitVector>* out) {
+    for (auto it = b->rbegin(); it != b->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = it->insn;
+      if (out) {
+        out->push_back(live);
+      }
+      if (insn->dests_size()) {
+        live.reset(insn->dest());
+      }
+      for (size_t i = 0; i < insn->srcs_size(); i++) {
+        live.set(insn->src(i));
+      }
+    }
+  };
+  auto liveness = run_dataflow(
+      cfg,
+      DataflowDirection::BACKWARD,
+      BitVector(nregs),
+      [&](Block* b, const BitVector& out, BitVector& in) {
+        in = out;
+        transfer(b, in, nullptr);
+      },
+      [](const BitVector& from, BitVector& into) { into |= from; });
+  std::vector<BitVector> result;
+  for (auto b : cfg) {
+    auto live = liveness.out[b->id()];
+    transfer(b, live, &result);
+  }
+  return result;
+}
+
+bool has_pairs_or_ranges(DexMethod* m) {
+  for (auto insn : m->get_code()->get_instructions()) {
+    if ((insn->dests_size() && insn->dest_is_wide()) ||
+        insn->has_range_base()) {
+      return true;
+    }
+    for (size_t i = 0; i < insn->srcs_size(); i++) {
+      if (insn->src_is_wide(i)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+size_t old_conflicts(const std::vector<BitVector>& liveness, size_t nregs) {
+  std::vector<std::set<uint16_t>> conflicts(nregs);
+  for (auto& live : liveness) {
+    for (size_t i = 0; i < live.size(); i++) {
+      for (size_t j = i; j < live.size(); j++) {
+        if (live.test(i) && live.test(j)) {
+          conflicts[i].emplace(j);
+          conflicts[j].emplace(i);
+        }
+      }
+    }
+  }
+  size_t edges = 0;
+  for (auto& c : conflicts) {
+    edges += c.size();
+  }
+  return edges;
+}
+
+size_t new_conflicts(const std::vector<BitVector>& liveness, size_t nregs) {
+  InterferenceGraph graph(nregs);
+  for (auto& live : liveness) {
+    graph.add_clique(live);
+  }
+  size_t edges = 0;
+  for (size_t i = 0; i < nregs; ++i) {
+    edges += graph.adj(i).size();
+  }
+  return edges;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t nmethods = 20;
+  size_t repeats = 10;
+  bool coalesce = true;
+  int c;
+  while ((c = getopt(argc, argv, "n:r:C")) != -1) {
+    switch (c) {
+    case 'n':
+      nmethods = atoi(optarg);
+      break;
+    case 'r':
+      repeats = std::max(1, atoi(optarg));
+      break;
+    case 'C':
+      coalesce = false;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n <methods>] [-r <repeats>] [-C] <classes.dex>...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "No dex files given\n");
+    return 1;
+  }
+
+  auto methods = load_largest_methods(
+      argc, argv, optind, std::numeric_limits<size_t>::max());
+
+  printf("%6s %5s | %10s %10s | %s\n",
+         "insns", "regs", "sets-us", "matrix-us", "method");
+  double old_total = 0;
+  double new_total = 0;
+  for (size_t i = 0; i < std::min(nmethods, methods.size()); ++i) {
+    auto m = methods[i];
+    auto nregs = m->get_code()->get_registers_size();
+    auto transform = MethodTransform::get_method_transform(m, true);
+    auto liveness = instruction_liveness(transform, nregs);
+
+    size_t old_edges = 0;
+    auto start = BenchClock::now();
+    for (size_t r = 0; r < repeats; ++r) {
+      old_edges = old_conflicts(liveness, nregs);
+    }
+    auto old_time = usecs(BenchClock::now() - start) / repeats;
+
+    size_t new_edges = 0;
+    start = BenchClock::now();
+    for (size_t r = 0; r < repeats; ++r) {
+      new_edges = new_conflicts(liveness, nregs);
+    }
+    auto new_time = usecs(BenchClock::now() - start) / repeats;
+
+    // The sets also hold every live register's edge to itself.
+    if (old_edges < new_edges) {
+      fprintf(stderr, "Conflict graph mismatch in %s\n", SHOW(m));
+      return 1;
+    }
+    old_total += old_time;
+    new_total += new_time;
+    printf("%6lu %5u | %10.1f %10.1f | %s\n",
+           m->get_code()->get_instructions().size(), nregs, old_time,
+           new_time, SHOW(m));
+  }
+  printf("total: sets %.1fus, matrix %.1fus\n\n", old_total, new_total);
+
+  // Methods with wide values or range operands used to be skipped.
+  std::vector<bool> wide(methods.size());
+  for (size_t i = 0; i < methods.size(); ++i) {
+    wide[i] = has_pairs_or_ranges(methods[i]);
+  }
+  size_t allocated[2] = {0, 0};
+  size_t regs_before[2] = {0, 0};
+  size_t regs_after[2] = {0, 0};
+  size_t moves_removed = 0;
+  auto start = BenchClock::now();
+  for (size_t i = 0; i < methods.size(); ++i) {
+    auto stats = allocate_registers(methods[i], coalesce);
+    if (!stats.allocated) {
+      continue;
+    }
+    ++allocated[wide[i]];
+    regs_before[wide[i]] += stats.regs_before;
+    regs_after[wide[i]] += stats.regs_after;
+    moves_removed += stats.moves_removed;
+  }
+  auto alloc_time = usecs(BenchClock::now() - start);
+  printf("allocated %lu of %lu methods in %.1fms%s\n",
+         allocated[0] + allocated[1], methods.size(), alloc_time / 1000,
+         coalesce ? "" : " (no coalescing)");
+  printf("  without pairs or ranges: %lu methods, registers %lu -> %lu\n",
+         allocated[0], regs_before[0], regs_after[0]);
+  printf("  with pairs or ranges:    %lu methods, registers %lu -> %lu\n",
+         allocated[1], regs_before[1], regs_after[1]);
+  printf("%lu moves removed\n", moves_removed);
+  return 0;
+}
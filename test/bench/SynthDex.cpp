@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Writes a synthetic app (see SyntheticDex.h) to a directory, for feeding
+ * the benchmarks and redex-all inputs of a chosen size and shape:
+ *
+ *   synth_dex -o out -c 100000 -d 8 -a 0.5
+ *   make bench BENCH_DEX="$(echo out/classes*.dex)"
+ *
+ * Usage: synth_dex -o <dir> [-s <seed>] [-c <classes>] [-m <methods>]
+ *                  [-f <fields>] [-i <instructions>] [-d <depth>]
+ *                  [-a <annotation density>] [-S <strings>]
+ *                  [-n <classes per dex>] [-x <name>=<weight>,...]
+ *
+ * -x weights the statements method bodies are made of: consts, arith,
+ * fields, calls, branches and strings.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "RedexContext.h"
+#include "SyntheticDex.h"
+#include "walkers.h"
+
+namespace {
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s -o <dir> [-s <seed>] [-c <classes>] [-m <methods>] "
+          "[-f <fields>]\n"
+          "         [-i <instructions>] [-d <depth>] "
+          "[-a <annotation density>]\n"
+          "         [-S <strings>] [-n <classes per dex>] "
+          "[-x <name>=<weight>,...]\n",
+          argv0);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  SyntheticDexConfig config;
+  std::string dir;
+  int c;
+  while ((c = getopt(argc, argv, "o:s:c:m:f:i:d:a:S:n:x:")) != -1) {
+    switch (c) {
+    case 'o':
+      dir = optarg;
+      break;
+    case 's':
+      config.seed = strtoul(optarg, nullptr, 0);
+      break;
+    case 'c':
+      config.classes = strtoul(optarg, nullptr, 0);
+      break;
+    case 'm':
+      config.methods_per_class = strtoul(optarg, nullptr, 0);
+      break;
+    case 'f':
+      config.fields_per_class = strtoul(optarg, nullptr, 0);
+      break;
+    case 'i':
+      config.instructions_per_method = strtoul(optarg, nullptr, 0);
+      break;
+    case 'd':
+      config.hierarchy_depth = strtoul(optarg, nullptr, 0);
+      break;
+    case 'a':
+      config.annotation_density = atof(optarg);
+      break;
+    case 'S':
+      config.strings = strtoul(optarg, nullptr, 0);
+      break;
+    case 'n':
+      config.classes_per_dex = strtoul(optarg, nullptr, 0);
+      break;
+    case 'x':
+      if (!parse_instruction_mix(optarg, config.mix)) {
+        fprintf(stderr, "Bad instruction mix: %s\n", optarg);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (dir.empty() || optind != argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  mkdir(dir.c_str(), 0755);
+
+  g_redex = new RedexContext();
+  auto dexen = make_synthetic_dexen(config);
+  size_t nmethods = 0;
+  size_t ninsns = 0;
+  for (auto& classes : dexen) {
+    walk_code(classes, [](DexMethod*) { return true; },
+              [&](DexMethod*, DexCode* code) {
+                ++nmethods;
+                ninsns += code->get_instructions().size();
+              });
+  }
+  auto paths = write_synthetic_dexen(dexen, dir);
+  for (auto& path : paths) {
+    struct stat st;
+    stat(path.c_str(), &st);
+    printf("%s: %lld bytes\n", path.c_str(), (long long)st.st_size);
+  }
+  printf("%lu classes, %lu methods, %lu instructions in %lu dexes\n",
+         config.classes, nmethods, ninsns, dexen.size());
+  delete g_redex;
+  return 0;
+}
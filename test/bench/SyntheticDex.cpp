@@ -0,0 +1,350 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "SyntheticDex.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+#include "Creators.h"
+#include "Debug.h"
+#include "DexAnnotation.h"
+#include "DexOutput.h"
+
+namespace {
+
+// The method ref limit of a dex, less room for the refs a class makes
+// outside of its own methods.
+const size_t kMethodRefsPerDex = 60000;
+
+// if-eqz offsets are 16 bits and the branch targets go at the end of the
+// method, so bodies with branches must stay within about 32k code units.
+const size_t kMaxBranchingInstructions = 10000;
+
+const size_t kAnnotationTypes = 8;
+
+enum Statement { CONST, ARITH, FIELD, CALL, BRANCH, STRING, STATEMENTS };
+
+const DexOpcode kArithOps[] = {
+  OPCODE_ADD_INT, OPCODE_SUB_INT, OPCODE_MUL_INT, OPCODE_AND_INT,
+  OPCODE_OR_INT,  OPCODE_XOR_INT, OPCODE_SHL_INT, OPCODE_SHR_INT,
+  OPCODE_USHR_INT,
+};
+
+// Int locals each method computes with, besides its argument.
+const size_t kIntLocals = 4;
+
+class Generator {
+ public:
+  explicit Generator(const SyntheticDexConfig& config)
+      : m_config(config), m_rng(config.seed) {
+    always_assert_log(config.mix.branches == 0 ||
+                        config.instructions_per_method <=
+                          kMaxBranchingInstructions,
+                      "Methods with branches are limited to %lu instructions",
+                      kMaxBranchingInstructions);
+    auto& mix = config.mix;
+    unsigned weights[STATEMENTS] = {mix.consts, mix.arith,    mix.fields,
+                                    mix.calls,  mix.branches, mix.strings};
+    unsigned total = 0;
+    for (size_t i = 0; i < STATEMENTS; ++i) {
+      total += weights[i];
+      m_cumulative[i] = total;
+    }
+    always_assert_log(total > 0, "The instruction mix is empty");
+    m_int_type = get_int_type();
+    m_string_type = get_string_type();
+    m_proto = DexProto::make_proto(m_int_type,
+                                   DexTypeList::make_type_list({m_int_type}));
+    for (size_t i = 0; i < std::max<size_t>(config.strings, 1); ++i) {
+      std::ostringstream ss;
+      ss << "synthetic string " << i;
+      m_strings.push_back(DexString::make_string(ss.str().c_str()));
+    }
+    for (size_t i = 0; i < kAnnotationTypes; ++i) {
+      auto name = "LSynth/Anno" + std::to_string(i) + ";";
+      m_anno_types.push_back(DexType::make_type(name.c_str()));
+    }
+  }
+
+  DexClass* make_class(size_t i, DexClass* super) {
+    auto name = "LSynth/p" + std::to_string(i % 64) + "/C" +
+                std::to_string(i) + ";";
+    auto type = DexType::make_type(name.c_str());
+    ClassCreator cc(type);
+    cc.set_access(ACC_PUBLIC);
+    cc.set_super(super ? super->get_type() : get_object_type());
+    cc.set_anno_set(maybe_annotate());
+
+    std::vector<DexField*> fields;
+    for (size_t f = 0; f < m_config.fields_per_class; ++f) {
+      auto fname = "f" + std::to_string(f);
+      auto field = DexField::make_field(
+        type, DexString::make_string(fname.c_str()), m_int_type);
+      field->attach_annotation_set(maybe_annotate());
+      field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+      cc.add_field(field);
+      fields.push_back(field);
+    }
+
+    // Declare every method first so bodies can call any of them.
+    std::vector<DexMethod*> methods;
+    for (size_t m = 0; m < m_config.methods_per_class; ++m) {
+      auto mname = (is_static(m) ? "s" : "v") + std::to_string(m);
+      methods.push_back(DexMethod::make_method(
+        type, DexString::make_string(mname.c_str()), m_proto));
+    }
+    Callees callees;
+    add_callees(callees, methods);
+    if (super != nullptr) {
+      auto& dmethods = super->get_dmethods();
+      auto& vmethods = super->get_vmethods();
+      add_callees(callees,
+                  std::vector<DexMethod*>(dmethods.begin(), dmethods.end()));
+      add_callees(callees,
+                  std::vector<DexMethod*>(vmethods.begin(), vmethods.end()));
+    }
+    for (size_t m = 0; m < methods.size(); ++m) {
+      methods[m]->attach_annotation_set(maybe_annotate());
+      DexAccessFlags access = ACC_PUBLIC;
+      if (is_static(m)) {
+        access = access | ACC_STATIC;
+      }
+      MethodCreator mc(type, methods[m]->get_name(), m_proto, access);
+      make_body(mc, !is_static(m), fields, callees);
+      cc.add_method(mc.create());
+    }
+    return cc.create();
+  }
+
+ private:
+  struct Callees {
+    std::vector<DexMethod*> statics;
+    std::vector<DexMethod*> virtuals;
+  };
+
+  static bool is_static(size_t m) { return m % 2 == 0; }
+
+  static void add_callees(Callees& callees,
+                          const std::vector<DexMethod*>& methods) {
+    for (auto m : methods) {
+      if (m->get_name()->c_str()[0] == 's') {
+        callees.statics.push_back(m);
+      } else {
+        callees.virtuals.push_back(m);
+      }
+    }
+  }
+
+  size_t pick(size_t n) { return m_rng() % n; }
+
+  bool chance(double p) {
+    return m_rng() < p * static_cast<double>(std::mt19937::max());
+  }
+
+  Statement pick_statement() {
+    auto r = pick(m_cumulative[STATEMENTS - 1]);
+    size_t s = 0;
+    while (r >= m_cumulative[s]) {
+      ++s;
+    }
+    return static_cast<Statement>(s);
+  }
+
+  DexAnnotationSet* maybe_annotate() {
+    if (!chance(m_config.annotation_density)) {
+      return nullptr;
+    }
+    auto anno = new DexAnnotation(m_anno_types[pick(m_anno_types.size())],
+                                  DAV_RUNTIME);
+    anno->add_element(
+      "value", new DexEncodedValueString(m_strings[pick(m_strings.size())]));
+    auto aset = new DexAnnotationSet();
+    aset->get_annotations().push_back(anno);
+    return aset;
+  }
+
+  void make_body(MethodCreator& mc,
+                 bool is_virtual,
+                 const std::vector<DexField*>& fields,
+                 const Callees& callees) {
+    auto self = is_virtual ? mc.get_local(0) : Location::empty();
+    auto arg = mc.get_local(is_virtual ? 1 : 0);
+    std::vector<Location> ints{arg};
+    for (size_t i = 0; i < kIntLocals; ++i) {
+      ints.push_back(mc.make_local(m_int_type));
+    }
+    auto str = mc.make_local(m_string_type);
+    auto block = mc.get_main_block();
+    auto any_int = [&]() -> Location& { return ints[pick(ints.size())]; };
+    auto load_random = [&](MethodBlock* b) {
+      auto& dst = any_int();
+      b->load_const(dst, static_cast<int32_t>(pick(1 << 16)) - (1 << 15));
+    };
+
+    size_t emitted = 0;
+    for (size_t i = 1; i < ints.size(); ++i) {
+      block->load_const(ints[i], static_cast<int32_t>(i));
+      ++emitted;
+    }
+    while (emitted < m_config.instructions_per_method) {
+      switch (pick_statement()) {
+      case CONST:
+        load_random(block);
+        ++emitted;
+        break;
+      case ARITH: {
+        // Draw the operands in order: argument evaluation order is
+        // unspecified and the output must not depend on the compiler.
+        auto op = kArithOps[pick(sizeof(kArithOps) / sizeof(DexOpcode))];
+        auto& src1 = any_int();
+        auto& src2 = any_int();
+        block->binop(op, src1, src2, any_int());
+        ++emitted;
+        break;
+      }
+      case FIELD:
+        if (fields.empty()) {
+          load_random(block);
+        } else {
+          auto field = fields[pick(fields.size())];
+          if (chance(0.5)) {
+            block->sget(field, any_int());
+          } else {
+            block->sput(field, any_int());
+          }
+        }
+        ++emitted;
+        break;
+      case CALL: {
+        bool call_virtual = is_virtual && !callees.virtuals.empty() &&
+                            (callees.statics.empty() || chance(0.5));
+        if (call_virtual) {
+          std::vector<Location> args{self, any_int()};
+          block->invoke(OPCODE_INVOKE_VIRTUAL,
+                        callees.virtuals[pick(callees.virtuals.size())],
+                        args);
+        } else if (!callees.statics.empty()) {
+          std::vector<Location> args{any_int()};
+          block->invoke(OPCODE_INVOKE_STATIC,
+                        callees.statics[pick(callees.statics.size())],
+                        args);
+        } else {
+          load_random(block);
+          ++emitted;
+          break;
+        }
+        block->move_result(any_int(), m_int_type);
+        emitted += 2;
+        break;
+      }
+      case BRANCH: {
+        MethodBlock* taken;
+        auto fallthrough =
+          block->if_else_testz(OPCODE_IF_EQZ, any_int(), &taken);
+        load_random(fallthrough);
+        load_random(taken);
+        // The if, both loads and the goto back.
+        emitted += 4;
+        break;
+      }
+      case STRING:
+        block->load_const(str, m_strings[pick(m_strings.size())]);
+        ++emitted;
+        break;
+      case STATEMENTS:
+        not_reached();
+      }
+    }
+    block->ret(ints[0]);
+  }
+
+  const SyntheticDexConfig& m_config;
+  std::mt19937 m_rng;
+  unsigned m_cumulative[STATEMENTS];
+  DexType* m_int_type;
+  DexType* m_string_type;
+  DexProto* m_proto;
+  std::vector<DexString*> m_strings;
+  std::vector<DexType*> m_anno_types;
+};
+
+}
+
+bool parse_instruction_mix(const std::string& spec,
+                           SyntheticDexConfig::Mix& mix) {
+  std::istringstream ss(spec);
+  std::string entry;
+  while (std::getline(ss, entry, ',')) {
+    auto eq = entry.find('=');
+    if (eq == std::string::npos) {
+      return false;
+    }
+    auto name = entry.substr(0, eq);
+    unsigned weight = std::stoul(entry.substr(eq + 1));
+    if (name == "consts") {
+      mix.consts = weight;
+    } else if (name == "arith") {
+      mix.arith = weight;
+    } else if (name == "fields") {
+      mix.fields = weight;
+    } else if (name == "calls") {
+      mix.calls = weight;
+    } else if (name == "branches") {
+      mix.branches = weight;
+    } else if (name == "strings") {
+      mix.strings = weight;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+DexClassesVector make_synthetic_dexen(const SyntheticDexConfig& config) {
+  auto depth = std::max<size_t>(config.hierarchy_depth, 1);
+  auto per_dex = config.classes_per_dex;
+  if (per_dex == 0) {
+    per_dex = std::max<size_t>(
+      kMethodRefsPerDex / std::max<size_t>(config.methods_per_class, 1), 1);
+    // Keep each inheritance chain within a dex.
+    if (per_dex > depth) {
+      per_dex -= per_dex % depth;
+    }
+  }
+  Generator gen(config);
+  DexClassesVector dexen;
+  DexClass* super = nullptr;
+  for (size_t first = 0; first < config.classes; first += per_dex) {
+    auto count = std::min(per_dex, config.classes - first);
+    DexClasses classes(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto n = first + i;
+      if (n % depth == 0) {
+        super = nullptr;
+      }
+      super = gen.make_class(n, super);
+      classes.insert_at(super, i);
+    }
+    dexen.push_back(std::move(classes));
+  }
+  return dexen;
+}
+
+std::vector<std::string> write_synthetic_dexen(DexClassesVector& dexen,
+                                               const std::string& dir) {
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < dexen.size(); ++i) {
+    auto path = dir + "/classes" + (i ? std::to_string(i + 1) : "") + ".dex";
+    write_classes_to_dex(path, &dexen[i], nullptr, i, "");
+    paths.push_back(path);
+  }
+  return paths;
+}
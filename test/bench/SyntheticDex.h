@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+
+/*
+ * Generates apps of any size for the benchmarks, so scaling can be measured
+ * on inputs far larger than the integration test fixtures.
+ *
+ * Classes come in inheritance chains of `hierarchy_depth`, each class
+ * extending the one before it.  Every class has `fields_per_class` static
+ * int fields and `methods_per_class` int(int) methods, alternately static
+ * and virtual; the virtual ones override those of the same name up the
+ * chain.  Method bodies are `instructions_per_method` instructions drawn
+ * from `mix`, calling methods of their class and its superclass and loading
+ * strings from a pool of `strings`.  Classes, methods and fields each carry
+ * an annotation with probability `annotation_density`.
+ *
+ * The same config always produces the same classes.
+ */
+struct SyntheticDexConfig {
+  uint32_t seed{1};
+  size_t classes{1000};
+  size_t methods_per_class{10};
+  size_t fields_per_class{2};
+  size_t instructions_per_method{32};
+  size_t hierarchy_depth{1};
+  double annotation_density{0.1};
+  size_t strings{1000};
+  // Classes per dex; 0 fills each dex as far as the method ref limit allows.
+  size_t classes_per_dex{0};
+
+  // Relative weights of the statements method bodies are made of.
+  struct Mix {
+    unsigned consts{4};
+    unsigned arith{4};
+    unsigned fields{2};
+    unsigned calls{2};
+    unsigned branches{1};
+    unsigned strings{1};
+  } mix;
+};
+
+/*
+ * Parse "name=weight,..." (names as in SyntheticDexConfig::Mix) into `mix`.
+ * Returns false on an unknown name.
+ */
+bool parse_instruction_mix(const std::string& spec,
+                           SyntheticDexConfig::Mix& mix);
+
+/* Create the classes `config` describes, split into dexes. */
+DexClassesVector make_synthetic_dexen(const SyntheticDexConfig& config);
+
+/*
+ * Write `dexen` into `dir` as classes.dex, classes2.dex, ... and return the
+ * paths written.
+ */
+std::vector<std::string> write_synthetic_dexen(DexClassesVector& dexen,
+                                               const std::string& dir);
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+/*
+ * Measures type_class() throughput on the given dex files.  Collects every
+ * type the code refers to -- type operands and the owners of field and
+ * method references -- plus each class's superclass and interfaces, then
+ * looks them all up, first with type_class() and then through a hash map
+ * like the one type_class() used to search, on one thread and on all of the
+ * WorkQueue's.
+ *
+ * Usage: type_class_bench [-r <repeats>] <classes.dex>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "BenchUtil.h"
+#include "WorkQueue.h"
+
+namespace {
+
+using ClassMap = std::unordered_map<const DexType*, DexClass*>;
+
+struct Lookups {
+  const std::vector<const DexType*>* refs;
+  const ClassMap* map;
+  size_t begin;
+  size_t end;
+  size_t repeats;
+  size_t found;
+};
+
+void with_type_class(Lookups* l) {
+  size_t found = 0;
+  for (size_t r = 0; r < l->repeats; ++r) {
+    for (size_t i = l->begin; i < l->end; ++i) {
+      found += type_class((*l->refs)[i]) != nullptr;
+    }
+  }
+  l->found = found;
+}
+
+void with_map(Lookups* l) {
+  size_t found = 0;
+  for (size_t r = 0; r < l->repeats; ++r) {
+    for (size_t i = l->begin; i < l->end; ++i) {
+      found += l->map->count((*l->refs)[i]);
+    }
+  }
+  l->found = found;
+}
+
+/*
+ * Runs `fn` over `refs` split into `nthreads` slices and prints the lookup
+ * rate.
+ */
+void run(const char* name,
+         void (*fn)(Lookups*),
+         const std::vector<const DexType*>& refs,
+         const ClassMap& map,
+         size_t repeats,
+         size_t nthreads) {
+  std::vector<Lookups> slices(nthreads);
+  std::vector<WorkItem<Lookups>> items(nthreads);
+  for (size_t t = 0; t < nthreads; ++t) {
+    slices[t] = Lookups{&refs,
+                        &map,
+                        refs.size() * t / nthreads,
+                        refs.size() * (t + 1) / nthreads,
+                        repeats,
+                        0};
+    items[t].init(fn, &slices[t]);
+  }
+  auto start = BenchClock::now();
+  if (nthreads == 1) {
+    fn(&slices[0]);
+  } else {
+    WorkQueue wq;
+    wq.run_work_items(&items[0], nthreads);
+  }
+  auto time = usecs(BenchClock::now() - start);
+  size_t found = 0;
+  for (auto& s : slices) {
+    found += s.found;
+  }
+  auto lookups = double(refs.size()) * repeats;
+  printf("%-10s %2lu thread(s): %8.0fus, %6.2fns/lookup, %7.1fM lookups/s, "
+         "%lu found\n",
+         name, nthreads, time, time * 1000 / lookups, lookups / time,
+         found / repeats);
+}
+}
+
+int main(int argc, char* argv[]) {
+  size_t repeats = 20;
+  int c;
+  while ((c = getopt(argc, argv, "r:")) != -1) {
+    switch (c) {
+    case 'r':
+      repeats = std::max(1, atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-r <repeats>] <classes.dex>...\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "No dex files given\n");
+    return 1;
+  }
+
+  g_redex = new RedexContext();
+  DexClassesVector dexen;
+  for (int i = optind; i < argc; ++i) {
+    dexen.emplace_back(load_classes_from_dex(argv[i]));
+  }
+  auto scope = build_class_scope(dexen);
+
+  std::vector<const DexType*> refs;
+  ClassMap map;
+  for (auto cls : scope) {
+    map.emplace(cls->get_type(), cls);
+    refs.push_back(cls->get_super_class());
+    for (auto intf : cls->get_interfaces()->get_type_list()) {
+      refs.push_back(intf);
+    }
+  }
+  walk_opcodes(scope,
+               [](DexMethod*) { return true; },
+               [&](DexMethod*, DexInstruction* insn) {
+                 if (insn->has_types()) {
+                   refs.push_back(
+                     static_cast<DexOpcodeType*>(insn)->get_type());
+                 } else if (insn->has_methods()) {
+                   refs.push_back(
+                     static_cast<DexOpcodeMethod*>(insn)->get_method()
+                       ->get_class());
+                 } else if (insn->has_fields()) {
+                   refs.push_back(
+                     static_cast<DexOpcodeField*>(insn)->field()
+                       ->get_class());
+                 }
+               });
+  printf("%lu classes, %lu type references\n", scope.size(), refs.size());
+
+  run("type_class", with_type_class, refs, map, repeats, 1);
+  run("hash map", with_map, refs, map, repeats, 1);
+  run("type_class", with_type_class, refs, map, repeats, 4);
+  run("hash map", with_map, refs, map, repeats, 4);
+  return 0;
+}
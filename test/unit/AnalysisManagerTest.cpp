@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "AnalysisManager.h"
+#include "CallGraph.h"
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "Purity.h"
+#include "ReferenceIndex.h"
+
+TEST(AnalysisManagerTest, invalidate) {
+  g_redex = new RedexContext();
+
+  auto method = make_method("LFoo;", "bar", "V", {}, 0, {
+    insn(OPCODE_RETURN_VOID),
+  });
+  DexClassesVector dexen;
+  dexen.emplace_back(1);
+  dexen[0].insert_at(make_class("LFoo;", "Ljava/lang/Object;", {method}), 0);
+
+  {
+    AnalysisManager analyses(dexen);
+    EXPECT_EQ(1, analyses.scope().size());
+    analyses.call_graph();
+    analyses.reference_index();
+    analyses.purity();
+    analyses.purity();
+    EXPECT_EQ(1, analyses.builds(AnalysisManager::SCOPE));
+    EXPECT_EQ(1, analyses.builds(AnalysisManager::PURITY));
+    EXPECT_EQ(&analyses.reference_index(), ReferenceIndex::current());
+
+    // Preserving everything rebuilds nothing.
+    analyses.invalidate(AnalysisManager::ALL);
+    analyses.call_graph();
+    EXPECT_EQ(1, analyses.builds(AnalysisManager::CALL_GRAPH));
+
+    // Only what isn't preserved is dropped.
+    analyses.invalidate(AnalysisManager::SCOPE |
+                        AnalysisManager::CLASS_HIERARCHY |
+                        AnalysisManager::PURITY);
+    EXPECT_EQ(nullptr, ReferenceIndex::current());
+    analyses.purity();
+    analyses.call_graph();
+    analyses.reference_index();
+    EXPECT_EQ(1, analyses.builds(AnalysisManager::PURITY));
+    EXPECT_EQ(2, analyses.builds(AnalysisManager::CALL_GRAPH));
+    EXPECT_EQ(2, analyses.builds(AnalysisManager::REFERENCE_INDEX));
+
+    // Purity depends on the class hierarchy.
+    analyses.invalidate(AnalysisManager::SCOPE | AnalysisManager::PURITY);
+    analyses.purity();
+    EXPECT_EQ(2, analyses.builds(AnalysisManager::PURITY));
+    EXPECT_EQ(1, analyses.builds(AnalysisManager::SCOPE));
+
+    // Everything depends on the scope.
+    analyses.invalidate(AnalysisManager::ALL & ~AnalysisManager::SCOPE);
+    analyses.purity();
+    EXPECT_EQ(2, analyses.builds(AnalysisManager::SCOPE));
+    EXPECT_EQ(3, analyses.builds(AnalysisManager::PURITY));
+  }
+  EXPECT_EQ(nullptr, ReferenceIndex::current());
+
+  delete g_redex;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "CallGraph.h"
+#include "DexClass.h"
+#include "IRTestUtil.h"
+
+namespace {
+
+std::vector<DexMethod*> callers(const CallGraph& graph, DexMethod* callee) {
+  std::vector<DexMethod*> callers;
+  for (auto& site : graph.callers(callee)) {
+    callers.push_back(site.caller);
+  }
+  return callers;
+}
+}
+
+TEST(CallGraphTest, edges) {
+  g_redex = new RedexContext();
+
+  const char* obj = "Ljava/lang/Object;";
+  auto base_m = make_method("LBase;", "m", "V", {}, 1, {}, ACC_PUBLIC);
+  auto sub_m = make_method("LSub;", "m", "V", {}, 1, {}, ACC_PUBLIC);
+  auto intf_n = make_method("LI;", "n", "V", {}, 1, {},
+                            ACC_PUBLIC | ACC_ABSTRACT);
+  auto impl_n = make_method("LImpl;", "n", "V", {}, 1, {}, ACC_PUBLIC);
+  auto helper = make_method("LUser;", "helper", "V", {}, 1, {});
+  auto framework = DexMethod::make_method(obj, "notify", "V", {});
+  auto caller = make_method("LUser;", "caller", "V", {}, 1, {
+    invoke(OPCODE_INVOKE_VIRTUAL, base_m, {0}),
+    invoke(OPCODE_INVOKE_INTERFACE, intf_n, {0}),
+    invoke(OPCODE_INVOKE_STATIC, helper),
+    invoke(OPCODE_INVOKE_VIRTUAL, framework, {0}),
+    insn(OPCODE_RETURN_VOID),
+  });
+  auto direct = make_method("LUser;", "direct", "V", {}, 1, {
+    invoke(OPCODE_INVOKE_STATIC, helper),
+    insn(OPCODE_RETURN_VOID),
+  });
+  Scope scope{make_class("LBase;", obj, {base_m}),
+              make_class("LSub;", "LBase;", {sub_m}),
+              make_class("LI;", obj, {intf_n}, {}, {},
+                         ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT),
+              make_class("LImpl;", obj, {impl_n}, {}, {"LI;"}),
+              make_class("LUser;", obj, {helper, caller, direct})};
+
+  CallGraph graph(scope);
+  auto& calls = graph.callees(caller);
+  ASSERT_EQ(4, calls.size());
+  EXPECT_EQ(std::vector<DexMethod*>({base_m, sub_m}), calls[0].targets);
+  EXPECT_EQ(std::vector<DexMethod*>({impl_n}), calls[1].targets);
+  EXPECT_EQ(std::vector<DexMethod*>({helper}), calls[2].targets);
+  EXPECT_TRUE(calls[3].targets.empty());
+  EXPECT_EQ(std::vector<DexMethod*>({caller}), callers(graph, sub_m));
+  EXPECT_EQ(std::vector<DexMethod*>({caller, direct}), callers(graph, helper));
+  EXPECT_TRUE(graph.callers(intf_n).empty());
+  EXPECT_EQ(5, graph.edges());
+
+  // Inlining helper into direct leaves it without calls.
+  direct->get_code()->get_instructions().erase(
+    direct->get_code()->get_instructions().begin());
+  graph.update_method(direct);
+  EXPECT_TRUE(graph.callees(direct).empty());
+  EXPECT_EQ(std::vector<DexMethod*>({caller}), callers(graph, helper));
+  EXPECT_EQ(4, graph.edges());
+
+  graph.remove_method(sub_m);
+  EXPECT_EQ(std::vector<DexMethod*>({base_m}), calls[0].targets);
+  EXPECT_TRUE(graph.callers(sub_m).empty());
+  graph.update_method(caller);
+  EXPECT_EQ(std::vector<DexMethod*>({base_m}),
+            graph.callees(caller)[0].targets);
+  EXPECT_EQ(3, graph.edges());
+
+  delete g_redex;
+}
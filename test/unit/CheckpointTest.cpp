@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "Checkpoint.h"
+#include "ConfigFiles.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRTestUtil.h"
+#include "RedexContext.h"
+
+namespace {
+
+/* A class with an int field f and a method void m(int, Object). */
+DexClass* class_with_members(const char* name) {
+  auto field = DexField::make_field(
+      DexType::make_type(name), DexString::make_string("f"), get_int_type());
+  field->make_concrete(ACC_PUBLIC);
+  auto method = make_method(name, "m", "V", {"I", "Ljava/lang/Object;"}, 3,
+                            {insn(OPCODE_RETURN_VOID)}, ACC_PUBLIC);
+  return make_class(name, "Ljava/lang/Object;", {method}, {field});
+}
+
+}
+
+TEST(CheckpointTest, roundTrip) {
+  char dir[] = "/tmp/checkpoint_test.XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+
+  g_redex = new RedexContext();
+  auto foo = class_with_members("LFoo;");
+  auto bar = class_with_members("LBar;");
+  DexClassesVector dexen;
+  dexen.emplace_back(1);
+  dexen[0].insert_at(foo, 0);
+  dexen.emplace_back(1);
+  dexen[1].insert_at(bar, 0);
+  foo->rstate.ref_by_string(false);
+  foo->get_ifields().front()->rstate.ref_by_type();
+  bar->get_vmethods().front()->rstate.ref_by_seed();
+  DexString::make_string("unreferenced");
+  DexType::make_type("LUnreferenced;");
+  {
+    ConfigFiles cfg(folly::dynamic::object);
+    cfg.add_moved_methods(
+        MethodTuple(DexString::make_string("LOld;"),
+                    DexString::make_string("moved"),
+                    nullptr),
+        bar);
+    write_checkpoint(dir, 3, "SomePass#2", dexen, cfg);
+  }
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  CheckpointReader reader(dir);
+  EXPECT_EQ(3, reader.pass_index());
+  EXPECT_EQ("SomePass#2", reader.pass_name());
+  auto restored = reader.load_classes();
+  ASSERT_EQ(2, restored.size());
+  ASSERT_EQ(1, restored[0].size());
+  ASSERT_EQ(1, restored[1].size());
+  foo = restored[0].get(0);
+  bar = restored[1].get(0);
+  EXPECT_STREQ("LFoo;", foo->get_type()->get_name()->c_str());
+  EXPECT_STREQ("LBar;", bar->get_type()->get_name()->c_str());
+
+  EXPECT_FALSE(foo->rstate.can_rename());
+  EXPECT_FALSE(foo->rstate.can_delete());
+  // get_int_type() remembers the type from the first context.
+  auto field = DexField::get_field(
+      foo->get_type(), DexString::get_string("f"), DexType::get_type("I"));
+  ASSERT_NE(nullptr, field);
+  EXPECT_FALSE(field->rstate.can_delete());
+  EXPECT_TRUE(field->rstate.can_rename());
+  auto method = bar->get_vmethods().front();
+  EXPECT_TRUE(method->rstate.is_seed());
+  EXPECT_TRUE(bar->rstate.can_rename());
+  EXPECT_FALSE(foo->get_vmethods().front()->rstate.is_seed());
+
+  // Interned strings and types nothing refers to come back too.
+  EXPECT_NE(nullptr, DexString::get_string("unreferenced"));
+  EXPECT_NE(nullptr, DexType::get_type("LUnreferenced;"));
+
+  ConfigFiles cfg(folly::dynamic::object);
+  reader.restore_config(cfg);
+  EXPECT_TRUE(cfg.save_move_map());
+  auto moved = cfg.get_moved_methods_map();
+  ASSERT_EQ(1, moved->size());
+  EXPECT_EQ(bar, moved->begin()->second);
+  EXPECT_STREQ("moved", std::get<1>(moved->begin()->first)->c_str());
+  EXPECT_EQ(nullptr, std::get<2>(moved->begin()->first));
+  delete g_redex;
+
+  system((std::string("rm -rf ") + dir).c_str());
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRTestUtil.h"
+
+namespace {
+
+std::vector<const DexType*> types(const ClassHierarchy::Range& range) {
+  return std::vector<const DexType*>(range.begin(), range.end());
+}
+}
+
+TEST(ClassHierarchyTest, subtypes) {
+  g_redex = new RedexContext();
+
+  const char* obj = "Ljava/lang/Object;";
+  auto iface = ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT;
+  auto i = make_class("LI;", obj, {}, {}, {}, iface);
+  auto j = make_class("LJ;", obj, {}, {}, {"LI;"}, iface);
+  auto a = make_class("LA;", obj);
+  auto b = make_class("LB;", "LA;", {}, {}, {"LJ;"});
+  auto c = make_class("LC;", "LB;");
+  auto e = make_class("LE;", "LA;");
+  // Extends a type we know nothing about.
+  auto x = make_class("LX;", "Lext/Base;", {}, {}, {"LI;"});
+  std::vector<DexClass*> classes{i, j, a, b, c, e, x};
+  ClassHierarchy ch(classes);
+
+  auto t = [](DexClass* cls) { return cls->get_type(); };
+  auto base = DexType::make_type("Lext/Base;");
+  EXPECT_TRUE(ch.is_subclass(t(c), t(a)));
+  EXPECT_TRUE(ch.is_subclass(t(c), t(c)));
+  EXPECT_FALSE(ch.is_subclass(t(a), t(c)));
+  EXPECT_FALSE(ch.is_subclass(t(e), t(b)));
+  EXPECT_FALSE(ch.is_subclass(t(c), t(i)));
+  EXPECT_TRUE(ch.is_subclass(t(x), base));
+
+  // C gets I through B's superinterface J.
+  EXPECT_TRUE(ch.is_subtype(t(c), t(j)));
+  EXPECT_TRUE(ch.is_subtype(t(c), t(i)));
+  EXPECT_TRUE(ch.is_subtype(t(j), t(i)));
+  EXPECT_FALSE(ch.is_subtype(t(i), t(j)));
+  EXPECT_FALSE(ch.is_subtype(t(e), t(i)));
+  EXPECT_FALSE(ch.is_subtype(t(a), t(j)));
+  EXPECT_TRUE(ch.is_subtype(t(x), t(i)));
+  EXPECT_FALSE(ch.is_subtype(base, t(i)));
+
+  // Preorder, siblings in the order they were given.
+  EXPECT_EQ(std::vector<const DexType*>({t(b), t(c), t(e)}),
+            types(ch.subclasses(t(a))));
+  EXPECT_TRUE(ch.subclasses(t(c)).size() == 0);
+  EXPECT_TRUE(ch.subclasses(DexType::make_type("LUnknown;")).size() == 0);
+
+  // The shared snapshot agrees with the one built by hand and picks up new
+  // classes.
+  for (auto sub : classes) {
+    for (auto super : classes) {
+      EXPECT_EQ(ch.is_subtype(t(sub), t(super)),
+                check_cast(t(sub), t(super)));
+    }
+  }
+  auto before = ClassHierarchy::get();
+  auto f = make_class("LF;", "LC;");
+  auto after = ClassHierarchy::get();
+  EXPECT_NE(before, after);
+  EXPECT_FALSE(before->is_subclass(t(f), t(a)));
+  EXPECT_TRUE(after->is_subclass(t(f), t(a)));
+  EXPECT_TRUE(check_cast(t(f), t(i)));
+  TypeVector children;
+  get_all_children(t(a), children);
+  EXPECT_EQ(TypeVector({t(b), t(c), t(f), t(e)}), children);
+
+  delete g_redex;
+}
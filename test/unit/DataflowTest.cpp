@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+
+#include "Dataflow.h"
+
+namespace {
+
+/*
+ * A CFG with random edges (including back edges), and random gen/kill sets
+ * for each block.
+ */
+struct RandomProblem {
+  std::vector<Block*> blocks;
+  std::vector<BitVector> gen;
+  std::vector<BitVector> kill;
+
+  RandomProblem(size_t nblocks, size_t nbits, unsigned seed) {
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < nblocks; ++i) {
+      blocks.push_back(new Block(i));
+      gen.emplace_back(nbits);
+      kill.emplace_back(nbits);
+      for (size_t b = 0; b < nbits; ++b) {
+        if (rng() % 4 == 0) gen.back().set(b);
+        if (rng() % 4 == 0) kill.back().set(b);
+      }
+    }
+    for (size_t i = 0; i + 1 < nblocks; ++i) {
+      add_edge(i, i + 1);
+      if (rng() % 3 == 0) add_edge(i, rng() % nblocks);
+    }
+  }
+
+  ~RandomProblem() {
+    for (auto b : blocks) {
+      delete b;
+    }
+  }
+
+  void add_edge(size_t p, size_t s) {
+    blocks[p]->succs().push_back(blocks[s]);
+    blocks[s]->preds().push_back(blocks[p]);
+  }
+
+  void transfer(Block* b, const BitVector& input, BitVector& output) {
+    output = input;
+    output.subtract(kill[b->id()]);
+    output |= gen[b->id()];
+  }
+};
+
+/*
+ * Solve by iterating over every block until nothing changes.
+ */
+std::vector<BitVector> round_robin(RandomProblem& p,
+                                   size_t nbits,
+                                   DataflowDirection dir) {
+  bool forward = dir == DataflowDirection::FORWARD;
+  std::vector<BitVector> result(p.blocks.size(), BitVector(nbits));
+  bool changed;
+  do {
+    changed = false;
+    for (auto b : p.blocks) {
+      BitVector input(nbits);
+      for (auto n : forward ? b->preds() : b->succs()) {
+        input |= result[n->id()];
+      }
+      BitVector output(nbits);
+      p.transfer(b, input, output);
+      if (output != result[b->id()]) {
+        result[b->id()] = output;
+        changed = true;
+      }
+    }
+  } while (changed);
+  return result;
+}
+
+}
+
+TEST(BitVectorTest, ops) {
+  BitVector a(130);
+  BitVector b(130);
+  EXPECT_FALSE(a.any());
+  a.set(0);
+  a.set(64);
+  a.set(129);
+  b.set(64);
+  b.set(100);
+  EXPECT_TRUE(a.test(129));
+  EXPECT_FALSE(a.test(128));
+  EXPECT_EQ(3, a.count());
+
+  auto c = a;
+  c |= b;
+  EXPECT_EQ(4, c.count());
+  c &= b;
+  EXPECT_EQ(b, c);
+  a.subtract(b);
+  EXPECT_EQ(2, a.count());
+  EXPECT_FALSE(a.test(64));
+  a.reset(0);
+  a.reset();
+  EXPECT_FALSE(a.any());
+  EXPECT_EQ(std::string("101"), show([] {
+              BitVector v(3);
+              v.set(0);
+              v.set(2);
+              return v;
+            }()));
+}
+
+TEST(DataflowTest, matchesRoundRobin) {
+  const size_t nbits = 100;
+  for (unsigned seed = 0; seed < 50; ++seed) {
+    for (auto dir :
+         {DataflowDirection::FORWARD, DataflowDirection::BACKWARD}) {
+      RandomProblem p(40, nbits, seed);
+      auto expected = round_robin(p, nbits, dir);
+      auto result = run_dataflow(
+          p.blocks,
+          dir,
+          BitVector(nbits),
+          [&](Block* b, const BitVector& input, BitVector& output) {
+            p.transfer(b, input, output);
+          },
+          [](const BitVector& from, BitVector& into) { into |= from; });
+      auto& actual =
+          dir == DataflowDirection::FORWARD ? result.out : result.in;
+      for (size_t i = 0; i < p.blocks.size(); ++i) {
+        EXPECT_EQ(expected[i], actual[i]) << "seed " << seed << " block " << i;
+      }
+    }
+  }
+}
@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+#include "Dominators.h"
+
+namespace {
+
+struct Graph {
+  std::vector<Block*> blocks;
+
+  explicit Graph(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      blocks.push_back(new Block(i));
+    }
+  }
+
+  Graph(size_t n, std::vector<std::pair<size_t, size_t>> edges) : Graph(n) {
+    for (auto& e : edges) {
+      add_edge(e.first, e.second);
+    }
+  }
+
+  ~Graph() {
+    for (auto b : blocks) {
+      delete b;
+    }
+  }
+
+  void add_edge(size_t p, size_t s) {
+    blocks[p]->succs().push_back(blocks[s]);
+    blocks[s]->preds().push_back(blocks[p]);
+  }
+
+  Block* operator[](size_t i) { return blocks[i]; }
+};
+
+/*
+ * Dominator sets by the textbook set-intersection fixpoint.
+ */
+std::vector<std::vector<bool>> naive_dominators(Graph& g) {
+  auto n = g.blocks.size();
+  std::vector<bool> reachable(n);
+  std::vector<Block*> worklist{g[0]};
+  reachable[0] = true;
+  while (!worklist.empty()) {
+    auto b = worklist.back();
+    worklist.pop_back();
+    for (auto s : b->succs()) {
+      if (!reachable[s->id()]) {
+        reachable[s->id()] = true;
+        worklist.push_back(s);
+      }
+    }
+  }
+  std::vector<std::vector<bool>> dom(n, std::vector<bool>(n, true));
+  dom[0].assign(n, false);
+  dom[0][0] = true;
+  bool changed;
+  do {
+    changed = false;
+    for (size_t i = 1; i < n; ++i) {
+      if (!reachable[i]) {
+        continue;
+      }
+      std::vector<bool> d(n, true);
+      for (auto p : g[i]->preds()) {
+        if (!reachable[p->id()]) {
+          continue;
+        }
+        for (size_t j = 0; j < n; ++j) {
+          d[j] = d[j] && dom[p->id()][j];
+        }
+      }
+      d[i] = true;
+      if (d != dom[i]) {
+        dom[i] = d;
+        changed = true;
+      }
+    }
+  } while (changed);
+  for (size_t i = 0; i < n; ++i) {
+    if (!reachable[i]) {
+      dom[i].assign(n, false);
+    }
+  }
+  return dom;
+}
+
+std::vector<size_t> ids(const std::vector<Block*>& blocks) {
+  std::vector<size_t> ret;
+  for (auto b : blocks) {
+    ret.push_back(b->id());
+  }
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+}
+
+TEST(DominatorsTest, diamond) {
+  //  0 --> 1 --> 3
+  //  |           ^
+  //  +---> 2 ----+
+  Graph g(4, {{0, 1}, {0, 2}, {1, 3}, {2, 3}});
+  DominatorTree doms(g.blocks);
+  EXPECT_EQ(nullptr, doms.idom(g[0]));
+  EXPECT_EQ(g[0], doms.idom(g[1]));
+  EXPECT_EQ(g[0], doms.idom(g[2]));
+  EXPECT_EQ(g[0], doms.idom(g[3]));
+  EXPECT_TRUE(doms.dominates(g[0], g[3]));
+  EXPECT_FALSE(doms.dominates(g[1], g[3]));
+  EXPECT_EQ(std::vector<size_t>{3}, ids(doms.frontier(g[1])));
+  EXPECT_EQ(std::vector<size_t>{3}, ids(doms.frontier(g[2])));
+  EXPECT_TRUE(doms.frontier(g[0]).empty());
+
+  DominatorTree pdoms(g.blocks, true /* post */);
+  EXPECT_EQ(g[3], pdoms.idom(g[0]));
+  EXPECT_EQ(g[3], pdoms.idom(g[1]));
+  EXPECT_EQ(nullptr, pdoms.idom(g[3]));
+  EXPECT_TRUE(pdoms.dominates(g[3], g[0]));
+  EXPECT_FALSE(pdoms.dominates(g[1], g[0]));
+  EXPECT_EQ(std::vector<size_t>{0}, ids(pdoms.frontier(g[1])));
+}
+
+TEST(DominatorsTest, unreachable) {
+  Graph g(3, {{0, 1}, {2, 1}});
+  DominatorTree doms(g.blocks);
+  EXPECT_FALSE(doms.is_reachable(g[2]));
+  EXPECT_EQ(nullptr, doms.idom(g[2]));
+  EXPECT_EQ(g[0], doms.idom(g[1]));
+  EXPECT_FALSE(doms.dominates(g[2], g[1]));
+  EXPECT_FALSE(doms.dominates(g[0], g[2]));
+}
+
+TEST(DominatorsTest, loopToEntry) {
+  // The entry is a loop header, so it's in the frontier of its latch.
+  Graph g(3, {{0, 1}, {1, 0}, {1, 2}});
+  DominatorTree doms(g.blocks);
+  EXPECT_EQ(std::vector<size_t>{0}, ids(doms.frontier(g[1])));
+  EXPECT_EQ(std::vector<size_t>{0}, ids(doms.frontier(g[0])));
+  LoopInfo loops(g.blocks, doms);
+  ASSERT_EQ(1, loops.loops().size());
+  EXPECT_EQ(g[0], loops.loops()[0]->header);
+  EXPECT_EQ(0, loops.depth(g[2]));
+}
+
+TEST(DominatorsTest, nestedLoops) {
+  // 0 -> 1 -> 2 -> 3 -> 4 -> 5
+  //      ^    ^    |    |
+  //      |    +----+    |
+  //      +--------------+
+  Graph g(6, {{0, 1}, {1, 2}, {2, 3}, {3, 2}, {3, 4}, {4, 1}, {4, 5}});
+  DominatorTree doms(g.blocks);
+  LoopInfo loops(g.blocks, doms);
+  ASSERT_EQ(2, loops.loops().size());
+  ASSERT_EQ(1, loops.top_level().size());
+  auto outer = loops.top_level()[0];
+  EXPECT_EQ(g[1], outer->header);
+  EXPECT_EQ((std::vector<size_t>{1, 2, 3, 4}), ids(outer->blocks));
+  ASSERT_EQ(1, outer->children.size());
+  auto inner = outer->children[0];
+  EXPECT_EQ(g[2], inner->header);
+  EXPECT_EQ(outer, inner->parent);
+  EXPECT_EQ((std::vector<size_t>{2, 3}), ids(inner->blocks));
+  EXPECT_EQ(std::vector<size_t>{3}, ids(inner->latches));
+
+  EXPECT_EQ(0, loops.depth(g[0]));
+  EXPECT_EQ(1, loops.depth(g[1]));
+  EXPECT_EQ(2, loops.depth(g[3]));
+  EXPECT_EQ(1, loops.depth(g[4]));
+  EXPECT_EQ(0, loops.depth(g[5]));
+  EXPECT_EQ(inner, loops.loop_for(g[3]));
+  EXPECT_TRUE(loops.is_header(g[2]));
+  EXPECT_FALSE(loops.is_header(g[3]));
+  EXPECT_TRUE(outer->contains(g[3]));
+  EXPECT_FALSE(inner->contains(g[1]));
+}
+
+TEST(DominatorsTest, irreducible) {
+  // 1 and 2 form a cycle with two entries, so neither dominates the other
+  // and there's no natural loop.
+  Graph g(4, {{0, 1}, {0, 2}, {1, 2}, {2, 1}, {2, 3}});
+  DominatorTree doms(g.blocks);
+  EXPECT_EQ(g[0], doms.idom(g[1]));
+  EXPECT_EQ(g[0], doms.idom(g[2]));
+  LoopInfo loops(g.blocks, doms);
+  EXPECT_TRUE(loops.loops().empty());
+}
+
+TEST(DominatorsTest, randomGraphs) {
+  for (unsigned seed = 0; seed < 100; ++seed) {
+    std::mt19937 rng(seed);
+    size_t n = 2 + rng() % 40;
+    Graph g(n);
+    for (size_t i = 0; i < n; ++i) {
+      auto nsuccs = rng() % 3;
+      for (size_t j = 0; j < nsuccs; ++j) {
+        g.add_edge(i, rng() % n);
+      }
+    }
+    DominatorTree doms(g.blocks);
+    auto expected = naive_dominators(g);
+    for (size_t a = 0; a < n; ++a) {
+      for (size_t b = 0; b < n; ++b) {
+        EXPECT_EQ(expected[b][a], doms.dominates(g[a], g[b]))
+            << "seed " << seed << ": " << a << " dom " << b;
+      }
+    }
+    // DF(a) = { b | a dominates a predecessor of b but not strictly b }
+    for (size_t a = 0; a < n; ++a) {
+      std::vector<size_t> df;
+      for (size_t b = 0; b < n; ++b) {
+        bool strict = a != b && expected[b][a];
+        if (strict) {
+          continue;
+        }
+        for (auto p : g[b]->preds()) {
+          if (expected[p->id()][a]) {
+            df.push_back(b);
+            break;
+          }
+        }
+      }
+      EXPECT_EQ(df, ids(doms.frontier(g[a]))) << "seed " << seed << " DF "
+                                               << a;
+    }
+  }
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "DexUtil.h"
+
+/*
+ * Factories for the IR the unit tests in this directory build by hand.
+ */
+
+/* `op` with the given registers, and literal if it takes one. */
+inline DexInstruction* insn(DexOpcode op,
+                            int dest = -1,
+                            std::vector<uint16_t> srcs = {},
+                            int64_t literal = 0) {
+  auto insn = new DexInstruction(op);
+  if (dest >= 0) {
+    insn->set_dest(dest);
+  }
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    insn->set_src(i, srcs[i]);
+  }
+  if (insn->has_literal()) {
+    insn->set_literal(literal);
+  }
+  return insn;
+}
+
+/* A branch to `offset` code units away. */
+inline DexInstruction* branch(DexOpcode op,
+                              std::vector<uint16_t> srcs,
+                              int offset) {
+  auto b = insn(op, -1, srcs);
+  b->set_offset(offset);
+  return b;
+}
+
+/* A call to `callee` passing `srcs`. */
+inline DexInstruction* invoke(DexOpcode op,
+                              DexMethod* callee,
+                              std::vector<uint16_t> srcs = {}) {
+  auto insn = new DexOpcodeMethod(op, callee, 0);
+  insn->set_arg_word_count(srcs.size());
+  for (size_t i = 0; i < srcs.size(); ++i) {
+    insn->set_src(i, srcs[i]);
+  }
+  return insn;
+}
+
+/* A static get of `field` into `reg`, or put of `reg` into it. */
+inline DexInstruction* field_op(DexOpcode op, DexField* field, int reg) {
+  auto insn = new DexOpcodeField(op, field);
+  if (is_sget(op)) {
+    insn->set_dest(reg);
+  } else {
+    insn->set_src(0, reg);
+  }
+  return insn;
+}
+
+/*
+ * A concrete method of `cls` with its arguments, `this` included, in the
+ * last of `regs` registers, and no code if `insns` is empty.  It's virtual
+ * unless it's static, private or a constructor.
+ */
+inline DexMethod* make_method(const char* cls,
+                              const char* name,
+                              const char* rtype,
+                              std::vector<const char*> args,
+                              uint16_t regs,
+                              std::vector<DexInstruction*> insns,
+                              DexAccessFlags access = ACC_PUBLIC |
+                                                      ACC_STATIC) {
+  auto method = DexMethod::make_method(cls, name, rtype, args);
+  DexCode* code = nullptr;
+  if (!insns.empty()) {
+    code = new DexCode();
+    code->set_registers_size(regs);
+    code->set_ins_size(args.size() + (access & ACC_STATIC ? 0 : 1));
+    code->get_instructions() = insns;
+  }
+  bool is_virtual = !(access & (ACC_STATIC | ACC_PRIVATE | ACC_CONSTRUCTOR));
+  method->make_concrete(access, code, is_virtual);
+  return method;
+}
+
+inline DexClass* make_class(const char* name,
+                            const char* super = "Ljava/lang/Object;",
+                            std::vector<DexMethod*> methods = {},
+                            std::vector<DexField*> fields = {},
+                            std::vector<const char*> intfs = {},
+                            DexAccessFlags access = ACC_PUBLIC) {
+  ClassCreator cc(DexType::make_type(name));
+  cc.set_super(DexType::make_type(super));
+  cc.set_access(access);
+  for (auto intf : intfs) {
+    cc.add_interface(DexType::make_type(intf));
+  }
+  for (auto m : methods) {
+    cc.add_method(m);
+  }
+  for (auto f : fields) {
+    cc.add_field(f);
+  }
+  return cc.create();
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "MemoryAccounting.h"
+#include "RedexContext.h"
+#include "Transform.h"
+#include "WorkQueue.h"
+
+namespace {
+
+struct Alloc {
+  std::vector<DexInstruction*> insns;
+};
+
+void alloc(Alloc* a) {
+  for (int i = 0; i < 100; ++i) {
+    a->insns.push_back(new DexInstruction(OPCODE_NOP));
+  }
+}
+
+}
+
+TEST(MemoryAccountingTest, counts) {
+  g_redex = new RedexContext();
+  using MA = MemoryAccounting;
+
+  // Objects count at the size of their dynamic type.
+  auto insns_before = MA::usage(MA::INSTRUCTIONS);
+  auto method = DexMethod::make_method("LFoo;", "bar", "V", {});
+  DexInstruction* call = new DexOpcodeMethod(OPCODE_INVOKE_STATIC, method, 0);
+  auto insns = MA::usage(MA::INSTRUCTIONS);
+  EXPECT_EQ(insns_before.objects + 1, insns.objects);
+  EXPECT_EQ(insns_before.bytes + int64_t(sizeof(DexOpcodeMethod)),
+            insns.bytes);
+  delete call;
+  insns = MA::usage(MA::INSTRUCTIONS);
+  EXPECT_EQ(insns_before.objects, insns.objects);
+  EXPECT_EQ(insns_before.bytes, insns.bytes);
+
+  // Strings count their characters too, and the interning maps grow.
+  auto strings_before = MA::usage(MA::STRINGS);
+  auto maps_before = MA::usage(MA::CONTEXT_MAPS);
+  DexString::make_string("0123456789");
+  auto strings = MA::usage(MA::STRINGS);
+  EXPECT_EQ(strings_before.objects + 1, strings.objects);
+  EXPECT_EQ(strings_before.bytes + int64_t(sizeof(DexString) + 11),
+            strings.bytes);
+  EXPECT_EQ(maps_before.objects + 1, MA::usage(MA::CONTEXT_MAPS).objects);
+
+  auto items_before = MA::usage(MA::METHOD_ITEMS);
+  auto mei = new MethodItemEntry(new DexInstruction(OPCODE_NOP));
+  EXPECT_EQ(items_before.objects + 1, MA::usage(MA::METHOD_ITEMS).objects);
+  delete mei->insn;
+  delete mei;
+  EXPECT_EQ(items_before.bytes, MA::usage(MA::METHOD_ITEMS).bytes);
+
+  // Counts from other threads are included, and objects may be freed on a
+  // different thread than the one that allocated them.
+  std::vector<Alloc> allocs(8);
+  std::vector<WorkItem<Alloc>> items(allocs.size());
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    items[i].init(alloc, &allocs[i]);
+  }
+  WorkQueue wq;
+  wq.run_work_items(&items[0], items.size());
+  EXPECT_EQ(insns_before.objects + 800,
+            MA::usage(MA::INSTRUCTIONS).objects);
+  for (auto& a : allocs) {
+    for (auto insn : a.insns) {
+      delete insn;
+    }
+  }
+  EXPECT_EQ(insns_before.objects, MA::usage(MA::INSTRUCTIONS).objects);
+
+  delete g_redex;
+  strings = MA::usage(MA::STRINGS);
+  EXPECT_EQ(0, strings.objects);
+  EXPECT_EQ(0, strings.bytes);
+}
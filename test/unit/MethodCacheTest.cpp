@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "IRTestUtil.h"
+#include "MethodCache.h"
+#include "RedexContext.h"
+#include "ReferenceIndex.h"
+#include "Show.h"
+
+namespace {
+
+/*
+ * static void LFoo;.m()
+ *   const-string v0, "hello"
+ *   sget-object v1, LFoo;.f:Ljava/lang/String;
+ *   invoke-static {v0, v1}, LBar;.log(Ljava/lang/String;Ljava/lang/String;)V
+ *   return-void
+ * with the first two in a try catching LFooException;
+ */
+DexMethod* logging_method(uint16_t regs) {
+  auto foo = DexType::make_type("LFoo;");
+  auto string = DexType::make_type("Ljava/lang/String;");
+  auto field = DexField::make_field(foo, DexString::make_string("f"), string);
+  auto log = DexMethod::make_method(
+    "LBar;", "log", "V", {"Ljava/lang/String;", "Ljava/lang/String;"});
+  auto method = make_method("LFoo;", "m", "V", {}, regs, {
+    (new DexOpcodeString(OPCODE_CONST_STRING, DexString::make_string("hello")))
+        ->set_dest(0),
+    field_op(OPCODE_SGET_OBJECT, field, 1),
+    invoke(OPCODE_INVOKE_STATIC, log, {0, 1}),
+    insn(OPCODE_RETURN_VOID),
+  });
+  auto tri = new DexTryItem();
+  tri->m_start_addr = 0;
+  tri->m_insn_count = 4;
+  tri->m_catches.emplace_back(DexType::make_type("LFooException;"), 7);
+  tri->m_catchall = DEX_NO_INDEX;
+  method->get_code()->get_tries().push_back(tri);
+  return method;
+}
+
+std::string show_code(DexCode* code) {
+  std::string s = std::to_string(code->get_registers_size()) + "\n";
+  for (auto insn : code->get_instructions()) {
+    s += show(insn) + "\n";
+  }
+  for (auto tri : code->get_tries()) {
+    s += std::to_string(tri->m_start_addr) + "+" +
+      std::to_string(tri->m_insn_count) + ":";
+    for (auto& c : tri->m_catches) {
+      s += " " + show(c.first) + "@" + std::to_string(c.second);
+    }
+    s += "\n";
+  }
+  return s;
+}
+
+}
+
+TEST(MethodCacheTest, encodeInOneContextDecodeInAnother) {
+  g_redex = new RedexContext();
+  auto method = logging_method(2);
+  auto expected = show_code(method->get_code());
+  auto image = encode_method_code(method->get_code());
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  auto code = decode_method_code(
+    reinterpret_cast<const uint8_t*>(image.data()));
+  EXPECT_EQ(expected, show_code(code));
+  auto callee =
+    static_cast<DexOpcodeMethod*>(code->get_instructions()[2])->get_method();
+  auto log = DexMethod::make_method(
+    "LBar;", "log", "V", {"Ljava/lang/String;", "Ljava/lang/String;"});
+  EXPECT_EQ(log, callee);
+  delete code;
+  delete g_redex;
+}
+
+TEST(MethodCacheTest, restoreUnchangedMethods) {
+  char dir[] = "/tmp/method_cache_test.XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+
+  std::string key;
+  std::string result;
+  g_redex = new RedexContext();
+  {
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    ASSERT_TRUE(cache.enabled());
+    auto method = logging_method(2);
+    key = cache.key(method, "deps");
+    EXPECT_FALSE(cache.restore(method, key));
+    // What the pass did to it.
+    method->get_code()->set_registers_size(5);
+    result = show_code(method->get_code());
+    cache.save(method, key, {3, 0, 1ull << 40});
+    cache.write();
+    EXPECT_EQ(0, cache.hits());
+    EXPECT_EQ(1, cache.misses());
+  }
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  {
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    auto method = logging_method(2);
+    EXPECT_EQ(key, cache.key(method, "deps"));
+    EXPECT_FALSE(cache.restore(method, cache.key(method, "other deps")));
+    std::vector<uint64_t> counters;
+    EXPECT_TRUE(cache.restore(method, key, &counters));
+    EXPECT_EQ(result, show_code(method->get_code()));
+    // The pass's counters come back with the code.
+    EXPECT_EQ(std::vector<uint64_t>({3, 0, 1ull << 40}), counters);
+    cache.write();
+    EXPECT_EQ(1, cache.hits());
+  }
+  {
+    // Other passes have their own.
+    MethodCache cache(dir, "OtherPass", folly::dynamic::object);
+    auto method = logging_method(2);
+    EXPECT_FALSE(cache.restore(method, cache.key(method, "deps")));
+  }
+  {
+    // A run that doesn't come across the method drops it.
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    cache.write();
+  }
+  {
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    auto method = logging_method(2);
+    EXPECT_FALSE(cache.restore(method, key));
+  }
+  delete g_redex;
+
+  system((std::string("rm -rf ") + dir).c_str());
+}
+
+TEST(MethodCacheTest, restoreUpdatesReferenceIndex) {
+  char dir[] = "/tmp/method_cache_test.XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+
+  std::string key;
+  g_redex = new RedexContext();
+  {
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    auto method = logging_method(2);
+    key = cache.key(method, "");
+    cache.save(method, key);
+    cache.write();
+  }
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  {
+    auto method = logging_method(2);
+    Scope scope{make_class("LFoo;", "Ljava/lang/Object;", {method})};
+    ReferenceIndex index(scope);
+    auto log = DexMethod::make_method(
+      "LBar;", "log", "V", {"Ljava/lang/String;", "Ljava/lang/String;"});
+    auto hello = DexString::make_string("hello");
+
+    MethodCache cache(dir, "SomePass", folly::dynamic::object);
+    ASSERT_TRUE(cache.restore(method, key));
+    auto& insns = method->get_code()->get_instructions();
+    ASSERT_EQ(1, index.sites(hello).size());
+    EXPECT_EQ(insns[0], index.sites(hello)[0].insn);
+    ASSERT_EQ(1, index.sites(log).size());
+    EXPECT_EQ(method, index.sites(log)[0].method);
+    EXPECT_EQ(insns[2], index.sites(log)[0].insn);
+  }
+  delete g_redex;
+
+  system((std::string("rm -rf ") + dir).c_str());
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "Purity.h"
+
+/*
+ * One context for all the tests: helpers like is_clinit() cache interned
+ * strings in statics.
+ */
+class PurityTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() { g_redex = new RedexContext(); }
+  static void TearDownTestCase() { delete g_redex; }
+};
+
+TEST_F(PurityTest, summaries) {
+  const char* cls = "LPurityTest;";
+  auto count = DexField::make_field(DexType::make_type(cls),
+                                    DexString::make_string("count"),
+                                    DexType::make_type("I"));
+  count->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  auto add = make_method(cls, "add", "I", {"I", "I"}, 2, {
+    insn(OPCODE_ADD_INT, 0, {0, 1}),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto twice = make_method(cls, "twice", "I", {"I"}, 1, {
+    invoke(OPCODE_INVOKE_STATIC, add, {0, 0}),
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto get = make_method(cls, "get", "I", {}, 1, {
+    field_op(OPCODE_SGET, count, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto bump = make_method(cls, "bump", "V", {}, 1, {
+    field_op(OPCODE_SGET, count, 0),
+    insn(OPCODE_ADD_INT_LIT16, 0, {0}, 1),
+    field_op(OPCODE_SPUT, count, 0),
+    insn(OPCODE_RETURN_VOID),
+  });
+  auto calls_bump = make_method(cls, "callsBump", "V", {}, 0, {
+    invoke(OPCODE_INVOKE_STATIC, bump, {}),
+    insn(OPCODE_RETURN_VOID),
+  });
+  auto loop = make_method(cls, "loop", "I", {"I"}, 1, {
+    insn(OPCODE_ADD_INT_LIT16, 0, {0}, -1),
+    branch(OPCODE_IF_NEZ, {0}, -2),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto recurse_ref = DexMethod::make_method(cls, "recurse", "I", {"I"});
+  auto recurse = make_method(cls, "recurse", "I", {"I"}, 1, {
+    invoke(OPCODE_INVOKE_STATIC, recurse_ref, {0}),
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto length = DexMethod::make_method(
+    "Ljava/lang/String;", "length", "I", {});
+  auto len = make_method(cls, "len", "I", {"Ljava/lang/String;"}, 1, {
+    invoke(OPCODE_INVOKE_VIRTUAL, length, {0}),
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  Scope scope{make_class(
+    cls, "Ljava/lang/Object;",
+    {add, twice, get, bump, calls_bump, loop, recurse, len}, {count})};
+
+  PurityAnalysis purity(scope);
+  EXPECT_EQ(Purity::PURE, purity.purity(add));
+  EXPECT_EQ(Purity::PURE, purity.purity(twice));
+  EXPECT_EQ(Purity::SIDE_EFFECT_FREE, purity.purity(get));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(bump));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(calls_bump));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(loop));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(recurse));
+  EXPECT_EQ(Purity::PURE, purity.purity(len));
+  EXPECT_EQ(3, purity.count(Purity::PURE));
+  EXPECT_EQ(1, purity.count(Purity::SIDE_EFFECT_FREE));
+  EXPECT_EQ(4, purity.count(Purity::IMPURE));
+}
+
+/*
+ * Calling a static method of a class with a static initializer may run the
+ * initializer, except from inside the class.
+ */
+TEST_F(PurityTest, staticInitializers) {
+  const char* init_cls = "LPurityTestInit;";
+  auto clinit = make_method(init_cls, "<clinit>", "V", {}, 0, {
+    insn(OPCODE_RETURN_VOID),
+  }, ACC_STATIC | ACC_CONSTRUCTOR);
+  auto id = make_method(init_cls, "id", "I", {"I"}, 1, {
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto inside = make_method(init_cls, "inside", "I", {"I"}, 1, {
+    invoke(OPCODE_INVOKE_STATIC, id, {0}),
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  auto outside = make_method("LPurityTestUser;", "outside", "I", {"I"}, 1, {
+    invoke(OPCODE_INVOKE_STATIC, id, {0}),
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  Scope scope{
+    make_class(init_cls, "Ljava/lang/Object;", {clinit, id, inside}),
+    make_class("LPurityTestUser;", "Ljava/lang/Object;", {outside})};
+
+  PurityAnalysis purity(scope);
+  EXPECT_EQ(Purity::PURE, purity.purity(id));
+  EXPECT_EQ(Purity::PURE, purity.purity(inside));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(outside));
+  auto call = outside->get_code()->get_instructions()[0];
+  EXPECT_EQ(Purity::IMPURE, purity.invoke_purity(outside, call));
+  EXPECT_EQ(Purity::PURE, purity.invoke_purity(inside, call));
+}
+
+/*
+ * Jumbo field writes and invokes are never looked into, so they count as
+ * impure whatever they reach.
+ */
+TEST_F(PurityTest, jumboOpcodes) {
+  const char* cls = "LPurityTestJumbo;";
+  auto total = DexField::make_field(DexType::make_type(cls),
+                                    DexString::make_string("total"),
+                                    DexType::make_type("I"));
+  total->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  // DexInstruction can't set the registers of jumbo formats; purity
+  // doesn't look at them anyway.
+  auto put = make_method(cls, "put", "V", {}, 1, {
+    new DexOpcodeField(OPCODE_SPUT_JUMBO, total),
+    insn(OPCODE_RETURN_VOID),
+  });
+  auto call = make_method(cls, "call", "V", {}, 0, {
+    new DexOpcodeMethod(OPCODE_INVOKE_STATIC_JUMBO, put, 0),
+    insn(OPCODE_RETURN_VOID),
+  });
+  Scope scope{make_class(cls, "Ljava/lang/Object;", {put, call}, {total})};
+
+  PurityAnalysis purity(scope);
+  EXPECT_EQ(Purity::IMPURE, purity.purity(put));
+  EXPECT_EQ(Purity::IMPURE, purity.purity(call));
+  auto jumbo_call = call->get_code()->get_instructions()[0];
+  EXPECT_EQ(Purity::IMPURE, purity.invoke_purity(call, jumbo_call));
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "ReferenceIndex.h"
+#include "Transform.h"
+
+namespace {
+
+std::vector<DexInstruction*> insns(const ReferenceIndex::Sites& sites) {
+  std::vector<DexInstruction*> insns;
+  for (auto& site : sites) {
+    insns.push_back(site.insn);
+  }
+  return insns;
+}
+}
+
+TEST(ReferenceIndexTest, sites) {
+  g_redex = new RedexContext();
+
+  const char* cls = "LRefs;";
+  auto type = DexType::make_type(cls);
+  auto str = DexString::make_string("hello");
+  auto field = DexField::make_field(type, DexString::make_string("f"),
+                                    DexType::make_type("I"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+  auto callee = make_method(cls, "callee", "V", {}, 1, {
+    insn(OPCODE_RETURN_VOID),
+  });
+
+  auto load_str = new DexOpcodeString(OPCODE_CONST_STRING, str);
+  load_str->set_dest(0);
+  auto get = field_op(OPCODE_SGET, field, 0);
+  auto call = invoke(OPCODE_INVOKE_STATIC, callee);
+  auto alloc = new DexOpcodeType(OPCODE_NEW_INSTANCE, type);
+  alloc->set_dest(0);
+  auto caller = make_method(cls, "caller", "V", {}, 1, {
+    load_str, get, call, alloc, insn(OPCODE_RETURN_VOID),
+  });
+  auto get_again = field_op(OPCODE_SGET, field, 0);
+  auto other = make_method(cls, "other", "V", {}, 1, {
+    get_again, insn(OPCODE_RETURN_VOID),
+  });
+
+  Scope scope{make_class(
+    cls, "Ljava/lang/Object;", {callee, caller, other}, {field})};
+
+  {
+    ReferenceIndex index(scope);
+    EXPECT_EQ(&index, ReferenceIndex::current());
+    EXPECT_EQ(std::vector<DexInstruction*>({load_str}),
+              insns(index.sites(str)));
+    EXPECT_EQ(std::vector<DexInstruction*>({get, get_again}),
+              insns(index.sites(field)));
+    EXPECT_EQ(std::vector<DexInstruction*>({call}), insns(index.sites(callee)));
+    EXPECT_EQ(std::vector<DexInstruction*>({alloc}), insns(index.sites(type)));
+    EXPECT_EQ(caller, index.sites(callee)[0].method);
+
+    // Edits through MethodTransform keep it current.
+    auto transform = MethodTransform::get_method_transform(caller);
+    transform->remove_opcode(call);
+    EXPECT_TRUE(index.sites(callee).empty());
+    auto call_other = invoke(OPCODE_INVOKE_STATIC, other);
+    transform->replace_opcode(alloc, call_other);
+    EXPECT_TRUE(index.sites(type).empty());
+    EXPECT_EQ(std::vector<DexInstruction*>({call_other}),
+              insns(index.sites(other)));
+    auto call_again = invoke(OPCODE_INVOKE_STATIC, callee);
+    std::list<DexInstruction*> added{call_again};
+    transform->insert_after(get, added);
+    EXPECT_EQ(std::vector<DexInstruction*>({call_again}),
+              insns(index.sites(callee)));
+    transform->sync();
+
+    index.remove_method(other);
+    EXPECT_EQ(std::vector<DexInstruction*>({get}), insns(index.sites(field)));
+  }
+  EXPECT_EQ(nullptr, ReferenceIndex::current());
+
+  delete g_redex;
+}
+
+/*
+ * Removing a site from the middle of an entity's sites leaves the others,
+ * and removing it again, or adding one twice, changes nothing.
+ */
+TEST(ReferenceIndexTest, removeKeepsOtherSites) {
+  g_redex = new RedexContext();
+
+  const char* cls = "LRefs;";
+  auto field = DexField::make_field(DexType::make_type(cls),
+                                    DexString::make_string("f"),
+                                    DexType::make_type("I"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+  auto first = field_op(OPCODE_SGET, field, 0);
+  auto middle = field_op(OPCODE_SGET, field, 0);
+  auto last = field_op(OPCODE_SGET, field, 0);
+  auto reader = make_method(cls, "reader", "V", {}, 1, {
+    first, middle, last, insn(OPCODE_RETURN_VOID),
+  });
+  Scope scope{make_class(cls, "Ljava/lang/Object;", {reader}, {field})};
+
+  {
+    ReferenceIndex index(scope);
+    EXPECT_EQ(std::vector<DexInstruction*>({first, middle, last}),
+              insns(index.sites(field)));
+
+    index.remove(reader, middle);
+    EXPECT_EQ(std::vector<DexInstruction*>({first, last}),
+              insns(index.sites(field)));
+    index.remove(reader, middle);
+    EXPECT_EQ(2, index.sites(field).size());
+
+    index.add(reader, middle);
+    index.add(reader, middle);
+    EXPECT_EQ(std::vector<DexInstruction*>({first, last, middle}),
+              insns(index.sites(field)));
+
+    index.remove(reader, first);
+    index.remove(reader, last);
+    EXPECT_EQ(std::vector<DexInstruction*>({middle}),
+              insns(index.sites(field)));
+    index.remove_method(reader);
+    EXPECT_TRUE(index.sites(field).empty());
+  }
+
+  delete g_redex;
+}
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "RegAlloc.h"
+#include "Show.h"
+#include "Transform.h"
+
+namespace {
+
+std::vector<std::string> allocate(DexMethod* method, RegAllocStats& stats) {
+  stats = allocate_registers(method);
+  MethodTransform::get_method_transform(method)->sync();
+  std::vector<std::string> lines;
+  for (auto in : method->get_code()->get_instructions()) {
+    lines.push_back(show(in));
+  }
+  return lines;
+}
+}
+
+TEST(RegAllocTest, interferenceGraph) {
+  InterferenceGraph graph(200);
+  graph.add_edge(3, 150);
+  graph.add_edge(150, 3);
+  graph.add_edge(7, 7);
+  EXPECT_TRUE(graph.interferes(3, 150));
+  EXPECT_TRUE(graph.interferes(150, 3));
+  EXPECT_FALSE(graph.interferes(7, 7));
+  EXPECT_FALSE(graph.interferes(3, 149));
+  EXPECT_EQ(1, graph.adj(3).size());
+
+  BitVector live(200);
+  for (auto r : {0, 64, 130, 199}) {
+    live.set(r);
+  }
+  graph.add_clique(live);
+  graph.add_edges(5, live);
+  EXPECT_TRUE(graph.interferes(0, 199));
+  EXPECT_TRUE(graph.interferes(64, 130));
+  EXPECT_TRUE(graph.interferes(5, 130));
+  EXPECT_FALSE(graph.interferes(5, 3));
+  EXPECT_EQ(4, graph.adj(5).size());
+  EXPECT_EQ(4, graph.adj(199).size());
+}
+
+TEST(RegAllocTest, moveChain) {
+  g_redex = new RedexContext();
+  auto method = make_method("LRegAllocTest;", "chain", "I", {"I"}, 5, {
+    insn(OPCODE_CONST_4, 0, {}, 1),
+    insn(OPCODE_MOVE, 1, {0}),
+    insn(OPCODE_MOVE, 2, {1}),
+    insn(OPCODE_ADD_INT, 3, {2, 4}),
+    insn(OPCODE_RETURN, -1, {3}),
+  });
+  RegAllocStats stats;
+  auto lines = allocate(method, stats);
+  std::vector<std::string> expected = {
+    "const/4 v0",
+    "add-int v0, v0, v1",
+    "return v0",
+  };
+  EXPECT_EQ(expected, lines);
+  EXPECT_TRUE(stats.allocated);
+  EXPECT_EQ(2, stats.moves_removed);
+  EXPECT_EQ(5, stats.regs_before);
+  EXPECT_EQ(2, stats.regs_after);
+  EXPECT_EQ(2, method->get_code()->get_registers_size());
+  delete g_redex;
+}
+
+/*
+ * The argument doesn't interfere with any local, but still has to end up in
+ * the last register.
+ */
+TEST(RegAllocTest, argumentsOnTop) {
+  g_redex = new RedexContext();
+  auto method = make_method("LRegAllocTest;", "args", "I", {"I"}, 4, {
+    insn(OPCODE_ADD_INT, 0, {3, 3}),
+    insn(OPCODE_CONST_4, 1, {}, 1),
+    insn(OPCODE_CONST_4, 2, {}, 2),
+    insn(OPCODE_ADD_INT, 0, {0, 1}),
+    insn(OPCODE_ADD_INT, 0, {0, 2}),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  RegAllocStats stats;
+  auto lines = allocate(method, stats);
+  EXPECT_EQ("add-int v0, v2, v2", lines[0]);
+  EXPECT_EQ("const/4 v1", lines[1]);
+  EXPECT_EQ("const/4 v2", lines[2]);
+  EXPECT_EQ(3, method->get_code()->get_registers_size());
+  delete g_redex;
+}
+
+/*
+ * Pairs and ranges move as a whole: the long and the invoke's operands all
+ * end up at the bottom of the frame.
+ */
+TEST(RegAllocTest, pairsAndRanges) {
+  g_redex = new RedexContext();
+  auto callee = DexMethod::make_method("LRegAllocTest;", "callee", "I", {});
+  auto invoke = new DexOpcodeMethod(OPCODE_INVOKE_STATIC_RANGE, callee, 0);
+  invoke->set_range_base(0);
+  invoke->set_range_size(2);
+  auto method = make_method("LRegAllocTest;", "wide", "I", {}, 6, {
+    insn(OPCODE_CONST_WIDE_16, 4, {}, 5),
+    insn(OPCODE_LONG_TO_INT, 0, {4}),
+    insn(OPCODE_CONST_4, 1, {}, 1),
+    invoke,
+    insn(OPCODE_MOVE_RESULT, 0),
+    insn(OPCODE_RETURN, -1, {0}),
+  });
+  RegAllocStats stats;
+  auto lines = allocate(method, stats);
+  EXPECT_TRUE(stats.allocated);
+  EXPECT_EQ("const-wide/16 v0", lines[0]);
+  EXPECT_EQ("long-to-int v0, v0", lines[1]);
+  EXPECT_EQ(0, invoke->range_base());
+  EXPECT_EQ(2, invoke->range_size());
+  EXPECT_EQ(2, method->get_code()->get_registers_size());
+  delete g_redex;
+}
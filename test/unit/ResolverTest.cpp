@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "RedexContext.h"
+#include "Resolver.h"
+
+/*
+ * LC; extends LB; extends LA;.  References through LC; are resolved up the
+ * hierarchy and cached, nullptr included, until the cache is invalidated.
+ */
+TEST(ResolverTest, cachedUntilInvalidated) {
+  g_redex = new RedexContext();
+  auto a = make_class("LA;", "Ljava/lang/Object;");
+  auto b = make_class("LB;", "LA;");
+  make_class("LC;", "LB;");
+  auto a_foo = make_method("LA;", "foo", "V", {}, 1, {}, ACC_PUBLIC);
+  a->get_vmethods().push_back(a_foo);
+
+  auto foo_ref = DexMethod::make_method("LC;", "foo", "V", {});
+  auto bar_ref = DexMethod::make_method("LC;", "bar", "V", {});
+  EXPECT_EQ(a_foo, resolve_method(foo_ref, MethodSearch::Virtual));
+  EXPECT_EQ(nullptr, resolve_method(bar_ref, MethodSearch::Virtual));
+
+  auto b_foo = make_method("LB;", "foo", "V", {}, 1, {}, ACC_PUBLIC);
+  b->get_vmethods().push_back(b_foo);
+  auto a_bar = make_method("LA;", "bar", "V", {}, 1, {}, ACC_PUBLIC);
+  a->get_vmethods().push_back(a_bar);
+  EXPECT_EQ(a_foo, resolve_method(foo_ref, MethodSearch::Virtual));
+  EXPECT_EQ(nullptr, resolve_method(bar_ref, MethodSearch::Virtual));
+
+  invalidate_resolve_cache();
+  EXPECT_EQ(b_foo, resolve_method(foo_ref, MethodSearch::Virtual));
+  EXPECT_EQ(a_bar, resolve_method(bar_ref, MethodSearch::Virtual));
+  // Each search is cached on its own.
+  EXPECT_EQ(nullptr, resolve_method(foo_ref, MethodSearch::Static));
+  delete g_redex;
+}
+
+/*
+ * Field refs are cached the same way.  Every search looks at static and
+ * instance fields alike, so they all find the nearest field by that name.
+ */
+TEST(ResolverTest, fieldsCachedUntilInvalidated) {
+  g_redex = new RedexContext();
+  auto a = make_class("LA;", "Ljava/lang/Object;");
+  auto b = make_class("LB;", "LA;");
+  make_class("LC;", "LB;");
+  auto a_type = DexType::make_type("LA;");
+  auto count = DexString::make_string("count");
+  auto total = DexString::make_string("total");
+  auto type = DexType::make_type("I");
+  auto a_count = DexField::make_field(a_type, count, type);
+  a_count->make_concrete(ACC_PUBLIC | ACC_STATIC);
+  a->get_sfields().push_back(a_count);
+
+  auto count_ref = DexField::make_field(DexType::make_type("LC;"), count, type);
+  auto total_ref = DexField::make_field(DexType::make_type("LC;"), total, type);
+  for (auto fs : {FieldSearch::Static, FieldSearch::Instance,
+                  FieldSearch::Any}) {
+    EXPECT_EQ(a_count, resolve_field(count_ref, fs));
+    EXPECT_EQ(nullptr, resolve_field(total_ref, fs));
+  }
+
+  auto b_count = DexField::make_field(DexType::make_type("LB;"), count, type);
+  b_count->make_concrete(ACC_PUBLIC);
+  b->get_ifields().push_back(b_count);
+  auto a_total = DexField::make_field(a_type, total, type);
+  a_total->make_concrete(ACC_PUBLIC);
+  a->get_ifields().push_back(a_total);
+  EXPECT_EQ(a_count, resolve_field(count_ref));
+  EXPECT_EQ(nullptr, resolve_field(total_ref));
+
+  invalidate_resolve_cache();
+  for (auto fs : {FieldSearch::Static, FieldSearch::Instance,
+                  FieldSearch::Any}) {
+    EXPECT_EQ(b_count, resolve_field(count_ref, fs));
+    EXPECT_EQ(a_total, resolve_field(total_ref, fs));
+  }
+  delete g_redex;
+}
@@ -0,0 +1,242 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <unordered_map>
+
+#include "DexClass.h"
+#include "IRTestUtil.h"
+#include "SSA.h"
+#include "Show.h"
+
+namespace {
+
+/* Interpret the handful of opcodes used by these tests. */
+int run(DexMethod* method, std::vector<int> args) {
+  auto code = method->get_code();
+  auto& insns = code->get_instructions();
+  std::unordered_map<uint32_t, size_t> index;
+  std::vector<uint32_t> addrs;
+  uint32_t addr = 0;
+  for (size_t i = 0; i < insns.size(); ++i) {
+    index[addr] = i;
+    addrs.push_back(addr);
+    addr += insns[i]->size();
+  }
+  std::vector<int> regs(code->get_registers_size());
+  std::copy(args.begin(), args.end(), regs.end() - args.size());
+  size_t pc = 0;
+  for (int steps = 0; steps < 10000; ++steps) {
+    auto in = insns[pc];
+    auto jump = [&] { return index.at(addrs[pc] + in->offset()); };
+    switch (in->opcode()) {
+    case OPCODE_CONST_4:
+    case OPCODE_CONST_16:
+      regs[in->dest()] = in->literal();
+      break;
+    case OPCODE_MOVE:
+    case OPCODE_MOVE_FROM16:
+    case OPCODE_MOVE_16:
+      regs[in->dest()] = regs[in->src(0)];
+      break;
+    case OPCODE_ADD_INT:
+    case OPCODE_ADD_INT_2ADDR:
+      regs[in->dest()] = regs[in->src(0)] + regs[in->src(1)];
+      break;
+    case OPCODE_ADD_INT_LIT16:
+      regs[in->dest()] = regs[in->src(0)] + in->literal();
+      break;
+    case OPCODE_IF_EQZ:
+      if (regs[in->src(0)] == 0) {
+        pc = jump();
+        continue;
+      }
+      break;
+    case OPCODE_IF_LT:
+      if (regs[in->src(0)] < regs[in->src(1)]) {
+        pc = jump();
+        continue;
+      }
+      break;
+    case OPCODE_IF_GE:
+      if (regs[in->src(0)] >= regs[in->src(1)]) {
+        pc = jump();
+        continue;
+      }
+      break;
+    case OPCODE_GOTO:
+    case OPCODE_GOTO_16:
+      pc = jump();
+      continue;
+    case OPCODE_RETURN:
+      return regs[in->src(0)];
+    default:
+      ADD_FAILURE() << "Unexpected " << show(in);
+      return -1;
+    }
+    ++pc;
+  }
+  ADD_FAILURE() << "Doesn't terminate";
+  return -1;
+}
+
+std::vector<std::string> listing(DexMethod* method) {
+  std::vector<std::string> lines;
+  for (auto in : method->get_code()->get_instructions()) {
+    lines.push_back(show(in));
+  }
+  return lines;
+}
+
+void sync(DexMethod* method) {
+  MethodTransform::get_method_transform(method)->sync();
+}
+
+/*
+ * int diamond(int x) {
+ *   int r = 0;
+ *   if (x == 0) r = 1; else r = 2;
+ *   return r + x;
+ * }
+ */
+DexMethod* diamond() {
+  return make_method("LSSATest;", "diamond", "I", {"I"}, 2, {
+    insn(OPCODE_CONST_4, 0, {}, 0),            // 0
+    branch(OPCODE_IF_EQZ, {1}, 4),             // 1
+    insn(OPCODE_CONST_4, 0, {}, 2),            // 3
+    branch(OPCODE_GOTO, {}, 2),                // 4
+    insn(OPCODE_CONST_4, 0, {}, 1),            // 5
+    insn(OPCODE_ADD_INT_2ADDR, 0, {0, 1}),     // 6
+    insn(OPCODE_RETURN, -1, {0}),              // 7
+  });
+}
+
+/*
+ * int last(int n) {
+ *   int i = 0, prev;
+ *   do { prev = i; i++; } while (i < n);
+ *   return prev;
+ * }
+ */
+DexMethod* last() {
+  return make_method("LSSATest;", "last", "I", {"I"}, 3, {
+    insn(OPCODE_CONST_4, 0, {}, 0),            // 0
+    insn(OPCODE_MOVE, 1, {0}),                 // 1
+    insn(OPCODE_ADD_INT_LIT16, 0, {0}, 1),      // 2
+    branch(OPCODE_IF_LT, {0, 2}, -3),          // 4
+    insn(OPCODE_RETURN, -1, {1}),              // 6
+  });
+}
+
+/*
+ * The middle block hands the same value to the phis of both of its
+ * successors.
+ */
+DexMethod* shared() {
+  return make_method("LSSATest;", "shared", "I", {"I"}, 2, {
+    insn(OPCODE_CONST_4, 0, {}, 0),            // 0
+    branch(OPCODE_IF_EQZ, {1}, 5),             // 1
+    insn(OPCODE_CONST_4, 0, {}, 1),            // 3
+    branch(OPCODE_IF_EQZ, {1}, 4),             // 4
+    insn(OPCODE_ADD_INT_LIT16, 0, {0}, 1),      // 6
+    insn(OPCODE_RETURN, -1, {0}),              // 8
+  });
+}
+}
+
+TEST(SSATest, phis) {
+  g_redex = new RedexContext();
+  auto method = diamond();
+  ASSERT_TRUE(SSAForm::can_build(method));
+  {
+    SSAForm ssa(method);
+    auto transform = MethodTransform::get_method_transform(method);
+    size_t nphis = 0;
+    for (auto b : transform->cfg()) {
+      for (auto phi : ssa.phis(b)) {
+        ++nphis;
+        EXPECT_EQ(0, phi->dest->reg);
+        EXPECT_EQ(2, phi->srcs.size());
+        for (auto v : phi->srcs) {
+          EXPECT_EQ(SSAValue::INSN, v->kind);
+          EXPECT_EQ(OPCODE_CONST_4, v->insn->opcode());
+        }
+        EXPECT_EQ(1, phi->dest->uses.size());
+      }
+    }
+    EXPECT_EQ(1, nphis);
+    EXPECT_EQ(SSAValue::PARAM, ssa.param(0)->kind);
+    EXPECT_EQ(2, ssa.param(0)->uses.size());
+    // The first constant is dead.
+    auto first = method->get_code()->get_instructions()[0];
+    EXPECT_TRUE(ssa.def(first)->uses.empty());
+  }
+  sync(method);
+  delete g_redex;
+}
+
+TEST(SSATest, roundTrip) {
+  g_redex = new RedexContext();
+  for (auto method : {diamond(), last(), shared()}) {
+    auto before = listing(method);
+    {
+      SSAForm ssa(method);
+      EXPECT_TRUE(ssa.destruct());
+    }
+    sync(method);
+    EXPECT_EQ(before, listing(method));
+  }
+  delete g_redex;
+}
+
+TEST(SSATest, editsNeedCopies) {
+  g_redex = new RedexContext();
+  auto method = last();
+  std::vector<int> expected;
+  for (int n = 0; n < 5; ++n) {
+    expected.push_back(run(method, {n}));
+  }
+  auto move = method->get_code()->get_instructions()[1];
+  {
+    SSAForm ssa(method);
+    // Forward the copy; i's phi is now live past the increment, so it can't
+    // share a register with it any more.
+    ssa.replace_all_uses(ssa.def(move), ssa.use(move, 0));
+    ssa.remove(move);
+    EXPECT_TRUE(ssa.destruct());
+  }
+  sync(method);
+  for (int n = 0; n < 5; ++n) {
+    EXPECT_EQ(expected[n], run(method, {n}));
+  }
+  delete g_redex;
+}
+
+TEST(SSATest, copyPropagation) {
+  g_redex = new RedexContext();
+  auto method = make_method("LSSATest;", "copy", "I", {"I"}, 3, {
+    insn(OPCODE_MOVE, 0, {2}),
+    insn(OPCODE_ADD_INT, 1, {0, 0}),
+    insn(OPCODE_RETURN, -1, {1}),
+  });
+  auto move = method->get_code()->get_instructions()[0];
+  {
+    SSAForm ssa(method);
+    ssa.replace_all_uses(ssa.def(move), ssa.use(move, 0));
+    ssa.remove(move);
+    EXPECT_TRUE(ssa.destruct());
+  }
+  sync(method);
+  auto& insns = method->get_code()->get_instructions();
+  ASSERT_EQ(2, insns.size());
+  EXPECT_EQ(2, insns[0]->src(0));
+  EXPECT_EQ(2, insns[0]->src(1));
+  EXPECT_EQ(14, run(method, {7}));
+  delete g_redex;
+}
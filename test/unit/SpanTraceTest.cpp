@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <folly/json.h>
+
+#include "SpanTrace.h"
+
+namespace {
+
+/*
+ * SPANTRACE is read when the process starts, so run `test` in a fresh copy
+ * of this binary with it set, and return its exit status.
+ */
+int run_with_spantrace(const char* test, const std::string& path) {
+  auto pid = fork();
+  if (pid == 0) {
+    setenv("SPANTRACE", path.c_str(), 1);
+    auto filter = std::string("--gtest_filter=") + test;
+    execl("/proc/self/exe", "/proc/self/exe", filter.c_str(), nullptr);
+    _exit(127);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+}
+
+/*
+ * Spans from several threads, with names that need escaping, are written
+ * at exit as JSON that chrome://tracing can load.  Thread names too long
+ * to keep are cut short.
+ */
+TEST(SpanTraceTest, writesJsonAtExit) {
+  if (getenv("SPANTRACE") != nullptr) {
+    ASSERT_TRUE(SpanTrace::enabled());
+    SpanTrace::set_thread_name("main \"thread\"");
+    {
+      ScopedSpan outer("outer");
+      ScopedSpan inner(std::string("inner\\\n"));
+      auto worker = [] {
+        SpanTrace::set_thread_name("worker thread, named at some length");
+        ScopedSpan span("worker");
+      };
+      std::thread t1(worker);
+      std::thread t2(worker);
+      t1.join();
+      t2.join();
+    }
+    return;
+  }
+
+  char path[] = "/tmp/span_trace_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  close(fd);
+  ASSERT_EQ(0, run_with_spantrace("SpanTraceTest.writesJsonAtExit", path));
+
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  unlink(path);
+  auto trace = folly::parseJson(text.str());
+
+  std::map<std::string, int> spans;
+  std::map<int64_t, std::string> thread_names;
+  for (auto& event : trace["traceEvents"]) {
+    auto ph = event["ph"].asString().toStdString();
+    auto tid = event["tid"].asInt();
+    if (ph == "M") {
+      EXPECT_EQ("thread_name", event["name"].asString().toStdString());
+      thread_names[tid] = event["args"]["name"].asString().toStdString();
+    } else {
+      ASSERT_EQ("X", ph);
+      EXPECT_LE(0, event["ts"].asInt());
+      EXPECT_LE(0, event["dur"].asInt());
+      EXPECT_EQ(1, thread_names.count(tid));
+      spans[event["name"].asString().toStdString()]++;
+    }
+  }
+  EXPECT_EQ(3, thread_names.size());
+  EXPECT_EQ("main \"thread\"", thread_names[0]);
+  EXPECT_EQ("worker thread, named at some le", thread_names[1]);
+  EXPECT_EQ("worker thread, named at some le", thread_names[2]);
+  EXPECT_EQ(1, spans["outer"]);
+  EXPECT_EQ(1, spans["inner\\\n"]);
+  EXPECT_EQ(2, spans["worker"]);
+  EXPECT_EQ(3, spans.size());
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Debug.h"
+#include "Trace.h"
+
+namespace {
+
+const int kLines = 5000;
+
+/*
+ * TRACE and TRACEFILE are read when the process starts, so run `test` in a
+ * fresh copy of this binary with them set, and return its wait status.
+ */
+int run_with_trace(const char* test, const std::string& path) {
+  auto pid = fork();
+  if (pid == 0) {
+    setenv("TRACE", "PM:1", 1);
+    setenv("TRACEFILE", path.c_str(), 1);
+    auto filter = std::string("--gtest_filter=") + test;
+    execl("/proc/self/exe", "/proc/self/exe", filter.c_str(), nullptr);
+    _exit(127);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+    return -1;
+  }
+  return status;
+}
+
+}
+
+/*
+ * Two threads each trace lines in two pieces.  Enough of them that the
+ * buffers fill and are written while the other thread is tracing, yet
+ * every line comes out whole, once, with its thread's prefix.
+ */
+TEST(TraceTest, threadsWriteWholeLines) {
+  if (getenv("TRACEFILE") != nullptr) {
+    auto work = [](int t) {
+      for (int i = 0; i < kLines; ++i) {
+        TRACE(PM, 1, "thread %d ", t);
+        TRACE(PM, 1, "line %d\n", i);
+      }
+    };
+    std::thread t0(work, 0);
+    std::thread t1(work, 1);
+    t0.join();
+    t1.join();
+    flush_trace();
+    // Skip the tracer's destructor, so the rest has to come from the flush.
+    _exit(0);
+  }
+
+  char path[] = "/tmp/trace_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  close(fd);
+  ASSERT_EQ(0, run_with_trace("TraceTest.threadsWriteWholeLines", path));
+
+  std::ifstream in(path);
+  std::string line;
+  std::map<unsigned, int> thread_of_tid;
+  int next_line[2] = {0, 0};
+  while (std::getline(in, line)) {
+    unsigned tid;
+    int t;
+    int i;
+    int n = 0;
+    ASSERT_EQ(3, sscanf(line.c_str(), "[%u:PM] thread %d line %d%n",
+                        &tid, &t, &i, &n)) << line;
+    ASSERT_EQ(line.size(), size_t(n)) << line;
+    ASSERT_TRUE(t == 0 || t == 1) << line;
+    if (thread_of_tid.count(tid) == 0) {
+      thread_of_tid[tid] = t;
+    }
+    EXPECT_EQ(t, thread_of_tid[tid]) << line;
+    EXPECT_EQ(next_line[t], i) << line;
+    next_line[t] = i + 1;
+  }
+  unlink(path);
+  EXPECT_EQ(2, thread_of_tid.size());
+  EXPECT_EQ(kLines, next_line[0]);
+  EXPECT_EQ(kLines, next_line[1]);
+}
+
+/*
+ * Lines still buffered when the process crashes are written by the crash
+ * handler.
+ */
+TEST(TraceTest, crashWritesBufferedLines) {
+  if (getenv("TRACEFILE") != nullptr) {
+    signal(SIGABRT, crash_backtrace);
+    for (int i = 0; i < 10; ++i) {
+      TRACE(PM, 1, "line %d\n", i);
+    }
+    abort();
+  }
+
+  char path[] = "/tmp/trace_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  close(fd);
+  auto status = run_with_trace("TraceTest.crashWritesBufferedLines", path);
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(SIGABRT, WTERMSIG(status));
+
+  std::ifstream in(path);
+  std::string line;
+  int next_line = 0;
+  while (std::getline(in, line)) {
+    unsigned tid;
+    int i;
+    ASSERT_EQ(2, sscanf(line.c_str(), "[%u:PM] line %d", &tid, &i)) << line;
+    EXPECT_EQ(next_line, i) << line;
+    next_line = i + 1;
+  }
+  unlink(path);
+  EXPECT_EQ(10, next_line);
+}
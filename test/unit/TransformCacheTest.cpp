@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "IRTestUtil.h"
+#include "RedexContext.h"
+#include "Show.h"
+#include "Transform.h"
+
+namespace {
+
+/*
+ * static int m<i>() { int r = i; r = i; ... return r; }, long enough that
+ * ballooning it takes a while.
+ */
+DexMethod* long_method(int i) {
+  std::vector<DexInstruction*> insns;
+  for (int j = 0; j < 1000; ++j) {
+    insns.push_back(insn(OPCODE_CONST_16, 0, {}, i));
+  }
+  insns.push_back(insn(OPCODE_RETURN, -1, {0}));
+  return make_method("LTransformCacheTest;",
+                     ("m" + std::to_string(i)).c_str(), "I", {}, 1, insns);
+}
+}
+
+/*
+ * Threads asking for the same methods at once all get the one transform
+ * per method, and each method is ballooned once.
+ */
+TEST(TransformCacheTest, concurrentRequestsBalloonOnce) {
+  g_redex = new RedexContext();
+  const size_t kMethods = 200;
+  const size_t kThreads = 8;
+  std::vector<DexMethod*> methods;
+  for (size_t i = 0; i < kMethods; ++i) {
+    methods.push_back(long_method(i));
+  }
+  auto balloons_before = MethodTransform::balloon_count();
+
+  std::vector<std::vector<MethodTransform*>> seen(
+    kThreads, std::vector<MethodTransform*>(kMethods));
+  std::atomic<size_t> ready{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      ++ready;
+      while (ready < kThreads) {
+      }
+      // All in the same order, so they keep asking for the same method.
+      for (size_t i = 0; i < kMethods; ++i) {
+        seen[t][i] = MethodTransform::get_method_transform(methods[i]);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(kMethods, MethodTransform::balloon_count() - balloons_before);
+  for (size_t i = 0; i < kMethods; ++i) {
+    for (size_t t = 1; t < kThreads; ++t) {
+      EXPECT_EQ(seen[0][i], seen[t][i]);
+    }
+  }
+  MethodTransform::sync_all();
+  for (size_t i = 0; i < kMethods; ++i) {
+    auto& insns = methods[i]->get_code()->get_instructions();
+    ASSERT_EQ(1001, insns.size());
+    EXPECT_EQ(int64_t(i), insns[0]->literal());
+  }
+  delete g_redex;
+}
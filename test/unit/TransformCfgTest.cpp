@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <functional>
+
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "IRTestUtil.h"
+#include "RedexContext.h"
+#include "Show.h"
+#include "Transform.h"
+
+namespace {
+
+/*
+ * int diamond(int x) {
+ *   int r = 0;
+ *   if (x == 0) r = 1; else r = 2;
+ *   return r + x;
+ * }
+ */
+DexMethod* diamond(const char* name) {
+  return make_method("LTransformCfgTest;", name, "I", {"I"}, 2, {
+    insn(OPCODE_CONST_4, 0, {}, 0),            // 0
+    branch(OPCODE_IF_EQZ, {1}, 4),             // 1
+    insn(OPCODE_CONST_4, 0, {}, 2),            // 3
+    branch(OPCODE_GOTO, {}, 2),                // 4
+    insn(OPCODE_CONST_4, 0, {}, 1),            // 5
+    insn(OPCODE_ADD_INT_2ADDR, 0, {0, 1}),     // 6
+    insn(OPCODE_RETURN, -1, {0}),              // 7
+  });
+}
+
+/*
+ * int divide(int x) {
+ *   int r = 0;
+ *   try { r = x / x; } catch (ArithmeticException e) { return -1; }
+ *   return r;
+ * }
+ */
+DexMethod* divide(const char* name) {
+  auto method = make_method("LTransformCfgTest;", name, "I", {"I"}, 2, {
+    insn(OPCODE_CONST_4, 0, {}, 0),            // 0
+    insn(OPCODE_DIV_INT, 0, {1, 1}),           // 1
+    insn(OPCODE_RETURN, -1, {0}),              // 3
+    insn(OPCODE_CONST_4, 0, {}, -1),           // 4
+    insn(OPCODE_RETURN, -1, {0}),              // 5
+  });
+  auto tri = new DexTryItem();
+  tri->m_start_addr = 1;
+  tri->m_insn_count = 2;
+  tri->m_catches.emplace_back(
+    DexType::make_type("Ljava/lang/ArithmeticException;"), 4);
+  tri->m_catchall = DEX_NO_INDEX;
+  method->get_code()->get_tries().push_back(tri);
+  return method;
+}
+
+DexInstruction* nth_insn(MethodTransform* transform, size_t n) {
+  for (auto& mie : *transform) {
+    if (mie.type == MFLOW_OPCODE && n-- == 0) {
+      return mie.insn;
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * The blocks' contents and edges, leaving out fallthrough items, which
+ * build_cfg adds wherever a block would otherwise start with an opcode.
+ */
+std::string describe(std::vector<Block*>& blocks) {
+  std::string s;
+  for (auto b : blocks) {
+    s += "B" + std::to_string(b->id()) + ":";
+    std::vector<size_t> succs;
+    for (auto succ : b->succs()) {
+      succs.push_back(succ->id());
+    }
+    std::sort(succs.begin(), succs.end());
+    for (auto id : succs) {
+      s += " ->B" + std::to_string(id);
+    }
+    std::vector<size_t> preds;
+    for (auto pred : b->preds()) {
+      preds.push_back(pred->id());
+    }
+    std::sort(preds.begin(), preds.end());
+    for (auto id : preds) {
+      s += " <-B" + std::to_string(id);
+    }
+    s += "\n";
+    for (auto& mie : *b) {
+      switch (mie.type) {
+      case MFLOW_OPCODE:
+        s += "  " + show(mie.insn) + "\n";
+        break;
+      case MFLOW_TARGET:
+        s += "  target\n";
+        break;
+      case MFLOW_TRY:
+        s += "  try " + std::to_string(mie.tentry->type) + "\n";
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  return s;
+}
+
+/*
+ * Make the same method twice, edit both the same way and check after each
+ * edit that the CFG maintained through the edits of the one matches the CFG
+ * built from scratch for the other.
+ */
+void check_edits(
+    const std::function<DexMethod*(const char*)>& make,
+    const std::vector<std::function<void(MethodTransform*)>>& edits) {
+  auto incremental = MethodTransform::get_method_transform(make("inc"));
+  auto rebuilt = MethodTransform::get_method_transform(make("rebuilt"));
+  incremental->cfg();
+  for (size_t i = 0; i < edits.size(); ++i) {
+    edits[i](incremental);
+    edits[i](rebuilt);
+    auto expected = describe(rebuilt->cfg());
+    rebuilt->invalidate_cfg();
+    EXPECT_EQ(expected, describe(incremental->cfg())) << "after edit " << i;
+  }
+}
+
+}
+
+TEST(TransformCfgTest, branchyEditsMatchRebuild) {
+  g_redex = new RedexContext();
+  check_edits(diamond, {
+    // Plain insertion in the middle of a block.
+    [](MethodTransform* t) {
+      std::list<DexInstruction*> insns{insn(OPCODE_CONST_4, 0, {}, 5)};
+      t->insert_after(nth_insn(t, 0), insns);
+    },
+    // Insertion at the head of the method.
+    [](MethodTransform* t) {
+      std::list<DexInstruction*> insns{insn(OPCODE_CONST_4, 0, {}, 7)};
+      t->insert_after(nullptr, insns);
+    },
+    // Removal in the middle of a block and at the head of the method.
+    [](MethodTransform* t) { t->remove_opcode(nth_insn(t, 4)); },
+    [](MethodTransform* t) { t->remove_opcode(nth_insn(t, 0)); },
+    // A return in the middle of a block.
+    [](MethodTransform* t) {
+      t->replace_opcode(nth_insn(t, 0), insn(OPCODE_RETURN, -1, {0}));
+    },
+  });
+  MethodTransform::sync_all();
+  delete g_redex;
+}
+
+TEST(TransformCfgTest, branchSwapsMatchRebuild) {
+  g_redex = new RedexContext();
+  check_edits(diamond, {
+    // The goto becomes conditional, so its block gains the fallthrough.
+    [](MethodTransform* t) {
+      t->replace_opcode(nth_insn(t, 3), branch(OPCODE_IF_NEZ, {1}, 2));
+    },
+    // The if becomes unconditional, so its block loses the fallthrough.
+    [](MethodTransform* t) {
+      t->replace_opcode(nth_insn(t, 1), branch(OPCODE_GOTO, {}, 4));
+    },
+    // And back.
+    [](MethodTransform* t) {
+      t->replace_opcode(nth_insn(t, 1), branch(OPCODE_IF_EQZ, {1}, 4));
+    },
+  });
+  MethodTransform::sync_all();
+  delete g_redex;
+}
+
+TEST(TransformCfgTest, throwingEditsMatchRebuild) {
+  g_redex = new RedexContext();
+  check_edits(divide, {
+    // A throwing instruction outside the try region.
+    [](MethodTransform* t) {
+      std::list<DexInstruction*> insns{insn(OPCODE_DIV_INT, 0, {1, 1})};
+      t->insert_after(nth_insn(t, 0), insns);
+    },
+    // One inside it, which ends a block with an edge to the handler.
+    [](MethodTransform* t) {
+      std::list<DexInstruction*> insns{insn(OPCODE_DIV_INT, 0, {0, 1}),
+                                       insn(OPCODE_CONST_4, 1, {}, 3)};
+      t->insert_after(nth_insn(t, 2), insns);
+    },
+    // No longer throwing, so the blocks around it merge again.
+    [](MethodTransform* t) {
+      t->replace_opcode(nth_insn(t, 2), insn(OPCODE_ADD_INT, 0, {1, 1}));
+    },
+    [](MethodTransform* t) { t->remove_opcode(nth_insn(t, 3)); },
+    [](MethodTransform* t) { t->remove_opcode(nth_insn(t, 1)); },
+  });
+  MethodTransform::sync_all();
+  delete g_redex;
+}
@@ -0,0 +1,321 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "Daemon.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <folly/json.h>
+
+#include "Trace.h"
+
+namespace {
+
+bool write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool write_all(int fd, const std::string& s) {
+  return write_all(fd, s.data(), s.size());
+}
+
+bool socket_address(const std::string& path, sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ERROR: socket path %s is too long\n", path.c_str());
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+/*
+ * Clear the way to listen on `path`: fine if nothing's there, or a socket
+ * left by a daemon that's gone.  Refuses to remove anything else, or a
+ * socket a daemon is still listening on.
+ */
+bool remove_stale_socket(const std::string& path, const sockaddr_un& addr) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) {
+    return errno == ENOENT;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    fprintf(stderr, "ERROR: %s exists and isn't a socket\n", path.c_str());
+    return false;
+  }
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe < 0) {
+    perror("socket");
+    return false;
+  }
+  bool answered =
+    connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+  close(probe);
+  if (answered) {
+    fprintf(stderr, "ERROR: a daemon is already listening on %s\n",
+            path.c_str());
+    return false;
+  }
+  return unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+/* Whether the process on the other end of `conn` runs as our user. */
+bool is_own_user(int conn) {
+#ifdef SO_PEERCRED
+  ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return false;
+  }
+  return cred.uid == geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(conn, &uid, &gid) != 0) {
+    return false;
+  }
+  return uid == geteuid();
+#endif
+}
+
+int exit_status(int status) {
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return 1;
+}
+
+/*
+ * Run the job sent over `conn` in a child of its own, whose output goes to
+ * the client, then send the client its exit status.  Keeping this process
+ * around the job's lets the client hear how it ended even if it crashed.
+ */
+int serve_connection(
+    int conn, const std::function<int(const folly::dynamic&)>& run_job) {
+  std::string request;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(conn, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 1;
+    }
+    request.append(buf, n);
+  }
+
+  int status = 1;
+  folly::dynamic job = nullptr;
+  try {
+    job = folly::parseJson(request);
+  } catch (const std::exception& e) {
+    write_all(conn, std::string("ERROR: bad job: ") + e.what() + "\n");
+    job = nullptr;
+  }
+  if (!job.isNull()) {
+    flush_trace();
+    fflush(nullptr);
+    auto pid = fork();
+    if (pid == 0) {
+      dup2(conn, STDOUT_FILENO);
+      dup2(conn, STDERR_FILENO);
+      close(conn);
+      int code = run_job(job);
+      // _exit skips the destructors that would write these out.
+      flush_trace();
+      fflush(stdout);
+      fflush(stderr);
+      _exit(code);
+    } else if (pid < 0) {
+      write_all(conn, std::string("ERROR: cannot fork: ") + strerror(errno) +
+                "\n");
+    } else {
+      int wstatus;
+      while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+      }
+      status = exit_status(wstatus);
+    }
+  }
+  write_all(conn, std::string(1, '\0') + std::to_string(status) + "\n");
+  close(conn);
+  return status;
+}
+
+}
+
+int serve_jobs(const std::string& path,
+               size_t max_jobs,
+               const std::function<int(const folly::dynamic&)>& run_job) {
+  sockaddr_un addr;
+  if (!socket_address(path, addr)) {
+    return 1;
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+  // A socket left by an earlier daemon would make bind fail.
+  if (!remove_stale_socket(path, addr)) {
+    close(sock);
+    return 1;
+  }
+  // Jobs run as us, so only we may connect: the socket is created 0600.
+  auto old_mask = umask(0177);
+  int bound = bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  umask(old_mask);
+  if (bound != 0 || listen(sock, 16) != 0) {
+    fprintf(stderr, "ERROR: cannot listen on %s: %s\n",
+            path.c_str(), strerror(errno));
+    close(sock);
+    return 1;
+  }
+  // Clients that go away mid-job shouldn't take the job's process with
+  // them; writes to them fail instead.
+  signal(SIGPIPE, SIG_IGN);
+  TRACE(MAIN, 1, "Listening for jobs on %s\n", path.c_str());
+
+  size_t running = 0;
+  while (true) {
+    // Reap finished jobs, waiting for one if there are as many as allowed.
+    while (running > 0) {
+      int wstatus;
+      auto pid = waitpid(-1, &wstatus, running >= max_jobs ? 0 : WNOHANG);
+      if (pid > 0) {
+        running--;
+      } else if (pid == 0 || errno != EINTR) {
+        break;
+      }
+    }
+    int conn = accept(sock, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      perror("accept");
+      break;
+    }
+    // The socket's mode should keep others out, but its directory's
+    // permissions, or a filesystem ignoring modes, may let them in.
+    if (!is_own_user(conn)) {
+      TRACE(MAIN, 1, "Refused a job from another user\n");
+      write_all(conn, std::string("ERROR: daemon belongs to another user\n") +
+                std::string(1, '\0') + "1\n");
+      close(conn);
+      continue;
+    }
+    // Else output buffered so far, trace output included, would be written
+    // again by the child.
+    flush_trace();
+    fflush(nullptr);
+    auto pid = fork();
+    if (pid == 0) {
+      close(sock);
+      int status = serve_connection(conn, run_job);
+      flush_trace();
+      _exit(status);
+    }
+    if (pid < 0) {
+      write_all(conn, std::string("ERROR: cannot fork: ") + strerror(errno) +
+                "\n" + std::string(1, '\0') + "1\n");
+    } else {
+      running++;
+      TRACE(MAIN, 1, "Started job %d\n", pid);
+    }
+    close(conn);
+  }
+  close(sock);
+  unlink(path.c_str());
+  return 1;
+}
+
+int submit_job(const std::string& path, const folly::dynamic& job) {
+  sockaddr_un addr;
+  if (!socket_address(path, addr)) {
+    return 1;
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+  if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    fprintf(stderr, "ERROR: cannot connect to the daemon at %s: %s\n",
+            path.c_str(), strerror(errno));
+    close(sock);
+    return 1;
+  }
+  auto json = folly::toJson(job);
+  if (!write_all(sock, std::string(json.data(), json.size()) + "\n") ||
+      shutdown(sock, SHUT_WR) != 0) {
+    perror("ERROR: cannot send the job");
+    close(sock);
+    return 1;
+  }
+
+  // Output until the NUL, then the exit status.
+  bool trailer = false;
+  std::string status;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(sock, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    size_t i = 0;
+    if (!trailer) {
+      while (i < size_t(n) && buf[i] != '\0') {
+        i++;
+      }
+      fwrite(buf, 1, i, stderr);
+      if (i < size_t(n)) {
+        trailer = true;
+        i++;
+      }
+    }
+    status.append(buf + i, n - i);
+  }
+  close(sock);
+  if (!trailer || status.empty()) {
+    fprintf(stderr, "ERROR: the daemon at %s went away mid-job\n",
+            path.c_str());
+    return 1;
+  }
+  return atoi(status.c_str());
+}
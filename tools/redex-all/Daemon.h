@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <folly/dynamic.h>
+
+/*
+ * redex-all's daemon mode: one process loads the library jars and config
+ * once and serves jobs sent over a Unix socket, so a job skips straight to
+ * loading its own dexes.
+ *
+ * A client connects, writes its job as one JSON object and shuts down its
+ * side.  The daemon forks a process for the job, which inherits the loaded
+ * classes copy-on-write and exits when done, so nothing one job does to
+ * the classes is seen by the next.  The job's stdout and stderr go back
+ * over the connection, followed by a NUL and its exit status.
+ */
+
+/*
+ * Listen on `path` and run each job in a child process with `run_job`,
+ * whose result is the job's exit status, at most `max_jobs` at a time.
+ * Runs until the socket fails.
+ *
+ * The caller must not have started any threads, WorkQueue's included:
+ * the children get only the forking thread, and locks others held.
+ */
+int serve_jobs(const std::string& path,
+               size_t max_jobs,
+               const std::function<int(const folly::dynamic&)>& run_job);
+
+/*
+ * Send `job` to the daemon at `path`, copying its output to stderr, and
+ * return its exit status.
+ */
+int submit_job(const std::string& path, const folly::dynamic& job);
@@ -21,6 +21,7 @@
 #include "LocalDce.h"
 #include "Peephole.h"
 #include "ReBindRefs.h"
+#include "RegAllocPass.h"
 #include "RemoveEmptyClasses.h"
 #include "RenameClasses.h"
 #include "Shorten.h"
@@ -43,6 +44,7 @@ std::vector<Pass*> create_passes() {
     new LocalDcePass(),
     new PeepholePass(),
     new ReBindRefsPass(),
+    new RegAllocPass(),
     new RemoveEmptyClassesPass(),
     new RenameClassesPass(),
     new ShortenSrcStringsPass(),
@@ -7,6 +7,9 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -18,6 +21,7 @@
 #include <getopt.h>
 #include <signal.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -25,15 +29,20 @@
 #include <folly/json.h>
 #include <folly/FileUtil.h>
 
+#include "BuildCache.h"
+#include "Checkpoint.h"
+#include "Daemon.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "JarLoader.h"
+#include "MemoryAccounting.h"
 #include "DexOutput.h"
 #include "PassManager.h"
 #include "ProguardLoader.h"
 #include "ReachableClasses.h"
 #include "RedexContext.h"
+#include "SpanTrace.h"
 #include "Warning.h"
 
 /**
@@ -67,6 +76,22 @@ static void usage() {
     "  -JSomePassName.key=<json value>\n"
     "               Add a json value to a pass config, overwriting the existing value if any\n"
     "                 Example: -SRenameClassesPass.class_rename=[1, 2, 3]\n"
+    "  -Scheckpoint_after=<pass>[#<run>] -Scheckpoint_dir=<dir>\n"
+    "               Save the IR to <dir> after the pass runs (its <run>th run if given)\n"
+    "  -Sresume_from=<dir>\n"
+    "               Start from the checkpoint in <dir> instead of loading dexes, running\n"
+    "               only the passes after the one it was taken after\n"
+    "  -Sbuild_cache_dir=<dir>\n"
+    "               Reuse the outputs of an earlier run with the same inputs and config,\n"
+    "               and per-method pass results for unchanged methods\n"
+    "  --daemon=<socket>\n"
+    "               Load the jar, ProGuard config and config once, then run jobs sent to\n"
+    "               the Unix socket <socket>, each in a process of its own; the config\n"
+    "               key daemon_max_jobs (default 1) limits how many run at once\n"
+    "  --connect=<socket>\n"
+    "               Send this run to the daemon at <socket> and wait for it; the daemon's\n"
+    "               jar, ProGuard config and config are used, with this run's -S and -J\n"
+    "               values applied over the config\n"
     "\n"
     " Note: Be careful to properly escape JSON parameters, e.g. strings must be quoted.\n"
   );
@@ -82,6 +107,11 @@ struct Arguments {
   std::string proguard_config;
   std::string seeds_filename;
   std::string out_dir;
+  std::string apk_dir;
+  std::vector<std::string> json_values;
+  std::vector<std::string> string_values;
+  std::string daemon_socket;
+  std::string connect_socket;
 };
 
 bool parse_config(const char* config_file, Arguments& args) {
@@ -139,6 +169,21 @@ static bool add_value_to_config(folly::dynamic& config, std::string& key_value,
   return false;
 }
 
+static void add_values_to_config(folly::dynamic& config,
+                                 std::vector<std::string> json_values,
+                                 std::vector<std::string> string_values) {
+  for (auto& key_value : json_values) {
+    if (!add_value_to_config(config, key_value, true)) {
+      fprintf(stderr, "Error parsing value -J%s\n", key_value.c_str());
+    }
+  }
+  for (auto& key_value : string_values) {
+    if (!add_value_to_config(config, key_value, false)) {
+      fprintf(stderr, "Error parsing value -S%s\n", key_value.c_str());
+    }
+  }
+}
+
 folly::dynamic default_config() {
   auto passes = {
     "ReBindRefsPass",
@@ -168,16 +213,14 @@ int parse_args(int argc, char* argv[], Arguments& args) {
     { "seeds", required_argument, 0, 's'},
     { "outdir",  required_argument, 0, 'o' },
     { "warn",    required_argument, 0, 'w' },
+    { "daemon",  required_argument, 0, 'D' },
+    { "connect", required_argument, 0, 'C' },
     { nullptr, 0, nullptr, 0 },
   };
   args.out_dir = ".";
   char c;
 
-  std::vector<std::string> json_values_from_command_line;
-  std::vector<std::string> string_values_from_command_line;
-
   args.config = default_config();
-  const char* apk_dir = nullptr;
 
   while ((c = getopt_long(
             argc,
@@ -187,7 +230,7 @@ int parse_args(int argc, char* argv[], Arguments& args) {
             nullptr)) != -1) {
     switch (c) {
     case 'a':
-      apk_dir = optarg;
+      args.apk_dir = optarg;
       break;
     case 'c':
       if (!parse_config(optarg, args)) {
@@ -214,15 +257,21 @@ int parse_args(int argc, char* argv[], Arguments& args) {
     case 'S':
       if (optarg) {
         std::string value(optarg);
-        string_values_from_command_line.push_back(value);
+        args.string_values.push_back(value);
       }
       break;
     case 'J':
       if (optarg) {
         std::string value(optarg);
-        json_values_from_command_line.push_back(value);
+        args.json_values.push_back(value);
       }
       break;
+    case 'D':
+      args.daemon_socket = optarg;
+      break;
+    case 'C':
+      args.connect_socket = optarg;
+      break;
     case ':':
       fprintf(stderr, "ERROR: %s requires an argument\n", argv[optind - 1]);
       return 0;
@@ -236,19 +285,10 @@ int parse_args(int argc, char* argv[], Arguments& args) {
   // We add these values to the config at the end so that they will always
   // overwrite values read from the config file regardless of the order of
   // arguments
-  if (apk_dir) {
-    args.config["apk_dir"] = apk_dir;
-  }
-  for (auto& key_value : json_values_from_command_line) {
-    if (!add_value_to_config(args.config, key_value, true)) {
-      fprintf(stderr, "Error parsing value -J%s\n", key_value.c_str());
-    }
-  }
-  for (auto& key_value : string_values_from_command_line) {
-    if (!add_value_to_config(args.config, key_value, false)) {
-      fprintf(stderr, "Error parsing value -S%s\n", key_value.c_str());
-    }
+  if (!args.apk_dir.empty()) {
+    args.config["apk_dir"] = args.apk_dir;
   }
+  add_values_to_config(args.config, args.json_values, args.string_values);
   return optind;
 }
 
@@ -279,6 +319,53 @@ void output_stats(const char* path, const dex_output_stats_t& stats) {
   folly::writeFile(folly::toPrettyJson(d), path);
 }
 
+/*
+ * The per-pass perf report goes to "pass_perf_output" if set, else beside
+ * the stats as redex-pass-perf.json.
+ */
+std::string pass_perf_output(const folly::dynamic& config,
+                             const std::string& stats_output) {
+  auto path = config.getDefault("pass_perf_output", "").asString();
+  if (!path.empty() || stats_output.empty()) {
+    return path;
+  }
+  auto slash = stats_output.rfind('/');
+  auto dir = slash == std::string::npos ? std::string(".")
+                                        : stats_output.substr(0, slash);
+  return dir + "/redex-pass-perf.json";
+}
+
+void output_pass_perf(const char* path, const folly::dynamic& report) {
+  if (!strcmp(path, "")) {
+    return;
+  }
+  folly::writeFile(folly::toPrettyJson(report), path);
+}
+
+using Clock = std::chrono::steady_clock;
+
+double secs_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Peak resident set size over the life of the process, in KB. */
+int64_t process_peak_rss_kb() {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024;
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+int64_t file_size(const std::string& path) {
+  struct stat buf;
+  return stat(path.c_str(), &buf) == 0 ? buf.st_size : 0;
+}
+
 void output_moved_methods_map(const char* path, DexClassesVector& dexen, ConfigFiles& cfg) {
   // print out moved methods map
   if (cfg.save_move_map() && strcmp(path, "")) {
@@ -313,10 +400,273 @@ void output_moved_methods_map(const char* path, DexClassesVector& dexen, ConfigF
   }
 }
 
+/*
+ * If the config names a build cache, look the run up in it and copy the
+ * outputs into place on a hit.  On a miss `build_cache` is left for
+ * optimize() to store this run's outputs with.
+ */
+bool restore_from_build_cache(const Arguments& args,
+                              const std::vector<std::string>& dexes,
+                              std::unique_ptr<BuildCache>& build_cache) {
+  auto resume_from =
+    args.config.getDefault("resume_from", "").asString().toStdString();
+  auto build_cache_dir =
+    args.config.getDefault("build_cache_dir", "").asString().toStdString();
+  if (build_cache_dir.empty() || !resume_from.empty() || dexes.empty()) {
+    return false;
+  }
+  auto key = BuildCache::build_key(
+    args.config,
+    dexes,
+    {args.jar_path, args.proguard_config, args.seeds_filename});
+  if (key.empty()) {
+    fprintf(stderr, "WARNING: cannot hash the inputs, not caching the build\n");
+    return false;
+  }
+  build_cache.reset(new BuildCache(build_cache_dir, key));
+  return build_cache->restore(args.out_dir, args.config);
+}
+
+/*
+ * Load the dexes, or the checkpoint to resume from, run the passes over
+ * them and write the results.  The library jars are loaded already.
+ */
+int optimize(Arguments& args,
+             const std::vector<std::string>& dexes,
+             std::vector<Pass*>& passes,
+             std::vector<KeepRule>& rules,
+             std::unique_ptr<BuildCache> build_cache,
+             Clock::time_point load_start) {
+  auto resume_from =
+    args.config.getDefault("resume_from", "").asString().toStdString();
+  DexClassesVector dexen;
+  std::unique_ptr<CheckpointReader> checkpoint;
+  if (!resume_from.empty()) {
+    if (!dexes.empty()) {
+      fprintf(stderr, "WARNING: resuming from %s, ignoring input dexes\n",
+              resume_from.c_str());
+    }
+    checkpoint.reset(new CheckpointReader(resume_from));
+    dexen = checkpoint->load_classes();
+  } else {
+    for (auto& dex : dexes) {
+      dexen.emplace_back(load_classes_from_dex(dex.c_str()));
+    }
+  }
+
+  // A checkpoint has the seeds marked already.
+  if (!args.seeds_filename.empty() && !checkpoint) {
+    init_seed_classes(args.seeds_filename);
+  }
+
+  auto load_secs = secs_since(load_start);
+  MemoryAccounting::trace_report("after loading");
+
+  ConfigFiles cfg(args.config);
+  PassManager manager(passes, rules, args.config);
+  if (checkpoint) {
+    checkpoint->restore_config(cfg);
+    manager.resume_after(checkpoint->pass_index(), checkpoint->pass_name());
+    checkpoint.reset();
+  }
+  auto passes_start = Clock::now();
+  manager.run_passes(dexen, cfg);
+  auto passes_secs = secs_since(passes_start);
+
+  TRACE(MAIN, 1, "Writing out new DexClasses...\n");
+
+  auto output_start = Clock::now();
+  LocatorIndex* locator_index = nullptr;
+  if (args.config.getDefault("emit_locator_strings", false).asBool()) {
+    TRACE(LOC, 1, "Will emit class-locator strings "
+            "for classloader optimization\n");
+    locator_index = new LocatorIndex(make_locator_index(dexen));
+  }
+
+  dex_output_stats_t totals;
+  int64_t output_bytes = 0;
+  std::vector<std::string> output_dexes;
+
+  auto methodmapping = args.config.getDefault("method_mapping", "").asString();
+  auto stats_output = args.config.getDefault("stats_output", "").asString();
+  auto method_move_map = args.config.getDefault("method_move_map", "").asString();
+  for (size_t i = 0; i < dexen.size(); i++) {
+    std::stringstream ss;
+    ss << args.out_dir + "/classes";
+    if (i > 0) {
+      ss << (i + 1);
+    }
+    ss << ".dex";
+    auto stats = write_classes_to_dex(
+      ss.str(),
+      &dexen[i],
+      locator_index,
+      i,
+      methodmapping.c_str());
+    totals += stats;
+    output_bytes += file_size(ss.str());
+    output_dexes.push_back(ss.str());
+  }
+  auto output_secs = secs_since(output_start);
+  output_stats(stats_output.c_str(), totals);
+
+  // The pass report plus the phases around it, for redex-bench.
+  folly::dynamic perf = manager.get_perf_report();
+  perf["load_secs"] = load_secs;
+  perf["run_passes_secs"] = passes_secs;
+  perf["output_secs"] = output_secs;
+  perf["peak_rss_kb"] = process_peak_rss_kb();
+  perf["output_bytes"] = output_bytes;
+  perf["memory"] = MemoryAccounting::report();
+  output_pass_perf(pass_perf_output(args.config, stats_output).c_str(), perf);
+  output_moved_methods_map(method_move_map.c_str(), dexen, cfg);
+  if (build_cache) {
+    build_cache->store(output_dexes, args.config);
+  }
+  print_warning_summary();
+  delete g_redex;
+  TRACE(MAIN, 1, "Done.\n");
+
+  return 0;
+}
+
+/*
+ * A job sent to the daemon: the client's dexes, output directory, seeds
+ * and -S/-J values, over the daemon's own arguments.  It runs in a process
+ * forked from the daemon's, with the library classes loaded already.
+ */
+int run_job(const folly::dynamic& job,
+            Arguments args,
+            std::vector<Pass*>& passes,
+            std::vector<KeepRule>& rules) {
+  auto load_start = Clock::now();
+  args.out_dir = job.getDefault("out_dir", ".").asString().toStdString();
+  auto seeds = job.getDefault("seeds", "").asString().toStdString();
+  if (!seeds.empty()) {
+    args.seeds_filename = seeds;
+  }
+  std::vector<std::string> json_values;
+  for (auto& value : job.getDefault("json_values", folly::dynamic::array)) {
+    json_values.push_back(value.asString().toStdString());
+  }
+  std::vector<std::string> string_values;
+  for (auto& value : job.getDefault("string_values", folly::dynamic::array)) {
+    string_values.push_back(value.asString().toStdString());
+  }
+  add_values_to_config(args.config, json_values, string_values);
+  std::vector<std::string> dexes;
+  for (auto& dex : job.getDefault("dexes", folly::dynamic::array)) {
+    dexes.push_back(dex.asString().toStdString());
+  }
+
+  if (!dir_is_writable(args.out_dir)) {
+    fprintf(stderr, "outdir %s is not a writable directory\n",
+            args.out_dir.c_str());
+    return 1;
+  }
+  if (dexes.empty() &&
+      args.config.getDefault("resume_from", "").asString().empty()) {
+    fprintf(stderr, "ERROR: the job has no dexes\n");
+    return 1;
+  }
+  std::unique_ptr<BuildCache> build_cache;
+  if (restore_from_build_cache(args, dexes, build_cache)) {
+    TRACE(MAIN, 1, "Done, from the build cache.\n");
+    return 0;
+  }
+  return optimize(
+    args, dexes, passes, rules, std::move(build_cache), load_start);
+}
+
+std::string absolute_path(const std::string& path) {
+  if (path.empty() || path[0] == '/') {
+    return path;
+  }
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+    return path;
+  }
+  return std::string(cwd) + "/" + path;
+}
+
+/*
+ * The -S or -J `values`, with those of the global options that name files
+ * or directories made absolute.
+ */
+std::vector<std::string> absolute_path_values(
+    const std::vector<std::string>& values, bool is_json) {
+  static const std::vector<std::string> path_keys = {
+    "resume_from",
+    "build_cache_dir",
+    "checkpoint_dir",
+    "stats_output",
+    "pass_perf_output",
+  };
+  std::vector<std::string> result;
+  for (auto& key_value : values) {
+    auto equals_idx = key_value.find('=');
+    auto key = key_value.substr(0, equals_idx);
+    if (equals_idx == std::string::npos ||
+        std::find(path_keys.begin(), path_keys.end(), key) ==
+            path_keys.end()) {
+      result.push_back(key_value);
+      continue;
+    }
+    auto value_string = key_value.substr(equals_idx + 1);
+    if (!is_json) {
+      result.push_back(key + "=" + absolute_path(value_string));
+      continue;
+    }
+    auto value = parse_json_value(value_string);
+    if (!value.isString()) {
+      result.push_back(key_value);
+      continue;
+    }
+    auto json = folly::toJson(absolute_path(value.asString().toStdString()));
+    result.push_back(key + "=" + std::string(json.data(), json.size()));
+  }
+  return result;
+}
+
+/*
+ * Hand the run to the daemon at --connect.  Paths are made absolute, since
+ * the daemon's working directory is its own.
+ */
+int submit(const Arguments& args, const std::vector<std::string>& dexes) {
+  if (!args.jar_path.empty() || !args.proguard_config.empty()) {
+    fprintf(stderr, "WARNING: the daemon's jar and ProGuard config are used, "
+            "not these\n");
+  }
+  folly::dynamic job = folly::dynamic::object;
+  job["out_dir"] = absolute_path(args.out_dir);
+  job["seeds"] = absolute_path(args.seeds_filename);
+  folly::dynamic dex_paths = folly::dynamic::array;
+  for (auto& dex : dexes) {
+    dex_paths.push_back(absolute_path(dex));
+  }
+  job["dexes"] = dex_paths;
+  folly::dynamic json_values = folly::dynamic::array;
+  for (auto& value : absolute_path_values(args.json_values, true)) {
+    json_values.push_back(value);
+  }
+  job["json_values"] = json_values;
+  folly::dynamic string_values = folly::dynamic::array;
+  if (!args.apk_dir.empty()) {
+    string_values.push_back("apk_dir=" + absolute_path(args.apk_dir));
+  }
+  for (auto& value : absolute_path_values(args.string_values, false)) {
+    string_values.push_back(value);
+  }
+  job["string_values"] = string_values;
+  return submit_job(args.connect_socket, job);
+}
+
 int main(int argc, char* argv[]) {
   signal(SIGSEGV, crash_backtrace);
   signal(SIGABRT, crash_backtrace);
   signal(SIGBUS, crash_backtrace);
+  SpanTrace::set_thread_name("main");
+  auto load_start = Clock::now();
 
   g_redex = new RedexContext();
 
@@ -336,10 +686,33 @@ int main(int argc, char* argv[]) {
   //       list of library JARS.
   std::vector<std::string> library_jars;
   auto start = parse_args(argc, argv, args);
-  if (!dir_is_writable(args.out_dir)) {
-    fprintf(stderr, "outdir %s is not a writable directory\n",
-            args.out_dir.c_str());
-    exit(1);
+  std::vector<std::string> dexes;
+  if (start > 0) {
+    dexes.assign(argv + start, argv + argc);
+  }
+
+  auto resume_from =
+    args.config.getDefault("resume_from", "").asString().toStdString();
+  if (!args.connect_socket.empty()) {
+    if (start == 0 || (dexes.empty() && resume_from.empty())) {
+      usage();
+      exit(1);
+    }
+    return submit(args, dexes);
+  }
+
+  std::unique_ptr<BuildCache> build_cache;
+  if (args.daemon_socket.empty()) {
+    if (!dir_is_writable(args.out_dir)) {
+      fprintf(stderr, "outdir %s is not a writable directory\n",
+              args.out_dir.c_str());
+      exit(1);
+    }
+    if (restore_from_build_cache(args, dexes, build_cache)) {
+      delete g_redex;
+      TRACE(MAIN, 1, "Done, from the build cache.\n");
+      return 0;
+    }
   }
 
   if (!args.jar_path.empty()) {
@@ -366,7 +739,25 @@ int main(int argc, char* argv[]) {
     TRACE(MAIN, 1, "Skipping parsing the proguard config file because no file was specified\n");
   }
 
-  if (start == 0 || start == argc) {
+  if (!args.daemon_socket.empty()) {
+    if (start == 0) {
+      usage();
+      exit(1);
+    }
+    if (!dexes.empty()) {
+      fprintf(stderr, "WARNING: running as a daemon, ignoring input dexes\n");
+    }
+    // Jobs get the library jars through the classes loaded here.
+    auto max_jobs = args.config.getDefault("daemon_max_jobs", 1).asInt();
+    return serve_jobs(
+      args.daemon_socket,
+      std::max<int64_t>(max_jobs, 1),
+      [&](const folly::dynamic& job) {
+        return run_job(job, args, passes, rules);
+      });
+  }
+
+  if (start == 0 || (dexes.empty() && resume_from.empty())) {
     usage();
     exit(1);
   }
@@ -376,53 +767,6 @@ int main(int argc, char* argv[]) {
     library_jars.push_back(args.jar_path);
   }
 
-  DexClassesVector dexen;
-  for (int i = start; i < argc; i++) {
-    dexen.emplace_back(load_classes_from_dex(argv[i]));
-  }
-
-  if (!args.seeds_filename.empty()) {
-    init_seed_classes(args.seeds_filename);
-  }
-
-  ConfigFiles cfg(args.config);
-  PassManager manager(passes, rules, args.config);
-  manager.run_passes(dexen, cfg);
-
-  TRACE(MAIN, 1, "Writing out new DexClasses...\n");
-
-  LocatorIndex* locator_index = nullptr;
-  if (args.config.getDefault("emit_locator_strings", false).asBool()) {
-    TRACE(LOC, 1, "Will emit class-locator strings "
-            "for classloader optimization\n");
-    locator_index = new LocatorIndex(make_locator_index(dexen));
-  }
-
-  dex_output_stats_t totals;
-
-  auto methodmapping = args.config.getDefault("method_mapping", "").asString();
-  auto stats_output = args.config.getDefault("stats_output", "").asString();
-  auto method_move_map = args.config.getDefault("method_move_map", "").asString();
-  for (size_t i = 0; i < dexen.size(); i++) {
-    std::stringstream ss;
-    ss << args.out_dir + "/classes";
-    if (i > 0) {
-      ss << (i + 1);
-    }
-    ss << ".dex";
-    auto stats = write_classes_to_dex(
-      ss.str(),
-      &dexen[i],
-      locator_index,
-      i,
-      methodmapping.c_str());
-    totals += stats;
-  }
-  output_stats(stats_output.c_str(), totals);
-  output_moved_methods_map(method_move_map.c_str(), dexen, cfg);
-  print_warning_summary();
-  delete g_redex;
-  TRACE(MAIN, 1, "Done.\n");
-
-  return 0;
+  return optimize(
+    args, dexes, passes, rules, std::move(build_cache), load_start);
 }